@@ -0,0 +1,2 @@
+extern const char _binary_nvidia_installer_ncurses_ui_so_start[];
+extern const char _binary_nvidia_installer_ncurses_ui_so_end[];
@@ -33,15 +33,18 @@
 #include <sys/mman.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "nvidia-installer.h"
 #include "user-interface.h"
 #include "backup.h"
 #include "files.h"
 #include "crc.h"
+#include "digest.h"
 #include "misc.h"
 #include "kernel.h"
 #include "conflicting-kernel-modules.h"
+#include "probes.h"
 
 #define BACKUP_DIRECTORY "/var/lib/nvidia"
 #define BACKUP_LOG       (BACKUP_DIRECTORY "/log")
@@ -92,7 +95,7 @@ typedef struct {
     int    num;
     char  *filename;
     char  *target;
-    uint32 crc;
+    Digest digest;
     mode_t mode;
     uid_t  uid;
     gid_t  gid;
@@ -109,10 +112,44 @@ typedef struct {
 } BackupInfo;
 
 
+/*
+ * A parsed backup log, kept for lookups of installed files for as long as
+ * the log file's inode, size and modification time are unchanged.  The
+ * INSTALLED_FILE entries are indexed by filename, and, once the first
+ * lookup by inode is needed, by the device and inode number of each
+ * installed file.  The chains are linked through arrays of entry indices,
+ * terminated by -1.
+ */
+
+typedef struct {
+    BackupInfo *b;
+
+    ino_t  log_ino;
+    off_t  log_size;
+    struct timespec log_mtime;
+
+    int    num_buckets;
+    int   *name_heads;
+    int   *name_next;
+
+    int    inodes_indexed;
+    int   *inode_heads;
+    int   *inode_next;
+    dev_t *devs;
+    ino_t *inos;
+} BackupLogSession;
+
+static BackupLogSession backup_log_session;
+
+
 static BackupInfo *read_backup_log_file(Options *op);
 
 static void free_backup_info(BackupInfo *b);
 
+static BackupLogSession *get_backup_log_session(Options *op);
+
+static BackupInfo *take_backup_log(Options *op);
+
 static int check_backup_log_entries(Options *op, BackupInfo *b);
 
 static int do_uninstall(Options *op, const char *version,
@@ -122,36 +159,52 @@ static int sanity_check_backup_log_entries(Options *op, BackupInfo *b);
 
 static char *create_backwards_compatible_version_string(const char *str);
 
-static int reverse_strlen_compare(const void *a, const void *b);
+static int reverse_length_compare(const void *a, const void *b);
 
 
 
 
 
 /*
- * init_backup() - initialize the backup engine; this consists of
- * creating a new backup directory, and writing to the log file that
- * we're about to install a new driver version.
+ * write_backup_log_header() - write the version and description of the
+ * driver being installed at the start of a new backup log.
  */
 
-int init_backup(Options *op, Package *p)
+static void write_backup_log_header(FILE *log, Package *p)
+{
+    char *version = create_backwards_compatible_version_string(p->version);
+
+    fprintf(log, "%s\n", version);
+    fprintf(log, "%s\n", p->description);
+
+    nvfree(version);
+}
+
+
+/*
+ * create_backup_log() - create a new, empty backup directory 'directory'
+ * and open a backup log 'log_name' in it, with the version and description
+ * of the driver being installed already written.
+ */
+
+static FILE *create_backup_log(Options *op, Package *p, const char *directory,
+                               const char *log_name)
 {
     mode_t orig_mode;
-    char *version;
     FILE *log;
     
     /* remove the directory, if it already exists */
 
-    if (directory_exists(BACKUP_DIRECTORY)) {
-        if (!remove_directory(op, BACKUP_DIRECTORY)) {
-            return FALSE;
+    if (directory_exists(directory)) {
+        if (!remove_directory(op, directory)) {
+            return NULL;
         }
     }
 
     /* create the backup directory, with perms only for owner */
 
-    if (!mkdir_recursive(op, BACKUP_DIRECTORY, BACKUP_DIRECTORY_PERMS, FALSE)) {
-        return FALSE;
+    if (!mkdir_recursive(op, directory, BACKUP_DIRECTORY_PERMS, FALSE)) {
+        return NULL;
     }
 
     /*
@@ -160,7 +213,7 @@ int init_backup(Options *op, Package *p)
      * we temporarily set umask to ~BACKUP_LOG_PERMS to leave just the bits
      * we want.
      *
-     * This assumes that BACKUP_LOG does not already exist (if it does, the
+     * This assumes that the log does not already exist (if it does, the
      * file permissions will not be modified.) This is assured by the
      * directory removal and re-creation code above.
      */
@@ -168,22 +221,34 @@ int init_backup(Options *op, Package *p)
  
     /* create the log file */
     
-    log = fopen(BACKUP_LOG, "a");
+    log = fopen(log_name, "a");
     umask(orig_mode);
     if (!log) {
         ui_error(op, "Unable to create backup log file '%s' (%s).",
-                 BACKUP_LOG, strerror(errno));
-        return FALSE;
+                 log_name, strerror(errno));
+        return NULL;
     }
 
-    /* write the version and description */
+    write_backup_log_header(log, p);
 
-    version = create_backwards_compatible_version_string(p->version);
-    
-    fprintf(log, "%s\n", version);
-    fprintf(log, "%s\n", p->description);
+    return log;
+}
 
-    nvfree(version);
+
+
+/*
+ * init_backup() - initialize the backup engine; this consists of
+ * creating a new backup directory, and writing to the log file that
+ * we're about to install a new driver version.
+ */
+
+int init_backup(Options *op, Package *p)
+{
+    FILE *log = create_backup_log(op, p, BACKUP_DIRECTORY, BACKUP_LOG);
+
+    if (!log) {
+        return FALSE;
+    }
         
     /* close the log file */
 
@@ -199,6 +264,138 @@ int init_backup(Options *op, Package *p)
 
 
 
+/*
+ * open_root_log() - open the log file 'name' in the backup directory
+ * 'dir_fd' of a root for writing, replacing any existing one.
+ */
+
+static FILE *open_root_log(int dir_fd, const char *name)
+{
+    FILE *log;
+    int fd;
+
+    fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+                O_CLOEXEC, BACKUP_LOG_PERMS);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    if (fchmod(fd, BACKUP_LOG_PERMS) == -1 ||
+        (log = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    return log;
+}
+
+
+/*
+ * write_root_backup_log() - write the backup log and mkdir log for an
+ * installation into the directory 'root', such as the root of a container
+ * image, so that the driver can later be uninstalled from within it. The
+ * logs are written through 'root_fd', from open_root(), so that they stay
+ * within the root. The file names in 'entries' and 'dirs' are relative to
+ * 'root'; 'dirs' is a newline-separated list, as for log_mkdir(), or NULL.
+ * An existing backup log in 'root' is replaced.
+ */
+
+int write_root_backup_log(Options *op, Package *p, const char *root,
+                          int root_fd, const RootBackupEntry *entries,
+                          int num_entries, const char *dirs)
+{
+    const char *log_base = strrchr(BACKUP_LOG, '/') + 1;
+    const char *mkdir_log_base = strrchr(BACKUP_MKDIR_LOG, '/') + 1;
+    char *log_name, *mkdir_log_name, *digest_str;
+    FILE *log;
+    int i, dir_fd, ret = FALSE;
+
+    log_name = nvstrcat(root, "/", BACKUP_LOG, NULL);
+    mkdir_log_name = nvstrcat(root, "/", BACKUP_MKDIR_LOG, NULL);
+    collapse_multiple_slashes(log_name);
+    collapse_multiple_slashes(mkdir_log_name);
+
+    dir_fd = mkdir_in_root(root_fd, BACKUP_DIRECTORY, BACKUP_DIRECTORY_PERMS,
+                           NULL);
+    if (dir_fd == -1) {
+        ui_error(op, "Unable to create the backup directory '%s' in '%s' "
+                 "(%s).", BACKUP_DIRECTORY, root, strerror(errno));
+        goto done;
+    }
+
+    if (faccessat(dir_fd, log_base, F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+        ui_warn(op, "Replacing the existing NVIDIA driver backup log in '%s'; "
+                "the files it lists will not be uninstalled along with this "
+                "driver.", root);
+    }
+
+    log = open_root_log(dir_fd, log_base);
+    if (!log) {
+        ui_error(op, "Unable to create backup log file '%s' (%s).",
+                 log_name, strerror(errno));
+        goto close_dir;
+    }
+
+    write_backup_log_header(log, p);
+
+    for (i = 0; i < num_entries; i++) {
+        if (entries[i].target) {
+            fprintf(log, "%d: %s\n", INSTALLED_SYMLINK, entries[i].filename);
+            fprintf(log, "%s\n", entries[i].target);
+        } else {
+            fprintf(log, "%d: %s\n", INSTALLED_FILE, entries[i].filename);
+            digest_str = digest_to_string(&entries[i].digest);
+            fprintf(log, "%s\n", digest_str);
+            nvfree(digest_str);
+        }
+    }
+
+    if (fclose(log) != 0) {
+        ui_error(op, "Error while closing backup log file '%s' (%s).",
+                 log_name, strerror(errno));
+        goto close_dir;
+    }
+
+    /* an mkdir log left by an earlier installation no longer applies */
+
+    if (!dirs || !dirs[0]) {
+        if (unlinkat(dir_fd, mkdir_log_base, 0) == -1 && errno != ENOENT) {
+            ui_error(op, "Unable to remove mkdir log file '%s' (%s).",
+                     mkdir_log_name, strerror(errno));
+            goto close_dir;
+        }
+    } else {
+        log = open_root_log(dir_fd, mkdir_log_base);
+        if (!log) {
+            ui_error(op, "Unable to open mkdir log file '%s' (%s).",
+                     mkdir_log_name, strerror(errno));
+            goto close_dir;
+        }
+
+        fprintf(log, "%s", dirs);
+
+        if (fclose(log) != 0) {
+            ui_error(op, "Error while closing mkdir log file '%s' (%s).",
+                     mkdir_log_name, strerror(errno));
+            goto close_dir;
+        }
+    }
+
+    ret = TRUE;
+
+ close_dir:
+    close(dir_fd);
+
+ done:
+    nvfree(log_name);
+    nvfree(mkdir_log_name);
+
+    return ret;
+
+} /* write_root_backup_log() */
+
+
+
 /*
  * do_backup() - backup the specified file.  If it is a regular file,
  * just move it into the backup directory, and add an entry to the log
@@ -209,9 +406,9 @@ int do_backup(Options *op, const char *filename)
 {
     int len, ret, ret_val;
     struct stat stat_buf;
-    char *tmp = NULL;
+    char *tmp = NULL, *digest_str;
     FILE *log;
-    uint32 crc;
+    Digest digest;
 
     static int backup_file_number = BACKED_UP_FILE_NUM;
 
@@ -237,7 +434,10 @@ int do_backup(Options *op, const char *filename)
     }
 
     if (S_ISREG(stat_buf.st_mode)) {
-        crc = compute_crc(op, filename);
+        if (!compute_digest(op, op->digest_algorithm, filename, &digest)) {
+            ui_error(op, "Unable to backup file '%s'.", filename);
+            goto done;
+        }
         len = strlen(BACKUP_DIRECTORY) + 64;
         tmp = nvalloc(len + 1);
         snprintf(tmp, len, "%s/%d", BACKUP_DIRECTORY, backup_file_number);
@@ -248,9 +448,11 @@ int do_backup(Options *op, const char *filename)
         
         fprintf(log, "%d: %s\n", backup_file_number, filename);
         
-        /* write the filesize, permissions, uid, gid */
-        fprintf(log, "%u %04o %d %d\n", crc, stat_buf.st_mode,
+        /* write the digest, permissions, uid, gid */
+        digest_str = digest_to_string(&digest);
+        fprintf(log, "%s %04o %d %d\n", digest_str, stat_buf.st_mode,
                 stat_buf.st_uid, stat_buf.st_gid);
+        nvfree(digest_str);
         
         backup_file_number++;
     } else if (S_ISLNK(stat_buf.st_mode)) {
@@ -300,9 +502,29 @@ int do_backup(Options *op, const char *filename)
 
 
 int log_install_file(Options *op, const char *filename)
+{
+    Digest digest;
+
+    if (!compute_digest(op, op->digest_algorithm, filename, &digest)) {
+        return FALSE;
+    }
+
+    return log_install_file_digest(op, filename, &digest);
+
+} /* log_install_file() */
+
+
+
+/*
+ * log_install_file_digest() - log_install_file(), for a file whose digest
+ * the caller already has, e.g. from copy_and_fixup_file().
+ */
+
+int log_install_file_digest(Options *op, const char *filename,
+                            const Digest *digest)
 {
     FILE *log;
-    uint32 crc;
+    char *digest_str;
     
     /* open the log file */
 
@@ -315,9 +537,9 @@ int log_install_file(Options *op, const char *filename)
     
     fprintf(log, "%d: %s\n", INSTALLED_FILE, filename);
     
-    crc = compute_crc(op, filename);
-
-    fprintf(log, "%u\n", crc);
+    digest_str = digest_to_string(digest);
+    fprintf(log, "%s\n", digest_str);
+    nvfree(digest_str);
     
     /* close the log file */
 
@@ -329,7 +551,7 @@ int log_install_file(Options *op, const char *filename)
     
     return TRUE;
 
-} /* log_install_file() */
+} /* log_install_file_digest() */
 
 
 
@@ -363,124 +585,116 @@ int log_create_symlink(Options *op, const char *filename, const char *target)
 
 
 
-static int parse_first_line(const char *buf, int *num, char **filename)
+/*
+ * The parse_*() functions below parse one line of the backup log, as a
+ * slice of the mapped log file.
+ */
+
+static int parse_first_line(NvSlice buf, int *num, char **filename)
 {
-    char *c, *local_buf;
-        
-    if (!buf || !num || !filename) return FALSE;
+    const char *c = buf.s, *end = buf.s + buf.len;
 
-    local_buf = nvstrdup(buf);
-    
-    c = local_buf;
-    while ((*c != '\0') && (*c != ':')) {
+    if (!num || !filename) return FALSE;
+
+    *num = 0;
+
+    while ((c < end) && (*c != ':')) {
         if (!isdigit(*c)) return FALSE;
+        *num = *num * 10 + (*c - '0');
         c++;
     }
-    if (*c == '\0') return FALSE;
-
-    *c = '\0';
-    
-    *num = strtol(local_buf, NULL, 10);
+    if (c == end) return FALSE;
 
     c++;
-    while (isspace(*c)) c++;
-
-    *filename = nvstrdup(c);
+    while ((c < end) && isspace(*c)) c++;
 
-    free(local_buf);
+    *filename = nvstrndup(c, end - c);
 
     return TRUE;
 }
 
 
-static int parse_mode_uid_gid(const char *buf, mode_t *mode,
+static int parse_mode_uid_gid(NvSlice buf, mode_t *mode,
                               uid_t *uid, gid_t *gid)
 {
-    char *c, *local_buf, *str;
+    NvSlice word;
+    unsigned long value;
 
-    if (!buf || !mode || !uid || !gid) return FALSE;
+    if (!mode || !uid || !gid) return FALSE;
 
-    local_buf = nvstrdup(buf);
+    if (!nv_slice_next_word(&buf, &word) ||
+        !nv_slice_to_ulong(word, 8, &value)) return FALSE;
+    *mode = value;
 
-    c = str = local_buf;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    if (*c == '\0') return FALSE;
-    *c = '\0';
-    *mode = strtol(str, NULL, 8);
+    if (!nv_slice_next_word(&buf, &word) ||
+        !nv_slice_to_ulong(word, 10, &value)) return FALSE;
+    *uid = value;
 
-    str = ++c;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    if (*c == '\0') return FALSE;
-    *c = '\0';
-    *uid = strtol(str, NULL, 10);
-
-    str = ++c;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    *c = '\0';
-    *gid = strtol(str, NULL, 10);
-      
-    free(local_buf);
+    if (!nv_slice_next_word(&buf, &word) ||
+        !nv_slice_to_ulong(word, 10, &value)) return FALSE;
+    *gid = value;
 
     return TRUE;
 }
 
 
-static int parse_crc_mode_uid_gid(const char *buf, uint32 *crc, mode_t *mode,
-                                  uid_t *uid, gid_t *gid)
+/*
+ * parse_digest() - parse the digest at the start of the line, and advance
+ * the line past it.
+ */
+
+static int parse_digest(NvSlice *buf, Digest *digest)
 {
-    char *c, *local_buf, *str;
-
-    if (!buf || !crc || !mode || !uid || !gid) return FALSE;
-
-    local_buf = nvstrdup(buf);
-
-    c = str = local_buf;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    if (*c == '\0') return FALSE;
-    *c = '\0';
-    *crc = strtoul(str, NULL, 10);
-
-    str = ++c;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    if (*c == '\0') return FALSE;
-    *c = '\0';
-    *mode = strtol(str, NULL, 8);
-
-    str = ++c;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    if (*c == '\0') return FALSE;
-    *c = '\0';
-    *uid = strtol(str, NULL, 10);
-
-    str = ++c;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    *c = '\0';
-    *gid = strtol(str, NULL, 10);
-      
-    free(local_buf);
+    char str[2 * DIGEST_MAX_LENGTH + 32];
+    NvSlice word;
+
+    if (!digest) return FALSE;
+
+    if (!nv_slice_next_word(buf, &word) ||
+        !nv_slice_copy(word, str, sizeof(str))) return FALSE;
+
+    return digest_from_string(str, digest);
+
+} /* parse_digest() */
 
-    return TRUE;
-}
 
+/*
+ * parse_digest_mode_uid_gid() - parse a backed up file's "<digest> <mode>
+ * <uid> <gid>" line; the digest is a decimal CRC in logs written before
+ * the digest algorithm became selectable.
+ */
 
-static int parse_crc(const char *buf, uint32 *crc)
+static int parse_digest_mode_uid_gid(NvSlice buf, Digest *digest,
+                                     mode_t *mode, uid_t *uid, gid_t *gid)
 {
-    char *c, *local_buf, *str;
+    if (!parse_digest(&buf, digest)) return FALSE;
 
-    if (!buf || !crc) return FALSE;
+    return parse_mode_uid_gid(buf, mode, uid, gid);
+}
 
-    local_buf = nvstrdup(buf);
 
-    c = str = local_buf;
-    while ((*c != '\0') && (isdigit(*c))) c++;
-    *c = '\0';
-    *crc = strtoul(str, NULL, 10);
+/*
+ * changed_digest() - compute the digest of 'filename' with the algorithm
+ * that 'expected' was recorded with; returns NULL if they match, or else
+ * the new digest formatted as a string (or "unreadable", if it could not be
+ * computed), which the caller should free.
+ */
 
-    free(local_buf);
+static char *changed_digest(Options *op, const char *filename,
+                            const Digest *expected)
+{
+    Digest actual;
 
-    return TRUE;
+    if (!compute_digest(op, expected->algorithm, filename, &actual)) {
+        return nvstrdup("unreadable");
+    }
 
-} /* parse_crc() */
+    if (digests_equal(&actual, expected)) {
+        return NULL;
+    }
+
+    return digest_to_string(&actual);
+}
 
 
 /*
@@ -537,12 +751,12 @@ int log_mkdir(Options *op, const char *dirs)
 
 
 /*
- * reverse_strlen_compare() - Compare two strings by length, for sorting
+ * reverse_length_compare() - Compare two NvSlices by length, for sorting
  * in order of decreasing length.
  */
-static int reverse_strlen_compare(const void *a, const void *b)
+static int reverse_length_compare(const void *a, const void *b)
 {
-    return strlen(*(char * const *)b) - strlen(*(char * const *)a);
+    return (int) ((const NvSlice *)b)->len - (int) ((const NvSlice *)a)->len;
 }
 
 
@@ -557,67 +771,53 @@ static int reverse_strlen_compare(const void *a, const void *b)
  */
 static int rmdir_recursive(Options *op)
 {
-    FILE *log;
-    char **dirs;
-    int eof = FALSE, ret = TRUE, lines, i;
+    char *log, dir[PATH_MAX];
+    NvLineIter lines;
+    NvSlice line, *dirs = NULL;
+    int ret = TRUE, n = 0, i;
 
-    /* open the log file */
+    /* read the log file */
 
-    log = fopen(BACKUP_MKDIR_LOG, "r");
-    if (!log) {
+    if (!read_text_file(BACKUP_MKDIR_LOG, &log)) {
         /* Fail silently: most likely, the current driver was simply installed
          * with an nvidia-installer that didn't log created directories. */
         return FALSE;
     }
 
-    /* Count the number of lines */
-
-    for (lines = 0; !eof; lines++) {
-        char *dir;
-        dir = fget_next_line(log, &eof);
-        nvfree(dir);
-    }
-
-    rewind(log);
+    /* collect the directories, as slices of the log */
 
-    dirs = nvalloc(lines * sizeof(char*));
+    nv_line_iter_init(&lines, log, strlen(log));
 
-    for (i = 0; i < lines; i++) {
-        dirs[i] = fget_next_line(log, &eof); 
+    while (nv_line_iter_next(&lines, &line)) {
+        dirs = nvrealloc(dirs, (n + 1) * sizeof(NvSlice));
+        dirs[n++] = line;
     }
 
-    qsort(dirs, lines, sizeof(char*), reverse_strlen_compare);
+    qsort(dirs, n, sizeof(NvSlice), reverse_length_compare);
 
-    for (i = 0; i < lines; i++) {
-        if (dirs[i]) {
-            /* Ignore empty lines and the backup directory itself, since it is 
-             * never empty as long as the dirs file is still around. */
-            if (strlen(dirs[i]) && strcmp(dirs[i], BACKUP_DIRECTORY) != 0) {
-                if (rmdir(dirs[i]) != 0) {
-                    ui_log(op, "Failed to delete the directory '%s' (%s).",
-                           dirs[i], strerror(errno));
-                    ret = FALSE;
-                }
-            }
+    for (i = 0; i < n; i++) {
+        /* Ignore empty lines and the backup directory itself, since it is 
+         * never empty as long as the dirs file is still around. */
+        if (dirs[i].len == 0 || !nv_slice_copy(dirs[i], dir, sizeof(dir)) ||
+            strcmp(dir, BACKUP_DIRECTORY) == 0) {
+            continue;
+        }
+
+        if (rmdir(dir) != 0) {
+            ui_log(op, "Failed to delete the directory '%s' (%s).",
+                   dir, strerror(errno));
+            ret = FALSE;
         }
-        nvfree(dirs[i]);
     }
 
     nvfree(dirs);
+    nvfree(log);
 
     if (!ret) {
         ui_warn(op, "Failed to delete some directories. See %s for details.",
                 op->log_file_name);
     }
 
-    /* close the log file */
-
-    if (fclose(log) != 0) {
-        ui_error(op, "Error while closing mkdir log file '%s' (%s).",
-                 BACKUP_MKDIR_LOG, strerror(errno));
-        return FALSE;
-    }
-
     return ret;
 }
 
@@ -653,7 +853,7 @@ static int do_uninstall(Options *op, const char *version,
         return FALSE;
     }
     
-    if ((b = read_backup_log_file(op)) == NULL) return FALSE;
+    if ((b = take_backup_log(op)) == NULL) return FALSE;
 
     ok = check_backup_log_entries(op, b);
 
@@ -893,181 +1093,304 @@ static int do_uninstall(Options *op, const char *version,
 
 
 /*
- * read_backup_log_file() - 
+ * The backup log is read in layers, so that callers pay only for what they
+ * need: read_backup_log_header() reads just the version and description
+ * lines; open_backup_log() validates the backup directory and log
+ * permissions and positions a BackupLogReader after the header; each call
+ * to read_backup_log_entry() then parses a single file entry.
+ * read_backup_log_file() combines these to parse the whole log.
  */
 
-static BackupInfo *read_backup_log_file(Options *op)
+typedef struct {
+    int fd;
+    char *buf;
+    int length;
+    NvLineIter lines;
+    int line_num;
+} BackupLogReader;
+
+
+
+/*
+ * read_backup_log_header() - read the first two lines of the backup log,
+ * without reading or validating any file entries.
+ */
+
+static int read_backup_log_header(char **version_line, char **descr)
+{
+    FILE *fp = fopen(BACKUP_LOG, "r");
+
+    *version_line = *descr = NULL;
+
+    if (!fp) return FALSE;
+
+    *version_line = fget_next_line(fp, NULL);
+    if (*version_line) {
+        *descr = fget_next_line(fp, NULL);
+    }
+
+    fclose(fp);
+
+    if (!*descr) {
+        nvfree(*version_line);
+        *version_line = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+
+} /* read_backup_log_header() */
+
+
+
+/*
+ * close_backup_log() - release the resources held by a BackupLogReader.
+ */
+
+static void close_backup_log(BackupLogReader *r)
+{
+    if (r->buf && r->buf != MAP_FAILED) {
+        munmap(r->buf, r->length);
+    }
+    if (r->fd != -1) {
+        close(r->fd);
+    }
+
+    r->buf = NULL;
+    r->fd = -1;
+
+} /* close_backup_log() */
+
+
+
+/*
+ * open_backup_log() - check the permissions of the backup directory and
+ * log, map the log, and return its version and description.
+ */
+
+static int open_backup_log(Options *op, BackupLogReader *r,
+                           char **version, char **description)
 {
     struct stat stat_buf;
-    char *buf, *c, *line, *filename;
-    int fd, num, length, line_num = 0;
-    float percent;
-    
-    BackupLogEntry *e;
-    BackupInfo *b = NULL;
+    NvSlice line;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
 
     /* check the permissions of the backup directory */
 
     if (stat(BACKUP_DIRECTORY, &stat_buf) == -1) {
         ui_error(op, "Unable to get properties of %s (%s).",
                  BACKUP_DIRECTORY, strerror(errno));
-        return NULL;
+        return FALSE;
     }
     
     if ((stat_buf.st_mode & PERM_MASK) != BACKUP_DIRECTORY_PERMS) {
         ui_error(op, "The directory permissions of %s have been changed since"
                  "the directory was created!", BACKUP_DIRECTORY);
-        return NULL;
+        return FALSE;
     }
 
-    if ((fd = open(BACKUP_LOG, O_RDONLY)) == -1) {
+    if ((r->fd = open(BACKUP_LOG, O_RDONLY)) == -1) {
         ui_error(op, "Failure opening %s (%s).", BACKUP_LOG, strerror(errno));
-        return NULL;
+        return FALSE;
     }
 
-    if (fstat(fd, &stat_buf) == -1) {
+    if (fstat(r->fd, &stat_buf) == -1) {
         ui_error(op, "Failure getting file properties for %s (%s).",
                  BACKUP_LOG, strerror(errno));
-        goto pre_map_fail;
+        goto fail;
     }
 
     if ((stat_buf.st_mode & PERM_MASK) != BACKUP_LOG_PERMS) {
         ui_error(op, "The file permissions of %s have been changed since "
                  "the file was written!", BACKUP_LOG);
-        goto pre_map_fail;
+        goto fail;
     }
 
     /* map the file */
 
-    length = stat_buf.st_size;
+    r->length = stat_buf.st_size;
 
-    buf = mmap(0, length, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-    if (!buf) {
+    r->buf = mmap(0, r->length, PROT_READ, MAP_FILE | MAP_SHARED, r->fd, 0);
+    if (r->buf == MAP_FAILED) {
         ui_error(op, "Unable to mmap file '%s' (%s).", BACKUP_LOG,
                  strerror(errno));
-        return NULL;
+        goto fail;
     }
-    
-    ui_status_begin(op, "Parsing log file:", "Parsing");
 
-    b = nvalloc(sizeof(BackupInfo));
+    r->line_num = 1;
 
-    b->version = get_next_line(buf, &c, buf, length);
-    if (!b->version || !c) goto parse_error;
-    
-    percent = (float) (c - buf) / (float) stat_buf.st_size;
-    ui_status_update(op, percent, NULL);
+    nv_line_iter_init(&r->lines, r->buf, r->length);
 
-    b->description = get_next_line(c, &c, buf, length);
-    if (!b->description || !c) goto parse_error;
+    if (!nv_line_iter_next(&r->lines, &line) ||
+        nv_line_iter_done(&r->lines)) goto parse_error;
+    *version = nv_slice_dup(line);
 
-    b->n = 0;
-    b->e = NULL;
-    line_num = 3;
+    r->line_num++;
 
-    while (1) {
+    if (!nv_line_iter_next(&r->lines, &line) ||
+        nv_line_iter_done(&r->lines)) goto parse_error;
+    *description = nv_slice_dup(line);
 
-        percent = (float) (c - buf) / (float) stat_buf.st_size;
-        ui_status_update(op, percent, NULL);
-        
-        /* read and parse the next line */
+    r->line_num++;
 
-        line = get_next_line(c, &c, buf, length);
-        if (!line) break;
+    return TRUE;
 
-        if (!parse_first_line(line, &num, &filename)) goto parse_error;
-        line_num++;
-        free(line);
+ parse_error:
 
-        /* grow the BackupLogEntry array */
+    ui_error(op, "Error while parsing line %d of '%s'.", r->line_num,
+             BACKUP_LOG);
+    nvfree(*version);
+    *version = NULL;
 
-        b->n++;
-        b->e = (BackupLogEntry *)
-            nvrealloc(b->e, sizeof(BackupLogEntry) * b->n);
+ fail:
 
-        memset(&b->e[b->n - 1], 0, sizeof(BackupLogEntry));
+    close_backup_log(r);
+    return FALSE;
 
-        e = &b->e[b->n - 1];
-        e->num = num;
-        e->filename = filename;
-        e->ok = TRUE;
-        
-        switch(e->num) {
+} /* open_backup_log() */
 
-        case INSTALLED_FILE:
-            line = get_next_line(c, &c, buf, length);
-            if (line == NULL) goto parse_error;
-            line_num++;
 
-            if (!parse_crc(line, &e->crc)) goto parse_error;
-            free(line);
-        
-            break;
 
-        case INSTALLED_SYMLINK:
-            line = get_next_line(c, &c, buf, length);
-            if (line == NULL) goto parse_error;
-            line_num++;
-            
-            e->target = line;
-            
-            break;
-            
-        case BACKED_UP_SYMLINK:
-            line = get_next_line(c, &c, buf, length);
-            if (line == NULL) goto parse_error;
-            line_num++;
-            
-            e->target = line;
+/*
+ * read_backup_log_entry() - parse the next file entry from the backup log
+ * into 'e'.  Returns 1 if an entry was read, 0 at the end of the log, and
+ * -1 on a parse error.
+ */
 
-            line = get_next_line(c, &c, buf, length);
-            if (line == NULL) goto parse_error;
-            line_num++;
+static int read_backup_log_entry(BackupLogReader *r, BackupLogEntry *e)
+{
+    NvSlice line;
+    char *filename;
+    int num;
 
-            if (!parse_mode_uid_gid(line, &e->mode, &e->uid, &e->gid))
-                goto parse_error;
-            free(line);
-          
-            break;
-            
-        default:
-            if (num < BACKED_UP_FILE_NUM) goto parse_error;
-            
-            line = get_next_line(c, &c, buf, length);
-            if (line == NULL) goto parse_error;
-            line_num++;
+    memset(e, 0, sizeof(*e));
 
-            if (!parse_crc_mode_uid_gid(line, &e->crc, &e->mode,
-                                        &e->uid, &e->gid)) goto parse_error;
-            free(line);
+    /* read and parse the next line */
 
-            break;
-        }
-        
-        if (!c) break;
-    }
+    if (!nv_line_iter_next(&r->lines, &line)) return 0;
 
-    ui_status_end(op, "done.");
+    if (!parse_first_line(line, &num, &filename)) goto parse_error;
+    r->line_num++;
+
+    e->num = num;
+    e->filename = filename;
+    e->ok = TRUE;
     
-    munmap(buf, stat_buf.st_size);
-    close(fd);
+    switch(e->num) {
+
+    case INSTALLED_FILE:
+        if (!nv_line_iter_next(&r->lines, &line)) goto parse_error;
+        r->line_num++;
+
+        if (!parse_digest(&line, &e->digest)) goto parse_error;
     
-    return b;
+        break;
+
+    case INSTALLED_SYMLINK:
+        if (!nv_line_iter_next(&r->lines, &line)) goto parse_error;
+        r->line_num++;
+        
+        e->target = nv_slice_dup(line);
+        
+        break;
+        
+    case BACKED_UP_SYMLINK:
+        if (!nv_line_iter_next(&r->lines, &line)) goto parse_error;
+        r->line_num++;
+        
+        e->target = nv_slice_dup(line);
+
+        if (!nv_line_iter_next(&r->lines, &line)) goto parse_error;
+        r->line_num++;
+
+        if (!parse_mode_uid_gid(line, &e->mode, &e->uid, &e->gid))
+            goto parse_error;
+      
+        break;
+        
+    default:
+        if (num < BACKED_UP_FILE_NUM) goto parse_error;
+        
+        if (!nv_line_iter_next(&r->lines, &line)) goto parse_error;
+        r->line_num++;
+
+        if (!parse_digest_mode_uid_gid(line, &e->digest, &e->mode,
+                                       &e->uid, &e->gid)) goto parse_error;
+
+        break;
+    }
+
+    return 1;
 
  parse_error:
-    
-    ui_status_end(op, "error.");
 
-    munmap(buf, stat_buf.st_size);
+    nvfree(e->filename);
+    nvfree(e->target);
+    memset(e, 0, sizeof(*e));
 
-    ui_error(op, "Error while parsing line %d of '%s'.", line_num, BACKUP_LOG);
+    return -1;
 
-    nvfree(b);
+} /* read_backup_log_entry() */
 
- pre_map_fail:
 
-    close(fd);
-    return NULL;
+
+/*
+ * read_backup_log_file() - parse and validate the entire backup log.
+ */
+
+static BackupInfo *read_backup_log_file(Options *op)
+{
+    BackupLogReader r;
+    BackupLogEntry e;
+    BackupInfo *b;
+    int ret;
+
+    NV_PROBE1(read_backup_log__start, BACKUP_LOG);
+
+    b = nvalloc(sizeof(BackupInfo));
+
+    if (!open_backup_log(op, &r, &b->version, &b->description)) {
+        nvfree(b);
+        NV_PROBE2(read_backup_log__done, BACKUP_LOG, -1);
+        return NULL;
+    }
+
+    ui_status_begin(op, "Parsing log file:", "Parsing");
+
+    while ((ret = read_backup_log_entry(&r, &e)) > 0) {
+
+        ui_status_update(op, r.lines.cur ?
+                         (float) (r.lines.cur - r.buf) / (float) r.length :
+                         1.0, NULL);
+
+        /* grow the BackupLogEntry array */
+
+        b->n++;
+        b->e = (BackupLogEntry *)
+            nvrealloc(b->e, sizeof(BackupLogEntry) * b->n);
+
+        b->e[b->n - 1] = e;
+    }
+
+    if (ret < 0) {
+        ui_status_end(op, "error.");
+        ui_error(op, "Error while parsing line %d of '%s'.", r.line_num,
+                 BACKUP_LOG);
+        close_backup_log(&r);
+        free_backup_info(b);
+        NV_PROBE2(read_backup_log__done, BACKUP_LOG, -1);
+        return NULL;
+    }
+
+    ui_status_end(op, "done.");
+    
+    close_backup_log(&r);
+
+    NV_PROBE2(read_backup_log__done, BACKUP_LOG, b->n);
+    
+    return b;
 
 } /* read_backup_log_file() */
 
@@ -1108,8 +1431,7 @@ static void free_backup_info(BackupInfo *b)
 static int check_backup_log_entries(Options *op, BackupInfo *b)
 {
     BackupLogEntry *e;
-    uint32 crc;
-    char *tmpstr;
+    char *tmpstr, *actual, *expected;
     int i, j, len, ret = TRUE;
     float percent;
 
@@ -1127,7 +1449,7 @@ static int check_backup_log_entries(Options *op, BackupInfo *b)
 
             /* check if the file still matches its backup log entry */
 
-            e->ok = check_installed_file(op, e->filename, e->mode, e->crc,
+            e->ok = check_installed_file(op, e->filename, e->mode, &e->digest,
                                          ui_log);
             ret = ret && e->ok;
  
@@ -1204,13 +1526,16 @@ static int check_backup_log_entries(Options *op, BackupInfo *b)
                        e->filename, tmpstr, strerror(errno));
                 ret = e->ok = FALSE;
             } else {
-                crc = compute_crc(op, tmpstr);
+                actual = changed_digest(op, tmpstr, &e->digest);
                 
-                if (crc != e->crc) {
+                if (actual) {
+                    expected = digest_to_string(&e->digest);
                     ui_log(op, "Backed up file '%s' (saved as '%s) has "
-                           "different checksum (%" PRIu32 ") than when it was "
-                           "backed up (%" PRIu32").  %s will not be restored.",
-                           e->filename, tmpstr, crc, e->crc, e->filename);
+                           "different checksum (%s) than when it was "
+                           "backed up (%s).  %s will not be restored.",
+                           e->filename, tmpstr, actual, expected, e->filename);
+                    nvfree(expected);
+                    nvfree(actual);
                     ret = e->ok = FALSE;
                 }
             }
@@ -1246,48 +1571,22 @@ static int check_backup_log_entries(Options *op, BackupInfo *b)
 int get_installed_driver_version_and_descr(Options *op,
                                            char **pVersion, char **pDescr)
 {
-    struct stat stat_buf;
-    char *c, *version = NULL, *descr = NULL, *buf = NULL;
-    char *version_line = NULL;
-    int length, fd = -1;
-    int ret = FALSE;
+    char *version_line, *version, *descr;
 
-    if ((fd = open(BACKUP_LOG, O_RDONLY)) == -1) goto done;
-    
-    if (fstat(fd, &stat_buf) == -1) goto done;
-    
-    /* map the file */
-
-    length = stat_buf.st_size;
-    
-    buf = mmap(0, length, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
-    if (!buf) goto done;
-    
-    version_line = get_next_line(buf, &c, buf, length);
-    if (!version_line) goto done;
+    if (!read_backup_log_header(&version_line, &descr)) return FALSE;
 
     version = extract_version_string(version_line);
-
-    if (!version) goto done;
-    
-    descr = get_next_line(c, NULL, buf, length);
-
-    if (!descr) goto done;
-
-    *pVersion = strdup(version);
-    *pDescr = strdup(descr);
-    
-    ret = TRUE;
-    
- done:
     nvfree(version_line);
-    nvfree(version);
-    nvfree(descr);
 
-    if (buf) munmap(buf, stat_buf.st_size);
-    if (fd != -1) close(fd);
+    if (!version) {
+        nvfree(descr);
+        return FALSE;
+    }
+
+    *pVersion = version;
+    *pDescr = descr;
     
-    return ret;
+    return TRUE;
 
 } /* get_installed_driver_version_and_descr() */
 
@@ -1440,26 +1739,207 @@ int uninstall_existing_driver(Options *op, const int interactive,
 
 /*
  * Determine if the nvidia-uninstall executable at the path in 'uninstaller'
- * supports the '--skip-depmod' option.  To do this, we simply examine the help
- * text for the presence of the option.
+ * supports the '--skip-depmod' option.  Rather than running the uninstaller
+ * to examine its help text, look for the option's name in the executable's
+ * option table.  The result is cached for the given path.
  */
 static int check_skip_depmod_support(Options *op, const char *uninstaller)
 {
+    static const char option_name[] = "skip-depmod";
+    static char *cached_path = NULL;
+    static int cached_result;
+
+    struct stat stat_buf;
+    const char *buf, *c, *end;
+    int fd, ret = FALSE;
+
+    if (cached_path && strcmp(cached_path, uninstaller) == 0) {
+        return cached_result;
+    }
+
+    if ((fd = open(uninstaller, O_RDONLY)) == -1) return FALSE;
+
+    if (fstat(fd, &stat_buf) == -1 || stat_buf.st_size < sizeof(option_name)) {
+        close(fd);
+        return FALSE;
+    }
+
+    buf = mmap(0, stat_buf.st_size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (buf == MAP_FAILED) return FALSE;
+
+    /* the option name is stored as a NUL-terminated string */
+
+    end = buf + stat_buf.st_size - sizeof(option_name);
+
+    for (c = buf; c <= end; c++) {
+        c = memchr(c, option_name[0], end - c + 1);
+        if (!c) break;
+
+        if (memcmp(c, option_name, sizeof(option_name)) == 0) {
+            ret = TRUE;
+            break;
+        }
+    }
+
+    munmap((void *) buf, stat_buf.st_size);
+
+    nvfree(cached_path);
+    cached_path = nvstrdup(uninstaller);
+    cached_result = ret;
+
+    return ret;
+}
+
+
+/*
+ * compare_driver_versions() - compare two dot-separated numeric version
+ * strings; returns a negative value, zero or a positive value if 'a' is
+ * older than, the same as, or newer than 'b'.
+ */
+static int compare_driver_versions(const char *a, const char *b)
+{
+    while (*a || *b) {
+        char *a_end, *b_end;
+        unsigned long x = strtoul(a, &a_end, 10);
+        unsigned long y = strtoul(b, &b_end, 10);
+
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+
+        a = (*a_end == '.') ? a_end + 1 : a_end;
+        b = (*b_end == '.') ? b_end + 1 : b_end;
 
-    /* exit status is 0 in case of success, so invert here */
-    return !run_command(op, NULL, FALSE, NULL, FALSE,
-                        uninstaller, " -A | ", op->utils[GREP],
-                        " -q '^ \\+--skip-depmod$'", NULL);
+        /* stop at anything other than a digit or a separator */
+        if ((a == a_end && *a) || (b == b_end && *b)) {
+            break;
+        }
+    }
+
+    return 0;
 }
 
 
 /*
- * run_existing_uninstaller() - attempt to run `nvidia-uninstall` if it
- * exists; if it does not exist or fails, fall back to normal uninstallation.
+ * backup_log_is_compatible() - determine whether the existing
+ * installation can be uninstalled by this installer, rather than by the
+ * existing installation's own nvidia-uninstall: its backup log must have
+ * been written by this version or an earlier one, since a newer installer
+ * may record installation steps that this one doesn't know how to undo,
+ * and it must parse cleanly.
+ */
+static int backup_log_is_compatible(Options *op)
+{
+    char *version, *descr;
+    int ret;
+
+    if (!get_installed_driver_version_and_descr(op, &version, &descr)) {
+        return FALSE;
+    }
+
+    ret = compare_driver_versions(version, NVIDIA_INSTALLER_VERSION) <= 0 &&
+          get_backup_log_session(op) != NULL;
+
+    if (!ret) {
+        ui_log(op, "The existing installation of %s (version %s) will be "
+               "uninstalled using its own uninstaller.", descr, version);
+    }
+
+    nvfree(version);
+    nvfree(descr);
+
+    return ret;
+}
+
+
+/*
+ * get_uninstall_log_path() - use DEFAULT_UNINSTALL_LOG_FILE_NAME as the
+ * name for the uninstall log file, in the same directory as
+ * op->log_file_name, be it the default location or a custom one.
+ */
+static char *get_uninstall_log_path(Options *op)
+{
+    char *uninstall_log_dir, *uninstall_log_file, *uninstall_log_path;
+
+    uninstall_log_dir = nv_dirname(op->log_file_name);
+    uninstall_log_file = nv_basename(DEFAULT_UNINSTALL_LOG_FILE_NAME);
+    uninstall_log_path = nvdircat(uninstall_log_dir, uninstall_log_file,
+                                  NULL);
+    nvfree(uninstall_log_dir);
+    nvfree(uninstall_log_file);
+
+    return uninstall_log_path;
+}
+
+
+/*
+ * uninstall_in_process() - uninstall the existing installation with this
+ * installer's own uninstall code, presenting it as the external
+ * nvidia-uninstall run would: a single status indicator, with the details
+ * only in the log, which is also copied to the uninstall log file.
+ * Returns FALSE if the uninstallation failed.
+ */
+static int uninstall_in_process(Options *op, int skip_depmod)
+{
+    char *uninstall_log_path, *descr, *version, *title;
+    int ret, silent = op->silent, status_active = op->ui.status_active;
+
+    if (!get_installed_driver_version_and_descr(op, &version, &descr)) {
+        return TRUE;
+    }
+
+    uninstall_log_path = get_uninstall_log_path(op);
+    title = nvstrcat("Uninstalling ", descr, " (", version, ").", NULL);
+
+    ui_status_begin(op, "Uninstalling the previous installation", "");
+    ui_indeterminate_begin(op, "Uninstalling %s (%s)...", descr, version);
+
+    log_copy_begin(op, uninstall_log_path, title);
+
+    /*
+     * The external uninstaller was run with -s; the progress of the
+     * individual steps is written to the log, but not displayed.
+     */
+    op->silent = TRUE;
+    ret = do_uninstall(op, version, skip_depmod);
+    op->silent = silent;
+    op->ui.status_active = status_active;
+
+    log_copy_end(op);
+
+    ui_indeterminate_end(op);
+
+    if (ret) {
+        ui_status_end(op, "done.");
+        ui_log(op, "Uninstallation of existing driver: %s (%s) "
+               "is complete.", descr, version);
+    } else {
+        ui_status_end(op, "failed.");
+        ui_log(op, "Uninstallation failed; see %s for more details.",
+               op->logging ? uninstall_log_path : "the installer log");
+    }
+
+    nvfree(title);
+    nvfree(uninstall_log_path);
+    nvfree(descr);
+    nvfree(version);
+
+    return ret;
+}
+
+
+/*
+ * run_existing_uninstaller() - uninstall the existing installation: if its
+ * backup log is compatible with this installer, uninstall it in-process;
+ * otherwise attempt to run `nvidia-uninstall` if it exists.  If neither
+ * is possible or the uninstallation fails, fall back to normal
+ * uninstallation.
  */
 int run_existing_uninstaller(Options *op)
 {
-    char *uninstaller = find_system_util("nvidia-uninstall");
+    char *uninstaller;
 
     /*
      * This function is run as part of installation.  If we're about to install
@@ -1468,24 +1948,25 @@ int run_existing_uninstaller(Options *op)
      */
     int skip_depmod = !op->no_kernel_modules;
 
+    if (backup_log_is_compatible(op)) {
+        if (uninstall_in_process(op, skip_depmod)) {
+            return TRUE;
+        }
+
+        /* fall back to uninstalling via the backup log file */
+        uninstaller = NULL;
+    } else {
+        uninstaller = find_system_util("nvidia-uninstall");
+    }
+
     if (uninstaller) {
-        char *uninstall_log_dir, *uninstall_log_file, *uninstall_log_path;
+        char *uninstall_log_path;
         char *data = NULL;
         int ret;
 
         skip_depmod = skip_depmod && check_skip_depmod_support(op, uninstaller);
 
-        /*
-         * Use DEFAULT_UNINSTALL_LOG_FILE_NAME as the name for the uninstall
-         * log file, in the same directory as op->log_file_name, be it the
-         * default location or a custom one.
-         */
-        uninstall_log_dir = nv_dirname(op->log_file_name);
-        uninstall_log_file = nv_basename(DEFAULT_UNINSTALL_LOG_FILE_NAME);
-        uninstall_log_path = nvdircat(uninstall_log_dir, uninstall_log_file,
-                                      NULL);
-        nvfree(uninstall_log_dir);
-        nvfree(uninstall_log_file);
+        uninstall_log_path = get_uninstall_log_path(op);
 
         /* Run the uninstaller non-interactively, and explicitly log to the
          * uninstall log location: older installers may not do so implicitly. */
@@ -1578,33 +2059,229 @@ int test_installed_files(Options *op)
 
 
 /*
- * find_installed_file() - scan the backup log file for the specified
- * filename; return TRUE if the filename is listed as an installed file.
+ * hash_filename(), hash_inode() - FNV-1a hashes for the backup log session
+ * indices.
  */
 
-int find_installed_file(Options *op, char *filename)
+static unsigned int hash_filename(const char *s)
+{
+    unsigned int h = 2166136261u;
+
+    while (*s) {
+        h = (h ^ (unsigned char) *s++) * 16777619u;
+    }
+
+    return h;
+}
+
+static unsigned int hash_inode(dev_t dev, ino_t ino)
+{
+    unsigned long long v[2] = { dev, ino };
+    const unsigned char *c = (const unsigned char *) v;
+    unsigned int h = 2166136261u;
+    int i;
+
+    for (i = 0; i < sizeof(v); i++) {
+        h = (h ^ c[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+
+
+/*
+ * free_backup_log_session() - discard the cached backup log.
+ */
+
+static void free_backup_log_session(void)
+{
+    BackupLogSession *s = &backup_log_session;
+
+    free_backup_info(s->b);
+    nvfree(s->name_heads);
+    nvfree(s->name_next);
+    nvfree(s->inode_heads);
+    nvfree(s->inode_next);
+    nvfree(s->devs);
+    nvfree(s->inos);
+
+    memset(s, 0, sizeof(*s));
+
+} /* free_backup_log_session() */
+
+
+
+/*
+ * get_backup_log_session() - return the cached backup log session,
+ * (re)reading the backup log if it has changed since it was last parsed.
+ */
+
+static BackupLogSession *get_backup_log_session(Options *op)
+{
+    BackupLogSession *s = &backup_log_session;
+    struct stat stat_buf;
+    int i;
+
+    if (stat(BACKUP_LOG, &stat_buf) == -1) {
+        free_backup_log_session();
+        /* let read_backup_log_file() report the failure */
+        free_backup_info(read_backup_log_file(op));
+        return NULL;
+    }
+
+    if (s->b &&
+               stat_buf.st_ino == s->log_ino &&
+               stat_buf.st_size == s->log_size &&
+               stat_buf.st_mtim.tv_sec == s->log_mtime.tv_sec &&
+               stat_buf.st_mtim.tv_nsec == s->log_mtime.tv_nsec) {
+        return s;
+    }
+
+    free_backup_log_session();
+
+    if ((s->b = read_backup_log_file(op)) == NULL) return NULL;
+
+    s->log_ino = stat_buf.st_ino;
+    s->log_size = stat_buf.st_size;
+    s->log_mtime = stat_buf.st_mtim;
+
+    /* keep the load factor at or below 1/2 */
+
+    s->num_buckets = 16;
+    while (s->num_buckets < 2 * s->b->n) {
+        s->num_buckets *= 2;
+    }
+
+    s->name_heads = nvalloc(sizeof(int) * s->num_buckets);
+    s->name_next = nvalloc(sizeof(int) * (s->b->n + 1));
+
+    for (i = 0; i < s->num_buckets; i++) {
+        s->name_heads[i] = -1;
+    }
+
+    for (i = 0; i < s->b->n; i++) {
+        BackupLogEntry *e = &s->b->e[i];
+        unsigned int bucket;
+
+        if (e->num != INSTALLED_FILE) continue;
+
+        bucket = hash_filename(e->filename) & (s->num_buckets - 1);
+        s->name_next[i] = s->name_heads[bucket];
+        s->name_heads[bucket] = i;
+    }
+
+    return s;
+
+} /* get_backup_log_session() */
+
+
+
+/*
+ * take_backup_log() - return the parsed backup log, to be freed by the
+ * caller; the cached session's copy is used if the log is unchanged.
+ */
+
+static BackupInfo *take_backup_log(Options *op)
 {
+    BackupLogSession *s = get_backup_log_session(op);
     BackupInfo *b;
-    BackupLogEntry *e;
-    int i, ret = FALSE;
-    
-    if ((b = read_backup_log_file(op)) == NULL) return FALSE;
 
-    for (i = 0; i < b->n; i++) {
-        e = &b->e[i];
-        if ((e->num == INSTALLED_FILE) && strcmp(filename, e->filename) == 0) {
-            
-            /* XXX should maybe compare inodes rather than
-               filenames? */
+    if (!s) return NULL;
 
-            ret =  TRUE;
-            break;
+    b = s->b;
+    s->b = NULL;
+    free_backup_log_session();
+
+    return b;
+
+} /* take_backup_log() */
+
+
+
+/*
+ * index_backup_log_inodes() - stat each installed file in the session, and
+ * index the installed files by device and inode number.
+ */
+
+static void index_backup_log_inodes(BackupLogSession *s)
+{
+    int i;
+
+    s->inode_heads = nvalloc(sizeof(int) * s->num_buckets);
+    s->inode_next = nvalloc(sizeof(int) * (s->b->n + 1));
+    s->devs = nvalloc(sizeof(dev_t) * (s->b->n + 1));
+    s->inos = nvalloc(sizeof(ino_t) * (s->b->n + 1));
+
+    for (i = 0; i < s->num_buckets; i++) {
+        s->inode_heads[i] = -1;
+    }
+
+    for (i = 0; i < s->b->n; i++) {
+        BackupLogEntry *e = &s->b->e[i];
+        struct stat stat_buf;
+        unsigned int bucket;
+
+        if (e->num != INSTALLED_FILE) continue;
+        if (stat(e->filename, &stat_buf) == -1) continue;
+
+        s->devs[i] = stat_buf.st_dev;
+        s->inos[i] = stat_buf.st_ino;
+
+        bucket = hash_inode(stat_buf.st_dev, stat_buf.st_ino) &
+                 (s->num_buckets - 1);
+        s->inode_next[i] = s->inode_heads[bucket];
+        s->inode_heads[bucket] = i;
+    }
+
+    s->inodes_indexed = TRUE;
+
+} /* index_backup_log_inodes() */
+
+
+
+/*
+ * find_installed_file() - look up the specified filename in the backup
+ * log; return TRUE if the filename is listed as an installed file.  If the
+ * name itself is not listed, the file may still have been installed under
+ * another name for the same file (e.g., through a symlinked directory such
+ * as /lib -> /usr/lib), so installed files are also matched by device and
+ * inode number.
+ */
+
+int find_installed_file(Options *op, char *filename)
+{
+    BackupLogSession *s;
+    struct stat stat_buf;
+    unsigned int bucket;
+    int i;
+
+    if ((s = get_backup_log_session(op)) == NULL) return FALSE;
+
+    bucket = hash_filename(filename) & (s->num_buckets - 1);
+
+    for (i = s->name_heads[bucket]; i >= 0; i = s->name_next[i]) {
+        if (strcmp(filename, s->b->e[i].filename) == 0) {
+            return TRUE;
         }
     }
 
-    free_backup_info(b);
+    if (stat(filename, &stat_buf) == -1) return FALSE;
 
-    return ret;
+    if (!s->inodes_indexed) {
+        index_backup_log_inodes(s);
+    }
+
+    bucket = hash_inode(stat_buf.st_dev, stat_buf.st_ino) &
+             (s->num_buckets - 1);
+
+    for (i = s->inode_heads[bucket]; i >= 0; i = s->inode_next[i]) {
+        if (s->devs[i] == stat_buf.st_dev && s->inos[i] == stat_buf.st_ino) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 
 } /* find_installed_file() */
 
@@ -1619,8 +2296,7 @@ int find_installed_file(Options *op, char *filename)
 static int sanity_check_backup_log_entries(Options *op, BackupInfo *b)
 {
     BackupLogEntry *e;
-    uint32 crc;
-    char *tmpstr;
+    char *tmpstr, *actual, *expected;
     int i, len, ret = TRUE;
     float percent;
     
@@ -1641,13 +2317,16 @@ static int sanity_check_backup_log_entries(Options *op, BackupInfo *b)
                          e->filename);
                 ret = FALSE;
             } else {
-                crc = compute_crc(op, e->filename);
+                actual = changed_digest(op, e->filename, &e->digest);
                 
-                if (crc != e->crc) {
+                if (actual) {
+                    expected = digest_to_string(&e->digest);
                     ui_error(op, "The installed file '%s' has a different "
-                             "checksum (%" PRIu32 ") than when it was "
-                             "installed (%" PRIu32 ").", e->filename, crc,
-                             e->crc);
+                             "checksum (%s) than when it was "
+                             "installed (%s).", e->filename, actual,
+                             expected);
+                    nvfree(expected);
+                    nvfree(actual);
                     ret = FALSE;
                 }
             }
@@ -1702,13 +2381,16 @@ static int sanity_check_backup_log_entries(Options *op, BackupInfo *b)
                          "no longer exists.", e->filename, tmpstr);
                 ret = FALSE;
             } else {
-                crc = compute_crc(op, tmpstr);
+                actual = changed_digest(op, tmpstr, &e->digest);
                 
-                if (crc != e->crc) {
+                if (actual) {
+                    expected = digest_to_string(&e->digest);
                     ui_error(op, "Backed up file '%s' (saved as '%s) has a "
-                             "different checksum (%" PRIu32 ") than when it "
-                             "was backed up (%" PRIu32 ").", e->filename,
-                             tmpstr, crc, e->crc);
+                             "different checksum (%s) than when it "
+                             "was backed up (%s).", e->filename,
+                             tmpstr, actual, expected);
+                    nvfree(expected);
+                    nvfree(actual);
                     ret = FALSE;
                 }
             }
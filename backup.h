@@ -21,15 +21,24 @@
 #define __NVIDIA_INSTALLER_BACKUP_H__
 
 #include "nvidia-installer.h"
+#include "digest.h"
 
 #define INSTALLED_SYMLINK  0
 #define INSTALLED_FILE     1
 #define BACKED_UP_SYMLINK  2
 #define BACKED_UP_FILE_NUM 100
 
+/* a file or symlink installed into a root by write_root_backup_log() */
+typedef struct {
+    const char *filename;   /* the path within the root */
+    const char *target;     /* the symlink target, or NULL for a file */
+    Digest digest;          /* the digest of a file */
+} RootBackupEntry;
+
 int init_backup                 (Options*, Package*);
 int do_backup                   (Options*, const char*);
 int log_install_file            (Options*, const char*);
+int log_install_file_digest     (Options*, const char*, const Digest*);
 int log_create_symlink          (Options*, const char*, const char*);
 int check_for_existing_driver   (Options*, Package*);
 int uninstall_existing_driver   (Options*, const int, const int);
@@ -41,5 +50,8 @@ int test_installed_files(Options *op);
 int find_installed_file(Options *op, char *filename);
 
 int log_mkdir(Options *op, const char *dirs);
+int write_root_backup_log(Options *op, Package *p, const char *root,
+                          int root_fd, const RootBackupEntry *entries,
+                          int num_entries, const char *dirs);
 
 #endif /* __NVIDIA_INSTALLER_BACKUP_H__ */
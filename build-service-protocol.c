@@ -0,0 +1,348 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * build-service-protocol.c - reading and writing the records that make up
+ * build service requests and replies. See build-service.h for a description
+ * of the wire format. This file is linked into both nvidia-installer and
+ * nvidia-build-service, so it must not depend on the Options structure or
+ * on the nvidia-installer user interface.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+
+#define NV_BUILD_SERVICE_DAEMON
+#include "build-service.h"
+#include "common-utils.h"
+
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *buf = data;
+
+    while (size > 0) {
+        ssize_t ret = write(fd, buf, size);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+
+        buf += ret;
+        size -= ret;
+    }
+
+    return TRUE;
+}
+
+
+static int read_all(int fd, void *data, size_t size)
+{
+    char *buf = data;
+
+    while (size > 0) {
+        ssize_t ret = read(fd, buf, size);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return FALSE;
+        }
+
+        buf += ret;
+        size -= ret;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * build_service_send_record() - write a single record header, followed by
+ * its payload, to 'fd'. Returns TRUE on success, FALSE on error.
+ */
+
+int build_service_send_record(int fd, const char *kind, mode_t mode,
+                              const char *name, const void *data,
+                              size_t size)
+{
+    char *header;
+    int ret;
+
+    header = nvasprintf("%s %o %zu %s\n", kind, (unsigned int) mode, size,
+                        name ? name : "-");
+    ret = write_all(fd, header, strlen(header));
+    nvfree(header);
+
+    if (ret && size > 0) {
+        ret = write_all(fd, data, size);
+    }
+
+    return ret;
+}
+
+
+int build_service_send_param(int fd, const char *name, const char *value)
+{
+    if (!value) {
+        value = "";
+    }
+
+    return build_service_send_record(fd, BUILD_SERVICE_RECORD_PARAM, 0, name,
+                                     value, strlen(value));
+}
+
+
+/*
+ * build_service_send_file() - send the regular file 'root'/'relpath' as a
+ * "file" record named 'relpath'.
+ */
+
+int build_service_send_file(int fd, const char *root, const char *relpath)
+{
+    struct stat stat_buf;
+    char *path, *data = NULL;
+    int file_fd, ret = FALSE;
+
+    path = nvdircat(root, relpath, NULL);
+    file_fd = open(path, O_RDONLY);
+    nvfree(path);
+
+    if (file_fd < 0) {
+        return FALSE;
+    }
+
+    if (fstat(file_fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode)) {
+        goto done;
+    }
+
+    if (stat_buf.st_size > 0) {
+        data = nvalloc(stat_buf.st_size);
+        if (!read_all(file_fd, data, stat_buf.st_size)) {
+            goto done;
+        }
+    }
+
+    ret = build_service_send_record(fd, BUILD_SERVICE_RECORD_FILE,
+                                    stat_buf.st_mode & 07777, relpath,
+                                    data, stat_buf.st_size);
+
+done:
+    nvfree(data);
+    close(file_fd);
+
+    return ret;
+}
+
+
+/*
+ * build_service_send_directory() - recursively send every regular file
+ * beneath 'root'/'rel'. Entries are sent in sorted order, so that two
+ * clients sending identical trees produce identical byte streams; the
+ * reference daemon relies on this to deduplicate requests.
+ */
+
+int build_service_send_directory(int fd, const char *root, const char *rel)
+{
+    struct dirent **entries;
+    char *dir;
+    int i, n, ret = TRUE;
+
+    dir = rel ? nvdircat(root, rel, NULL) : nvstrdup(root);
+    n = scandir(dir, &entries, NULL, alphasort);
+    nvfree(dir);
+
+    if (n < 0) {
+        return FALSE;
+    }
+
+    for (i = 0; i < n; i++) {
+        const char *name = entries[i]->d_name;
+        struct stat stat_buf;
+        char *relpath, *path;
+
+        if (!ret || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            free(entries[i]);
+            continue;
+        }
+
+        relpath = rel ? nvdircat(rel, name, NULL) : nvstrdup(name);
+        path = nvdircat(root, relpath, NULL);
+
+        if (stat(path, &stat_buf) != 0) {
+            ret = FALSE;
+        } else if (S_ISDIR(stat_buf.st_mode)) {
+            ret = build_service_send_directory(fd, root, relpath);
+        } else if (S_ISREG(stat_buf.st_mode)) {
+            ret = build_service_send_file(fd, root, relpath);
+        }
+
+        nvfree(path);
+        nvfree(relpath);
+        free(entries[i]);
+    }
+
+    free(entries);
+
+    return ret;
+}
+
+
+/*
+ * build_service_recv_record() - read the next record from 'fd' into 'rec'.
+ * The payload is NUL-terminated for the convenience of callers that
+ * expect text. Returns TRUE on success, FALSE on a malformed record or if
+ * the connection was closed.
+ */
+
+int build_service_recv_record(int fd, BuildServiceRecord *rec)
+{
+    char header[4096], kind[32];
+    unsigned int mode;
+    size_t size;
+    int len = 0, name_offset;
+
+    memset(rec, 0, sizeof(*rec));
+
+    /* headers are short; read them one byte at a time up to the newline */
+
+    while (TRUE) {
+        if (len == sizeof(header) - 1 || !read_all(fd, header + len, 1)) {
+            return FALSE;
+        }
+        if (header[len] == '\n') {
+            break;
+        }
+        len++;
+    }
+
+    header[len] = '\0';
+
+    if (sscanf(header, "%31s %o %zu %n", kind, &mode, &size,
+               &name_offset) != 3 ||
+        size > BUILD_SERVICE_MAX_RECORD_SIZE) {
+        return FALSE;
+    }
+
+    rec->kind = nvstrdup(kind);
+    rec->name = nvstrdup(header + name_offset);
+    rec->mode = mode;
+    rec->size = size;
+    rec->data = nvalloc(size + 1);
+
+    if (size > 0 && !read_all(fd, rec->data, size)) {
+        build_service_free_record(rec);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+void build_service_free_record(BuildServiceRecord *rec)
+{
+    nvfree(rec->kind);
+    nvfree(rec->name);
+    nvfree(rec->data);
+    memset(rec, 0, sizeof(*rec));
+}
+
+
+/*
+ * build_service_path_is_safe() - reject relative paths from the other end
+ * of the socket which could escape the directory they are written into.
+ */
+
+int build_service_path_is_safe(const char *relpath)
+{
+    const char *component = relpath;
+
+    if (relpath[0] == '\0' || relpath[0] == '/') {
+        return FALSE;
+    }
+
+    while (component) {
+        if (strncmp(component, "..", 2) == 0 &&
+            (component[2] == '/' || component[2] == '\0')) {
+            return FALSE;
+        }
+
+        component = strchr(component, '/');
+        if (component) {
+            component++;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * build_service_write_file() - write the payload of the "file" record 'rec'
+ * to 'root'/'rec->name', creating any missing parent directories.
+ */
+
+int build_service_write_file(const char *root, const BuildServiceRecord *rec)
+{
+    char *path, *dir, *error = NULL;
+    int fd, ret;
+
+    if (!build_service_path_is_safe(rec->name)) {
+        return FALSE;
+    }
+
+    path = nvdircat(root, rec->name, NULL);
+    dir = nv_dirname(path);
+    ret = nv_mkdir_recursive(dir, 0755, &error, NULL);
+    nvfree(error);
+    nvfree(dir);
+
+    if (!ret) {
+        nvfree(path);
+        return FALSE;
+    }
+
+    unlink(path);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, rec->mode & 07777);
+    nvfree(path);
+
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    ret = write_all(fd, rec->data, rec->size);
+
+    if (fchmod(fd, rec->mode & 07777) != 0) {
+        ret = FALSE;
+    }
+
+    close(fd);
+
+    return ret;
+}
@@ -0,0 +1,264 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * build-service.c - offload the kernel module build to a local build
+ * service (such as nvidia-build-service) listening on a Unix domain socket,
+ * rather than running make(1) in the installer's own process tree.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "build-service.h"
+#include "kernel.h"
+#include "misc.h"
+#include "digest.h"
+
+/*
+ * Files from the kernel output directory which identify the configuration
+ * that modules are built against. The build service uses the fingerprint of
+ * these files, rather than the kernel name alone, to decide whether a cached
+ * build can be reused.
+ */
+static const char * const kernel_fingerprint_files[] = {
+    ".config",
+    "Module.symvers",
+    "include/config/kernel.release",
+    "include/generated/autoconf.h",
+    "include/generated/utsrelease.h",
+};
+
+
+/*
+ * get_kernel_fingerprint() - build a string of "file:digest" pairs, using
+ * BLAKE3 digests, for those kernel_fingerprint_files which exist under the
+ * kernel output path.
+ */
+
+static char *get_kernel_fingerprint(Options *op)
+{
+    char *fingerprint = nvstrdup("");
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(kernel_fingerprint_files); i++) {
+        Digest digest;
+        char *path = nvdircat(op->kernel_output_path,
+                              kernel_fingerprint_files[i], NULL);
+
+        if (access(path, R_OK) == 0 &&
+            compute_digest(op, DIGEST_BLAKE3, path, &digest)) {
+            char *str = digest_to_string(&digest);
+            nv_append_sprintf(&fingerprint, "%s:%s ",
+                              kernel_fingerprint_files[i], str);
+            nvfree(str);
+        }
+
+        nvfree(path);
+    }
+
+    return fingerprint;
+}
+
+
+static int connect_to_build_service(Options *op)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(op->build_service_socket) >= sizeof(addr.sun_path)) {
+        ui_error(op, "The build service socket path '%s' is too long.",
+                 op->build_service_socket);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, op->build_service_socket);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+        ui_error(op, "Unable to connect to the kernel module build service at "
+                 "'%s' (%s). Make sure that the build service is running, or "
+                 "install without the --build-service-socket option to build "
+                 "the kernel modules locally.", op->build_service_socket,
+                 strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static int send_request(Options *op, Package *p, int fd,
+                        const char *builddir, int build_interfaces)
+{
+    char *kernel_fingerprint;
+    int i, ret;
+
+    kernel_fingerprint = get_kernel_fingerprint(op);
+    log_printf(op, NULL, "Kernel fingerprint for the build service: %s",
+               kernel_fingerprint);
+
+    ret = build_service_send_param(fd, "protocol",
+                                   BUILD_SERVICE_PROTOCOL_VERSION) &&
+          build_service_send_param(fd, "kernel-name", get_kernel_name(op)) &&
+          build_service_send_param(fd, "kernel-source-path",
+                                   op->kernel_source_path) &&
+          build_service_send_param(fd, "kernel-output-path",
+                                   op->kernel_output_path) &&
+          build_service_send_param(fd, "kernel-fingerprint",
+                                   kernel_fingerprint) &&
+          build_service_send_param(fd, "excluded-kernel-modules",
+                                   p->excluded_kernel_modules);
+
+    nvfree(kernel_fingerprint);
+
+    /*
+     * Request each kernel module, and when building interfaces, each
+     * separate interface file. The service returns the requested files
+     * that it was able to build.
+     */
+    for (i = 0; ret && i < p->num_kernel_modules; i++) {
+        KernelModuleInfo *module = p->kernel_modules + i;
+
+        ret = build_service_send_param(fd, "module", module->module_name);
+
+        if (ret && build_interfaces && module->has_separate_interface_file) {
+            ret = build_service_send_param(fd, "target",
+                                           module->interface_filename);
+        }
+    }
+
+    ret = ret && build_service_send_directory(fd, builddir, NULL);
+
+    return ret && build_service_send_record(fd, BUILD_SERVICE_RECORD_END,
+                                            0, NULL, NULL, 0);
+}
+
+
+static int receive_reply(Options *op, Package *p, int fd, const char *builddir)
+{
+    int build_ok = FALSE;
+
+    while (TRUE) {
+        BuildServiceRecord rec;
+        int done = FALSE;
+
+        if (!build_service_recv_record(fd, &rec)) {
+            ui_error(op, "The kernel module build service closed the "
+                     "connection unexpectedly.");
+            return FALSE;
+        }
+
+        if (strcmp(rec.kind, BUILD_SERVICE_RECORD_END) == 0) {
+            done = TRUE;
+        } else if (strcmp(rec.kind, BUILD_SERVICE_RECORD_PARAM) == 0) {
+            if (strcmp(rec.name, "status") == 0) {
+                build_ok = (strcmp(rec.data, "ok") == 0);
+            } else if (strcmp(rec.name, "cache") == 0) {
+                ui_log(op, "Build service cache %s.", rec.data);
+            } else if (strcmp(rec.name, "error") == 0) {
+                ui_error(op, "The kernel module build service reported an "
+                         "error: %s", rec.data);
+            }
+        } else if (strcmp(rec.kind, BUILD_SERVICE_RECORD_LOG) == 0) {
+            char *old_logs = p->kernel_make_logs;
+            p->kernel_make_logs = nvstrcat(old_logs ? old_logs : "",
+                                           rec.data, NULL);
+            nvfree(old_logs);
+        } else if (strcmp(rec.kind, BUILD_SERVICE_RECORD_FILE) == 0) {
+            log_printf(op, NULL, "Received '%s' from the build service.",
+                       rec.name);
+            if (!build_service_write_file(builddir, &rec)) {
+                ui_error(op, "Unable to write '%s' received from the kernel "
+                         "module build service to '%s'.", rec.name, builddir);
+                build_ok = FALSE;
+                done = TRUE;
+            }
+        }
+
+        build_service_free_record(&rec);
+
+        if (done) {
+            return build_ok;
+        }
+    }
+}
+
+
+/*
+ * build_service_build_kernel_modules() - send the contents of 'builddir',
+ * along with a fingerprint of the target kernel's configuration, to the
+ * build service at op->build_service_socket, and write the kernel modules
+ * (and, if 'build_interfaces' is set, the separate kernel interface files)
+ * that it returns back into 'builddir'. The service's build output is
+ * appended to p->kernel_make_logs. Returns TRUE if the service reported a
+ * successful build, FALSE otherwise.
+ */
+
+int build_service_build_kernel_modules(Options *op, Package *p,
+                                       const char *builddir,
+                                       int build_interfaces)
+{
+    int fd, ret;
+
+    fd = connect_to_build_service(op);
+
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    ui_log(op, "Sending kernel module sources to the build service at '%s'.",
+           op->build_service_socket);
+
+    if (!send_request(op, p, fd, builddir, build_interfaces)) {
+        ui_error(op, "Failed to send the kernel module sources to the build "
+                 "service (%s).", strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    shutdown(fd, SHUT_WR);
+
+    ui_indeterminate_begin(op, "Building kernel modules with the build "
+                           "service");
+    ret = receive_reply(op, p, fd, builddir);
+    ui_indeterminate_end(op);
+
+    close(fd);
+
+    if (!ret) {
+        ui_error(op, "The kernel module build service was unable to build "
+                 "the kernel modules. See %s for details.", op->log_file_name);
+        ui_log(op, "Build service output:\n\n%s",
+               p->kernel_make_logs ? p->kernel_make_logs : "");
+    }
+
+    return ret;
+}
@@ -0,0 +1,90 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * build-service.h - definitions shared by the nvidia-installer build
+ * service client and the reference nvidia-build-service daemon.
+ *
+ * A request and its reply are each a sequence of records, terminated by
+ * an "end" record. Every record begins with a single text header line:
+ *
+ *     <kind> <mode> <size> <name>\n
+ *
+ * followed by exactly <size> bytes of payload. <mode> is printed in
+ * octal and is only meaningful for "file" records. The record kinds are:
+ *
+ *     param   <name> is a parameter name; the payload is its value
+ *     file    <name> is a path relative to the build directory; the
+ *             payload is the contents of the file
+ *     log     the payload is the output of the build
+ *     end     terminates the message; <size> is 0
+ *
+ * The first record of every message is a "param" record named "protocol",
+ * whose value is BUILD_SERVICE_PROTOCOL_VERSION.
+ */
+
+#ifndef __NVIDIA_INSTALLER_BUILD_SERVICE_H__
+#define __NVIDIA_INSTALLER_BUILD_SERVICE_H__
+
+#include <sys/types.h>
+
+#define BUILD_SERVICE_PROTOCOL_VERSION "1"
+#define BUILD_SERVICE_DEFAULT_SOCKET "/run/nvidia-build-service.sock"
+
+#define BUILD_SERVICE_RECORD_PARAM "param"
+#define BUILD_SERVICE_RECORD_FILE  "file"
+#define BUILD_SERVICE_RECORD_LOG   "log"
+#define BUILD_SERVICE_RECORD_END   "end"
+
+/* don't accept records larger than this from the other end of the socket */
+#define BUILD_SERVICE_MAX_RECORD_SIZE (256 * 1024 * 1024)
+
+typedef struct {
+    char *kind;
+    char *name;
+    mode_t mode;
+    size_t size;
+    char *data;
+} BuildServiceRecord;
+
+/* build-service-protocol.c: helpers shared with nvidia-build-service */
+
+int build_service_send_record(int fd, const char *kind, mode_t mode,
+                              const char *name, const void *data,
+                              size_t size);
+int build_service_send_param(int fd, const char *name, const char *value);
+int build_service_send_file(int fd, const char *root, const char *relpath);
+int build_service_send_directory(int fd, const char *root, const char *rel);
+int build_service_recv_record(int fd, BuildServiceRecord *rec);
+void build_service_free_record(BuildServiceRecord *rec);
+int build_service_write_file(const char *root, const BuildServiceRecord *rec);
+int build_service_path_is_safe(const char *relpath);
+
+#ifndef NV_BUILD_SERVICE_DAEMON
+
+#include "nvidia-installer.h"
+
+/* build-service.c: nvidia-installer side of the protocol */
+
+int build_service_build_kernel_modules(Options *op, Package *p,
+                                       const char *builddir,
+                                       int build_interfaces);
+
+#endif /* NV_BUILD_SERVICE_DAEMON */
+
+#endif /* __NVIDIA_INSTALLER_BUILD_SERVICE_H__ */
@@ -46,6 +46,10 @@
 #include "manifest.h"
 #include "conflicting-kernel-modules.h"
 #include "initramfs.h"
+#include "io-uring-install.h"
+#include "probes.h"
+#include "directory-plan.h"
+#include "scan-cache.h"
 
 
 /*
@@ -72,6 +76,9 @@
  *
  * FUNCTION_CMD - Call the function pointed to by 'function', with a pointer
  * to the Options structure passed as an argument.
+ *
+ * MKDIR_CMD - create the missing directories in 'plan', which the files
+ * installed by the later commands go in.
  */
 
 typedef enum {
@@ -84,6 +91,7 @@ typedef enum {
     DELETE_CMD,
     TOUCH_CMD,
     FUNCTION_CMD,
+    MKDIR_CMD,
 } CommandID;
 
 
@@ -103,6 +111,23 @@ typedef struct __command {
     char *command;
     mode_t mode;
     CommandFunction function;
+    int batch_result; /* 0: not batched; 1: batch install ok; -1: failed */
+    int batch_logged; /* the batched install is already in the backup log */
+    int clear_exec_stack; /* INSTALL_CMD: clear the executable stack flag of
+                           * the copy; 'command' is the execstack fallback */
+    DirectoryPlan *plan;
+
+    /*
+     * For RUN_CMDs added with add_fixup_command(): 'command' is the tool
+     * and its options in 'fixup_prefix', run on each of the files in
+     * 'fixup_files', followed by 'fixup_suffix'. If 'fixup_multiple_files'
+     * is set, the tool accepts several files in one invocation.
+     */
+    char *fixup_prefix;
+    char *fixup_suffix;
+    char **fixup_files;
+    int num_fixup_files;
+    int fixup_multiple_files;
 } Command;
 
 static void free_file_list(FileList* l);
@@ -116,8 +141,16 @@ static void condense_file_list(Package *p, FileList *l);
 
 static void add_command (CommandList *c, CommandID cmd, ...);
 
+static void remove_commands(CommandList *c);
+
+static void add_fixup_command(CommandList *c, const char *prefix,
+                              const char *file, const char *suffix,
+                              int multiple_files);
+
 static void add_file_to_list(const char*, const char*, FileList*);
 
+static char *get_command_description(const Command *c);
+
 static void append_to_rpm_file_list(Options *op, Command *c);
 
 static ConflictingFileInfo *build_conflicting_file_list(Options *op, Package *p);
@@ -134,6 +167,7 @@ typedef struct {
 } NoRecursionDirectory;
 
 static void find_conflicting_files(Options *op,
+                                   ScanCache *cache,
                                    char *path,
                                    ConflictingFileInfo *files,
                                    FileList *l,
@@ -257,7 +291,8 @@ CommandList *build_command_list(Options *op, Package *p)
     FileList *l;
     CommandList *c;
     CommandID cmd;
-    int i;
+    DirectoryPlan *plan;
+    int i, mkdir_cmd;
     PackageEntryFileTypeList installable_files;
     PackageEntryFileTypeList tmp_installable_files;
     char *tmp;
@@ -309,6 +344,7 @@ CommandList *build_command_list(Options *op, Package *p)
         char **paths;
         int numpaths, i;
         ConflictingFileInfo *conflicting_files;
+        ScanCache *cache;
 
         /*
          * stop recursing into any "nvidia-cg-toolkit"
@@ -333,11 +369,14 @@ CommandList *build_command_list(Options *op, Package *p)
         ui_status_begin(op, "Searching for conflicting files:", "Searching");
 
         conflicting_files = build_conflicting_file_list(op, p);
+        cache = op->no_recursion ? NULL :
+                scan_cache_open(op, conflicting_files, paths, numpaths);
         for (i = 0; i < numpaths; i++) {
             ui_status_update(op, (i + 1.0f) / numpaths, "Searching: %s", paths[i]);
-            find_conflicting_files(op, paths[i], conflicting_files, l,
+            find_conflicting_files(op, cache, paths[i], conflicting_files, l,
                                    skipdirs);
         }
+        scan_cache_close(op, cache);
         nvfree(conflicting_files);
 
         ui_status_end(op, "done.");
@@ -382,21 +421,31 @@ CommandList *build_command_list(Options *op, Package *p)
         add_command(c, FUNCTION_CMD, update_initramfs, "Rebuilding initramfs");
     }
 
+    /*
+     * Create the directories for all the installed files and symlinks at
+     * once, before the first is installed.
+     */
+
+    plan = directory_plan_new();
+    add_command(c, MKDIR_CMD, plan);
+    mkdir_cmd = c->num - 1;
+
     /* Add all the installable files to the list */
     
     for (i = 0; i < p->num_entries; i++) {
         /*
-         * Install first, then run execstack. This sets the selinux context on
-         * the installed file in the target filesystem, which is essentially
-         * guaranteed to support selinux attributes if selinux is enabled.
-         * However, the temporary filesystem containing the uninstalled file
-         * may be on a filesystem that doesn't support selinux attributes,
-         * such as NFS.
+         * Clear the executable stack flag of shared libraries while they
+         * are copied, so that each file is written once in its final form,
+         * and its CRC for the backup log is computed in the same pass.
          *
-         * Since execstack also changes the file on disk, we need to run it
-         * after the file is installed but before we compute and log its CRC in
-         * the backup log. To achieve that, we tell INTALL_CMD to run execstack
-         * as a post-install step.
+         * If that isn't possible, INSTALL_CMD falls back to running
+         * execstack as a post-install step, before the CRC is computed and
+         * logged. Install first, then run execstack: this sets the selinux
+         * context on the installed file in the target filesystem, which is
+         * essentially guaranteed to support selinux attributes if selinux
+         * is enabled. However, the temporary filesystem containing the
+         * uninstalled file may be on a filesystem that doesn't support
+         * selinux attributes, such as NFS.
          *
          * See bugs 530083 and 611327
          */
@@ -410,11 +459,24 @@ CommandList *build_command_list(Options *op, Package *p)
         }
 
         if (installable_files.types[p->entries[i].type]) {
+            directory_plan_add_file(plan, p->entries[i].dst);
             add_command(c, INSTALL_CMD,
                         p->entries[i].file,
                         p->entries[i].dst,
                         tmp,
                         p->entries[i].mode);
+
+            /*
+             * clear the flag in-process only where `execstack -c` would
+             * have been run, so that systems without execstack behave as
+             * before
+             */
+            if (tmp) {
+                c->cmds[c->num - 1].clear_exec_stack = TRUE;
+                nvfree(c->descriptions[c->num - 1]);
+                c->descriptions[c->num - 1] =
+                    get_command_description(&c->cmds[c->num - 1]);
+            }
         }
 
         nvfree(tmp);
@@ -442,8 +504,8 @@ CommandList *build_command_list(Options *op, Package *p)
         if (op->selinux_enabled &&
             (p->entries[i].caps.is_shared_lib)) {
             tmp = nvstrcat(op->utils[CHCON], " -t ", op->selinux_chcon_type,
-                           " ", p->entries[i].dst, NULL);
-            add_command(c, RUN_CMD, tmp);
+                           NULL);
+            add_fixup_command(c, tmp, p->entries[i].dst, "", TRUE);
             nvfree(tmp);
         }
     }
@@ -453,10 +515,25 @@ CommandList *build_command_list(Options *op, Package *p)
     
     for (i = 0; i < p->num_entries; i++) {
         if (p->entries[i].caps.is_symlink) {
+            directory_plan_add_file(plan, p->entries[i].dst);
             add_command(c, SYMLINK_CMD, p->entries[i].dst,
                         p->entries[i].target);
         }
     }
+
+    /*
+     * now that the plan is complete, describe it, or drop the command if
+     * there are no directories to create
+     */
+
+    if (directory_plan_num_directories(plan) > 0) {
+        nvfree(c->descriptions[mkdir_cmd]);
+        c->descriptions[mkdir_cmd] =
+            get_command_description(&c->cmds[mkdir_cmd]);
+    } else {
+        c->cmds[mkdir_cmd].cmd = INVALID_CMD;
+        remove_commands(c);
+    }
     
     /*
      * if "--no-abi-note" was requested, scan for any OpenGL
@@ -471,10 +548,9 @@ CommandList *build_command_list(Options *op, Package *p)
             for (i = 0; i < p->num_entries; i++) {
                 if (p->entries[i].type == FILE_TYPE_OPENGL_LIB) {
                     tmp = nvstrcat(op->utils[OBJCOPY],
-                            " --remove-section=.note.ABI-tag ",
-                            p->entries[i].dst,
-                            " 2> /dev/null ; true", NULL);
-                    add_command(c, RUN_CMD, tmp);
+                            " --remove-section=.note.ABI-tag", NULL);
+                    add_fixup_command(c, tmp, p->entries[i].dst,
+                                      " 2> /dev/null ; true", FALSE);
                     nvfree(tmp);
                 }
             }
@@ -541,6 +617,31 @@ static void free_file_list(FileList* l)
 
 
 
+/*
+ * free_command() - free the strings owned by a command
+ */
+
+static void free_command(Command *c)
+{
+    int i;
+
+    free(c->path);
+    free(c->target);
+    free(c->command);
+    free(c->fixup_prefix);
+    free(c->fixup_suffix);
+
+    for (i = 0; i < c->num_fixup_files; i++) {
+        free(c->fixup_files[i]);
+    }
+    free(c->fixup_files);
+
+    free_directory_plan(c->plan);
+
+} /* free_command() */
+
+
+
 /*
  * free_command_list() - free the specified commandlist
  */
@@ -554,9 +655,7 @@ void free_command_list(Options *op, CommandList *cl)
 
     for (i = 0; i < cl->num; i++) {
         c = &cl->cmds[i];
-        free(c->path);
-        free(c->target);
-        free(c->command);
+        free_command(c);
         free(cl->descriptions[i]);
     }
 
@@ -567,6 +666,440 @@ void free_command_list(Options *op, CommandList *cl)
 
 } /* free_command_list() */
 
+/*
+ * Command list optimization: optimize_command_list() rewrites the list
+ * built by build_command_list() into an equivalent, shorter one:
+ *
+ *   - repeated commands that only need to run once (touching the same
+ *     directory, running the same fixup on the same file, deleting the
+ *     same file) are reduced to a single command;
+ *
+ *   - fixup commands that run the same tool on different files are
+ *     merged into one command, which passes all of the files to the tool
+ *     if it accepts several, or else runs it once per file from a single
+ *     shell;
+ *
+ *   - the commands that only need to follow the installation of some
+ *     file (fixups, touches and the deletion of temporary files) are
+ *     moved after the run of installs they are interleaved with, so that
+ *     the installs can be batched.
+ *
+ * A command is never moved before a command it follows in the original
+ * list, and is never moved past a command that writes one of the paths
+ * it operates on.
+ */
+
+/* the most files merged into a single fixup command */
+#define MAX_FIXUP_FILES 64
+
+
+/*
+ * remove_commands() - drop the commands whose cmd has been set to
+ * INVALID_CMD, keeping the order of the rest.
+ */
+
+static void remove_commands(CommandList *c)
+{
+    int i, n = 0;
+
+    for (i = 0; i < c->num; i++) {
+        if (c->cmds[i].cmd == INVALID_CMD) {
+            free_command(&c->cmds[i]);
+            nvfree(c->descriptions[i]);
+            continue;
+        }
+        c->cmds[n] = c->cmds[i];
+        c->descriptions[n] = c->descriptions[i];
+        n++;
+    }
+
+    c->num = n;
+
+} /* remove_commands() */
+
+
+/*
+ * command_writes_path() - return TRUE if the command creates, replaces or
+ * removes 'path'.
+ */
+
+static int command_writes_path(const Command *c, const char *path)
+{
+    switch (c->cmd) {
+    case INSTALL_CMD:
+        return strcmp(c->target, path) == 0;
+    case SYMLINK_CMD:
+    case BACKUP_CMD:
+    case DELETE_CMD:
+        return strcmp(c->path, path) == 0;
+    default:
+        return FALSE;
+    }
+
+} /* command_writes_path() */
+
+
+/*
+ * command_reads_path() - return TRUE if the command needs 'path' to still
+ * exist when it runs.
+ */
+
+static int command_reads_path(const Command *c, const char *path)
+{
+    return c->cmd == INSTALL_CMD && strcmp(c->path, path) == 0;
+
+} /* command_reads_path() */
+
+
+static int is_fixup_command(const Command *c)
+{
+    return c->cmd == RUN_CMD && c->fixup_prefix != NULL;
+}
+
+
+static int same_fixup_tool(const Command *a, const Command *b)
+{
+    return strcmp(a->fixup_prefix, b->fixup_prefix) == 0 &&
+           strcmp(a->fixup_suffix, b->fixup_suffix) == 0 &&
+           a->fixup_multiple_files == b->fixup_multiple_files;
+}
+
+
+/*
+ * is_barrier() - return TRUE if no command may be moved past this one:
+ * anything other than installing, linking, touching or deleting a file,
+ * or a fixup.
+ */
+
+static int is_barrier(const Command *c)
+{
+    switch (c->cmd) {
+    case INSTALL_CMD:
+    case SYMLINK_CMD:
+    case DELETE_CMD:
+    case TOUCH_CMD:
+    case INVALID_CMD:
+        return FALSE;
+    default:
+        return !is_fixup_command(c);
+    }
+}
+
+
+/*
+ * fixup_conflicts() - return TRUE if 'other' writes any of the files the
+ * fixup command 'c' operates on.
+ */
+
+static int fixup_conflicts(const Command *c, const Command *other)
+{
+    int i;
+
+    for (i = 0; i < c->num_fixup_files; i++) {
+        if (command_writes_path(other, c->fixup_files[i])) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * deduplicate_commands() - remove the repeated commands that only need to
+ * run once. Of identical TOUCH_CMDs and fixups with no barrier between
+ * them, the last one is kept, so that it still follows everything that the
+ * earlier ones followed; of identical DELETE_CMDs with no barrier between
+ * them, the first, unless the file is written again in between.
+ */
+
+static void deduplicate_commands(CommandList *c)
+{
+    int i, j;
+
+    for (i = 0; i < c->num; i++) {
+        Command *a = &c->cmds[i];
+
+        if (a->cmd != TOUCH_CMD && a->cmd != DELETE_CMD &&
+            !is_fixup_command(a)) {
+            continue;
+        }
+
+        for (j = i + 1; j < c->num; j++) {
+            Command *b = &c->cmds[j];
+
+            if (a->cmd == DELETE_CMD && b->cmd != DELETE_CMD &&
+                command_writes_path(b, a->path)) {
+                break;
+            }
+
+            /*
+             * a barrier, such as a RUN_CMD or FUNCTION_CMD, may recreate
+             * a deleted file, so a DELETE_CMD after one is still needed
+             */
+
+            if (is_barrier(b)) {
+                break;
+            }
+
+            if (b->cmd != a->cmd) {
+                continue;
+            }
+
+            if (a->cmd == TOUCH_CMD && strcmp(a->path, b->path) == 0) {
+                a->cmd = INVALID_CMD;
+                break;
+            }
+
+            if (a->cmd == DELETE_CMD && strcmp(a->path, b->path) == 0) {
+                b->cmd = INVALID_CMD;
+            }
+
+            if (is_fixup_command(a) && is_fixup_command(b) &&
+                strcmp(a->command, b->command) == 0) {
+                a->cmd = INVALID_CMD;
+                break;
+            }
+        }
+    }
+
+    remove_commands(c);
+
+} /* deduplicate_commands() */
+
+
+/*
+ * build_fixup_command_string() - return the shell command that runs the
+ * fixup on all of its files.
+ */
+
+static char *build_fixup_command_string(const Command *c)
+{
+    char *ret = NULL, *tmp;
+    int i;
+
+    for (i = 0; i < c->num_fixup_files; i++) {
+        if (i == 0) {
+            tmp = nvstrcat(c->fixup_prefix, " ", c->fixup_files[i], NULL);
+        } else if (c->fixup_multiple_files) {
+            tmp = nvstrcat(ret, " ", c->fixup_files[i], NULL);
+        } else {
+            tmp = nvstrcat(ret, c->fixup_suffix, " ; ", c->fixup_prefix, " ",
+                           c->fixup_files[i], NULL);
+        }
+        nvfree(ret);
+        ret = tmp;
+    }
+
+    tmp = nvstrcat(ret, c->fixup_suffix, NULL);
+    nvfree(ret);
+
+    return tmp;
+}
+
+
+/*
+ * merge_fixup_commands() - merge each fixup command with the later fixups
+ * that run the same tool, up to MAX_FIXUP_FILES files, or until a barrier
+ * or a command that writes one of the files. The merged command takes the
+ * place of the last fixup merged into it.
+ */
+
+static void merge_fixup_commands(CommandList *c)
+{
+    int i, j;
+
+    for (i = 0; i < c->num; i++) {
+        Command *a = &c->cmds[i];
+        int last = i;
+
+        if (!is_fixup_command(a)) {
+            continue;
+        }
+
+        for (j = i + 1; j < c->num &&
+                        a->num_fixup_files < MAX_FIXUP_FILES; j++) {
+            Command *b = &c->cmds[j];
+            int k;
+
+            if (is_fixup_command(b) && same_fixup_tool(a, b)) {
+                a->fixup_files = nvrealloc(a->fixup_files, sizeof(char *) *
+                                           (a->num_fixup_files +
+                                            b->num_fixup_files));
+                for (k = 0; k < b->num_fixup_files; k++) {
+                    a->fixup_files[a->num_fixup_files++] = b->fixup_files[k];
+                }
+                b->num_fixup_files = 0;
+                b->cmd = INVALID_CMD;
+                last = j;
+            } else if (is_barrier(b) || fixup_conflicts(a, b)) {
+                break;
+            }
+        }
+
+        if (last == i) {
+            continue;
+        }
+
+        /* rebuild the command, and move it to where the last fixup was */
+
+        nvfree(a->command);
+        a->command = build_fixup_command_string(a);
+
+        free_command(&c->cmds[last]);
+        nvfree(c->descriptions[last]);
+
+        c->cmds[last] = *a;
+        c->descriptions[last] = get_command_description(a);
+
+        memset(a, 0, sizeof(Command));
+    }
+
+    remove_commands(c);
+
+} /* merge_fixup_commands() */
+
+
+/*
+ * is_deferrable() - return TRUE if the i'th command only needs to follow
+ * the commands before it, and so may run later: fixups, touches, and the
+ * deletion of a file that an earlier command installed from.
+ */
+
+static int is_deferrable(const CommandList *c, int i)
+{
+    const Command *cmd = &c->cmds[i];
+    int j;
+
+    if (is_fixup_command(cmd) || cmd->cmd == TOUCH_CMD) {
+        return TRUE;
+    }
+
+    if (cmd->cmd == DELETE_CMD) {
+        for (j = 0; j < i; j++) {
+            if (command_reads_path(&c->cmds[j], cmd->path)) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * may_defer_past() - return TRUE if the deferrable command 'd' may be
+ * moved after the INSTALL_CMD 'install'.
+ */
+
+static int may_defer_past(const Command *d, const Command *install)
+{
+    if (is_fixup_command(d)) {
+        return !fixup_conflicts(d, install);
+    }
+
+    if (d->cmd == DELETE_CMD) {
+        return !command_reads_path(install, d->path) &&
+               !command_writes_path(install, d->path);
+    }
+
+    return !command_writes_path(install, d->path);
+}
+
+
+/*
+ * defer_post_install_commands() - within each run of INSTALL_CMDs and
+ * deferrable commands, move the deferrable commands after the installs,
+ * keeping the order of each. A run is left as it is if one of its
+ * deferrable commands could not be moved past a later install.
+ */
+
+static void defer_post_install_commands(CommandList *c)
+{
+    Command *cmds;
+    char **descriptions;
+    int start, end, i, j, n;
+
+    cmds = nvalloc(sizeof(Command) * c->num);
+    descriptions = nvalloc(sizeof(char *) * c->num);
+
+    for (start = 0; start < c->num; start = end) {
+        int ok = TRUE;
+
+        for (end = start; end < c->num; end++) {
+            if (c->cmds[end].cmd != INSTALL_CMD && !is_deferrable(c, end)) {
+                break;
+            }
+        }
+
+        if (end == start) {
+            end++;
+            continue;
+        }
+
+        for (i = start; i < end && ok; i++) {
+            if (c->cmds[i].cmd == INSTALL_CMD) {
+                continue;
+            }
+            for (j = i + 1; j < end && ok; j++) {
+                if (c->cmds[j].cmd == INSTALL_CMD &&
+                    !may_defer_past(&c->cmds[i], &c->cmds[j])) {
+                    ok = FALSE;
+                }
+            }
+        }
+
+        if (!ok) {
+            continue;
+        }
+
+        n = 0;
+        for (i = start; i < end; i++) {
+            if (c->cmds[i].cmd == INSTALL_CMD) {
+                cmds[n] = c->cmds[i];
+                descriptions[n++] = c->descriptions[i];
+            }
+        }
+        for (i = start; i < end; i++) {
+            if (c->cmds[i].cmd != INSTALL_CMD) {
+                cmds[n] = c->cmds[i];
+                descriptions[n++] = c->descriptions[i];
+            }
+        }
+
+        memcpy(&c->cmds[start], cmds, sizeof(Command) * n);
+        memcpy(&c->descriptions[start], descriptions, sizeof(char *) * n);
+    }
+
+    nvfree(cmds);
+    nvfree(descriptions);
+
+} /* defer_post_install_commands() */
+
+
+/*
+ * optimize_command_list() - rewrite the command list built by
+ * build_command_list() as described above, and log how many commands
+ * were saved.
+ */
+
+void optimize_command_list(Options *op, CommandList *c)
+{
+    int before = c->num;
+
+    deduplicate_commands(c);
+    merge_fixup_commands(c);
+    defer_post_install_commands(c);
+
+    c->num_unoptimized = before;
+
+    ui_log(op, "Optimized the command list from %d to %d commands.",
+           before, c->num);
+
+} /* optimize_command_list() */
+
+
+
 /*
  * execute_run_command() - execute a RUN_CMD from the command list.
  */
@@ -606,126 +1139,343 @@ static inline int execute_run_command(Options *op, float percent, const char *cm
 } /* execute_run_command() */
 
 /*
- * execute_command_list() - execute the commands in the command list.
+ * batch_install_files() - install the run of consecutive INSTALL_CMDs
+ * starting at c->cmds[first] as a single io_uring batch, and record each
+ * file's result in its batch_result. The run ends at an install with a
+ * post-install command (which must run before the next file is installed),
+ * before an install that clears the executable stack flag of the copy, at
+ * a second install to the same target, or at the maximum batch size.
  *
- * If any failure occurs, ask the user if they would like to continue.
+ * Each installed file is added to the backup log as soon as the batch
+ * completes, rather than when its own command is reached, so that it is
+ * still uninstalled if an earlier file in the batch fails and the user
+ * stops. A file with a post-install command can only be logged after the
+ * command has run; execute_command_list() removes it if it never is.
  */
 
-int execute_command_list(Options *op, CommandList *c,
-                         const char *title, const char *msg)
+static void batch_install_files(Options *op, CommandList *c, int first)
 {
-    int i, ret;
-    float percent;
+    const char *srcs[IO_URING_INSTALL_MAX_BATCH];
+    const char *dsts[IO_URING_INSTALL_MAX_BATCH];
+    mode_t modes[IO_URING_INSTALL_MAX_BATCH];
+    int results[IO_URING_INSTALL_MAX_BATCH];
+    int i, j, n = 0;
 
-    ui_status_begin(op, title, "%s", msg);
+    for (i = first; i < c->num && n < IO_URING_INSTALL_MAX_BATCH; i++) {
+        Command *cmd = &c->cmds[i];
 
-    for (i = 0; i < c->num; i++) {
+        if (cmd->cmd != INSTALL_CMD || cmd->clear_exec_stack) {
+            break;
+        }
 
-        percent = (float) i / (float) c->num;
+        for (j = 0; j < n; j++) {
+            if (strcmp(dsts[j], cmd->target) == 0) {
+                break;
+            }
+        }
+        if (j < n) {
+            break;
+        }
 
-        switch (c->cmds[i].cmd) {
-                
-        case INSTALL_CMD:
-            ui_expert(op, "Installing: %s --> %s",
-                      c->cmds[i].path, c->cmds[i].target);
-            ui_status_update(op, percent, "Installing: %s", c->cmds[i].target);
+        srcs[n] = cmd->path;
+        dsts[n] = cmd->target;
+        modes[n] = cmd->mode;
+        n++;
+
+        if (cmd->command) {
+            break;
+        }
+    }
+
+    /* a lone file gains nothing from the ring */
+    if (n < 2) {
+        return;
+    }
+
+    if (!io_uring_install_files(op, n, srcs, dsts, modes, results)) {
+        op->io_uring_install = FALSE;
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        Command *cmd = &c->cmds[first + i];
+
+        cmd->batch_result = results[i] ? 1 : -1;
+
+        if (results[i] && !cmd->command) {
+            log_install_file(op, cmd->target);
+            cmd->batch_logged = TRUE;
+        }
+    }
+
+} /* batch_install_files() */
+
+
+/*
+ * Whether the executable stack flag cleared by copy_and_fixup_file() has
+ * been checked with `execstack -q`, and if so, whether execstack did not
+ * agree, in which case execstack is used from then on.
+ */
+static int in_process_execstack_verified;
+static int in_process_execstack_failed;
+
+
+/*
+ * verify_exec_stack_cleared() - the first time the executable stack flag
+ * of an installed file is cleared in-process, check with `execstack -q`
+ * that execstack also sees it as cleared. Returns FALSE if it does not,
+ * in which case execstack should be run on the file after all.
+ */
+
+static int verify_exec_stack_cleared(Options *op, const char *filename)
+{
+    char *cmd, *data = NULL;
+    int ret;
+
+    if (in_process_execstack_verified || !op->utils[EXECSTACK]) {
+        return !in_process_execstack_failed;
+    }
+
+    in_process_execstack_verified = TRUE;
+
+    cmd = nvstrcat(op->utils[EXECSTACK], " -q ", filename, NULL);
+    ret = run_command(op, &data, FALSE, NULL, TRUE, cmd, NULL);
+
+    /* `execstack -q` prints '-' for a non-executable stack, 'X' if not */
+
+    if (ret == 0 && data && data[0] == 'X') {
+        ui_warn(op, "The executable stack flag of '%s' was cleared by "
+                "nvidia-installer, but `%s` does not agree; `%s` will be "
+                "used to clear it instead.", filename, cmd,
+                op->utils[EXECSTACK]);
+        in_process_execstack_failed = TRUE;
+    } else if (ret == 0 && data && data[0] == '-') {
+        ui_log(op, "Verified the executable stack flag cleared by "
+               "nvidia-installer with `%s`.", cmd);
+    } else {
+        ui_log(op, "Unable to verify the executable stack flag of '%s' with "
+               "`%s`.", filename, cmd);
+    }
+
+    nvfree(cmd);
+    nvfree(data);
+
+    return !in_process_execstack_failed;
+
+} /* verify_exec_stack_cleared() */
+
+
+/*
+ * execute_command() - execute the i'th command in the command list;
+ * returns FALSE if the command failed and the user chose not to continue.
+ */
+
+static int execute_command(Options *op, CommandList *c, int i, float percent)
+{
+    int ret, have_digest, exec_stack_cleared;
+    Digest digest;
+
+    switch (c->cmds[i].cmd) {
             
-            ret = install_file(op, c->cmds[i].path, c->cmds[i].target,
-                               c->cmds[i].mode);
-            if (!ret) {
-                ret = continue_after_error(op, "Cannot install %s",
-                                           c->cmds[i].target);
-                if (!ret) return FALSE;
-            } else {
-                /*
-                 * perform post-install step before logging the backup
-                 */
-                if (c->cmds[i].command &&
-                    !execute_run_command(op, percent, c->cmds[i].command)) {
+    case INSTALL_CMD:
+        ui_expert(op, "Installing: %s --> %s",
+                  c->cmds[i].path, c->cmds[i].target);
+        ui_status_update(op, percent, "Installing: %s", c->cmds[i].target);
+
+        if (op->io_uring_install && op->copy_rate_limit <= 0 &&
+            c->cmds[i].batch_result == 0) {
+            batch_install_files(op, c, i);
+        }
+
+        have_digest = FALSE;
+        exec_stack_cleared = FALSE;
+
+        if (c->cmds[i].batch_result != 0) {
+            ret = (c->cmds[i].batch_result > 0);
+        } else {
+            ret = install_and_fixup_file(op, c->cmds[i].path,
+                                         c->cmds[i].target, c->cmds[i].mode,
+                                         c->cmds[i].clear_exec_stack &&
+                                         !in_process_execstack_failed,
+                                         &exec_stack_cleared, &digest);
+            have_digest = ret;
+        }
+        if (!ret) {
+            ret = continue_after_error(op, "Cannot install %s",
+                                       c->cmds[i].target);
+            if (!ret) return FALSE;
+        } else {
+            if (exec_stack_cleared &&
+                !verify_exec_stack_cleared(op, c->cmds[i].target)) {
+                exec_stack_cleared = FALSE;
+            }
+
+            /*
+             * perform post-install step before logging the backup
+             */
+            if (c->cmds[i].command && !exec_stack_cleared) {
+                if (!execute_run_command(op, percent, c->cmds[i].command)) {
                     return FALSE;
                 }
+                have_digest = FALSE;
+            }
 
+            if (c->cmds[i].batch_logged) {
+                /* already logged by batch_install_files() */
+            } else if (have_digest) {
+                log_install_file_digest(op, c->cmds[i].target, &digest);
+            } else {
                 log_install_file(op, c->cmds[i].target);
-                append_to_rpm_file_list(op, &c->cmds[i]);
             }
-            break;
-            
-        case RUN_CMD:
-            if (!execute_run_command(op, percent, c->cmds[i].command)) {
-                return FALSE;
-            }
-            break;
-        case RUN_CMD_LONG:
-            if (!execute_run_command(op, c->cmds[i].cmd == RUN_CMD_LONG ? -1 : percent, c->cmds[i].command)) {
-                return FALSE;
-            }
-            break;
+            c->cmds[i].batch_logged = TRUE;
+            append_to_rpm_file_list(op, &c->cmds[i]);
+        }
+        break;
+        
+    case RUN_CMD:
+        if (!execute_run_command(op, percent, c->cmds[i].command)) {
+            return FALSE;
+        }
+        break;
+    case RUN_CMD_LONG:
+        if (!execute_run_command(op, c->cmds[i].cmd == RUN_CMD_LONG ? -1 : percent, c->cmds[i].command)) {
+            return FALSE;
+        }
+        break;
 
-        case SYMLINK_CMD:
-            ui_expert(op, "Creating symlink: %s -> %s",
-                      c->cmds[i].path, c->cmds[i].target);
-            ui_status_update(op, percent, "Creating symlink: %s",
-                             c->cmds[i].target);
+    case SYMLINK_CMD:
+        ui_expert(op, "Creating symlink: %s -> %s",
+                  c->cmds[i].path, c->cmds[i].target);
+        ui_status_update(op, percent, "Creating symlink: %s",
+                         c->cmds[i].target);
 
-            ret = install_symlink(op, c->cmds[i].target, c->cmds[i].path);
+        ret = install_symlink(op, c->cmds[i].target, c->cmds[i].path);
 
-            if (!ret) {
-                ret = continue_after_error(op, "Cannot create symlink %s (%s)",
-                                           c->cmds[i].path, strerror(errno));
-                if (!ret) return FALSE;
-            } else {
-                log_create_symlink(op, c->cmds[i].path, c->cmds[i].target);
-            }
-            break;
+        if (!ret) {
+            ret = continue_after_error(op, "Cannot create symlink %s (%s)",
+                                       c->cmds[i].path, strerror(errno));
+            if (!ret) return FALSE;
+        } else {
+            log_create_symlink(op, c->cmds[i].path, c->cmds[i].target);
+        }
+        break;
 
-        case BACKUP_CMD:
-            ui_expert(op, "Backing up: %s", c->cmds[i].path);
-            ui_status_update(op, percent, "Backing up: %s", c->cmds[i].path);
+    case BACKUP_CMD:
+        ui_expert(op, "Backing up: %s", c->cmds[i].path);
+        ui_status_update(op, percent, "Backing up: %s", c->cmds[i].path);
 
-            ret = do_backup(op, c->cmds[i].path);
-            if (!ret) {
-                ret = continue_after_error(op, "Cannot backup %s",
-                                           c->cmds[i].path);
-                if (!ret) return FALSE;
-            }
-            break;
+        ret = do_backup(op, c->cmds[i].path);
+        if (!ret) {
+            ret = continue_after_error(op, "Cannot backup %s",
+                                       c->cmds[i].path);
+            if (!ret) return FALSE;
+        }
+        break;
 
-        case DELETE_CMD:
-            ui_expert(op, "Deleting: %s", c->cmds[i].path);
-            ret = unlink(c->cmds[i].path);
-            if (ret == -1) {
-                ret = continue_after_error(op, "Cannot delete %s",
-                                           c->cmds[i].path);
-                if (!ret) return FALSE;
-            }
-            break;
+    case DELETE_CMD:
+        ui_expert(op, "Deleting: %s", c->cmds[i].path);
+        ret = unlink(c->cmds[i].path);
+        if (ret == -1) {
+            ret = continue_after_error(op, "Cannot delete %s",
+                                       c->cmds[i].path);
+            if (!ret) return FALSE;
+        }
+        break;
 
-        case TOUCH_CMD:
-            ui_expert(op, "Updating mtime: %s", c->cmds[i].path);
-            ret = utime(c->cmds[i].path, NULL);
-            if (ret == -1) {
-                ret = continue_after_error(op, "Cannot touch %s",
-                                           c->cmds[i].path);
-                if (!ret) return FALSE;
-            }
-            break;
-        case FUNCTION_CMD:
-            ui_expert(op, "%s:", c->descriptions[i]);
-            ret = c->cmds[i].function(op);
-            if (!ret) {
-                ret = continue_after_error(op, "%s failed", c->descriptions[i]);
-                if (!ret) return FALSE;
-            }
-            break;
-        default:
-            /* XXX should never get here */
+    case TOUCH_CMD:
+        ui_expert(op, "Updating mtime: %s", c->cmds[i].path);
+        ret = utime(c->cmds[i].path, NULL);
+        if (ret == -1) {
+            ret = continue_after_error(op, "Cannot touch %s",
+                                       c->cmds[i].path);
+            if (!ret) return FALSE;
+        }
+        break;
+    case MKDIR_CMD:
+        ui_expert(op, "Creating directories");
+        ui_status_update(op, percent, "Creating directories");
+        ret = create_planned_directories(op, c->cmds[i].plan);
+        if (!ret) {
+            ret = continue_after_error(op, "Cannot create all of the "
+                                       "directories for the installed files");
+            if (!ret) return FALSE;
+        }
+        break;
+    case FUNCTION_CMD:
+        ui_expert(op, "%s:", c->descriptions[i]);
+        ret = c->cmds[i].function(op);
+        if (!ret) {
+            ret = continue_after_error(op, "%s failed", c->descriptions[i]);
+            if (!ret) return FALSE;
+        }
+        break;
+    default:
+        /* XXX should never get here */
+        return FALSE;
+        break;
+    }
+
+    return TRUE;
+
+} /* execute_command() */
+
+
+/*
+ * discard_unlogged_installs() - remove the files that were installed ahead
+ * of their commands by batch_install_files(), from c->cmds[first] on, but
+ * not added to the backup log, since uninstalling would not remove them.
+ */
+
+static void discard_unlogged_installs(Options *op, CommandList *c, int first)
+{
+    int i;
+
+    for (i = first; i < c->num; i++) {
+        if (c->cmds[i].cmd == INSTALL_CMD && c->cmds[i].batch_result > 0 &&
+            !c->cmds[i].batch_logged) {
+            ui_log(op, "Removing '%s', which was installed but not logged.",
+                   c->cmds[i].target);
+            unlink(c->cmds[i].target);
+        }
+    }
+}
+
+
+/*
+ * execute_command_list() - execute the commands in the command list.
+ *
+ * If any failure occurs, ask the user if they would like to continue.
+ * The path identities are forgotten afterwards, since the commands may
+ * have created, removed or replaced directories.
+ */
+
+int execute_command_list(Options *op, CommandList *c,
+                         const char *title, const char *msg)
+{
+    int i, ret;
+    float percent;
+
+    ui_status_begin(op, title, "%s", msg);
+
+    for (i = 0; i < c->num; i++) {
+
+        percent = (float) i / (float) c->num;
+
+        NV_PROBE2(command__start, i, (int) c->cmds[i].cmd);
+        ret = execute_command(op, c, i, percent);
+        NV_PROBE3(command__done, i, (int) c->cmds[i].cmd, ret);
+
+        if (!ret) {
+            discard_unlogged_installs(op, c, i);
+            reset_path_identities();
             return FALSE;
-            break;
         }
     }
 
     ui_status_end(op, "done.");
 
+    reset_path_identities();
+
     return TRUE;
     
 } /* execute_command_list() */
@@ -746,11 +1496,12 @@ int execute_command_list(Options *op, CommandList *c,
 
 static void find_conflicting_kernel_modules(Options *op, FileList *l)
 {
-    int i = 0;
+    int i = 0, num_paths;
     ConflictingFileInfo *files;
     char *paths[3];
     char *tmp = get_kernel_name(op);
     char **filenames;
+    ScanCache *cache;
 
     /* Don't descend into the "build" or "source" directories; these won't
      * contain modules, and may be symlinks back to an actual source tree. */
@@ -769,6 +1520,7 @@ static void find_conflicting_kernel_modules(Options *op, FileList *l)
     }
 
     paths[i] = NULL;
+    num_paths = i;
 
     /* Build the list of conflicting kernel modules */
 
@@ -781,15 +1533,20 @@ static void find_conflicting_kernel_modules(Options *op, FileList *l)
         files[i].len = strlen(filenames[i]);
     }
 
+    cache = op->no_recursion ? NULL :
+            scan_cache_open(op, files, paths, num_paths);
+
     for (i = 0; paths[i]; i++) {
         /*
          * Recursively search for the conflicting kernel modules
          * relative to the current prefix.
          */
 
-        find_conflicting_files(op, paths[i], files, l, skipdirs);
+        find_conflicting_files(op, cache, paths[i], files, l, skipdirs);
     }
 
+    scan_cache_close(op, cache);
+
     /* free any paths we nvstrcat()'d above  */
 
     for (i = 1; paths[i]; i++) {
@@ -917,13 +1674,165 @@ static int ignore_conflicting_file(Options *op,
 
 
 
+/*
+ * ScanAncestor - the directories above the one being searched, so that a
+ * symbolic link back to one of them is not followed in a loop.
+ */
+
+typedef struct __scan_ancestor {
+    dev_t dev;
+    ino_t ino;
+    const struct __scan_ancestor *parent;
+} ScanAncestor;
+
+
+static void find_conflicting_files_cached(Options *op,
+                                          ScanCache *cache,
+                                          const char *path,
+                                          const struct stat *st,
+                                          int level,
+                                          const ScanAncestor *parent,
+                                          ConflictingFileInfo *files,
+                                          FileList *l,
+                                          const NoRecursionDirectory *skipdirs);
+
+
+/*
+ * check_conflicting_file() - add 'file', whose name is 'name', to the list
+ * if it is one of the conflicting files.
+ */
+
+static void check_conflicting_file(Options *op, const char *name,
+                                   const char *file,
+                                   ConflictingFileInfo *files, FileList *l)
+{
+    int i;
+
+    for (i = 0; files[i].name; i++) {
+        /* end compare at len e.g. so "libGL." matches "libGL.so.1" */
+        if (!strncmp(name, files[i].name, files[i].len) &&
+            !ignore_conflicting_file(op, file, files[i])) {
+            add_file_to_list(NULL, file, l);
+        }
+    }
+}
+
+
+/*
+ * search_subdirectory() - search the directory 'subdir', named 'name' and
+ * with the stat(2) information 'sub_st', found at depth 'level' + 1,
+ * unless it is one of 'skipdirs' or one of its own ancestors.
+ */
+
+static void search_subdirectory(Options *op, ScanCache *cache,
+                                const char *subdir, const char *name,
+                                const struct stat *sub_st, int level,
+                                const ScanAncestor *self,
+                                ConflictingFileInfo *files, FileList *l,
+                                const NoRecursionDirectory *skipdirs)
+{
+    const NoRecursionDirectory *dir;
+    const ScanAncestor *a;
+
+    for (dir = skipdirs; dir && dir->name; dir++) {
+        if ((dir->level < 0 || dir->level >= level + 1) &&
+            strcmp(name, dir->name) == 0) {
+            return;
+        }
+    }
+
+    for (a = self; a; a = a->parent) {
+        if (a->dev == sub_st->st_dev && a->ino == sub_st->st_ino) {
+            return;
+        }
+    }
+
+    find_conflicting_files_cached(op, cache, subdir, sub_st, level + 1, self,
+                                  files, l, skipdirs);
+}
+
+
+/*
+ * find_conflicting_files_cached() - search the directory 'path' at depth
+ * 'level' below the search root, and the hierarchy under it, in the same
+ * way as the fts(3) traversal in find_conflicting_files(), but using the
+ * scan cache's listing of each directory.  The targets of symbolic links
+ * may change without the listing changing, so each one is looked up again
+ * to decide whether it is a directory to search or a file to check.
+ */
+
+static void find_conflicting_files_cached(Options *op,
+                                          ScanCache *cache,
+                                          const char *path,
+                                          const struct stat *st,
+                                          int level,
+                                          const ScanAncestor *parent,
+                                          ConflictingFileInfo *files,
+                                          FileList *l,
+                                          const NoRecursionDirectory *skipdirs)
+{
+    const ScanCacheDirectory *d;
+    ScanAncestor self;
+    int j;
+
+    d = scan_cache_read_directory(cache, path, st);
+    if (!d) return;
+
+    for (j = 0; j < d->num_files; j++) {
+        char *file = scan_cache_child_path(path, d->files[j]);
+
+        check_conflicting_file(op, d->files[j], file, files, l);
+
+        nvfree(file);
+    }
+
+    self.dev = st->st_dev;
+    self.ino = st->st_ino;
+    self.parent = parent;
+
+    for (j = 0; j < d->num_links; j++) {
+        char *link = scan_cache_child_path(path, d->links[j]);
+        struct stat link_st;
+
+        if (stat(link, &link_st) == 0) {
+            if (S_ISDIR(link_st.st_mode)) {
+                search_subdirectory(op, cache, link, d->links[j], &link_st,
+                                    level, &self, files, l, skipdirs);
+            } else if (S_ISREG(link_st.st_mode)) {
+                check_conflicting_file(op, d->links[j], link, files, l);
+            }
+        } else if (lstat(link, &link_st) == 0 && S_ISLNK(link_st.st_mode)) {
+            /* a broken link, as fts(3) reports with FTS_SLNONE */
+            check_conflicting_file(op, d->links[j], link, files, l);
+        }
+
+        nvfree(link);
+    }
+
+    for (j = 0; j < d->num_subdirs; j++) {
+        char *subdir = scan_cache_child_path(path, d->subdirs[j]);
+        struct stat sub_st;
+
+        if (stat(subdir, &sub_st) == 0 && S_ISDIR(sub_st.st_mode)) {
+            search_subdirectory(op, cache, subdir, d->subdirs[j], &sub_st,
+                                level, &self, files, l, skipdirs);
+        }
+
+        nvfree(subdir);
+    }
+
+} /* find_conflicting_files_cached() */
+
+
 /*
  * find_conflicting_files() - search for any conflicting
  * files in all the specified paths within the hierarchy under
- * the given prefix.
+ * the given prefix.  If a scan cache is given, directories that
+ * are unchanged since the last search are not read again.
  */
 
 static void find_conflicting_files(Options *op,
+                                   ScanCache *cache,
                                    char *path,
                                    ConflictingFileInfo *files,
                                    FileList *l,
@@ -934,6 +1843,17 @@ static void find_conflicting_files(Options *op,
     FTS *fts;
     FTSENT *ent;
 
+    if (cache) {
+        struct stat st;
+
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            scan_cache_add_root(cache, path);
+            find_conflicting_files_cached(op, cache, path, &st, 0, NULL,
+                                          files, l, skipdirs);
+        }
+        return;
+    }
+
     paths[0] = path; /* search root */
     paths[1] = NULL;
 
@@ -1141,7 +2061,15 @@ static char *get_command_description(const Command *c)
         perms = mode_to_permission_string(c->mode);
         ret = nvasprintf("Install the file '%s' as '%s' with permissions '%s'",
                          c->path, c->target, perms);
-        if (c->command) {
+        if (c->clear_exec_stack) {
+            char *newret  = nvstrcat(ret, " and clear its executable stack "
+                                     "flag", c->command ? " (or, failing "
+                                     "that, execute the command `" : "",
+                                     c->command ? c->command : "",
+                                     c->command ? "`)" : "", NULL);
+            nvfree(ret);
+            ret = newret;
+        } else if (c->command) {
             char *newret  = nvstrcat(ret, " then execute the command `",
                                      c->command, "`", NULL);
             nvfree(ret);
@@ -1167,6 +2095,12 @@ static char *get_command_description(const Command *c)
         ret = nvasprintf("Delete the file '%s'", c->path);
         break;
 
+    case MKDIR_CMD:
+        ret = nvasprintf("Create any of the %d directories for the installed "
+                         "files that do not exist",
+                         directory_plan_num_directories(c->plan));
+        break;
+
     case FUNCTION_CMD:
         /* FUNCTION_CMD descriptions get set by the caller */
         break;
@@ -1226,6 +2160,9 @@ static void add_command(CommandList *c, CommandID cmd, ...)
         s = va_arg(ap, char *);
         c->cmds[n].command = nvstrdup(s);
         break;
+      case MKDIR_CMD:
+        c->cmds[n].plan = va_arg(ap, DirectoryPlan *);
+        break;
       case FUNCTION_CMD:
         c->cmds[n].function = va_arg(ap, CommandFunction);
         s = va_arg(ap, char *);
@@ -1246,6 +2183,35 @@ static void add_command(CommandList *c, CommandID cmd, ...)
 } /* add_command() */
 
 
+/*
+ * add_fixup_command() - append a RUN_CMD that runs the tool and options
+ * in 'prefix' on the installed file 'file', followed by 'suffix'; set
+ * 'multiple_files' if the tool accepts several files at once, so that
+ * optimize_command_list() may merge fixups that use the same tool.
+ */
+
+static void add_fixup_command(CommandList *c, const char *prefix,
+                              const char *file, const char *suffix,
+                              int multiple_files)
+{
+    Command *cmd;
+    char *tmp;
+
+    tmp = nvstrcat(prefix, " ", file, suffix, NULL);
+    add_command(c, RUN_CMD, tmp);
+    nvfree(tmp);
+
+    cmd = &c->cmds[c->num - 1];
+    cmd->fixup_prefix = nvstrdup(prefix);
+    cmd->fixup_suffix = nvstrdup(suffix);
+    cmd->fixup_files = nvalloc(sizeof(char *));
+    cmd->fixup_files[0] = nvstrdup(file);
+    cmd->num_fixup_files = 1;
+    cmd->fixup_multiple_files = multiple_files;
+
+} /* add_fixup_command() */
+
+
 
 /*
  * add_file_to_list() - concatenate the given directory and filename,
@@ -30,6 +30,7 @@ typedef struct {
     int num;
     char **descriptions;
     struct __command *cmds;
+    int num_unoptimized; /* num before optimize_command_list(), or 0 */
 } CommandList;
 
 
@@ -44,6 +45,7 @@ typedef struct {
 
 
 CommandList *build_command_list(Options*, Package *);
+void optimize_command_list(Options*, CommandList*);
 void free_command_list(Options*, CommandList*);
 int execute_command_list(Options*, CommandList*, const char*, const char*);
 
@@ -434,6 +434,135 @@ char *fget_next_line(FILE *fp, int *eof)
     return NULL; /* should never get here */
 }
 
+/*
+ * nv_line_iter_init() - prepare to iterate over the lines of the 'len'
+ * characters at 'buf'.
+ */
+void nv_line_iter_init(NvLineIter *it, const char *buf, size_t len)
+{
+    it->cur = buf;
+    it->end = buf ? buf + len : NULL;
+}
+
+static int line_iter_at_end(const NvLineIter *it, const char *c)
+{
+    // Cast comparisons to EOF to signed char, so that they also work where
+    // char is unsigned
+    return (c >= it->end) || (*c == '\0') || (((signed char)*c) == EOF);
+}
+
+/*
+ * nv_line_iter_next() - point 'line' at the next line of the buffer, and
+ * return TRUE; or return FALSE if there are no more lines.  A line ends at
+ * a newline, carriage return, NUL or EOF character, or the end of the
+ * buffer, and the terminator is not part of the line.  Any non-printable
+ * characters after the line (such as blank lines) are skipped.
+ */
+int nv_line_iter_next(NvLineIter *it, NvSlice *line)
+{
+    const char *c = it->cur;
+
+    if (!c || line_iter_at_end(it, c)) {
+        it->cur = NULL;
+        return FALSE;
+    }
+
+    while (!line_iter_at_end(it, c) && (*c != '\n') && (*c != '\r')) c++;
+
+    line->s = it->cur;
+    line->len = c - it->cur;
+
+    while (!line_iter_at_end(it, c) && !isprint((unsigned char)*c)) c++;
+
+    it->cur = line_iter_at_end(it, c) ? NULL : c;
+
+    return TRUE;
+}
+
+/*
+ * nv_line_iter_done() - return TRUE if there are no more lines to read.
+ */
+int nv_line_iter_done(const NvLineIter *it)
+{
+    return it->cur == NULL;
+}
+
+/*
+ * nv_slice_next_word() - skip any whitespace at the start of 's', then
+ * point 'word' at the characters up to the next whitespace, and advance
+ * 's' past them.  Returns FALSE if there are no more words.
+ */
+int nv_slice_next_word(NvSlice *s, NvSlice *word)
+{
+    const char *c = s->s, *end = s->s + s->len;
+
+    while ((c < end) && isspace((unsigned char)*c)) c++;
+    word->s = c;
+
+    while ((c < end) && !isspace((unsigned char)*c)) c++;
+    word->len = c - word->s;
+
+    s->len = end - c;
+    s->s = c;
+
+    return word->len > 0;
+}
+
+int nv_slice_equal(NvSlice s, const char *str)
+{
+    return (strlen(str) == s.len) && (memcmp(s.s, str, s.len) == 0);
+}
+
+int nv_slice_has_prefix(NvSlice s, const char *prefix)
+{
+    size_t len = strlen(prefix);
+
+    return (len <= s.len) && (memcmp(s.s, prefix, len) == 0);
+}
+
+/*
+ * nv_slice_to_ulong() - parse the whole of 's' as an unsigned number in
+ * the given base; returns FALSE if it is empty, or is not a valid number.
+ */
+int nv_slice_to_ulong(NvSlice s, int base, unsigned long *value)
+{
+    char buf[32], *end;
+
+    if ((s.len == 0) || !nv_slice_copy(s, buf, sizeof(buf))) {
+        return FALSE;
+    }
+
+    errno = 0;
+    *value = strtoul(buf, &end, base);
+
+    return (errno == 0) && (*end == '\0');
+}
+
+/*
+ * nv_slice_copy() - copy 's' into the caller's buffer of 'size' bytes as a
+ * NUL terminated string; returns FALSE, and copies nothing, if it does not
+ * fit.
+ */
+int nv_slice_copy(NvSlice s, char *buf, size_t size)
+{
+    if (s.len >= size) {
+        return FALSE;
+    }
+
+    memcpy(buf, s.s, s.len);
+    buf[s.len] = '\0';
+
+    return TRUE;
+}
+
+/*
+ * nv_slice_dup() - return a newly allocated, NUL terminated copy of 's'.
+ */
+char *nv_slice_dup(NvSlice s)
+{
+    return nvstrndup(s.s, s.len);
+}
+
 char *nvstrchrnul(char *s, int c)
 {
     char *result = strchr(s, c);
@@ -69,6 +69,36 @@ char *nv_prepend_to_string_list(char *list, const char *item, const char *delim)
 
 char *fget_next_line(FILE *fp, int *eof);
 
+/*
+ * NvSlice - a view of 'len' characters of a buffer, which need not be NUL
+ * terminated.  A slice is only valid for as long as the buffer it points
+ * into; use nv_slice_dup() or nv_slice_copy() to keep its contents.
+ */
+typedef struct {
+    const char *s;
+    size_t len;
+} NvSlice;
+
+/*
+ * NvLineIter - iterates over the lines of an in-memory or mmap()ed buffer
+ * without copying them; 'cur' is NULL once the last line has been read.
+ */
+typedef struct {
+    const char *cur;
+    const char *end;
+} NvLineIter;
+
+void nv_line_iter_init(NvLineIter *it, const char *buf, size_t len);
+int nv_line_iter_next(NvLineIter *it, NvSlice *line);
+int nv_line_iter_done(const NvLineIter *it);
+
+int nv_slice_next_word(NvSlice *s, NvSlice *word);
+int nv_slice_equal(NvSlice s, const char *str);
+int nv_slice_has_prefix(NvSlice s, const char *prefix);
+int nv_slice_to_ulong(NvSlice s, int base, unsigned long *value);
+int nv_slice_copy(NvSlice s, char *buf, size_t size);
+char *nv_slice_dup(NvSlice s);
+
 int nv_open(const char *pathname, int flags, mode_t mode);
 int nv_get_file_length(const char *filename);
 void nv_set_file_length(const char *filename, int fd, int len);
@@ -44,6 +44,7 @@
 #include "user-interface.h"
 #include "misc.h"
 #include "crc.h"
+#include "probes.h"
 
 #define BIT(x) (1 << (x))
 #define CRC_GEN_MASK (BIT(26) | BIT(23) | BIT(22) | BIT(16) | BIT(12) | \
@@ -91,6 +92,26 @@ uint32 compute_crc_from_buffer(const uint8 *buf, int len)
 
 
 
+/*
+ * crc.c is shared with mkprecompiled, whose Options structure is different;
+ * so rather than checking op->low_impact, compute_crc() is told whether to
+ * drop the files it reads from the page cache through this setter.
+ */
+
+static int drop_page_cache = FALSE;
+
+void compute_crc_set_drop_page_cache(int enable)
+{
+    drop_page_cache = enable;
+}
+
+int compute_crc_get_drop_page_cache(void)
+{
+    return drop_page_cache;
+}
+
+
+
 uint32 compute_crc(Options *op, const char *filename)
 {
     uint32 cword = ~0;
@@ -100,6 +121,8 @@ uint32 compute_crc(Options *op, const char *filename)
     struct stat stat_buf;
     size_t len = 0;
 
+    NV_PROBE1(compute_crc__start, filename);
+
     if ((fd = open(filename, O_RDONLY)) == -1) goto done;
     if (fstat(fd, &stat_buf) == -1) goto done;
 
@@ -127,8 +150,13 @@ uint32 compute_crc(Options *op, const char *filename)
         munmap(buf, len);
     }
     if (fd >= 0) {
+        if (drop_page_cache) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
         close(fd);
     }
+
+    NV_PROBE3(compute_crc__done, filename, (long) len, success);
     
     return cword;
         
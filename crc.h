@@ -23,5 +23,7 @@
 
 uint32 compute_crc_from_buffer(const uint8 *buf, int len);
 uint32 compute_crc(Options *op, const char *filename);
+void compute_crc_set_drop_page_cache(int enable);
+int compute_crc_get_drop_page_cache(void);
 
 #endif /* __NVIDIA_INSTALLER_CRC_H__ */
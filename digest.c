@@ -0,0 +1,855 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * digest.c - file digests with a selectable algorithm: the installer's
+ * original 32-bit CRC (see crc.c), kept for compatibility with existing
+ * backup logs and precompiled packages; XXH3-128, which is much faster;
+ * and BLAKE3, a cryptographic hash whose tree structure lets large files
+ * be hashed by several threads at once.
+ *
+ * Like crc.c, this file is shared with mkprecompiled and
+ * nvidia-build-service, so it must not look inside the Options structure.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "crc.h"
+#include "digest.h"
+
+static const struct {
+    const char *name;
+    int length;
+} digest_algorithms[NUM_DIGEST_ALGORITHMS] = {
+    [DIGEST_CRC32]    = { "crc32",    4 },
+    [DIGEST_XXH3_128] = { "xxh3-128", 16 },
+    [DIGEST_BLAKE3]   = { "blake3",   32 },
+};
+
+
+static uint32 read_le32(const uint8 *p)
+{
+    return (uint32) p[0] | ((uint32) p[1] << 8) |
+           ((uint32) p[2] << 16) | ((uint32) p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8 *p)
+{
+    return (uint64_t) read_le32(p) | ((uint64_t) read_le32(p + 4) << 32);
+}
+
+static void write_be64(uint8 *p, uint64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        p[i] = v & 0xff;
+        v >>= 8;
+    }
+}
+
+
+
+/*
+ ***************************************************************************
+ * XXH3-128
+ *
+ * The scalar code path of the reference implementation (xxhash.h, by Yann
+ * Collet), specialized for the default secret and a seed of 0.
+ ***************************************************************************
+ */
+
+#define XXH_PRIME32_1 0x9E3779B1U
+#define XXH_PRIME32_2 0x85EBCA77U
+#define XXH_PRIME32_3 0xC2B2AE3DU
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+#define XXH_PRIME_MX1 0x165667919E3779F9ULL
+#define XXH_PRIME_MX2 0x9FB21C651E98DF25ULL
+
+#define XXH_SECRET_SIZE      192
+#define XXH_STRIPE_LEN       64
+#define XXH_SECRET_CONSUME   8
+#define XXH_ACC_NB           8
+#define XXH_MIDSIZE_MAX      240
+#define XXH_MIDSIZE_START    3
+#define XXH_MIDSIZE_LAST     17
+#define XXH_SECRET_SIZE_MIN  136
+#define XXH_LASTACC_START    7
+#define XXH_MERGEACCS_START  11
+
+static const uint8 xxh3_secret[XXH_SECRET_SIZE] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe,
+    0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78,
+    0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e,
+    0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e,
+    0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f,
+    0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3,
+    0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49,
+    0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28,
+    0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+typedef struct {
+    uint64_t low, high;
+} Xxh128;
+
+static uint32 swap32(uint32 x)
+{
+    return ((x << 24) & 0xff000000) | ((x << 8) & 0x00ff0000) |
+           ((x >> 8) & 0x0000ff00) | ((x >> 24) & 0x000000ff);
+}
+
+static uint64_t swap64(uint64_t x)
+{
+    return ((uint64_t) swap32((uint32) x) << 32) | swap32((uint32) (x >> 32));
+}
+
+static Xxh128 mult64to128(uint64_t a, uint64_t b)
+{
+    unsigned __int128 product = (unsigned __int128) a * b;
+    Xxh128 r = { (uint64_t) product, (uint64_t) (product >> 64) };
+
+    return r;
+}
+
+static uint64_t mul128_fold64(uint64_t a, uint64_t b)
+{
+    Xxh128 product = mult64to128(a, b);
+
+    return product.low ^ product.high;
+}
+
+static uint64_t xxh64_avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t xxh3_avalanche(uint64_t h)
+{
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t xxh3_mix16(const uint8 *in, const uint8 *secret)
+{
+    return mul128_fold64(read_le64(in) ^ read_le64(secret),
+                         read_le64(in + 8) ^ read_le64(secret + 8));
+}
+
+static Xxh128 xxh3_mix32(Xxh128 acc, const uint8 *in1, const uint8 *in2,
+                         const uint8 *secret)
+{
+    acc.low += xxh3_mix16(in1, secret);
+    acc.low ^= read_le64(in2) + read_le64(in2 + 8);
+    acc.high += xxh3_mix16(in2, secret + 16);
+    acc.high ^= read_le64(in1) + read_le64(in1 + 8);
+    return acc;
+}
+
+static Xxh128 xxh3_128_0to16(const uint8 *in, size_t len)
+{
+    const uint8 *secret = xxh3_secret;
+    Xxh128 h;
+
+    if (len > 8) {
+        uint64_t bitflipl = read_le64(secret + 32) ^ read_le64(secret + 40);
+        uint64_t bitfliph = read_le64(secret + 48) ^ read_le64(secret + 56);
+        uint64_t in_lo = read_le64(in);
+        uint64_t in_hi = read_le64(in + len - 8);
+        Xxh128 m = mult64to128(in_lo ^ in_hi ^ bitflipl, XXH_PRIME64_1);
+
+        m.low += (uint64_t) (len - 1) << 54;
+        in_hi ^= bitfliph;
+        m.high += in_hi + (uint64_t) (uint32) in_hi * (XXH_PRIME32_2 - 1);
+        m.low ^= swap64(m.high);
+
+        h = mult64to128(m.low, XXH_PRIME64_2);
+        h.high += m.high * XXH_PRIME64_2;
+        h.low = xxh3_avalanche(h.low);
+        h.high = xxh3_avalanche(h.high);
+    } else if (len >= 4) {
+        uint64_t in64 = read_le32(in) + ((uint64_t) read_le32(in + len - 4) << 32);
+        uint64_t bitflip = read_le64(secret + 16) ^ read_le64(secret + 24);
+
+        h = mult64to128(in64 ^ bitflip, XXH_PRIME64_1 + (len << 2));
+        h.high += h.low << 1;
+        h.low ^= h.high >> 3;
+        h.low ^= h.low >> 35;
+        h.low *= XXH_PRIME_MX2;
+        h.low ^= h.low >> 28;
+        h.high = xxh3_avalanche(h.high);
+    } else if (len > 0) {
+        uint32 combinedl = ((uint32) in[0] << 16) | ((uint32) in[len >> 1] << 24) |
+                           (uint32) in[len - 1] | ((uint32) len << 8);
+        uint32 combinedh = swap32(combinedl);
+        uint64_t bitflipl = read_le32(secret) ^ read_le32(secret + 4);
+        uint64_t bitfliph = read_le32(secret + 8) ^ read_le32(secret + 12);
+
+        combinedh = (combinedh << 13) | (combinedh >> 19);
+        h.low = xxh64_avalanche(combinedl ^ bitflipl);
+        h.high = xxh64_avalanche(combinedh ^ bitfliph);
+    } else {
+        h.low = xxh64_avalanche(read_le64(secret + 64) ^
+                                read_le64(secret + 72));
+        h.high = xxh64_avalanche(read_le64(secret + 80) ^
+                                 read_le64(secret + 88));
+    }
+
+    return h;
+}
+
+static Xxh128 xxh3_128_17to240(const uint8 *in, size_t len)
+{
+    const uint8 *secret = xxh3_secret;
+    Xxh128 acc = { len * XXH_PRIME64_1, 0 }, h;
+
+    if (len <= 128) {
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    acc = xxh3_mix32(acc, in + 48, in + len - 64, secret + 96);
+                }
+                acc = xxh3_mix32(acc, in + 32, in + len - 48, secret + 64);
+            }
+            acc = xxh3_mix32(acc, in + 16, in + len - 32, secret + 32);
+        }
+        acc = xxh3_mix32(acc, in, in + len - 16, secret);
+    } else {
+        int i, rounds = len / 32;
+
+        for (i = 0; i < 4; i++) {
+            acc = xxh3_mix32(acc, in + 32 * i, in + 32 * i + 16,
+                             secret + 32 * i);
+        }
+        acc.low = xxh3_avalanche(acc.low);
+        acc.high = xxh3_avalanche(acc.high);
+
+        for (i = 4; i < rounds; i++) {
+            acc = xxh3_mix32(acc, in + 32 * i, in + 32 * i + 16,
+                             secret + XXH_MIDSIZE_START + 32 * (i - 4));
+        }
+
+        acc = xxh3_mix32(acc, in + len - 16, in + len - 32,
+                         secret + XXH_SECRET_SIZE_MIN - XXH_MIDSIZE_LAST - 16);
+    }
+
+    h.low = acc.low + acc.high;
+    h.high = acc.low * XXH_PRIME64_1 + acc.high * XXH_PRIME64_4 +
+             len * XXH_PRIME64_2;
+    h.low = xxh3_avalanche(h.low);
+    h.high = 0 - xxh3_avalanche(h.high);
+
+    return h;
+}
+
+static void xxh3_accumulate_512(uint64_t *acc, const uint8 *in,
+                                const uint8 *secret)
+{
+    int i;
+
+    for (i = 0; i < XXH_ACC_NB; i++) {
+        uint64_t data_val = read_le64(in + 8 * i);
+        uint64_t data_key = data_val ^ read_le64(secret + 8 * i);
+
+        acc[i ^ 1] += data_val;
+        acc[i] += (uint64_t) (uint32) data_key * (data_key >> 32);
+    }
+}
+
+static void xxh3_scramble(uint64_t *acc, const uint8 *secret)
+{
+    int i;
+
+    for (i = 0; i < XXH_ACC_NB; i++) {
+        uint64_t a = acc[i];
+
+        a ^= a >> 47;
+        a ^= read_le64(secret + 8 * i);
+        a *= XXH_PRIME32_1;
+        acc[i] = a;
+    }
+}
+
+static uint64_t xxh3_merge_accs(const uint64_t *acc, const uint8 *secret,
+                                uint64_t start)
+{
+    uint64_t result = start;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        result += mul128_fold64(acc[2 * i] ^ read_le64(secret + 16 * i),
+                                acc[2 * i + 1] ^ read_le64(secret + 16 * i + 8));
+    }
+
+    return xxh3_avalanche(result);
+}
+
+static Xxh128 xxh3_128_long(const uint8 *in, size_t len)
+{
+    const uint8 *secret = xxh3_secret;
+    const size_t stripes_per_block =
+        (XXH_SECRET_SIZE - XXH_STRIPE_LEN) / XXH_SECRET_CONSUME;
+    const size_t block_len = XXH_STRIPE_LEN * stripes_per_block;
+    const size_t blocks = (len - 1) / block_len;
+    size_t n, s, stripes;
+    uint64_t acc[XXH_ACC_NB] = {
+        XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+        XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1,
+    };
+    Xxh128 h;
+
+    for (n = 0; n < blocks; n++) {
+        for (s = 0; s < stripes_per_block; s++) {
+            xxh3_accumulate_512(acc, in + n * block_len + s * XXH_STRIPE_LEN,
+                                secret + s * XXH_SECRET_CONSUME);
+        }
+        xxh3_scramble(acc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN);
+    }
+
+    /* the last, partial block, and then the last stripe */
+
+    stripes = ((len - 1) - block_len * blocks) / XXH_STRIPE_LEN;
+    for (s = 0; s < stripes; s++) {
+        xxh3_accumulate_512(acc, in + blocks * block_len + s * XXH_STRIPE_LEN,
+                            secret + s * XXH_SECRET_CONSUME);
+    }
+    xxh3_accumulate_512(acc, in + len - XXH_STRIPE_LEN,
+                        secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN -
+                        XXH_LASTACC_START);
+
+    h.low = xxh3_merge_accs(acc, secret + XXH_MERGEACCS_START,
+                            (uint64_t) len * XXH_PRIME64_1);
+    h.high = xxh3_merge_accs(acc, secret + XXH_SECRET_SIZE - XXH_STRIPE_LEN -
+                             XXH_MERGEACCS_START,
+                             ~((uint64_t) len * XXH_PRIME64_2));
+
+    return h;
+}
+
+static void xxh3_128(const uint8 *in, size_t len, uint8 *out)
+{
+    Xxh128 h;
+
+    if (len <= 16) {
+        h = xxh3_128_0to16(in, len);
+    } else if (len <= XXH_MIDSIZE_MAX) {
+        h = xxh3_128_17to240(in, len);
+    } else {
+        h = xxh3_128_long(in, len);
+    }
+
+    /* canonical form: big endian, high half first */
+
+    write_be64(out, h.high);
+    write_be64(out + 8, h.low);
+}
+
+
+
+/*
+ ***************************************************************************
+ * BLAKE3
+ *
+ * A direct implementation of the specification's reference code.  Inputs
+ * of at least BLAKE3_PARALLEL_MIN bytes are split along the hash tree and
+ * the subtrees are hashed by separate threads.
+ ***************************************************************************
+ */
+
+#define BLAKE3_BLOCK_LEN  64
+#define BLAKE3_CHUNK_LEN  1024
+
+#define BLAKE3_CHUNK_START (1 << 0)
+#define BLAKE3_CHUNK_END   (1 << 1)
+#define BLAKE3_PARENT      (1 << 2)
+#define BLAKE3_ROOT        (1 << 3)
+
+/* the smallest subtree that is worth handing to another thread */
+#define BLAKE3_PARALLEL_MIN (1 << 20)
+
+static const uint32 blake3_iv[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+static const int blake3_permutation[16] = {
+    2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8,
+};
+
+static uint32 rotr32(uint32 x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static void blake3_g(uint32 *s, int a, int b, int c, int d,
+                     uint32 mx, uint32 my)
+{
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+/*
+ * blake3_compress() - compress one block into the chaining value 'cv',
+ * which is updated in place.
+ */
+
+static void blake3_compress(uint32 *cv, const uint32 *block_words,
+                            uint64_t counter, uint32 block_len, uint32 flags)
+{
+    uint32 s[16], m[16], tmp[16];
+    int r, i;
+
+    memcpy(s, cv, 8 * sizeof(uint32));
+    memcpy(s + 8, blake3_iv, 4 * sizeof(uint32));
+    s[12] = (uint32) counter;
+    s[13] = (uint32) (counter >> 32);
+    s[14] = block_len;
+    s[15] = flags;
+
+    memcpy(m, block_words, sizeof(m));
+
+    for (r = 0; r < 7; r++) {
+        blake3_g(s, 0, 4,  8, 12, m[0],  m[1]);
+        blake3_g(s, 1, 5,  9, 13, m[2],  m[3]);
+        blake3_g(s, 2, 6, 10, 14, m[4],  m[5]);
+        blake3_g(s, 3, 7, 11, 15, m[6],  m[7]);
+        blake3_g(s, 0, 5, 10, 15, m[8],  m[9]);
+        blake3_g(s, 1, 6, 11, 12, m[10], m[11]);
+        blake3_g(s, 2, 7,  8, 13, m[12], m[13]);
+        blake3_g(s, 3, 4,  9, 14, m[14], m[15]);
+
+        if (r < 6) {
+            for (i = 0; i < 16; i++) {
+                tmp[i] = m[blake3_permutation[i]];
+            }
+            memcpy(m, tmp, sizeof(m));
+        }
+    }
+
+    for (i = 0; i < 8; i++) {
+        cv[i] = s[i] ^ s[i + 8];
+    }
+}
+
+/*
+ * blake3_chunk() - compute the chaining value of one chunk of at most
+ * BLAKE3_CHUNK_LEN bytes; 'flags' is added to the chunk's last block.
+ */
+
+static void blake3_chunk(const uint8 *in, size_t len, uint64_t counter,
+                         uint32 flags, uint32 *cv)
+{
+    uint32 words[16];
+    uint8 block[BLAKE3_BLOCK_LEN];
+    size_t offset = 0;
+
+    memcpy(cv, blake3_iv, 8 * sizeof(uint32));
+
+    do {
+        size_t block_len = NV_MIN(len - offset, BLAKE3_BLOCK_LEN);
+        uint32 block_flags = 0;
+        int i;
+
+        memset(block, 0, sizeof(block));
+        memcpy(block, in + offset, block_len);
+        for (i = 0; i < 16; i++) {
+            words[i] = read_le32(block + 4 * i);
+        }
+
+        if (offset == 0) block_flags |= BLAKE3_CHUNK_START;
+        if (offset + block_len >= len) block_flags |= BLAKE3_CHUNK_END | flags;
+
+        blake3_compress(cv, words, counter, block_len, block_flags);
+
+        offset += block_len;
+    } while (offset < len);
+}
+
+static void blake3_parent(const uint32 *left, const uint32 *right,
+                          uint32 flags, uint32 *cv)
+{
+    uint32 words[16];
+
+    memcpy(words, left, 8 * sizeof(uint32));
+    memcpy(words + 8, right, 8 * sizeof(uint32));
+    memcpy(cv, blake3_iv, 8 * sizeof(uint32));
+
+    blake3_compress(cv, words, 0, BLAKE3_BLOCK_LEN, BLAKE3_PARENT | flags);
+}
+
+/* the length of the left subtree of an input of more than one chunk */
+
+static size_t blake3_left_len(size_t len)
+{
+    size_t chunks = (len - 1) / BLAKE3_CHUNK_LEN, left = 1;
+
+    while (left * 2 <= chunks) {
+        left *= 2;
+    }
+
+    return left * BLAKE3_CHUNK_LEN;
+}
+
+typedef struct {
+    const uint8 *in;
+    size_t len;
+    uint64_t counter;
+    uint32 flags;
+    int threads;
+    uint32 cv[8];
+} Blake3Subtree;
+
+static void *blake3_subtree(void *arg)
+{
+    Blake3Subtree *t = arg;
+    Blake3Subtree left, right;
+    pthread_t thread;
+    int threaded = FALSE;
+
+    if (t->len <= BLAKE3_CHUNK_LEN) {
+        blake3_chunk(t->in, t->len, t->counter, t->flags, t->cv);
+        return NULL;
+    }
+
+    left.in = t->in;
+    left.len = blake3_left_len(t->len);
+    left.counter = t->counter;
+    left.flags = 0;
+
+    right.in = t->in + left.len;
+    right.len = t->len - left.len;
+    right.counter = t->counter + left.len / BLAKE3_CHUNK_LEN;
+    right.flags = 0;
+
+    /* split the available threads between the two halves */
+
+    left.threads = t->threads / 2;
+    right.threads = t->threads - left.threads;
+
+    if (t->threads > 1 && left.len >= BLAKE3_PARALLEL_MIN) {
+        threaded = (pthread_create(&thread, NULL, blake3_subtree,
+                                   &left) == 0);
+    }
+
+    if (!threaded) {
+        blake3_subtree(&left);
+    }
+    blake3_subtree(&right);
+
+    if (threaded) {
+        pthread_join(thread, NULL);
+    }
+
+    blake3_parent(left.cv, right.cv, t->flags, t->cv);
+
+    return NULL;
+}
+
+static void blake3(const uint8 *in, size_t len, uint8 *out)
+{
+    Blake3Subtree root;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
+
+    root.in = in;
+    root.len = len;
+    root.counter = 0;
+    root.flags = BLAKE3_ROOT;
+    root.threads = (len >= 2 * BLAKE3_PARALLEL_MIN && cpus > 1) ? cpus : 1;
+
+    blake3_subtree(&root);
+
+    for (i = 0; i < 8; i++) {
+        out[4 * i]     = root.cv[i] & 0xff;
+        out[4 * i + 1] = (root.cv[i] >> 8) & 0xff;
+        out[4 * i + 2] = (root.cv[i] >> 16) & 0xff;
+        out[4 * i + 3] = (root.cv[i] >> 24) & 0xff;
+    }
+}
+
+
+
+/*
+ ***************************************************************************
+ * the digest interface
+ ***************************************************************************
+ */
+
+const char *digest_algorithm_name(DigestAlgorithm algorithm)
+{
+    if (algorithm < 0 || algorithm >= NUM_DIGEST_ALGORITHMS) {
+        return "unknown";
+    }
+
+    return digest_algorithms[algorithm].name;
+}
+
+int digest_algorithm_from_name(const char *name, DigestAlgorithm *algorithm)
+{
+    int i;
+
+    for (i = 0; i < NUM_DIGEST_ALGORITHMS; i++) {
+        if (strcasecmp(name, digest_algorithms[i].name) == 0) {
+            *algorithm = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+int digest_length(DigestAlgorithm algorithm)
+{
+    if (algorithm < 0 || algorithm >= NUM_DIGEST_ALGORITHMS) {
+        return 0;
+    }
+
+    return digest_algorithms[algorithm].length;
+}
+
+
+void compute_digest_from_buffer(DigestAlgorithm algorithm, const uint8 *buf,
+                                size_t len, Digest *digest)
+{
+    memset(digest, 0, sizeof(*digest));
+    digest->algorithm = algorithm;
+    digest->length = digest_length(algorithm);
+
+    switch (algorithm) {
+        case DIGEST_XXH3_128:
+            xxh3_128(buf, len, digest->bytes);
+            break;
+        case DIGEST_BLAKE3:
+            blake3(buf, len, digest->bytes);
+            break;
+        case DIGEST_CRC32:
+        default: {
+            uint32 crc = compute_crc_from_buffer(buf, len);
+
+            digest->algorithm = DIGEST_CRC32;
+            digest->length = 4;
+            digest->bytes[0] = crc >> 24;
+            digest->bytes[1] = crc >> 16;
+            digest->bytes[2] = crc >> 8;
+            digest->bytes[3] = crc;
+            break;
+        }
+    }
+}
+
+
+/*
+ * compute_digest() - compute the digest of the named file with the given
+ * algorithm.  Returns FALSE, after printing a warning, if the file could not
+ * be read; '*digest' is then left with a zero length, which never compares
+ * equal to any other digest.
+ */
+
+int compute_digest(Options *op, DigestAlgorithm algorithm,
+                   const char *filename, Digest *digest)
+{
+    uint8 *buf = MAP_FAILED;
+    struct stat stat_buf;
+    int success = FALSE;
+    size_t len = 0;
+    int fd;
+
+    memset(digest, 0, sizeof(*digest));
+    digest->algorithm = algorithm;
+
+    if (algorithm == DIGEST_CRC32) {
+        /* go through compute_crc(), for its page cache handling */
+        uint32 crc = compute_crc(op, filename);
+
+        compute_digest_from_buffer(DIGEST_CRC32, NULL, 0, digest);
+        digest->bytes[0] = crc >> 24;
+        digest->bytes[1] = crc >> 16;
+        digest->bytes[2] = crc >> 8;
+        digest->bytes[3] = crc;
+        return TRUE;
+    }
+
+    if ((fd = open(filename, O_RDONLY)) == -1) goto done;
+    if (fstat(fd, &stat_buf) == -1) goto done;
+
+    len = stat_buf.st_size;
+
+    if (len > 0) {
+        buf = mmap(0, len, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+        if (buf == MAP_FAILED) goto done;
+    }
+
+    compute_digest_from_buffer(algorithm, len > 0 ? buf : (const uint8 *) "",
+                               len, digest);
+
+    success = TRUE;
+
+ done:
+    if (!success) {
+        ui_warn(op, "Unable to compute the %s digest of file '%s' (%s).",
+                digest_algorithm_name(algorithm), filename, strerror(errno));
+    }
+
+    if (buf != MAP_FAILED) {
+        munmap(buf, len);
+    }
+    if (fd >= 0) {
+        if (compute_crc_get_drop_page_cache()) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        close(fd);
+    }
+
+    return success;
+}
+
+
+/*
+ * digest_to_string() - format a digest as "<algorithm>:<hex digits>".
+ * CRC32 digests are formatted as a plain decimal number instead, which is
+ * how they have always been recorded in the backup log.
+ */
+
+char *digest_to_string(const Digest *digest)
+{
+    char *str;
+    int i;
+
+    if (digest->algorithm == DIGEST_CRC32) {
+        return nvasprintf("%" PRIu32, (uint32) digest->bytes[0] << 24 |
+                                      (uint32) digest->bytes[1] << 16 |
+                                      (uint32) digest->bytes[2] << 8 |
+                                      (uint32) digest->bytes[3]);
+    }
+
+    str = nvalloc(strlen(digest_algorithm_name(digest->algorithm)) + 1 +
+                  2 * digest->length + 1);
+    strcpy(str, digest_algorithm_name(digest->algorithm));
+    strcat(str, ":");
+
+    for (i = 0; i < digest->length; i++) {
+        sprintf(str + strlen(str), "%02x", digest->bytes[i]);
+    }
+
+    return str;
+}
+
+
+/*
+ * digest_from_string() - parse a digest formatted by digest_to_string(),
+ * up to the first whitespace.  Returns FALSE if it is malformed.
+ */
+
+int digest_from_string(const char *str, Digest *digest)
+{
+    DigestAlgorithm algorithm;
+    const char *colon;
+    char *name;
+    int i, ok;
+
+    memset(digest, 0, sizeof(*digest));
+
+    if (isdigit(str[0])) {
+        uint32 crc = strtoul(str, NULL, 10);
+
+        digest->algorithm = DIGEST_CRC32;
+        digest->length = 4;
+        digest->bytes[0] = crc >> 24;
+        digest->bytes[1] = crc >> 16;
+        digest->bytes[2] = crc >> 8;
+        digest->bytes[3] = crc;
+        return TRUE;
+    }
+
+    colon = strchr(str, ':');
+    if (!colon) return FALSE;
+
+    name = nvstrndup(str, colon - str);
+    ok = digest_algorithm_from_name(name, &algorithm);
+    nvfree(name);
+
+    if (!ok) return FALSE;
+
+    digest->algorithm = algorithm;
+    digest->length = digest_length(algorithm);
+
+    for (i = 0; i < digest->length; i++) {
+        char hex[3] = { colon[1 + 2 * i], 0, 0 };
+
+        if (!isxdigit(hex[0])) return FALSE;
+        hex[1] = colon[2 + 2 * i];
+        if (!isxdigit(hex[1])) return FALSE;
+
+        digest->bytes[i] = strtoul(hex, NULL, 16);
+    }
+
+    return TRUE;
+}
+
+
+int digests_equal(const Digest *a, const Digest *b)
+{
+    return a->length > 0 &&
+           a->algorithm == b->algorithm && a->length == b->length &&
+           memcmp(a->bytes, b->bytes, a->length) == 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_DIGEST_H__
+#define __NVIDIA_INSTALLER_DIGEST_H__
+
+#include <stddef.h>
+
+/*
+ * The file digest algorithms.  The values are recorded in precompiled
+ * packages, so they must not be changed.
+ */
+typedef enum {
+    DIGEST_CRC32 = 0,    /* the installer's original 32-bit CRC */
+    DIGEST_XXH3_128,     /* XXH3, 128-bit variant, seed 0 */
+    DIGEST_BLAKE3,       /* BLAKE3, 256-bit output */
+    NUM_DIGEST_ALGORITHMS
+} DigestAlgorithm;
+
+#define DIGEST_MAX_LENGTH 32
+
+typedef struct {
+    DigestAlgorithm algorithm;
+    int length;
+    uint8 bytes[DIGEST_MAX_LENGTH];
+} Digest;
+
+const char *digest_algorithm_name(DigestAlgorithm algorithm);
+int digest_algorithm_from_name(const char *name, DigestAlgorithm *algorithm);
+int digest_length(DigestAlgorithm algorithm);
+
+void compute_digest_from_buffer(DigestAlgorithm algorithm, const uint8 *buf,
+                                size_t len, Digest *digest);
+int compute_digest(Options *op, DigestAlgorithm algorithm,
+                   const char *filename, Digest *digest);
+
+char *digest_to_string(const Digest *digest);
+int digest_from_string(const char *str, Digest *digest);
+int digests_equal(const Digest *a, const Digest *b);
+
+#endif /* __NVIDIA_INSTALLER_DIGEST_H__ */
@@ -0,0 +1,367 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ *
+ * directory-plan.c - create the directories that the installed files go
+ * in ahead of the files themselves.
+ *
+ * The directories containing each installed file are collected into a
+ * tree. When the plan is carried out, the tree is walked from the root to
+ * find the missing directories; each subtree that is missing entirely is
+ * then created parent-first, the independent subtrees in parallel, and
+ * all of the created directories are logged with a single write to the
+ * mkdir log. After that, directory_was_planned() tells install_file() and
+ * friends which directories are known to exist, so that they don't need
+ * to check each component of the path of every file again.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "directory-plan.h"
+#include "backup.h"
+#include "files.h"
+#include "misc.h"
+
+/* the most threads used to create independent subtrees */
+#define MAX_DIRECTORY_WORKERS 8
+
+typedef struct __directory_node DirectoryNode;
+
+struct __directory_node {
+    char *path;                 /* "" for the root directory */
+    DirectoryNode **children;
+    int num_children;
+
+    int created;                /* created by create_planned_directories() */
+    int error;                  /* errno, if it could not be created */
+};
+
+struct __directory_plan {
+    DirectoryNode root;
+    int num_directories;
+
+    DirectoryNode **missing;    /* the roots of the missing subtrees */
+    int num_missing;
+    int next_missing;
+};
+
+static DirectoryPlan *active_plan;
+
+
+DirectoryPlan *directory_plan_new(void)
+{
+    DirectoryPlan *plan = nvalloc(sizeof(DirectoryPlan));
+
+    plan->root.path = nvstrdup("");
+
+    return plan;
+}
+
+
+static DirectoryNode *find_child(const DirectoryNode *node, const char *name,
+                                 size_t len)
+{
+    size_t parent_len = strlen(node->path);
+    int i;
+
+    for (i = 0; i < node->num_children; i++) {
+        const char *child_name = node->children[i]->path + parent_len + 1;
+
+        if (strncmp(child_name, name, len) == 0 && child_name[len] == '\0') {
+            return node->children[i];
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * directory_plan_add_file() - add the directory containing 'filename',
+ * which must be an absolute path, and its parents to the plan.
+ */
+
+void directory_plan_add_file(DirectoryPlan *plan, const char *filename)
+{
+    DirectoryNode *node = &plan->root;
+    const char *name = filename, *end;
+
+    if (!filename || filename[0] != '/') {
+        return;
+    }
+
+    for (;;) {
+        DirectoryNode *child;
+        size_t len;
+
+        while (*name == '/') name++;
+
+        end = strchr(name, '/');
+
+        /* the last component is the file itself */
+
+        if (!end) {
+            break;
+        }
+
+        len = end - name;
+
+        if ((len == 1 && name[0] == '.') ||
+            (len == 2 && name[0] == '.' && name[1] == '.')) {
+            return;
+        }
+
+        child = find_child(node, name, len);
+
+        if (!child) {
+            child = nvalloc(sizeof(DirectoryNode));
+            child->path = nvalloc(strlen(node->path) + len + 2);
+            sprintf(child->path, "%s/%.*s", node->path, (int) len, name);
+
+            node->children = nvrealloc(node->children, sizeof(DirectoryNode *) *
+                                       (node->num_children + 1));
+            node->children[node->num_children++] = child;
+            plan->num_directories++;
+        }
+
+        node = child;
+        name = end;
+    }
+}
+
+
+int directory_plan_num_directories(const DirectoryPlan *plan)
+{
+    return plan->num_directories;
+}
+
+
+/*
+ * find_missing_directories() - walk the tree from 'node', which exists,
+ * and add the children that don't exist to the list of subtrees to create.
+ */
+
+static void find_missing_directories(DirectoryPlan *plan, DirectoryNode *node)
+{
+    int i;
+
+    for (i = 0; i < node->num_children; i++) {
+        DirectoryNode *child = node->children[i];
+
+        if (directory_exists(child->path)) {
+            find_missing_directories(plan, child);
+        } else {
+            plan->missing = nvrealloc(plan->missing, sizeof(DirectoryNode *) *
+                                      (plan->num_missing + 1));
+            plan->missing[plan->num_missing++] = child;
+        }
+    }
+}
+
+
+/*
+ * create_subtree() - create the directory 'node' and everything below it,
+ * parent-first. This may run on a worker thread, so it only records what
+ * happened in the nodes.
+ */
+
+static void create_subtree(DirectoryNode *node)
+{
+    int i;
+
+    if (mkdir(node->path, 0755) == 0) {
+        node->created = TRUE;
+    } else if (errno != EEXIST || !directory_exists(node->path)) {
+        node->error = errno;
+        return;
+    }
+
+    for (i = 0; i < node->num_children; i++) {
+        create_subtree(node->children[i]);
+    }
+}
+
+
+static void *directory_worker(void *arg)
+{
+    DirectoryPlan *plan = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&plan->next_missing, 1,
+                                   __ATOMIC_SEQ_CST)) < plan->num_missing) {
+        create_subtree(plan->missing[i]);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * collect_results() - append the directories created below 'node' to
+ * 'log', parent-first, and report the ones that could not be created.
+ */
+
+static void collect_results(Options *op, const DirectoryNode *node,
+                            char **log, int *num_created, int *num_failed)
+{
+    int i;
+
+    if (node->error) {
+        ui_log(op, "Failure creating directory '%s' : (%s)", node->path,
+               strerror(node->error));
+        (*num_failed)++;
+        return;
+    }
+
+    if (node->created) {
+        char *tmp = nvstrcat(*log ? *log : "", node->path, "\n", NULL);
+        nvfree(*log);
+        *log = tmp;
+        (*num_created)++;
+    }
+
+    for (i = 0; i < node->num_children; i++) {
+        collect_results(op, node->children[i], log, num_created,
+                        num_failed);
+    }
+}
+
+
+/*
+ * create_planned_directories() - create the missing directories in the
+ * plan, and make it the plan that directory_was_planned() consults. A
+ * directory that cannot be created is left to be created, and the error
+ * reported, when a file is installed in it. Returns FALSE if any directory
+ * could not be created.
+ */
+
+int create_planned_directories(Options *op, DirectoryPlan *plan)
+{
+    pthread_t threads[MAX_DIRECTORY_WORKERS];
+    int started[MAX_DIRECTORY_WORKERS];
+    int num_workers, num_created = 0, num_failed = 0, i;
+    char *log = NULL;
+
+    find_missing_directories(plan, &plan->root);
+
+    num_workers = NV_MIN(NV_MIN(op->concurrency_level, MAX_DIRECTORY_WORKERS),
+                         plan->num_missing - 1);
+
+    for (i = 0; i < num_workers; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, directory_worker,
+                                     plan) == 0);
+    }
+
+    directory_worker(plan);
+
+    for (i = 0; i < num_workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    collect_results(op, &plan->root, &log, &num_created, &num_failed);
+
+    if (log) {
+        log_mkdir(op, log);
+        nvfree(log);
+    }
+
+    ui_log(op, "Created %d of the %d directories needed for the installed "
+           "files.", num_created, plan->num_directories);
+
+    active_plan = plan;
+
+    /* directories that were looked up before may have been created now */
+
+    reset_path_identities();
+
+    return num_failed == 0;
+}
+
+
+/*
+ * directory_was_planned() - return TRUE if 'dir' is known to exist because
+ * it is in the plan that was carried out.
+ */
+
+int directory_was_planned(const char *dir)
+{
+    DirectoryNode *node;
+    const char *name = dir, *end;
+
+    if (!active_plan || !dir || dir[0] != '/') {
+        return FALSE;
+    }
+
+    node = &active_plan->root;
+
+    while (*name) {
+        size_t len;
+
+        while (*name == '/') name++;
+        if (!*name) break;
+
+        end = strchr(name, '/');
+        len = end ? (size_t) (end - name) : strlen(name);
+
+        node = find_child(node, name, len);
+        if (!node || node->error) {
+            return FALSE;
+        }
+
+        name += len;
+    }
+
+    return node != &active_plan->root;
+}
+
+
+static void free_node(DirectoryNode *node)
+{
+    int i;
+
+    for (i = 0; i < node->num_children; i++) {
+        free_node(node->children[i]);
+        nvfree(node->children[i]);
+    }
+
+    nvfree(node->children);
+    nvfree(node->path);
+}
+
+
+void free_directory_plan(DirectoryPlan *plan)
+{
+    if (!plan) return;
+
+    if (active_plan == plan) {
+        active_plan = NULL;
+    }
+
+    free_node(&plan->root);
+    nvfree(plan->missing);
+    nvfree(plan);
+}
@@ -0,0 +1,34 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_DIRECTORY_PLAN_H__
+#define __NVIDIA_INSTALLER_DIRECTORY_PLAN_H__
+
+#include "nvidia-installer.h"
+
+typedef struct __directory_plan DirectoryPlan;
+
+DirectoryPlan *directory_plan_new(void);
+void directory_plan_add_file(DirectoryPlan *plan, const char *filename);
+int directory_plan_num_directories(const DirectoryPlan *plan);
+int create_planned_directories(Options *op, DirectoryPlan *plan);
+int directory_was_planned(const char *dir);
+void free_directory_plan(DirectoryPlan *plan);
+
+#endif /* __NVIDIA_INSTALLER_DIRECTORY_PLAN_H__ */
@@ -31,6 +31,7 @@ SRC += command-list.c
 SRC += crc.c
 SRC += files.c
 SRC += install-from-cwd.c
+SRC += install-from-archive.c
 SRC += kernel.c
 SRC += log.c
 SRC += misc.c
@@ -43,6 +44,17 @@ SRC += manifest.c
 SRC += conflicting-kernel-modules.c
 SRC += initramfs.c
 SRC += ui-status-indeterminate.c
+SRC += build-service.c
+SRC += build-service-protocol.c
+SRC += jobserver.c
+SRC += io-uring-install.c
+SRC += timing-history.c
+SRC += digest.c
+SRC += directory-plan.c
+SRC += multi-root.c
+SRC += package-cache.c
+SRC += library-detect.c
+SRC += scan-cache.c
 
 DIST_FILES := $(SRC)
 
@@ -62,6 +74,17 @@ DIST_FILES += manifest.h
 DIST_FILES += conflicting-kernel-modules.h
 DIST_FILES += initramfs.h
 DIST_FILES += ui-status-indeterminate.h
+DIST_FILES += build-service.h
+DIST_FILES += jobserver.h
+DIST_FILES += io-uring-install.h
+DIST_FILES += timing-history.h
+DIST_FILES += probes.h
+DIST_FILES += digest.h
+DIST_FILES += directory-plan.h
+DIST_FILES += multi-root.h
+DIST_FILES += package-cache.h
+DIST_FILES += library-detect.h
+DIST_FILES += scan-cache.h
 
 DIST_FILES += COPYING
 DIST_FILES += README
@@ -70,6 +93,8 @@ DIST_FILES += dist-files.mk
 DIST_FILES += nvidia-installer.1.m4
 DIST_FILES += gen-manpage-opts.c
 DIST_FILES += makeself-help-script.c
+DIST_FILES += nvidia-installer-latency.bt
 
 DIST_FILES += ncurses-ui.c
 DIST_FILES += mkprecompiled.c
+DIST_FILES += nvidia-build-service.c
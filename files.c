@@ -36,6 +36,20 @@
 #include <utime.h>
 #include <time.h>
 #include <sys/wait.h>
+#include <elf.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/openat2.h>)
+#include <linux/openat2.h>
+#endif
+#endif
+
+#if defined(__NR_openat2) && defined(RESOLVE_IN_ROOT)
+#define NV_HAVE_OPENAT2 1
+#endif
 
 #include "nvidia-installer.h"
 #include "user-interface.h"
@@ -44,9 +58,16 @@
 #include "precompiled.h"
 #include "backup.h"
 #include "kernel.h"
+#include "probes.h"
+#include "directory-plan.h"
+#include "library-detect.h"
 
 
 static void  get_x_library_and_module_paths(Options *op);
+static const char *canonical_directory(const char *dir);
+
+/* guards the path identity cache, see is_subdirectory() */
+static pthread_mutex_t path_cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
 
 /*
@@ -207,6 +228,120 @@ int touch_directory(Options *op, const char *victim)
 }
 
 
+/*
+ * rate_limited_copy() - memcpy() in chunks, sleeping between chunks as
+ * needed to stay within the --copy-rate-limit bandwidth.
+ */
+
+static void rate_limited_copy(Options *op, char *dst, const char *src,
+                              size_t len)
+{
+    /*
+     * The budget is shared by all files copied during the installation,
+     * which may be copied by several threads at once: track the time of
+     * the first copy, and the bytes copied since then, under 'lock'.
+     */
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static struct timespec start;
+    static int started;
+    static double copied;
+    const size_t chunk = 1024 * 1024;
+    const double rate = op->copy_rate_limit * 1024.0 * 1024.0;
+    size_t offset;
+
+    for (offset = 0; offset < len; offset += chunk) {
+        size_t n = NV_MIN(chunk, len - offset);
+        struct timespec now;
+        double elapsed, expected;
+
+        memcpy(dst + offset, src + offset, n);
+
+        pthread_mutex_lock(&lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        if (!started) {
+            start = now;
+            started = TRUE;
+        }
+
+        copied += n;
+        elapsed = (now.tv_sec - start.tv_sec) +
+                  (now.tv_nsec - start.tv_nsec) / 1e9;
+        expected = copied / rate;
+
+        pthread_mutex_unlock(&lock);
+
+        if (expected > elapsed) {
+            struct timespec delay;
+            double wait = expected - elapsed;
+
+            delay.tv_sec = (time_t) wait;
+            delay.tv_nsec = (long) ((wait - delay.tv_sec) * 1e9);
+            nanosleep(&delay, NULL);
+        }
+    }
+}
+
+
+/*
+ * clear_elf_exec_stack() - clear the executable flag of the PT_GNU_STACK
+ * program header of the ELF image in 'buf', as `execstack -c` does.
+ * Returns TRUE if the flag is now clear; FALSE if the image isn't an ELF
+ * file of the host's byte order, or has no PT_GNU_STACK header, in which
+ * case the caller should fall back to execstack.
+ */
+
+#define CLEAR_ELF_EXEC_STACK(Ehdr, Phdr)                                    \
+    do {                                                                    \
+        const Ehdr *ehdr = (const Ehdr *) buf;                              \
+        size_t i;                                                           \
+                                                                            \
+        if (len < sizeof(Ehdr) || ehdr->e_phentsize != sizeof(Phdr) ||     \
+            ehdr->e_phoff > len ||                                          \
+            (len - ehdr->e_phoff) / sizeof(Phdr) < ehdr->e_phnum) {         \
+            return FALSE;                                                   \
+        }                                                                   \
+                                                                            \
+        for (i = 0; i < ehdr->e_phnum; i++) {                               \
+            Phdr phdr;                                                      \
+            unsigned char *p = buf + ehdr->e_phoff + i * sizeof(Phdr);      \
+                                                                            \
+            memcpy(&phdr, p, sizeof(phdr));                                 \
+            if (phdr.p_type == PT_GNU_STACK) {                              \
+                if (phdr.p_flags & PF_X) {                                  \
+                    phdr.p_flags &= ~PF_X;                                  \
+                    memcpy(p, &phdr, sizeof(phdr));                         \
+                }                                                           \
+                return TRUE;                                                \
+            }                                                               \
+        }                                                                   \
+        return FALSE;                                                       \
+    } while (0)
+
+static int clear_elf_exec_stack(unsigned char *buf, size_t len)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    const unsigned char host_data = ELFDATA2LSB;
+#else
+    const unsigned char host_data = ELFDATA2MSB;
+#endif
+
+    if (len < EI_NIDENT || memcmp(buf, ELFMAG, SELFMAG) != 0 ||
+        buf[EI_DATA] != host_data) {
+        return FALSE;
+    }
+
+    switch (buf[EI_CLASS]) {
+        case ELFCLASS32: CLEAR_ELF_EXEC_STACK(Elf32_Ehdr, Elf32_Phdr);
+        case ELFCLASS64: CLEAR_ELF_EXEC_STACK(Elf64_Ehdr, Elf64_Phdr);
+        default:         return FALSE;
+    }
+}
+
+#undef CLEAR_ELF_EXEC_STACK
+
+
 /*
  * copy_file() - copy the file specified by srcfile to dstfile, using
  * mmap and memcpy.  The destination file is created with the
@@ -217,11 +352,32 @@ int touch_directory(Options *op, const char *victim)
 
 int copy_file(Options *op, const char *srcfile,
               const char *dstfile, mode_t mode)
+{
+    return copy_and_fixup_file(op, srcfile, dstfile, mode, FALSE, NULL,
+                               NULL);
+}
+
+
+/*
+ * copy_and_fixup_file() - copy_file(), but if 'clear_exec_stack' is set,
+ * also clear the executable stack flag of the copy, setting
+ * '*exec_stack_cleared' to whether that was possible; and if 'digest' is
+ * non-NULL, compute the digest of the copy, as it was written, with
+ * op->digest_algorithm.
+ */
+
+int copy_and_fixup_file(Options *op, const char *srcfile,
+                        const char *dstfile, mode_t mode,
+                        int clear_exec_stack, int *exec_stack_cleared,
+                        Digest *digest)
 {
     int src_fd = -1, dst_fd = -1;
     int success = FALSE;
     struct stat stat_buf;
     char *src, *dst;
+    off_t bytes = 0;
+
+    NV_PROBE2(copy_file__start, srcfile, dstfile);
     
     if ((src_fd = open(srcfile, O_RDONLY)) == -1) {
         ui_error (op, "Unable to open '%s' for copying (%s)",
@@ -248,7 +404,14 @@ int copy_file(Options *op, const char *srcfile,
                   srcfile, strerror (errno));
         goto done;
     }
+    bytes = stat_buf.st_size;
+    if (exec_stack_cleared) {
+        *exec_stack_cleared = FALSE;
+    }
     if (stat_buf.st_size == 0) {
+        if (digest) {
+            compute_digest_from_buffer(op->digest_algorithm, NULL, 0, digest);
+        }
         success = TRUE;
         goto done;
     }
@@ -275,8 +438,25 @@ int copy_file(Options *op, const char *srcfile,
         goto done;
     }
     
-    memcpy (dst, src, stat_buf.st_size);
-    
+    if (op->copy_rate_limit > 0) {
+        rate_limited_copy(op, dst, src, stat_buf.st_size);
+    } else {
+        memcpy (dst, src, stat_buf.st_size);
+    }
+
+    if (clear_exec_stack) {
+        int cleared = clear_elf_exec_stack((unsigned char *) dst,
+                                           stat_buf.st_size);
+        if (exec_stack_cleared) {
+            *exec_stack_cleared = cleared;
+        }
+    }
+
+    if (digest) {
+        compute_digest_from_buffer(op->digest_algorithm, (uint8 *) dst,
+                                   stat_buf.st_size, digest);
+    }
+
     if (munmap (src, stat_buf.st_size) == -1) {
         ui_error (op, "Unable to unmap source file '%s' after copying (%s)",
                  srcfile, strerror (errno));
@@ -299,6 +479,9 @@ int copy_file(Options *op, const char *srcfile,
          */
 
         fchmod(dst_fd, mode);
+
+        drop_from_page_cache(op, src_fd, FALSE);
+        drop_from_page_cache(op, dst_fd, TRUE);
     }
 
     if (src_fd != -1) {
@@ -308,6 +491,8 @@ int copy_file(Options *op, const char *srcfile,
         close (dst_fd);
     }
 
+    NV_PROBE3(copy_file__done, srcfile, (long) bytes, success);
+
     return success;
 }
 
@@ -1227,19 +1412,16 @@ void remove_systemd_files_from_package(Package *p)
 
 
 /*
- * mode_string_to_mode() - convert the string s 
+ * mode_string_to_mode() - convert the octal permission string s
  */
 
-int mode_string_to_mode(Options *op, char *s, mode_t *mode)
+int mode_string_to_mode(Options *op, NvSlice s, mode_t *mode)
 {
-    char *endptr;
-    long int ret;
-    
-    ret = strtol(s, &endptr, 8);
+    unsigned long ret;
 
-    if ((ret == LONG_MIN) || (ret == LONG_MAX) || (*endptr != '\0')) {
-        ui_error(op, "Error parsing permission string '%s' (%s)",
-                 s, strerror (errno));
+    if (!nv_slice_to_ulong(s, 8, &ret)) {
+        ui_error(op, "Error parsing permission string '%.*s'",
+                 (int) s.len, s.s);
         return FALSE;
     }
 
@@ -1412,6 +1594,47 @@ char *get_symlink_target(Options *op, const char *filename)
 
 
 
+/*
+ * resolve_path() - realpath(3), except that the directory part of the path
+ * is resolved through the path identity cache, so that links into the same
+ * directory only resolve it once. A path whose last component is itself a
+ * symlink, "." or ".." is passed to realpath(3) as a whole.
+ */
+
+static char *resolve_path(const char *path)
+{
+    char *copy, *base, *dir, *ret = NULL;
+    const char *canonical;
+    struct stat st;
+
+    copy = nvstrdup(path);
+    base = strrchr(copy, '/');
+
+    if (!base || base == copy || strcmp(base + 1, ".") == 0 ||
+        strcmp(base + 1, "..") == 0 || base[1] == '\0' ||
+        lstat(path, &st) != 0 || S_ISLNK(st.st_mode)) {
+        nvfree(copy);
+        return realpath(path, NULL);
+    }
+
+    *base++ = '\0';
+    dir = copy;
+
+    pthread_mutex_lock(&path_cache_lock);
+
+    if ((canonical = canonical_directory(dir)) != NULL) {
+        ret = nvstrcat(canonical, strcmp(canonical, "/") == 0 ? "" : "/",
+                       base, NULL);
+    }
+
+    pthread_mutex_unlock(&path_cache_lock);
+
+    nvfree(copy);
+
+    return ret;
+}
+
+
 /*
  * get_resolved_symlink_target() - same as get_symlink_target, except that
  * relative links get resolved to an absolute path.
@@ -1432,8 +1655,7 @@ char * get_resolved_symlink_target(Options *op, const char *filename)
         nvfree(filename_copy);
         nvfree(target);
 
-        target = nvalloc(PATH_MAX);
-        target = realpath(full_target_path, target);
+        target = resolve_path(full_target_path);
 
         nvfree(full_target_path);
     }
@@ -1453,23 +1675,40 @@ char * get_resolved_symlink_target(Options *op, const char *filename)
 int install_file(Options *op, const char *srcfile,
                  const char *dstfile, mode_t mode)
 {   
-    int retval; 
+    return install_and_fixup_file(op, srcfile, dstfile, mode, FALSE, NULL,
+                                  NULL);
+
+} /* install_file() */
+
+
+/*
+ * install_and_fixup_file() - install_file(), with the additional
+ * arguments of copy_and_fixup_file().
+ */
+
+int install_and_fixup_file(Options *op, const char *srcfile,
+                           const char *dstfile, mode_t mode,
+                           int clear_exec_stack, int *exec_stack_cleared,
+                           Digest *digest)
+{
+    int retval;
     char *dirc, *dname;
 
     dirc = nvstrdup(dstfile);
     dname = dirname(dirc);
     
-    if (!mkdir_with_log(op, dname, 0755)) {
+    if (!directory_was_planned(dname) && !mkdir_with_log(op, dname, 0755)) {
         free(dirc);
         return FALSE;
     }
 
-    retval = copy_file(op, srcfile, dstfile, mode);
+    retval = copy_and_fixup_file(op, srcfile, dstfile, mode, clear_exec_stack,
+                                 exec_stack_cleared, digest);
     free(dirc);
 
     return retval;
 
-} /* install_file() */
+} /* install_and_fixup_file() */
 
 
 /*
@@ -1485,7 +1724,7 @@ int install_symlink(Options *op, const char *linkname, const char *dstfile)
     dirc = nvstrdup(dstfile);
     dname = dirname(dirc);
     
-    if (!mkdir_with_log(op, dname, 0755)) {
+    if (!directory_was_planned(dname) && !mkdir_with_log(op, dname, 0755)) {
         free(dirc);
         return FALSE;
     }
@@ -2332,6 +2571,369 @@ static char * find_libdir_and_fall_back(Options *op, char * const * list,
 }
 
 
+/*
+ * resolve_in_root() - open 'path' as though the directory 'root_fd' were the
+ * root directory, with openat2(2). If 'no_symlinks' is set, a path through
+ * any symbolic link fails with ELOOP; otherwise, ".." and absolute symbolic
+ * links are resolved within the root.
+ */
+
+static int resolve_in_root(int root_fd, const char *path, int flags,
+                           mode_t mode, int no_symlinks)
+{
+#if defined(NV_HAVE_OPENAT2)
+    struct open_how how;
+    int fd, tries = 0;
+
+    memset(&how, 0, sizeof(how));
+    how.flags = flags | O_CLOEXEC;
+    how.mode = (flags & O_CREAT) ? mode : 0;
+    how.resolve = RESOLVE_IN_ROOT |
+                  (no_symlinks ? RESOLVE_NO_SYMLINKS : RESOLVE_NO_MAGICLINKS);
+
+    /* EAGAIN means that a concurrent rename may have escaped the root */
+
+    do {
+        fd = syscall(__NR_openat2, root_fd, path, &how, sizeof(how));
+    } while (fd == -1 && errno == EAGAIN && ++tries < 8);
+
+    return fd;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/*
+ * open_in_root() - open 'path' as though the directory 'root_fd' were the
+ * root directory: ".." and absolute symbolic links are resolved within it,
+ * so that a symbolic link in a target root can't lead outside of it.
+ * Returns -1, with errno set, on failure; ENOSYS if the kernel can't
+ * resolve paths this way.
+ */
+
+int open_in_root(int root_fd, const char *path, int flags, mode_t mode)
+{
+    return resolve_in_root(root_fd, path, flags, mode, FALSE);
+}
+
+
+/*
+ * open_beneath() - open 'path' below the directory 'dir_fd' without
+ * following any symbolic link or ".." on the way, so that files being
+ * extracted can't be redirected by links extracted before them. Uses
+ * openat2(2) where available, or else opens one component at a time
+ * with O_NOFOLLOW. Returns -1, with errno set, on failure.
+ */
+
+int open_beneath(int dir_fd, const char *path, int flags, mode_t mode)
+{
+    char *copy, *name, *end;
+    int fd, next, saved_errno;
+
+    fd = resolve_in_root(dir_fd, path, flags, mode, TRUE);
+    if (fd != -1 || errno != ENOSYS) {
+        return fd;
+    }
+
+    copy = nvstrdup(path);
+    name = copy;
+    fd = dir_fd;
+
+    for (;;) {
+        while (*name == '/') name++;
+
+        end = strchr(name, '/');
+        if (end) *end = '\0';
+
+        if (strcmp(name, "..") == 0) {
+            next = -1;
+            errno = EXDEV;
+        } else if (end && end[1] != '\0') {
+            next = openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+                          O_CLOEXEC);
+        } else {
+            next = openat(fd, name[0] ? name : ".",
+                          flags | O_NOFOLLOW | O_CLOEXEC, mode);
+            end = NULL;
+        }
+
+        saved_errno = errno;
+        if (fd != dir_fd) close(fd);
+        fd = next;
+        errno = saved_errno;
+
+        if (fd == -1 || !end) break;
+        name = end + 1;
+    }
+
+    nvfree(copy);
+
+    return fd;
+}
+
+
+/*
+ * open_root() - open the directory 'root' for open_in_root(). Fails, after
+ * printing an error, if paths can't be resolved within it.
+ */
+
+int open_root(Options *op, const char *root)
+{
+    int fd, probe;
+
+    fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        ui_error(op, "Unable to open the target root '%s' (%s).", root,
+                 strerror(errno));
+        return -1;
+    }
+
+    probe = open_in_root(fd, "/", O_RDONLY | O_DIRECTORY, 0);
+    if (probe == -1) {
+        ui_error(op, "Unable to resolve paths within the target root '%s' "
+                 "(%s); installing into target roots requires openat2(2), "
+                 "available since Linux 5.6.", root, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    close(probe);
+
+    return fd;
+}
+
+
+/*
+ * make_directories() - create the directory 'dir', and any missing parent
+ * directories, below 'root_fd', and return a descriptor of it. Each
+ * directory is looked up again after it is created, with open_beneath()
+ * if 'beneath' is set, or else with open_in_root().
+ */
+
+static int make_directories(int root_fd, const char *dir, mode_t mode,
+                            char **created, int beneath)
+{
+    char *path = nvstrdup(dir), *name = path, *end;
+    int fd, next, saved_errno;
+
+    fd = beneath ? open_beneath(root_fd, ".", O_RDONLY | O_DIRECTORY, 0) :
+                   open_in_root(root_fd, "/", O_RDONLY | O_DIRECTORY, 0);
+
+    while (fd >= 0) {
+        while (*name == '/') name++;
+        if (*name == '\0') break;
+
+        end = strchr(name, '/');
+        if (end) *end = '\0';
+
+        /* create the directory in its parent, which is within the root */
+
+        if (mkdirat(fd, name, mode) == 0) {
+            if (created) {
+                char *tmp = nvstrcat(*created ? *created : "",
+                                     path[0] == '/' ? "" : "/", path, "\n",
+                                     NULL);
+                nvfree(*created);
+                *created = tmp;
+            }
+        } else if (errno != EEXIST) {
+            saved_errno = errno;
+            close(fd);
+            fd = -1;
+            errno = saved_errno;
+            break;
+        }
+
+        /* then look it up again from the root, in case it is a symlink */
+
+        next = beneath ?
+            open_beneath(root_fd, path, O_RDONLY | O_DIRECTORY, 0) :
+            open_in_root(root_fd, path, O_RDONLY | O_DIRECTORY, 0);
+        saved_errno = errno;
+        close(fd);
+        fd = next;
+        errno = saved_errno;
+
+        if (!end) break;
+        *end = '/';
+        name = end + 1;
+    }
+
+    nvfree(path);
+
+    return fd;
+}
+
+
+/*
+ * mkdir_in_root() - create the directory 'dir', and any missing parent
+ * directories, within the root 'root_fd', as nv_mkdir_recursive() does,
+ * and return a descriptor of it for use with the *at() calls.
+ * Each directory created is appended to '*created' (if not NULL), as a
+ * path within the root followed by a newline. Returns -1, with errno set,
+ * on failure.
+ */
+
+int mkdir_in_root(int root_fd, const char *dir, mode_t mode, char **created)
+{
+    return make_directories(root_fd, dir, mode, created, FALSE);
+}
+
+
+/*
+ * mkdir_beneath() - mkdir_in_root(), but looking up every directory with
+ * open_beneath(), so that no symbolic link is followed.
+ */
+
+int mkdir_beneath(int dir_fd, const char *dir, mode_t mode)
+{
+    return make_directories(dir_fd, dir, mode, NULL, TRUE);
+}
+
+
+/*
+ * directory_exists_in_root() - directory_exists(), for a path within the
+ * root 'root_fd'.
+ */
+
+static int directory_exists_in_root(int root_fd, const char *path)
+{
+    int fd = open_in_root(root_fd, path, O_RDONLY | O_DIRECTORY, 0);
+
+    if (fd == -1) {
+        return FALSE;
+    }
+
+    close(fd);
+    return TRUE;
+}
+
+
+static const char *find_libdir_in_root(char * const *list, const char *prefix,
+                                       int root_fd)
+{
+    int i;
+
+    for (i = 0; list[i]; i++) {
+        char *path = nvstrcat(prefix, "/", list[i], NULL);
+        int found = directory_exists_in_root(root_fd, path);
+
+        nvfree(path);
+        if (found) break;
+    }
+
+    return list[i];
+}
+
+
+/*
+ * get_libdirs_in_root() - find the native and 32-bit compatibility library
+ * directories to use when installing into the root 'root_fd' (from
+ * open_root()) rather than into this system. The directories chosen for
+ * this system are kept if they exist in the root; otherwise, the first of
+ * the usual directories that exists there is used, and failing that, the
+ * directory chosen for this system. Returns FALSE if the 32-bit
+ * compatibility libraries go into a chroot on this system, and that chroot
+ * doesn't exist in the root.
+ */
+
+int get_libdirs_in_root(Options *op, int root_fd,
+                        const char **native, const char **compat32)
+{
+    const char *libdir;
+    char *path;
+
+    if (op->compat32_chroot &&
+        !directory_exists_in_root(root_fd, op->compat32_chroot)) {
+        return FALSE;
+    }
+
+    path = nvstrcat(op->opengl_prefix, "/", op->opengl_libdir, NULL);
+    libdir = find_libdir_in_root(native_libdirs, op->opengl_prefix, root_fd);
+    *native = (directory_exists_in_root(root_fd, path) || !libdir) ?
+              op->opengl_libdir : libdir;
+    nvfree(path);
+
+    *compat32 = op->compat32_libdir;
+
+#if defined(NV_X86_64)
+    if (op->compat32_prefix && op->compat32_libdir) {
+        path = nvstrcat(op->compat32_prefix, "/", op->compat32_libdir, NULL);
+        libdir = find_libdir_in_root(compat_libdirs, op->compat32_prefix,
+                                     root_fd);
+        if (!directory_exists_in_root(root_fd, path) && libdir) {
+            *compat32 = libdir;
+        }
+        nvfree(path);
+    }
+#endif /* NV_X86_64 */
+
+    return TRUE;
+}
+
+
+/*
+ * x_path_in_root() - return a copy of 'path' if it is a directory within
+ * the root 'root_fd', or else 'guess'; the one not returned is freed.
+ */
+
+static char *x_path_in_root(int root_fd, const char *path, char *guess)
+{
+    remove_trailing_slashes(guess);
+    collapse_multiple_slashes(guess);
+
+    if (path && directory_exists_in_root(root_fd, path)) {
+        nvfree(guess);
+        return nvstrdup(path);
+    }
+
+    return guess;
+}
+
+
+/*
+ * get_x_paths_in_root() - find the X library, module and sysconfig paths to
+ * use when installing into the root 'root_fd' rather than into this system.
+ * As in get_libdirs_in_root(), the paths found for this system are kept if
+ * they exist in the root; otherwise, they are built the way that
+ * get_x_paths_helper() does when the X server can't be queried, from the
+ * first of the usual library directories that exists in the root. Each
+ * path is NULL if it wasn't found for this system either; the others must
+ * be freed with nvfree().
+ */
+
+void get_x_paths_in_root(Options *op, int root_fd, char **library,
+                         char **module, char **sysconfig)
+{
+    const char *libdir;
+
+    *library = *module = *sysconfig = NULL;
+
+    if (!op->x_library_path) {
+        return;
+    }
+
+    libdir = find_libdir_in_root(&native_libdirs[1], op->x_prefix, root_fd);
+
+    *library = x_path_in_root(root_fd, op->x_library_path,
+                              nvstrcat(op->x_prefix, "/",
+                                       libdir ? libdir : op->x_libdir, NULL));
+
+    if (op->x_module_path) {
+        *module = x_path_in_root(root_fd, op->x_module_path,
+                                 nvstrcat(*library, "/", op->x_moddir, NULL));
+    }
+
+    if (op->x_sysconfig_path) {
+        *sysconfig = x_path_in_root(root_fd, op->x_sysconfig_path,
+                                    nvstrcat(DEFAULT_X_DATAROOT_PATH, "/",
+                                             DEFAULT_CONFDIR, NULL));
+    }
+}
+
+
 /*
  * get_default_prefixes_and_paths() - assign the default prefixes and
  * paths depending on the architecture, distribution and the X.Org
@@ -2920,6 +3522,308 @@ void invalidate_package_entry(PackageEntry *entry)
 }
 
 
+/*
+ * Path identities: is_subdirectory() and directory_equals() are asked
+ * about the same few directories many times while choosing and checking
+ * the installation paths. Each path is resolved once to the (st_dev,
+ * st_ino) identity of what it names, and each identity's chain of parent
+ * directories is followed once with openat(fd, ".."); the identities,
+ * their parents, the paths resolved to them, and the answers to
+ * is_subdirectory() are all remembered, so that asking again doesn't
+ * touch the filesystem. reset_path_identities() forgets everything, for
+ * when directories may have been removed or replaced. The cache is shared
+ * by all threads, and guarded by path_cache_lock.
+ */
+
+#if !defined(O_PATH)
+#define O_PATH O_RDONLY
+#endif
+
+#define PATH_HASH_SIZE 256 /* must be a power of 2 */
+
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    int parent;         /* index of the parent directory, or -1 if unknown */
+    int next;           /* next identity in the same hash bucket, or -1 */
+} PathIdentity;
+
+typedef struct {
+    char *path;
+    int identity;       /* -1 if not resolved yet */
+    char *canonical;    /* realpath(3) of 'path', or NULL if not resolved */
+    int next;           /* next name in the same hash bucket, or -1 */
+} PathName;
+
+typedef struct {
+    int dir, subdir;
+    int is_subdir;
+    int next;           /* next result in the same hash bucket, or -1 */
+} SubdirectoryResult;
+
+static struct {
+    int initialized;
+
+    PathIdentity *identities;
+    int num_identities;
+    int identity_buckets[PATH_HASH_SIZE];
+
+    PathName *names;
+    int num_names;
+    int name_buckets[PATH_HASH_SIZE];
+
+    SubdirectoryResult *results;
+    int num_results;
+    int result_buckets[PATH_HASH_SIZE];
+} path_cache;
+
+
+static void init_path_cache(void)
+{
+    int i;
+
+    if (path_cache.initialized) {
+        return;
+    }
+
+    for (i = 0; i < PATH_HASH_SIZE; i++) {
+        path_cache.identity_buckets[i] = -1;
+        path_cache.name_buckets[i] = -1;
+        path_cache.result_buckets[i] = -1;
+    }
+
+    path_cache.initialized = TRUE;
+}
+
+
+/*
+ * reset_path_identities() - forget all of the path identities, e.g. after
+ * an existing driver has been uninstalled, or files have been installed.
+ */
+
+void reset_path_identities(void)
+{
+    int i;
+
+    pthread_mutex_lock(&path_cache_lock);
+
+    for (i = 0; i < path_cache.num_names; i++) {
+        nvfree(path_cache.names[i].path);
+        nvfree(path_cache.names[i].canonical);
+    }
+
+    nvfree(path_cache.identities);
+    nvfree(path_cache.names);
+    nvfree(path_cache.results);
+
+    memset(&path_cache, 0, sizeof(path_cache));
+
+    pthread_mutex_unlock(&path_cache_lock);
+}
+
+
+static unsigned int hash_path(const char *path)
+{
+    unsigned int h = 5381;
+
+    while (*path) {
+        h = h * 33 + (unsigned char) *path++;
+    }
+
+    return h & (PATH_HASH_SIZE - 1);
+}
+
+
+/*
+ * identity_of_fd() - return the index of the identity of the open file
+ * 'fd', adding it if it is new; or -1 on error.
+ */
+
+static int identity_of_fd(int fd)
+{
+    struct stat st;
+    unsigned int h;
+    int i;
+
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+
+    h = (unsigned int) (st.st_dev * 31 + st.st_ino) & (PATH_HASH_SIZE - 1);
+
+    for (i = path_cache.identity_buckets[h]; i >= 0;
+         i = path_cache.identities[i].next) {
+        if (path_cache.identities[i].dev == st.st_dev &&
+            path_cache.identities[i].ino == st.st_ino) {
+            return i;
+        }
+    }
+
+    i = path_cache.num_identities++;
+    path_cache.identities = nvrealloc(path_cache.identities,
+                                      sizeof(PathIdentity) *
+                                      path_cache.num_identities);
+    path_cache.identities[i].dev = st.st_dev;
+    path_cache.identities[i].ino = st.st_ino;
+    path_cache.identities[i].parent = -1;
+    path_cache.identities[i].next = path_cache.identity_buckets[h];
+    path_cache.identity_buckets[h] = i;
+
+    return i;
+}
+
+
+/*
+ * find_path_name() - return the cache entry for 'path', adding an empty
+ * one if it is new.
+ */
+
+static PathName *find_path_name(const char *path)
+{
+    unsigned int h;
+    int i;
+
+    init_path_cache();
+
+    h = hash_path(path);
+
+    for (i = path_cache.name_buckets[h]; i >= 0; i = path_cache.names[i].next) {
+        if (strcmp(path_cache.names[i].path, path) == 0) {
+            return &path_cache.names[i];
+        }
+    }
+
+    i = path_cache.num_names++;
+    path_cache.names = nvrealloc(path_cache.names, sizeof(PathName) *
+                                 path_cache.num_names);
+    path_cache.names[i].path = nvstrdup(path);
+    path_cache.names[i].identity = -1;
+    path_cache.names[i].canonical = NULL;
+    path_cache.names[i].next = path_cache.name_buckets[h];
+    path_cache.name_buckets[h] = i;
+
+    return &path_cache.names[i];
+}
+
+
+/*
+ * path_identity() - return the index of the identity of 'path', resolving
+ * it and the chain of its parent directories if it hasn't been resolved
+ * before; or -1 if 'path' doesn't exist.
+ */
+
+static int path_identity(const char *path)
+{
+    PathName *name = find_path_name(path);
+    int i, id, fd;
+
+    if (name->identity >= 0) {
+        return name->identity;
+    }
+
+    if ((fd = open(path, O_PATH | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+
+    id = identity_of_fd(fd);
+
+    /*
+     * Follow the parents until one whose parent is already known, or the
+     * root directory, which is its own parent.
+     */
+
+    for (i = id; i >= 0 && path_cache.identities[i].parent < 0; ) {
+        int parent_fd = openat(fd, "..", O_PATH | O_CLOEXEC);
+        int parent;
+
+        close(fd);
+        fd = parent_fd;
+
+        if (fd < 0 || (parent = identity_of_fd(fd)) < 0) {
+            break;
+        }
+
+        path_cache.identities[i].parent = parent;
+        i = parent;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    name->identity = id;
+
+    return id;
+}
+
+
+/*
+ * canonical_directory() - return realpath(3) of the directory 'dir',
+ * remembering it; or NULL if it doesn't exist. The returned string
+ * belongs to the cache.
+ */
+
+static const char *canonical_directory(const char *dir)
+{
+    PathName *name = find_path_name(dir);
+
+    if (!name->canonical) {
+        name->canonical = realpath(dir, NULL);
+    }
+
+    return name->canonical;
+}
+
+
+/*
+ * identity_is_subdirectory() - walk up from 'subdir' to the root looking
+ * for 'dir', remembering the answer. Returns FALSE if some parent could
+ * not be resolved.
+ */
+
+static int identity_is_subdirectory(int dir, int subdir, int *is_subdir)
+{
+    unsigned int h = (unsigned int) (dir * 31 + subdir) & (PATH_HASH_SIZE - 1);
+    int i;
+
+    for (i = path_cache.result_buckets[h]; i >= 0;
+         i = path_cache.results[i].next) {
+        if (path_cache.results[i].dir == dir &&
+            path_cache.results[i].subdir == subdir) {
+            *is_subdir = path_cache.results[i].is_subdir;
+            return TRUE;
+        }
+    }
+
+    *is_subdir = FALSE;
+
+    for (i = subdir; ; i = path_cache.identities[i].parent) {
+        if (i == dir) {
+            *is_subdir = TRUE;
+            break;
+        }
+        if (path_cache.identities[i].parent < 0) {
+            return FALSE;
+        }
+        if (path_cache.identities[i].parent == i) {
+            break;
+        }
+    }
+
+    i = path_cache.num_results++;
+    path_cache.results = nvrealloc(path_cache.results,
+                                   sizeof(SubdirectoryResult) *
+                                   path_cache.num_results);
+    path_cache.results[i].dir = dir;
+    path_cache.results[i].subdir = subdir;
+    path_cache.results[i].is_subdir = *is_subdir;
+    path_cache.results[i].next = path_cache.result_buckets[h];
+    path_cache.result_buckets[h] = i;
+
+    return TRUE;
+}
+
+
 /*
  * is_subdirectory() - test whether subdir is a subdir of dir
  * returns TRUE on successful test, or FALSE on error
@@ -2935,37 +3839,16 @@ void invalidate_package_entry(PackageEntry *entry)
 
 int is_subdirectory(const char *dir, const char *subdir, int *is_subdir)
 {
-    struct stat root_st, dir_st;
-
-    if (stat("/", &root_st) != 0 || stat(dir, &dir_st) != 0) {
-        return FALSE;
-    } else {
-        struct stat testdir_st;
-        char *testdir = nvstrdup(subdir);
-
-        *is_subdir = FALSE;
-
-        do {
-            char *oldtestdir;
-
-            if (stat(testdir, &testdir_st) != 0) {
-                nvfree(testdir);
-                return FALSE;
-            }
-
-            if (testdir_st.st_dev == dir_st.st_dev &&
-                testdir_st.st_ino == dir_st.st_ino) {
-                *is_subdir = TRUE;
-                break;
-            }
+    int dir_id, subdir_id, ret;
 
-            oldtestdir = testdir;
-            testdir = nvstrcat(oldtestdir, "/..", NULL);
-            nvfree(oldtestdir);
-        } while (testdir_st.st_dev != root_st.st_dev ||
-                 testdir_st.st_ino != root_st.st_ino);
+    pthread_mutex_lock(&path_cache_lock);
+    ret = (dir_id = path_identity(dir)) >= 0 &&
+          (subdir_id = path_identity(subdir)) >= 0 &&
+          identity_is_subdirectory(dir_id, subdir_id, is_subdir);
+    pthread_mutex_unlock(&path_cache_lock);
 
-        nvfree(testdir);
+    if (!ret) {
+        return FALSE;
     }
 
     if (!*is_subdir) {
@@ -3063,81 +3946,6 @@ void add_libgl_abi_symlink(Options *op, Package *p)
     nvfree(opengl32_path);
 }
 
-typedef enum {
-    LIBGLVND_CHECK_RESULT_INSTALLED = 0,
-    LIBGLVND_CHECK_RESULT_NOT_INSTALLED = 1,
-    LIBGLVND_CHECK_RESULT_PARTIAL = 2,
-    LIBGLVND_CHECK_RESULT_ERROR = 3,
-} LibglvndInstallCheckResult;
-
-/*
- * run_libglvnd_script() - Finds and runs the libglvnd install checker script.
- *
- * This runs a helper script which determines whether the libglvnd libraries
- * are installed, missing, or partially installed.
- *
- * If the helper script is not included in the package, then it will just
- * return LIBGLVND_CHECK_RESULT_NOT_INSTALLED.
- */
-static LibglvndInstallCheckResult run_libglvnd_script(Options *op, Package *p,
-                                                      char **missing_libs)
-{
-    const char *scriptPath = "./libglvnd_install_checker/check-libglvnd-install.sh";
-    char *output = NULL;
-    int status;
-    LibglvndInstallCheckResult result = LIBGLVND_CHECK_RESULT_ERROR;
-
-    if (missing_libs) {
-        *missing_libs = "";
-    }
-
-    log_printf(op, NULL, "Looking for install checker script at %s", scriptPath);
-    if (access(scriptPath, R_OK) != 0) {
-        // We don't have the install check script, so assume that it's not
-        // installed.
-        log_printf(op, NULL, "No libglvnd install checker script, assuming not installed.");
-        result = LIBGLVND_CHECK_RESULT_NOT_INSTALLED;
-        goto done;
-    }
-
-    status = run_command(op, &output, TRUE, NULL, FALSE,
-                         "/bin/sh ", scriptPath, NULL);
-    if (WIFEXITED(status)) {
-        result = WEXITSTATUS(status);
-    } else {
-        result = LIBGLVND_CHECK_RESULT_ERROR;
-    }
-
-    // If the installation is partial, pass the list of missing libraries
-    // reported by the script back to the caller.
-    if (result == LIBGLVND_CHECK_RESULT_PARTIAL && missing_libs) {
-        char *line, *end, *buf;
-        int len = strlen(output);
-        static const char *missing_label = "Missing libglvnd libraries: ";
-
-        for (buf = output;
-             (line = get_next_line(buf, &end, output, len));
-             buf = end) {
-            int found = FALSE;
-
-            if (strncmp(line, missing_label, strlen(missing_label)) == 0) {
-                *missing_libs = nvstrdup(line + strlen(missing_label));
-                found = TRUE;
-            }
-
-            free(line);
-
-            if (found) {
-                break;
-            }
-        }
-    }
-
-done:
-    nvfree(output);
-    return result;
-}
-
 /*
  * set_libglvnd_egl_json_path() - Tries to figure out what path to install the
  * JSON file to for a libglvnd EGL vendor library.
@@ -3208,6 +4016,130 @@ static int list_includes_essential_library(const char *libraries)
     return essential_library_found;
 }
 
+/*
+ * library_list_contains() - whether the space-separated list of libraries
+ * 'list' includes 'lib'; returns the number of libraries in 'list' if 'lib'
+ * is NULL.
+ */
+static int library_list_contains(const char *list, const char *lib)
+{
+    char *libs = nvstrdup(list ? list : "");
+    char *l, *save = NULL;
+    int n = 0;
+
+    for (l = strtok_r(libs, " ", &save); l; l = strtok_r(NULL, " ", &save)) {
+        if (!lib || strcmp(l, lib) == 0) {
+            n++;
+        }
+    }
+
+    nvfree(libs);
+    return n;
+}
+
+/*
+ * same_library_lists() - whether the space-separated lists of libraries
+ * 'a' and 'b' name the same libraries, in any order.
+ */
+static int same_library_lists(const char *a, const char *b)
+{
+    char *libs = nvstrdup(a ? a : "");
+    char *lib, *save = NULL;
+    int ret = TRUE;
+
+    for (lib = strtok_r(libs, " ", &save); lib;
+         lib = strtok_r(NULL, " ", &save)) {
+        if (!library_list_contains(b, lib)) {
+            ret = FALSE;
+        }
+    }
+
+    nvfree(libs);
+
+    return ret && library_list_contains(a, NULL) ==
+                  library_list_contains(b, NULL);
+}
+
+/*
+ * compare_with_libglvnd_script() - In expert mode, run the libglvnd install
+ * checker script, if the package includes it, and log whether it agrees
+ * with the result of detect_libglvnd(). The script loads the libraries, so
+ * it is only run to check the in-process detection, never to replace it.
+ */
+static void compare_with_libglvnd_script(Options *op,
+                                         LibglvndInstallCheckResult result,
+                                         const char *missing_libs)
+{
+    static const char *scriptPath =
+        "./libglvnd_install_checker/check-libglvnd-install.sh";
+    static const char *missing_label = "Missing libglvnd libraries: ";
+    char *output = NULL, *script_missing_libs = NULL;
+    int status, script_result;
+
+    if (!op->expert || access(scriptPath, R_OK) != 0) {
+        return;
+    }
+
+    status = run_command(op, &output, FALSE, NULL, FALSE,
+                         "/bin/sh ", scriptPath, NULL);
+    script_result = WIFEXITED(status) ? WEXITSTATUS(status) :
+                                        LIBGLVND_CHECK_RESULT_ERROR;
+
+    if (script_result == LIBGLVND_CHECK_RESULT_PARTIAL && output) {
+        NvLineIter lines;
+        NvSlice line;
+
+        nv_line_iter_init(&lines, output, strlen(output));
+
+        while (nv_line_iter_next(&lines, &line)) {
+            if (nv_slice_has_prefix(line, missing_label)) {
+                line.s += strlen(missing_label);
+                line.len -= strlen(missing_label);
+                script_missing_libs = nv_slice_dup(line);
+                break;
+            }
+        }
+    }
+
+    if (script_result == result &&
+        (result != LIBGLVND_CHECK_RESULT_PARTIAL ||
+         same_library_lists(missing_libs, script_missing_libs))) {
+        ui_expert(op, "The libglvnd install checker script agrees with the "
+                  "detected libglvnd installation.");
+    } else {
+        ui_log(op, "The libglvnd install checker script reported result %d "
+               "(missing: %s), but result %d (missing: %s) was detected.",
+               script_result,
+               script_missing_libs ? script_missing_libs : "",
+               (int) result, missing_libs ? missing_libs : "");
+    }
+
+    nvfree(script_missing_libs);
+    nvfree(output);
+}
+
+/*
+ * remove_libglvnd_files_from_package() - Invalidate the libglvnd libraries,
+ * and the client libraries that come with them, so that they're not
+ * installed.
+ */
+void remove_libglvnd_files_from_package(Options *op, Package *p)
+{
+    int i;
+
+    for (i = 0; i < p->num_entries; i++) {
+        if (p->entries[i].type == FILE_TYPE_GLVND_LIB ||
+            p->entries[i].type == FILE_TYPE_GLVND_SYMLINK ||
+            p->entries[i].type == FILE_TYPE_GLX_CLIENT_LIB ||
+            p->entries[i].type == FILE_TYPE_GLX_CLIENT_SYMLINK ||
+            p->entries[i].type == FILE_TYPE_EGL_CLIENT_LIB ||
+            p->entries[i].type == FILE_TYPE_EGL_CLIENT_SYMLINK) {
+            ui_log(op, "Skipping GLVND file: \"%s\"", p->entries[i].file);
+            invalidate_package_entry(&(p->entries[i]));
+        }
+    }
+}
+
 /*
  * check_libglvnd_files() - Checks whether or not the installer should install
  * the libglvnd libraries.
@@ -3250,10 +4182,11 @@ int check_libglvnd_files(Options *op, Package *p)
     if (shouldInstall == NV_OPTIONAL_BOOL_DEFAULT) {
         char *missing_libs;
 
-        // Try to figure out whether libglvnd is already installed. We'll defer
-        // to a separate program to do that.
+        // Try to figure out whether libglvnd is already installed, from the
+        // ELF headers of the installed libraries.
 
-        LibglvndInstallCheckResult result = run_libglvnd_script(op, p, &missing_libs);
+        LibglvndInstallCheckResult result = detect_libglvnd(op, &missing_libs);
+        compare_with_libglvnd_script(op, result, missing_libs);
         if (result == LIBGLVND_CHECK_RESULT_INSTALLED) {
             // The libraries are already installed, so leave them alone.
             shouldInstall = NV_OPTIONAL_BOOL_FALSE;
@@ -3294,6 +4227,7 @@ int check_libglvnd_files(Options *op, Package *p)
                         "This will overwrite any existing libglvnd libraries.",
                         optional_only);
             }
+            nvfree(missing_libs);
             if (partialAction == 0) {
                 // Don't install
                 shouldInstall = NV_OPTIONAL_BOOL_FALSE;
@@ -3318,17 +4252,7 @@ int check_libglvnd_files(Options *op, Package *p)
 
     if (shouldInstall != NV_OPTIONAL_BOOL_TRUE) {
         log_printf(op, NULL, "Will not install libglvnd libraries.");
-        for (i = 0; i < p->num_entries; i++) {
-            if (p->entries[i].type == FILE_TYPE_GLVND_LIB ||
-                p->entries[i].type == FILE_TYPE_GLVND_SYMLINK ||
-                p->entries[i].type == FILE_TYPE_GLX_CLIENT_LIB ||
-                p->entries[i].type == FILE_TYPE_GLX_CLIENT_SYMLINK ||
-                p->entries[i].type == FILE_TYPE_EGL_CLIENT_LIB ||
-                p->entries[i].type == FILE_TYPE_EGL_CLIENT_SYMLINK) {
-                ui_log(op, "Skipping GLVND file: \"%s\"", p->entries[i].file);
-                invalidate_package_entry(&(p->entries[i]));
-            }
-        }
+        remove_libglvnd_files_from_package(op, p);
 
         if (foundJSONFile) {
             set_libglvnd_egl_json_path(op);
@@ -27,6 +27,10 @@ int remove_directory(Options *op, const char *victim);
 int touch_directory(Options *op, const char *victim);
 int copy_file(Options *op, const char *srcfile,
               const char *dstfile, mode_t mode);
+int copy_and_fixup_file(Options *op, const char *srcfile,
+                        const char *dstfile, mode_t mode,
+                        int clear_exec_stack, int *exec_stack_cleared,
+                        Digest *digest);
 char *write_temp_file(Options *op, const int len,
                       const void *data, mode_t perm);
 int set_destinations(Options *op, Package *p); /* XXX move? */
@@ -36,8 +40,9 @@ void remove_non_kernel_module_files_from_package(Package *p);
 void remove_non_installed_kernel_module_source_files_from_package(Package *p);
 void remove_opengl_files_from_package(Package *p);
 void remove_wine_files_from_package(Package *p);
+void remove_libglvnd_files_from_package(Options *op, Package *p);
 void remove_systemd_files_from_package(Package *p);
-int mode_string_to_mode(Options *op, char *s, mode_t *mode);
+int mode_string_to_mode(Options *op, NvSlice s, mode_t *mode);
 char *mode_to_permission_string(mode_t mode);
 int confirm_path(Options *op, const char *path);
 int mkdir_recursive(Options *op, const char *path, const mode_t mode, int log);
@@ -46,6 +51,10 @@ char *get_symlink_target(Options *op, const char *filename);
 char *get_resolved_symlink_target(Options *op, const char *filename);
 int install_file(Options *op, const char *srcfile,
                  const char *dstfile, mode_t mode);
+int install_and_fixup_file(Options *op, const char *srcfile,
+                           const char *dstfile, mode_t mode,
+                           int clear_exec_stack, int *exec_stack_cleared,
+                           Digest *digest);
 int install_symlink(Options *op, const char *linkname, const char *dstfile);
 size_t get_file_size(Options *op, const char *filename);
 size_t fget_file_size(Options *op, const int fd);
@@ -63,12 +72,22 @@ void process_dot_desktop_files(Options *op, Package *p);
 void process_dkms_conf(Options *op, Package *p);
 int set_security_context(Options *op, const char *filename, const char *type);
 void get_default_prefixes_and_paths(Options *op);
+int open_in_root(int root_fd, const char *path, int flags, mode_t mode);
+int open_beneath(int dir_fd, const char *path, int flags, mode_t mode);
+int open_root(Options *op, const char *root);
+int mkdir_in_root(int root_fd, const char *dir, mode_t mode, char **created);
+int mkdir_beneath(int dir_fd, const char *dir, mode_t mode);
+int get_libdirs_in_root(Options *op, int root_fd,
+                        const char **native, const char **compat32);
+void get_x_paths_in_root(Options *op, int root_fd, char **library,
+                         char **module, char **sysconfig);
 void get_compat32_path(Options *op);
 char *nv_strreplace(const char *src, const char *orig, const char *replace);
 char *get_filename(Options *op, const char *def, const char *msg);
 int secure_delete(Options *op, const char *file);
 void invalidate_package_entry(PackageEntry *entry);
 int is_subdirectory(const char *dir, const char *subdir, int *is_subdir);
+void reset_path_identities(void);
 void add_libgl_abi_symlink(Options *op, Package *p);
 
 int check_libglvnd_files(Options *op, Package *p);
@@ -502,6 +502,8 @@ typedef struct {
     /* The initramfs was successfully scanned and the *_ko_detected flags can
      * be trusted to accurately reflect the contents of the initramfs. */
     int scan_complete;
+    /* Messages reported by the scan thread, displayed once it is joined. */
+    UiWorkerMessages *messages;
 } ScanThreadData;
 
 static void scan_initramfs(Options *op, ScanThreadData *data, int interactive)
@@ -559,10 +561,14 @@ static void *initramfs_scan_worker(void *arg)
     static ScanThreadData data = {};
     Options *op = arg;
 
+    ui_worker_begin();
+
     data.tool = find_initramfs_tool(op, INITRAMFS_LIST_TOOL, NON_INTERACTIVE);
 
     scan_initramfs(op, &data, NON_INTERACTIVE);
 
+    data.messages = ui_worker_end();
+
     return &data;
 }
 
@@ -629,6 +635,9 @@ int update_initramfs(Options *op)
         data_pointer = &data;
     }
 
+    ui_worker_flush(op, data_pointer->messages);
+    data_pointer->messages = NULL;
+
     if (data_pointer->try_scan_again) {
         data_pointer->tool = find_initramfs_tool(op, INITRAMFS_LIST_TOOL,
                                                  INTERACTIVE);
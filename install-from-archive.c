@@ -0,0 +1,1141 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * install-from-archive.c - install directly from a driver package archive
+ * (a self-extracting .run file, or the tar archive it contains), extracting
+ * only the files that the installation can use.
+ *
+ * The archive is read in two passes over the decompressed tar stream.  The
+ * first pass stops as soon as it has read the package's .manifest; the
+ * manifest and the command line options then determine which packaged
+ * files are certain not to be installed (e.g., OpenGL files with
+ * --no-opengl-files, or 32-bit compatibility libraries with
+ * --install-compat32-libs=no).  The second pass extracts everything else
+ * into a temporary directory, or into the package cache (see
+ * package-cache.c), from which the installation proceeds as it would from
+ * an extracted package.  Files which are not listed in the manifest are
+ * always extracted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "files.h"
+#include "misc.h"
+#include "manifest.h"
+#include "kernel.h"
+#include "package-cache.h"
+
+#define TAR_BLOCK_SIZE 512
+
+/* how far into the archive to look for the start of the payload */
+#define PAYLOAD_SEARCH_LIMIT (1024 * 1024)
+
+/* the number of header lines at the top of a .manifest file */
+#define MANIFEST_HEADER_LINES 8
+
+/*
+ * compression formats that may be used for the payload of a .run file; the
+ * payload is decompressed by piping it through the named utility.
+ */
+
+static const struct {
+    const char *magic;
+    int magic_len;
+    const char *decompressor;
+} payload_formats[] = {
+    { "\xfd" "7zXZ\0",      6, "xz"    },
+    { "\x28\xb5\x2f\xfd",   4, "zstd"  },
+    { "\x1f\x8b\x08",       3, "gzip"  },
+};
+
+typedef struct {
+    int fd;
+    pid_t pid;
+} PayloadStream;
+
+typedef struct {
+    char *name;
+    char *linkname;
+    char type;
+    mode_t mode;
+    unsigned long long size;
+} TarEntry;
+
+typedef struct {
+    int num;
+    char **files;
+} ExcludedFiles;
+
+
+/*
+ * read_full() - read up to len bytes from fd, retrying short reads; returns
+ * the number of bytes read, or -1 on error.
+ */
+
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = read(fd, (char *) buf + done, len - done);
+
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (ret == 0) break;
+
+        done += ret;
+    }
+
+    return done;
+}
+
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = write(fd, (const char *) buf + done, len - done);
+
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return FALSE;
+        }
+
+        done += ret;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * find_payload() - locate the tar payload within the archive: either the
+ * archive is itself a tar file, or the payload begins at the first
+ * compressed stream signature after the self-extracting script.
+ */
+
+static int find_payload(Options *op, int fd, off_t *offset,
+                        const char **decompressor)
+{
+    char *buf = nvalloc(PAYLOAD_SEARCH_LIMIT);
+    ssize_t len = read_full(fd, buf, PAYLOAD_SEARCH_LIMIT);
+    ssize_t i;
+    int j, ret = FALSE;
+
+    if (len >= TAR_BLOCK_SIZE && strncmp(buf + 257, "ustar", 5) == 0) {
+        *offset = 0;
+        *decompressor = NULL;
+        ret = TRUE;
+        goto done;
+    }
+
+    for (i = 0; i < len && !ret; i++) {
+        for (j = 0; j < ARRAY_LEN(payload_formats); j++) {
+            if (i + payload_formats[j].magic_len <= len &&
+                memcmp(buf + i, payload_formats[j].magic,
+                       payload_formats[j].magic_len) == 0) {
+                *offset = i;
+                *decompressor = payload_formats[j].decompressor;
+                ret = TRUE;
+                break;
+            }
+        }
+    }
+
+done:
+    nvfree(buf);
+    return ret;
+}
+
+
+/*
+ * open_payload_stream() - open the archive and return a file descriptor
+ * from which the decompressed tar stream can be read.
+ */
+
+static int open_payload_stream(Options *op, PayloadStream *stream)
+{
+    const char *decompressor;
+    off_t offset;
+    int fd, pipe_fds[2];
+
+    stream->fd = -1;
+    stream->pid = 0;
+
+    fd = open(op->archive_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ui_error(op, "Unable to open '%s' (%s).", op->archive_file,
+                 strerror(errno));
+        return FALSE;
+    }
+
+    if (!find_payload(op, fd, &offset, &decompressor)) {
+        ui_error(op, "'%s' does not appear to be an NVIDIA driver package.",
+                 op->archive_file);
+        close(fd);
+        return FALSE;
+    }
+
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        ui_error(op, "Unable to seek in '%s' (%s).", op->archive_file,
+                 strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    if (!decompressor) {
+        stream->fd = fd;
+        return TRUE;
+    }
+
+    if (pipe(pipe_fds) != 0) {
+        ui_error(op, "Unable to create a pipe (%s).", strerror(errno));
+        close(fd);
+        return FALSE;
+    }
+
+    stream->pid = fork();
+
+    if (stream->pid < 0) {
+        ui_error(op, "Unable to fork (%s).", strerror(errno));
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        close(fd);
+        return FALSE;
+    }
+
+    if (stream->pid == 0) {
+        dup2(fd, STDIN_FILENO);
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        execlp(decompressor, decompressor, "-dc", NULL);
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+    close(fd);
+
+    ui_expert(op, "Decompressing the payload of '%s' with %s(1), starting "
+              "at offset %lld.", op->archive_file, decompressor,
+              (long long) offset);
+
+    stream->fd = pipe_fds[0];
+
+    return TRUE;
+}
+
+
+/*
+ * close_payload_stream() - close the stream and reap the decompressor.
+ * When the stream is closed before it was fully read, the decompressor is
+ * expected to die from SIGPIPE, and its exit status is not checked.
+ */
+
+static int close_payload_stream(Options *op, PayloadStream *stream,
+                                int complete)
+{
+    int status;
+
+    if (stream->fd >= 0) {
+        close(stream->fd);
+    }
+
+    if (stream->pid <= 0) {
+        return TRUE;
+    }
+
+    if (!complete) {
+        kill(stream->pid, SIGTERM);
+    }
+
+    while (waitpid(stream->pid, &status, 0) < 0) {
+        if (errno != EINTR) return !complete;
+    }
+
+    if (complete && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        ui_error(op, "Failed to decompress the payload of '%s'.",
+                 op->archive_file);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * parse_tar_number() - parse a numeric tar header field, which is either
+ * octal text or, for large values, big-endian base-256.
+ */
+
+static unsigned long long parse_tar_number(const char *field, int len)
+{
+    unsigned long long value = 0;
+    int i;
+
+    if (field[0] & 0x80) {
+        value = field[0] & 0x7f;
+        for (i = 1; i < len; i++) {
+            value = (value << 8) | (unsigned char) field[i];
+        }
+        return value;
+    }
+
+    for (i = 0; i < len && (field[i] == ' ' || field[i] == '\0'); i++);
+
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = (value << 3) | (field[i] - '0');
+    }
+
+    return value;
+}
+
+
+static unsigned long long tar_padded_size(unsigned long long size)
+{
+    return (size + TAR_BLOCK_SIZE - 1) & ~((unsigned long long)
+                                           TAR_BLOCK_SIZE - 1);
+}
+
+
+/*
+ * tar_skip_data() - discard an entry's data, including padding.
+ */
+
+static int tar_skip_data(int fd, unsigned long long size)
+{
+    char buf[64 * 1024];
+    unsigned long long remaining = tar_padded_size(size);
+
+    while (remaining > 0) {
+        size_t len = NV_MIN(remaining, sizeof(buf));
+
+        if (read_full(fd, buf, len) != len) {
+            return FALSE;
+        }
+        remaining -= len;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * tar_read_data() - read an entry's data into a newly allocated, NUL
+ * terminated buffer.
+ */
+
+static char *tar_read_data(int fd, unsigned long long size)
+{
+    unsigned long long padded = tar_padded_size(size);
+    char *buf = nvalloc(padded + 1);
+
+    if (read_full(fd, buf, padded) != padded) {
+        nvfree(buf);
+        return NULL;
+    }
+
+    buf[size] = '\0';
+
+    return buf;
+}
+
+
+/*
+ * parse_pax_header() - pick the path, link path and size overrides out of
+ * a pax extended header.
+ */
+
+static void parse_pax_header(const char *data, unsigned long long size,
+                             char **name, char **linkname,
+                             unsigned long long *file_size, int *have_size)
+{
+    const char *p = data, *end = data + size;
+
+    while (p < end) {
+        char *record_end;
+        const char *key, *eq;
+        long len = strtol(p, &record_end, 10);
+
+        if (len <= 0 || p + len > end || *record_end != ' ') {
+            break;
+        }
+
+        key = record_end + 1;
+        eq = memchr(key, '=', p + len - key);
+
+        if (eq) {
+            size_t key_len = eq - key;
+            size_t value_len = (p + len - 1) - (eq + 1);
+            char *value = nvalloc(value_len + 1);
+
+            memcpy(value, eq + 1, value_len);
+
+            if (key_len == 4 && strncmp(key, "path", 4) == 0) {
+                nvfree(*name);
+                *name = value;
+            } else if (key_len == 8 && strncmp(key, "linkpath", 8) == 0) {
+                nvfree(*linkname);
+                *linkname = value;
+            } else {
+                if (key_len == 4 && strncmp(key, "size", 4) == 0) {
+                    *file_size = strtoull(value, NULL, 10);
+                    *have_size = TRUE;
+                }
+                nvfree(value);
+            }
+        }
+
+        p += len;
+    }
+}
+
+
+/*
+ * tar_next_entry() - read the next entry's header, following GNU long name
+ * and pax extended headers.  Returns 1 if an entry was read, 0 at the end
+ * of the archive, and -1 if the archive is malformed.
+ */
+
+static int tar_next_entry(int fd, TarEntry *entry)
+{
+    unsigned char header[TAR_BLOCK_SIZE];
+    char *long_name = NULL, *long_linkname = NULL;
+    unsigned long long pax_size = 0;
+    int have_pax_size = FALSE;
+
+    memset(entry, 0, sizeof(*entry));
+
+    while (1) {
+        unsigned long long checksum, sum = 0;
+        char *data;
+        int i;
+
+        if (read_full(fd, header, sizeof(header)) != sizeof(header)) {
+            goto fail;
+        }
+
+        for (i = 0; i < sizeof(header) && header[i] == 0; i++);
+        if (i == sizeof(header)) {
+            nvfree(long_name);
+            nvfree(long_linkname);
+            return 0;
+        }
+
+        checksum = parse_tar_number((char *) header + 148, 8);
+        for (i = 0; i < sizeof(header); i++) {
+            sum += (i >= 148 && i < 156) ? ' ' : header[i];
+        }
+        if (sum != checksum) {
+            goto fail;
+        }
+
+        entry->type = header[156];
+        entry->mode = parse_tar_number((char *) header + 100, 8) & 07777;
+        entry->size = parse_tar_number((char *) header + 124, 12);
+
+        switch (entry->type) {
+        case 'L':
+        case 'K':
+        case 'x':
+            data = tar_read_data(fd, entry->size);
+            if (!data) goto fail;
+
+            if (entry->type == 'L') {
+                nvfree(long_name);
+                long_name = data;
+            } else if (entry->type == 'K') {
+                nvfree(long_linkname);
+                long_linkname = data;
+            } else {
+                parse_pax_header(data, entry->size, &long_name,
+                                 &long_linkname, &pax_size, &have_pax_size);
+                nvfree(data);
+            }
+            continue;
+
+        case 'g':
+            if (!tar_skip_data(fd, entry->size)) goto fail;
+            continue;
+        }
+
+        break;
+    }
+
+    if (long_name) {
+        entry->name = long_name;
+    } else if (header[345] != '\0') {
+        entry->name = nvasprintf("%.155s/%.100s", header + 345, header);
+    } else {
+        entry->name = nvasprintf("%.100s", header);
+    }
+
+    if (long_linkname) {
+        entry->linkname = long_linkname;
+    } else {
+        entry->linkname = nvasprintf("%.100s", header + 157);
+    }
+
+    if (have_pax_size) {
+        entry->size = pax_size;
+    }
+
+    /* only regular files carry data that the caller must consume */
+    if (entry->type != '0' && entry->type != '\0' && entry->type != '7') {
+        if (!tar_skip_data(fd, entry->size)) goto fail;
+        entry->size = 0;
+    }
+
+    return 1;
+
+fail:
+    nvfree(long_name);
+    nvfree(long_linkname);
+    return -1;
+}
+
+
+static void free_tar_entry(TarEntry *entry)
+{
+    nvfree(entry->name);
+    nvfree(entry->linkname);
+}
+
+
+static int is_regular_tar_entry(const TarEntry *entry)
+{
+    return entry->type == '0' || entry->type == '\0' || entry->type == '7';
+}
+
+
+/*
+ * strip_package_prefix() - return the portion of 'name' within the
+ * package, i.e. without any leading "./" components and without 'prefix',
+ * or NULL if 'name' is not within the package.
+ */
+
+static const char *strip_package_prefix(const char *name, const char *prefix)
+{
+    while (strncmp(name, "./", 2) == 0) {
+        name += 2;
+    }
+
+    if (strncmp(name, prefix, strlen(prefix)) != 0) {
+        return NULL;
+    }
+
+    name += strlen(prefix);
+
+    while (strncmp(name, "./", 2) == 0) {
+        name += 2;
+    }
+
+    return name;
+}
+
+
+/*
+ * path_is_within_package() - reject absolute paths and paths containing
+ * ".." components, which could refer to files outside of the extraction
+ * directory.
+ */
+
+static int path_is_within_package(const char *path)
+{
+    const char *p = path;
+
+    if (path[0] == '/') {
+        return FALSE;
+    }
+
+    while (*p) {
+        size_t len = strcspn(p, "/");
+
+        if (len == 2 && strncmp(p, "..", 2) == 0) {
+            return FALSE;
+        }
+
+        p += len;
+        while (*p == '/') p++;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * read_manifest_from_archive() - read the archive up to the package's
+ * .manifest, and return its contents along with the directory prefix
+ * under which the package's files are stored in the archive.
+ */
+
+static int read_manifest_from_archive(Options *op, char **manifest,
+                                      char **prefix)
+{
+    PayloadStream stream;
+    TarEntry entry;
+    int ret;
+
+    *manifest = NULL;
+    *prefix = NULL;
+
+    if (!open_payload_stream(op, &stream)) {
+        return FALSE;
+    }
+
+    while ((ret = tar_next_entry(stream.fd, &entry)) > 0) {
+        const char *name = strip_package_prefix(entry.name, "");
+        const char *slash = strchr(name, '/');
+        const char *base = slash ? slash + 1 : name;
+
+        if (is_regular_tar_entry(&entry) && strcmp(base, ".manifest") == 0) {
+            *manifest = tar_read_data(stream.fd, entry.size);
+            *prefix = nvstrndup(name, base - name);
+            free_tar_entry(&entry);
+            break;
+        }
+
+        if (!tar_skip_data(stream.fd, entry.size)) {
+            ret = -1;
+        }
+
+        free_tar_entry(&entry);
+
+        if (ret < 0) break;
+    }
+
+    close_payload_stream(op, &stream, FALSE);
+
+    if (!*manifest) {
+        ui_error(op, "%s while looking for the package manifest in '%s'.",
+                 ret < 0 ? "Invalid or truncated archive data found" :
+                           "No package manifest found",
+                 op->archive_file);
+        nvfree(*prefix);
+        *prefix = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * manifest_entry_is_needed() - determine from the command line options
+ * alone whether a packaged file might be used by this installation; this
+ * mirrors the remove_*_files_from_package() calls in install_from_cwd(),
+ * but answers TRUE whenever the outcome depends on a later decision.
+ */
+
+static int manifest_entry_is_needed(Options *op, const char *file,
+                                    PackageEntryFileType type,
+                                    PackageEntryFileCapabilities caps,
+                                    PackageEntryFileCompatArch arch)
+{
+    if (op->kernel_modules_only &&
+        type != FILE_TYPE_KERNEL_MODULE &&
+        type != FILE_TYPE_KERNEL_MODULE_SRC &&
+        type != FILE_TYPE_DKMS_CONF) {
+        return FALSE;
+    }
+
+    if (op->no_opengl_files && caps.is_opengl) {
+        return FALSE;
+    }
+
+    if (op->no_wine_files && type == FILE_TYPE_WINE_LIB) {
+        return FALSE;
+    }
+
+    if (op->use_systemd == NV_OPTIONAL_BOOL_FALSE &&
+        (type == FILE_TYPE_SYSTEMD_UNIT ||
+         type == FILE_TYPE_SYSTEMD_UNIT_SYMLINK ||
+         type == FILE_TYPE_SYSTEMD_SLEEP_SCRIPT)) {
+        return FALSE;
+    }
+
+    if (op->install_compat32_libs == NV_OPTIONAL_BOOL_FALSE &&
+        arch == FILE_COMPAT_ARCH_COMPAT32) {
+        return FALSE;
+    }
+
+    if (type == FILE_TYPE_KERNEL_MODULE_SRC) {
+        const char *dir = op->kernel_module_build_directory_request;
+
+        if (!dir && op->kernel_module_type_request) {
+            dir = kernel_module_type_directory(op->kernel_module_type_request);
+        }
+
+        if (op->no_kernel_modules && op->no_kernel_module_source) {
+            return FALSE;
+        }
+
+        /* only the sources in the selected build directory are used */
+        if (dir) {
+            while (strncmp(dir, "./", 2) == 0) dir += 2;
+            while (strncmp(file, "./", 2) == 0) file += 2;
+
+            if (strncmp(file, dir, strlen(dir)) != 0 ||
+                file[strlen(dir)] != '/') {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+/*
+ * build_excluded_file_list() - parse the manifest's file entries and
+ * collect the names of the files that won't be needed, sorted for
+ * bsearch(3).
+ */
+
+static void build_excluded_file_list(Options *op, char *manifest,
+                                     ExcludedFiles *excluded)
+{
+    char *line, *next;
+    int line_num = 0;
+
+    excluded->num = 0;
+    excluded->files = NULL;
+
+    /* header lines may be empty, so strtok(3) can't split the lines */
+
+    for (line = manifest; line; line = next) {
+        PackageEntryFileCapabilities caps;
+        PackageEntryFileCompatArch arch = FILE_COMPAT_ARCH_NONE;
+        PackageEntryFileType type;
+        char *file, *mode, *flag, *arch_str, *word_saveptr = NULL;
+
+        next = strchr(line, '\n');
+        if (next) {
+            *next++ = '\0';
+        }
+
+        if (++line_num <= MANIFEST_HEADER_LINES) {
+            continue;
+        }
+
+        file = strtok_r(line, " \t", &word_saveptr);
+        mode = strtok_r(NULL, " \t", &word_saveptr);
+        flag = strtok_r(NULL, " \t", &word_saveptr);
+
+        if (!file || !mode || !flag) {
+            continue;
+        }
+
+        type = parse_manifest_file_type(flag, &caps);
+        if (type == FILE_TYPE_NONE) {
+            continue;
+        }
+
+        if (caps.has_arch) {
+            arch_str = strtok_r(NULL, " \t", &word_saveptr);
+
+            if (arch_str && strcmp(arch_str, "COMPAT32") == 0) {
+                arch = FILE_COMPAT_ARCH_COMPAT32;
+            } else if (arch_str && strcmp(arch_str, "NATIVE") == 0) {
+                arch = FILE_COMPAT_ARCH_NATIVE;
+            }
+        }
+
+        if (manifest_entry_is_needed(op, file, type, caps, arch)) {
+            continue;
+        }
+
+        /* symlinks are created from the manifest, not the archive */
+        if (caps.is_symlink) {
+            continue;
+        }
+
+        excluded->files = nvrealloc(excluded->files, sizeof(char *) *
+                                    (excluded->num + 1));
+        excluded->files[excluded->num++] =
+            nvstrdup(strip_package_prefix(file, ""));
+    }
+
+    if (excluded->num > 0) {
+        qsort(excluded->files, excluded->num, sizeof(char *),
+              compare_strings);
+    }
+}
+
+
+static void free_excluded_file_list(ExcludedFiles *excluded)
+{
+    int i;
+
+    for (i = 0; i < excluded->num; i++) {
+        nvfree(excluded->files[i]);
+    }
+    nvfree(excluded->files);
+}
+
+
+static int file_is_excluded(const ExcludedFiles *excluded, const char *name)
+{
+    return excluded->num > 0 &&
+           bsearch(&name, excluded->files, excluded->num, sizeof(char *),
+                   compare_strings) != NULL;
+}
+
+
+/*
+ * extract_file() - write the data of a regular file entry to 'name' in the
+ * directory 'dir_fd'; 'path' is the full path, for messages.
+ */
+
+static int extract_file(Options *op, int stream_fd, const TarEntry *entry,
+                        int dir_fd, const char *name, const char *path)
+{
+    char buf[64 * 1024];
+    unsigned long long remaining = entry->size;
+    int fd, ret = TRUE;
+
+    fd = openat(dir_fd, name,
+                O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                entry->mode | S_IRUSR | S_IWUSR);
+
+    if (fd < 0) {
+        ui_error(op, "Unable to create '%s' (%s).", path, strerror(errno));
+        return FALSE;
+    }
+
+    while (remaining > 0) {
+        size_t len = NV_MIN(remaining, sizeof(buf));
+
+        if (read_full(stream_fd, buf, len) != len) {
+            ui_error(op, "Unexpected end of the archive while extracting "
+                     "'%s'.", path);
+            ret = FALSE;
+            break;
+        }
+
+        if (!write_full(fd, buf, len)) {
+            ui_error(op, "Unable to write '%s' (%s).", path, strerror(errno));
+            ret = FALSE;
+            break;
+        }
+
+        remaining -= len;
+    }
+
+    if (ret) {
+        fchmod(fd, entry->mode);
+        drop_from_page_cache(op, fd, TRUE);
+    }
+
+    close(fd);
+
+    /* consume the padding after the data */
+    remaining = tar_padded_size(entry->size) - entry->size;
+    if (ret && read_full(stream_fd, buf, remaining) != remaining) {
+        ret = FALSE;
+    }
+
+    return ret;
+}
+
+
+/*
+ * split_package_path() - split the path 'name' within the package into its
+ * directory ("." if none) and its last component.
+ */
+
+static char *split_package_path(const char *name, const char **base)
+{
+    const char *slash = strrchr(name, '/');
+
+    if (!slash) {
+        *base = name;
+        return nvstrdup(".");
+    }
+
+    *base = slash + 1;
+    return nvstrndup(name, slash - name);
+}
+
+
+/*
+ * extract_package() - extract every file in the package that is not on
+ * the excluded list into 'dir'. Every entry is created relative to a
+ * descriptor of 'dir' without following symbolic links, and symbolic links
+ * may only point down into the package, so that no entry can be written
+ * outside of 'dir' through a link extracted before it.
+ */
+
+static int extract_package(Options *op, const char *dir, const char *prefix,
+                           const ExcludedFiles *excluded)
+{
+    PayloadStream stream;
+    TarEntry entry;
+    int dir_fd, ret = 0, success = TRUE;
+    int num_extracted = 0, num_skipped = 0;
+    unsigned long long bytes_extracted = 0, bytes_skipped = 0;
+
+    dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        ui_error(op, "Unable to open '%s' (%s).", dir, strerror(errno));
+        return FALSE;
+    }
+
+    if (!open_payload_stream(op, &stream)) {
+        close(dir_fd);
+        return FALSE;
+    }
+
+    ui_indeterminate_begin(op, "Extracting %s", op->archive_file);
+
+    while (success && (ret = tar_next_entry(stream.fd, &entry)) > 0) {
+        const char *name, *base;
+        char *path, *parent;
+        int parent_fd;
+
+        remove_trailing_slashes(entry.name);
+        name = strip_package_prefix(entry.name, prefix);
+
+        if (!name || name[0] == '\0') {
+            success = tar_skip_data(stream.fd, entry.size);
+            free_tar_entry(&entry);
+            continue;
+        }
+
+        if (!path_is_within_package(name)) {
+            ui_error(op, "Refusing to extract '%s' from '%s'.", entry.name,
+                     op->archive_file);
+            free_tar_entry(&entry);
+            success = FALSE;
+            break;
+        }
+
+        if (is_regular_tar_entry(&entry) && file_is_excluded(excluded, name)) {
+            ui_expert(op, "Not extracting: %s", name);
+            num_skipped++;
+            bytes_skipped += entry.size;
+            success = tar_skip_data(stream.fd, entry.size);
+            free_tar_entry(&entry);
+            continue;
+        }
+
+        path = nvdircat(dir, name, NULL);
+        parent = split_package_path(name, &base);
+
+        parent_fd = mkdir_beneath(dir_fd, parent, 0755);
+
+        if (parent_fd == -1) {
+            ui_error(op, "Unable to create the directory for '%s' (%s).",
+                     path, strerror(errno));
+            success = FALSE;
+        } else if (is_regular_tar_entry(&entry)) {
+            success = extract_file(op, stream.fd, &entry, parent_fd, base,
+                                   path);
+            num_extracted++;
+            bytes_extracted += entry.size;
+        } else if (entry.type == '5') {
+            int fd = mkdir_beneath(dir_fd, name, entry.mode | S_IRWXU);
+
+            if (fd == -1) {
+                ui_error(op, "Unable to create the directory '%s' (%s).",
+                         path, strerror(errno));
+                success = FALSE;
+            } else {
+                close(fd);
+            }
+        } else if (entry.type == '2') {
+            /* only allow links down into the package, as hard links are */
+
+            if (!path_is_within_package(entry.linkname)) {
+                ui_error(op, "Refusing to extract the symbolic link '%s' -> "
+                         "'%s' from '%s'.", entry.name, entry.linkname,
+                         op->archive_file);
+                success = FALSE;
+            } else if (symlinkat(entry.linkname, parent_fd, base) != 0) {
+                ui_error(op, "Unable to create symbolic link '%s' (%s).",
+                         path, strerror(errno));
+                success = FALSE;
+            }
+        } else if (entry.type == '1') {
+            const char *target = strip_package_prefix(entry.linkname, prefix);
+            const char *target_base;
+            char *target_parent;
+            int target_fd;
+
+            if (!target || !path_is_within_package(target)) {
+                ui_error(op, "Refusing to extract '%s' from '%s'.",
+                         entry.name, op->archive_file);
+                success = FALSE;
+            } else {
+                target_parent = split_package_path(target, &target_base);
+                target_fd = open_beneath(dir_fd, target_parent,
+                                         O_RDONLY | O_DIRECTORY, 0);
+
+                if (target_fd == -1 ||
+                    linkat(target_fd, target_base, parent_fd, base, 0) != 0) {
+                    ui_error(op, "Unable to create hard link '%s' (%s).",
+                             path, strerror(errno));
+                    success = FALSE;
+                }
+
+                if (target_fd != -1) close(target_fd);
+                nvfree(target_parent);
+            }
+        }
+
+        if (parent_fd != -1) close(parent_fd);
+        nvfree(parent);
+        nvfree(path);
+        free_tar_entry(&entry);
+    }
+
+    close(dir_fd);
+
+    if (success && ret < 0) {
+        ui_error(op, "Invalid or truncated archive data found in '%s'.",
+                 op->archive_file);
+        success = FALSE;
+    }
+
+    if (!close_payload_stream(op, &stream, success)) {
+        success = FALSE;
+    }
+
+    ui_indeterminate_end(op);
+
+    if (success) {
+        ui_log(op, "Extracted %d files (%llu bytes) from '%s'; skipped %d "
+               "files (%llu bytes) that will not be installed.",
+               num_extracted, bytes_extracted, op->archive_file,
+               num_skipped, bytes_skipped);
+    }
+
+    return success;
+}
+
+
+/*
+ * install_from_archive() - extract the files that may be installed from
+ * the package archive named by op->archive_file, and install from there;
+ * or, with --add-this-kernel, add a precompiled kernel interface to the
+ * extracted package. The package is extracted into the package cache, or
+ * used from there if it was extracted before, or, if the package cache is
+ * disabled, extracted into a temporary directory.
+ */
+
+int install_from_archive(Options *op)
+{
+    ExcludedFiles excluded;
+    PackageCache *pc;
+    char *manifest, *prefix, *dir = NULL;
+    int cwd_fd, ret = FALSE;
+
+    if (!read_manifest_from_archive(op, &manifest, &prefix)) {
+        return FALSE;
+    }
+
+    build_excluded_file_list(op, manifest, &excluded);
+    nvfree(manifest);
+
+    pc = package_cache_open(op);
+
+    if (pc) {
+        dir = nvstrdup(package_cache_directory(pc));
+
+        if (package_cache_lookup(op, pc, excluded.files, excluded.num)) {
+            ui_log(op, "Using the package extracted from '%s' in '%s'.",
+                   op->archive_file, dir);
+        } else if (!package_cache_prepare(op, pc) ||
+                   !extract_package(op, dir, prefix, &excluded)) {
+            goto done;
+        } else {
+            package_cache_commit(op, pc, excluded.files, excluded.num);
+        }
+    } else {
+        if (op->add_this_kernel) {
+            ui_error(op, "The package cache is needed to keep the "
+                     "precompiled kernel interface built by "
+                     "--add-this-kernel with --install-from-archive.");
+            goto done;
+        }
+
+        dir = nvstrcat(op->tmpdir, "/nvidia-installer-XXXXXX", NULL);
+
+        if (!mkdtemp(dir)) {
+            ui_error(op, "Unable to create a temporary directory in '%s' "
+                     "(%s).", op->tmpdir, strerror(errno));
+            goto done;
+        }
+
+        if (!extract_package(op, dir, prefix, &excluded)) {
+            goto cleanup;
+        }
+    }
+
+    cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (cwd_fd < 0 || chdir(dir) != 0) {
+        ui_error(op, "Unable to change to the directory '%s' (%s).", dir,
+                 strerror(errno));
+        if (cwd_fd >= 0) close(cwd_fd);
+        goto cleanup;
+    }
+
+    if (apply_kernel_module_build_directory_requests(op)) {
+        ret = op->add_this_kernel ? add_this_kernel(op) : install_from_cwd(op);
+    }
+
+    if (fchdir(cwd_fd) != 0) {
+        ui_warn(op, "Unable to return to the original working directory "
+                "(%s).", strerror(errno));
+    }
+    close(cwd_fd);
+
+cleanup:
+    if (!pc) {
+        remove_directory(op, dir);
+    }
+
+done:
+    package_cache_close(op, pc);
+    nvfree(dir);
+    nvfree(prefix);
+    free_excluded_file_list(&excluded);
+
+    return ret;
+}
@@ -47,12 +47,14 @@
 #include "misc.h"
 #include "sanity.h"
 #include "manifest.h"
+#include "multi-root.h"
 
 /* local prototypes */
 
 
 static Package *parse_manifest(Options *op);
 static int install_kernel_modules(Options *op,  Package *p);
+static int select_package_files(Options *op, Package *p);
 static void free_package(Package *p);
 static int assisted_module_signing(Options *op, Package *p);
 
@@ -121,6 +123,18 @@ int install_from_cwd(Options *op)
     }
 
     ui_set_title(op, "%s (%s)", p->description, p->version);
+
+    /*
+     * when installing into other root directories, none of the checks
+     * of this system below apply
+     */
+
+    if (op->target_roots) {
+        int ret = select_package_files(op, p) && install_into_roots(op, p);
+
+        free_package(p);
+        return ret;
+    }
     
     /* 
      * warn the user if "legacy" GPUs are installed in this system
@@ -236,61 +250,12 @@ int install_from_cwd(Options *op)
                 "are installed separately.");
     }
     
-    /*
-     * if we are only installing the kernel modules, then remove
-     * everything else from the package; otherwise do some
-     * OpenGL-specific stuff
-     */
-
-    if (op->kernel_modules_only) {
-        remove_non_kernel_module_files_from_package(p);
-    } else {
-
-        /* ask for the XFree86 and OpenGL installation prefixes. */
-    
-        if (!get_prefixes(op)) goto failed;
+    if (!select_package_files(op, p)) goto failed;
 
-        /*
-         * if the package contains any .desktop files,
-         * process them (perform some search and replacing so
-         * that they reflect the correct installation path, etc)
-         * and add them to the package list (files to be installed).
-         */
-
-        process_dot_desktop_files(op, p);
-
-#if defined(NV_X86_64)
-        /*
-         * ask if we should install the 32bit compatibility files on
-         * this machine.
-         */
-
-        should_install_compat32_files(op, p);
-#endif /* NV_X86_64 */
-    }
-
-    if (op->no_opengl_files) {
-        remove_opengl_files_from_package(p);
-    } else {
+    if (!op->no_opengl_files) {
         check_for_vulkan_loader(op);
     }
 
-    if (op->no_wine_files) {
-        remove_wine_files_from_package(p);
-    }
-
-    /*
-     * determine whether systemd files should be installed
-     */
-    if (op->use_systemd != NV_OPTIONAL_BOOL_TRUE) {
-        remove_systemd_files_from_package(p);
-    }
-
-    /*
-     * Remove any kernel module source files that won't be installed.
-     */
-    remove_non_installed_kernel_module_source_files_from_package(p);
-
     /*
      * now that we have the installation prefixes, build the
      * destination for each file to be installed
@@ -319,6 +284,9 @@ int install_from_cwd(Options *op)
          */
         if (!run_existing_uninstaller(op)) goto failed;
 
+        /* the uninstaller may have removed or replaced directories */
+        reset_path_identities();
+
         /* initialize the backup log */
         if (!init_backup(op, p)) goto failed;
     }
@@ -336,6 +304,8 @@ int install_from_cwd(Options *op)
     
     if ((c = build_command_list(op, p)) == NULL) goto failed;
 
+    optimize_command_list(op, c);
+
     /* call the ui to get approval for the list of commands */
     
     if (!ui_approve_command_list(op, c, "%s", p->description)) {
@@ -455,6 +425,73 @@ int install_from_cwd(Options *op)
 
 
 
+/*
+ * select_package_files() - remove the files that will not be installed
+ * from the package, and prepare the ones that will be, asking for the
+ * installation prefixes if needed.
+ */
+
+static int select_package_files(Options *op, Package *p)
+{
+    /*
+     * if we are only installing the kernel modules, then remove
+     * everything else from the package; otherwise do some
+     * OpenGL-specific stuff
+     */
+
+    if (op->kernel_modules_only) {
+        remove_non_kernel_module_files_from_package(p);
+    } else {
+
+        /* ask for the XFree86 and OpenGL installation prefixes. */
+    
+        if (!get_prefixes(op)) return FALSE;
+
+        /*
+         * if the package contains any .desktop files,
+         * process them (perform some search and replacing so
+         * that they reflect the correct installation path, etc)
+         * and add them to the package list (files to be installed).
+         */
+
+        process_dot_desktop_files(op, p);
+
+#if defined(NV_X86_64)
+        /*
+         * ask if we should install the 32bit compatibility files on
+         * this machine.
+         */
+
+        should_install_compat32_files(op, p);
+#endif /* NV_X86_64 */
+    }
+
+    if (op->no_opengl_files) {
+        remove_opengl_files_from_package(p);
+    }
+
+    if (op->no_wine_files) {
+        remove_wine_files_from_package(p);
+    }
+
+    /*
+     * determine whether systemd files should be installed
+     */
+    if (op->use_systemd != NV_OPTIONAL_BOOL_TRUE) {
+        remove_systemd_files_from_package(p);
+    }
+
+    /*
+     * Remove any kernel module source files that won't be installed.
+     */
+    remove_non_installed_kernel_module_source_files_from_package(p);
+
+    return TRUE;
+
+} /* select_package_files() */
+
+
+
 /*
  * Attempt to build and install the appropriate kernel modules for the
  * running kernel; we first check if prebuilt kernel interfaces exist.
@@ -495,11 +532,12 @@ static int install_kernel_modules(Options *op,  Package *p)
     
     if ((precompiled_info = find_precompiled_kernel_interface(op, p))) {
 
-        int i, precompiled_success = TRUE;
+        int precompiled_success;
 
         /*
          * we have a prebuilt kernel interface package, so now link the
-         * kernel interface files to produce the kernel module.
+         * kernel interface files to produce the kernel module, and sign
+         * them if possible.
          *
          * XXX if linking fails, maybe we should fall through and
          * attempt to build the kernel module?  No, if linking fails,
@@ -507,13 +545,8 @@ static int install_kernel_modules(Options *op,  Package *p)
          * abort.
          */
 
-        for (i = 0; i < precompiled_info->num_files; i++) {
-            if (!unpack_kernel_modules(op, p, p->kernel_module_build_directory,
-                                       &(precompiled_info->files[i]))) {
-                precompiled_success = FALSE;
-                break;
-            }
-        }
+        precompiled_success = link_precompiled_kernel_modules(op, p,
+                                                              precompiled_info);
 
         free_precompiled(precompiled_info);
         if (!precompiled_success) {
@@ -551,6 +584,47 @@ static int install_kernel_modules(Options *op,  Package *p)
 }
 
 
+/*
+ * add_this_kernel_all_types() - build and pack a precompiled kernel
+ * interface for the running kernel for each kernel module type in the
+ * package; each is packed into the precompiled directory of its own type.
+ */
+
+static int add_this_kernel_all_types(Options *op, Package *p)
+{
+    const char *dirs[NUM_KERNEL_MODULE_TYPES];
+    PrecompiledFileInfo *fileInfos[NUM_KERNEL_MODULE_TYPES];
+    char *selected_dir = p->kernel_module_build_directory;
+    int num_dirs, ret, i;
+
+    num_dirs = kernel_module_type_directories(dirs);
+
+    if (num_dirs == 0) {
+        ui_error(op, "No kernel module sources were found in this package.");
+        return FALSE;
+    }
+
+    if (!build_kernel_interfaces_all_types(op, p, dirs, num_dirs, fileInfos)) {
+        return FALSE;
+    }
+
+    for (ret = TRUE, i = 0; i < num_dirs; i++) {
+        if (!ret) {
+            nvfree(fileInfos[i]);
+            continue;
+        }
+
+        p->kernel_module_build_directory = (char *) dirs[i];
+        ret = pack_precompiled_files(op, p, p->num_kernel_modules,
+                                     fileInfos[i]);
+    }
+
+    p->kernel_module_build_directory = selected_dir;
+
+    return ret;
+}
+
+
 /*
  * add_this_kernel() - build a precompiled kernel interface for the
  * running kernel, and repackage the .run file to include the new
@@ -574,6 +648,14 @@ int add_this_kernel(Options *op)
 
     if (!determine_kernel_source_path(op, p)) goto failed;
 
+    if (op->all_kernel_module_types) {
+        if (!add_this_kernel_all_types(op, p)) goto failed;
+
+        free_package(p);
+
+        return TRUE;
+    }
+
     /* build the precompiled files */
 
     if (p->num_kernel_modules != build_kernel_interfaces(op, p, &fileInfos))
@@ -661,20 +743,22 @@ static char *nvidia_to_nv(const char *name, const char *suffix) {
  * Iterate over the list of kernel modules from the manifest file; generate
  * and store module information records for each module in the Package.
  */
-static int parse_kernel_modules_list(Package *p, char *list) {
-    char *name;
+static int parse_kernel_modules_list(Package *p, NvSlice list) {
+    NvSlice word;
 
     p->num_kernel_modules = 0; /* in case this gets called more than once */
 
-    for (name = strtok(list, " "); name; name = strtok(NULL, " ")) {
+    while (nv_slice_next_word(&list, &word)) {
         KernelModuleInfo *module;
+        char *name = nv_slice_dup(word);
+
         p->kernel_modules = nvrealloc(p->kernel_modules,
                                       (p->num_kernel_modules + 1) *
                                       sizeof(p->kernel_modules[0]));
         module = p->kernel_modules + p->num_kernel_modules;
         memset(module, 0, sizeof(*module));
 
-        module->module_name = nvstrdup(name);
+        module->module_name = name;
         module->module_filename = nvstrcat(name, ".ko", NULL);
         module->has_separate_interface_file = has_separate_interface_file(name);
         if (module->has_separate_interface_file) {
@@ -725,12 +809,13 @@ static int parse_kernel_modules_list(Package *p, char *list) {
 
 static Package *parse_manifest (Options *op)
 {
-    char *buf, *c, *tmpstr;
+    NvLineIter lines;
+    NvSlice buf, word;
     int line;
     int fd, ret, len = 0;
     struct stat stat_buf;
     Package *p;
-    char *manifest = MAP_FAILED, *ptr;
+    char *manifest = MAP_FAILED;
     int opengl_files_packaged = FALSE;
 
     p = (Package *) nvalloc(sizeof (Package));
@@ -751,31 +836,37 @@ static Package *parse_manifest (Options *op)
     manifest = mmap(0, len, PROT_READ, MAP_FILE|MAP_SHARED, fd, 0);
     if (manifest == MAP_FAILED) goto cannot_open;
     
+    /*
+     * the lines of the manifest are read in place; only the values that
+     * are kept in the Package are copied
+     */
+
+    nv_line_iter_init(&lines, manifest, len);
+
     /* the first line is the description */
 
     line = 1;
-    p->description = get_next_line(manifest, &ptr, manifest, len);
-    if (!p->description) goto invalid_manifest_file;
+    if (!nv_line_iter_next(&lines, &buf)) goto invalid_manifest_file;
+    p->description = nv_slice_dup(buf);
     
     /* the second line is the version */
     
     line++;
-    p->version = get_next_line(ptr, &ptr, manifest, len);
-    if (!p->version) goto invalid_manifest_file;
+    if (!nv_line_iter_next(&lines, &buf)) goto invalid_manifest_file;
+    p->version = nv_slice_dup(buf);
     
     /* Ignore the third line */
 
     line++;
-    nvfree(get_next_line(ptr, &ptr, manifest, len));
+    nv_line_iter_next(&lines, &buf);
 
     /* the fourth line is the list of kernel modules. */
 
     line++;
-    tmpstr = get_next_line(ptr, &ptr, manifest, len);
-    if (parse_kernel_modules_list(p, tmpstr) == 0) {
+    if (!nv_line_iter_next(&lines, &buf) ||
+        parse_kernel_modules_list(p, buf) == 0) {
         goto invalid_manifest_file;
     }
-    nvfree(tmpstr);
 
     /*
      * set the default value of excluded_kernel_modules to an empty, heap
@@ -790,13 +881,13 @@ static Package *parse_manifest (Options *op)
      */
 
     line++;
-    nvfree(get_next_line(ptr, &ptr, manifest, len));
+    nv_line_iter_next(&lines, &buf);
     line++;
-    nvfree(get_next_line(ptr, &ptr, manifest, len));
+    nv_line_iter_next(&lines, &buf);
     line++;
-    nvfree(get_next_line(ptr, &ptr, manifest, len));
+    nv_line_iter_next(&lines, &buf);
     line++;
-    nvfree(get_next_line(ptr, &ptr, manifest, len));
+    nv_line_iter_next(&lines, &buf);
 
     /*
      * allow the kernel module build directory to be overridden from the command
@@ -816,8 +907,9 @@ static Package *parse_manifest (Options *op)
         if (num_types > 0) {
             int selection;
 
-            if (num_types == 1) {
-                selection = 0;
+            if (num_types == 1 || op->all_kernel_module_types) {
+                /* with --all-kernel-module-types, every type is built */
+                selection = types.default_entry;
             } else {
                 selection = ui_multiple_choice(op, types.licenses, num_types,
                     types.default_entry,
@@ -838,13 +930,12 @@ static Package *parse_manifest (Options *op)
 
     line++;
     
-    for (; (buf = get_next_line(ptr, &ptr, manifest, len)); line++) {
-        char *flag = NULL;
+    for (; nv_line_iter_next(&lines, &buf); line++) {
+        char flag[64];
         PackageEntry entry;
         int entry_success = FALSE;
 
-        if (buf[0] == '\0') {
-            free(buf);
+        if (buf.len == 0) {
             break;
         }
 
@@ -854,21 +945,15 @@ static Package *parse_manifest (Options *op)
 
         /* read the file name and permissions */
 
-        c = buf;
-
-        entry.file = read_next_word(buf, &c);
-
-        if (!entry.file) goto entry_done;
+        if (!nv_slice_next_word(&buf, &word)) goto entry_done;
 
-        tmpstr = read_next_word(c, &c);
+        entry.file = nv_slice_dup(word);
 
-        if (!tmpstr) goto entry_done;
+        if (!nv_slice_next_word(&buf, &word)) goto entry_done;
 
         /* translate the mode string into an octal mode */
 
-        ret = mode_string_to_mode(op, tmpstr, &entry.mode);
-
-        free(tmpstr);
+        ret = mode_string_to_mode(op, word, &entry.mode);
 
         if (!ret) goto entry_done;
 
@@ -876,8 +961,8 @@ static Package *parse_manifest (Options *op)
 
         entry.type = FILE_TYPE_NONE;
 
-        flag = read_next_word(c, &c);
-        if (!flag) goto entry_done;
+        if (!nv_slice_next_word(&buf, &word) ||
+            !nv_slice_copy(word, flag, sizeof(flag))) goto entry_done;
 
         entry.type = parse_manifest_file_type(flag, &entry.caps);
 
@@ -911,13 +996,11 @@ static Package *parse_manifest (Options *op)
         entry.compat_arch = FILE_COMPAT_ARCH_NONE;
 
         if (entry.caps.has_arch) {
-            nvfree(flag);
-            flag = read_next_word(c, &c);
-            if (!flag) goto entry_done;
+            if (!nv_slice_next_word(&buf, &word)) goto entry_done;
 
-            if (strcmp(flag, "COMPAT32") == 0)
+            if (nv_slice_equal(word, "COMPAT32"))
                 entry.compat_arch = FILE_COMPAT_ARCH_COMPAT32;
-            else if (strcmp(flag, "NATIVE") == 0)
+            else if (nv_slice_equal(word, "NATIVE"))
                 entry.compat_arch = FILE_COMPAT_ARCH_NATIVE;
             else {
                 goto entry_done;
@@ -933,20 +1016,24 @@ static Package *parse_manifest (Options *op)
         /* some file types have a path field, or inherit their paths */
 
         if (entry.caps.has_path) {
-            entry.path = read_next_word(c, &c);
-            if (!entry.path) goto invalid_manifest_file;
+            if (!nv_slice_next_word(&buf, &word)) goto invalid_manifest_file;
+            entry.path = nv_slice_dup(word);
         } else if (entry.caps.inherit_path) {
             int i;
-            char *path, *depth, *slash;
+            char *path, *slash;
+            unsigned long depth;
             const char * const depth_marker = "INHERIT_PATH_DEPTH:";
 
-            depth = read_next_word(c, &c);
-            if (!depth ||
-                strncmp(depth, depth_marker, strlen(depth_marker)) != 0) {
+            if (!nv_slice_next_word(&buf, &word) ||
+                !nv_slice_has_prefix(word, depth_marker)) {
+                goto invalid_manifest_file;
+            }
+            word.s += strlen(depth_marker);
+            word.len -= strlen(depth_marker);
+            if (!nv_slice_to_ulong(word, 10, &depth)) {
                 goto invalid_manifest_file;
             }
-            entry.inherit_path_depth = atoi(depth + strlen(depth_marker));
-            nvfree(depth);
+            entry.inherit_path_depth = depth;
 
             /* Remove the file component from the packaged filename */
             path = entry.path = nvstrdup(entry.file);
@@ -976,8 +1063,8 @@ static Package *parse_manifest (Options *op)
         /* symlinks have a target */
 
         if (entry.caps.is_symlink) {
-            entry.target = read_next_word(c, &c);
-            if (!entry.target) goto invalid_manifest_file;
+            if (!nv_slice_next_word(&buf, &word)) goto invalid_manifest_file;
+            entry.target = nv_slice_dup(word);
         } else {
             entry.target = NULL;
         }
@@ -1006,10 +1093,6 @@ static Package *parse_manifest (Options *op)
         entry_success = TRUE;
 
  entry_done:
-        /* clean up */
-
-        nvfree(buf);
-        nvfree(flag);
         if (!entry_success) {
             goto invalid_manifest_file;
         }
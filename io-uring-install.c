@@ -0,0 +1,690 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * io-uring-install.c - copy a batch of files into place using io_uring,
+ * keeping many files in flight at once instead of performing each file's
+ * open/fstat/write/close sequence one file at a time.
+ *
+ * Each file moves through three phases: openat(2) of the source and the
+ * destination together with statx(2) of the source; a pipeline of read and
+ * write operations through a per-file buffer; and close(2) of both files.
+ * Up to MAX_FILES_IN_FLIGHT files are active at a time, and all of their
+ * operations are submitted to the kernel together. There is no io_uring
+ * operation for fchmod(2), which is called directly between the last write
+ * and the close.
+ *
+ * The ring is driven with the raw system calls, so no liburing is needed.
+ * If the kernel or the headers that nvidia-installer was built against do
+ * not support everything needed here, io_uring_install_files() returns
+ * FALSE and the caller falls back to install_file().
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libgen.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "io-uring-install.h"
+#include "files.h"
+#include "misc.h"
+#include "directory-plan.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#endif
+#endif
+
+/*
+ * IORING_FEAT_CUR_PERSONALITY was introduced alongside IORING_OP_OPENAT,
+ * IORING_OP_STATX, IORING_OP_CLOSE, IORING_OP_READ and IORING_OP_WRITE.
+ */
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_CUR_PERSONALITY)
+#define NV_HAVE_IO_URING 1
+#endif
+
+
+#if defined(NV_HAVE_IO_URING)
+
+#define RING_ENTRIES         128
+#define MAX_FILES_IN_FLIGHT  32
+#define COPY_CHUNK_SIZE      (1024 * 1024)
+
+/* operation type, stored in the low bits of each SQE's user_data */
+enum {
+    OP_OPEN_SRC,
+    OP_OPEN_DST,
+    OP_STATX,
+    OP_READ,
+    OP_WRITE,
+    OP_CLOSE,
+    OP_BITS = 4,
+};
+
+typedef struct {
+    int fd;
+
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned to_submit;
+} Ring;
+
+typedef enum {
+    JOB_PENDING = 0,
+    JOB_OPENING,
+    JOB_COPYING,
+    JOB_CLOSING,
+    JOB_DONE,
+} JobState;
+
+typedef struct {
+    const char *src;
+    const char *dst;
+    mode_t mode;
+
+    JobState state;
+    int outstanding;
+    int error;
+
+    int src_fd;
+    int dst_fd;
+    struct statx stx;
+
+    char *buf;
+    unsigned long long offset;
+    unsigned long long size;
+    size_t chunk_len;
+    size_t chunk_written;
+} Job;
+
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+static void ring_destroy(Ring *ring)
+{
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != MAP_FAILED &&
+        ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_len);
+    }
+    if (ring->sq_ptr && ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_len);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+}
+
+
+/*
+ * ring_supports_ops() - use IORING_REGISTER_PROBE to check that every
+ * operation used by this file is available on the running kernel.
+ */
+
+static int ring_supports_ops(Ring *ring)
+{
+    static const int required_ops[] = {
+        IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ,
+        IORING_OP_WRITE, IORING_OP_CLOSE,
+    };
+    const int nr_ops = 256;
+    struct io_uring_probe *probe;
+    int i, ret = TRUE;
+
+    probe = nvalloc(sizeof(*probe) + nr_ops * sizeof(probe->ops[0]));
+
+    if (sys_io_uring_register(ring->fd, IORING_REGISTER_PROBE, probe,
+                              nr_ops) < 0) {
+        nvfree(probe);
+        return FALSE;
+    }
+
+    for (i = 0; i < ARRAY_LEN(required_ops); i++) {
+        if (required_ops[i] > probe->last_op ||
+            !(probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ret = FALSE;
+        }
+    }
+
+    nvfree(probe);
+
+    return ret;
+}
+
+
+static int ring_init(Options *op, Ring *ring)
+{
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = sys_io_uring_setup(RING_ENTRIES, &params);
+
+    if (ring->fd < 0) {
+        ui_log(op, "io_uring is not available (%s); installing files "
+               "synchronously.", strerror(errno));
+        return FALSE;
+    }
+
+    if (!ring_supports_ops(ring)) {
+        ui_log(op, "The running kernel's io_uring does not support the "
+               "operations needed to install files; installing files "
+               "synchronously.");
+        goto fail;
+    }
+
+    ring->sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_len = params.cq_off.cqes +
+                   params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_len = ring->cq_len = NV_MAX(ring->sq_len, ring->cq_len);
+    }
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        goto map_fail;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    } else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            goto map_fail;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        goto map_fail;
+    }
+
+    ring->sq_head  = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail  = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask  = (unsigned *) ((char *) ring->sq_ptr +
+                                   params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) ((char *) ring->sq_ptr + params.sq_off.array);
+
+    ring->cq_head  = (unsigned *) ((char *) ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail  = (unsigned *) ((char *) ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask  = (unsigned *) ((char *) ring->cq_ptr +
+                                   params.cq_off.ring_mask);
+    ring->cqes     = (struct io_uring_cqe *) ((char *) ring->cq_ptr +
+                                              params.cq_off.cqes);
+
+    return TRUE;
+
+map_fail:
+    ui_log(op, "Unable to map the io_uring rings (%s); installing files "
+           "synchronously.", strerror(errno));
+fail:
+    ring_destroy(ring);
+    return FALSE;
+}
+
+
+/*
+ * ring_get_sqe() - return the next free submission queue entry, cleared and
+ * tagged with 'user_data'. The queue is sized so that it cannot overflow:
+ * each file in flight has at most three operations outstanding.
+ */
+
+static struct io_uring_sqe *ring_get_sqe(Ring *ring, int opcode,
+                                         unsigned long long user_data)
+{
+    unsigned tail = *ring->sq_tail + ring->to_submit;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+
+    ring->sq_array[index] = index;
+    ring->to_submit++;
+
+    return sqe;
+}
+
+
+/*
+ * ring_submit_and_wait() - publish queued SQEs to the kernel and wait for
+ * at least one completion.
+ */
+
+static int ring_submit_and_wait(Ring *ring)
+{
+    unsigned submitted;
+    int ret;
+
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->to_submit,
+                     __ATOMIC_RELEASE);
+
+    submitted = ring->to_submit;
+    ring->to_submit = 0;
+
+    do {
+        ret = sys_io_uring_enter(ring->fd, submitted, 1,
+                                 IORING_ENTER_GETEVENTS);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret >= 0;
+}
+
+
+static unsigned long long job_tag(int job, int op)
+{
+    return ((unsigned long long) job << OP_BITS) | op;
+}
+
+
+static void queue_open(Ring *ring, Job *job, int index)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = ring_get_sqe(ring, IORING_OP_OPENAT, job_tag(index, OP_OPEN_SRC));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long) job->src;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+    sqe = ring_get_sqe(ring, IORING_OP_OPENAT, job_tag(index, OP_OPEN_DST));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long) job->dst;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    sqe->len = job->mode;
+
+    sqe = ring_get_sqe(ring, IORING_OP_STATX, job_tag(index, OP_STATX));
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (unsigned long) job->src;
+    sqe->len = STATX_SIZE;
+    sqe->off = (unsigned long) &job->stx;
+
+    job->state = JOB_OPENING;
+    job->outstanding = 3;
+}
+
+
+static void queue_read(Ring *ring, Job *job, int index)
+{
+    struct io_uring_sqe *sqe;
+
+    job->chunk_len = NV_MIN(COPY_CHUNK_SIZE, job->size - job->offset);
+    job->chunk_written = 0;
+
+    sqe = ring_get_sqe(ring, IORING_OP_READ, job_tag(index, OP_READ));
+    sqe->fd = job->src_fd;
+    sqe->addr = (unsigned long) job->buf;
+    sqe->len = job->chunk_len;
+    sqe->off = job->offset;
+
+    job->outstanding = 1;
+}
+
+
+static void queue_write(Ring *ring, Job *job, int index)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = ring_get_sqe(ring, IORING_OP_WRITE, job_tag(index, OP_WRITE));
+    sqe->fd = job->dst_fd;
+    sqe->addr = (unsigned long) (job->buf + job->chunk_written);
+    sqe->len = job->chunk_len - job->chunk_written;
+    sqe->off = job->offset + job->chunk_written;
+
+    job->outstanding = 1;
+}
+
+
+/*
+ * queue_close() - finish the file: set the mode (which the umask may have
+ * affected when the destination was created), and close both files.
+ */
+
+static void queue_close(Options *op, Ring *ring, Job *job, int index)
+{
+    job->outstanding = 0;
+    job->state = JOB_CLOSING;
+
+    if (job->dst_fd >= 0) {
+        if (!job->error && fchmod(job->dst_fd, job->mode) != 0) {
+            job->error = errno;
+        }
+        drop_from_page_cache(op, job->dst_fd, TRUE);
+        ring_get_sqe(ring, IORING_OP_CLOSE,
+                     job_tag(index, OP_CLOSE))->fd = job->dst_fd;
+        job->outstanding++;
+    }
+
+    if (job->src_fd >= 0) {
+        drop_from_page_cache(op, job->src_fd, FALSE);
+        ring_get_sqe(ring, IORING_OP_CLOSE,
+                     job_tag(index, OP_CLOSE))->fd = job->src_fd;
+        job->outstanding++;
+    }
+
+    if (job->outstanding == 0) {
+        job->state = JOB_DONE;
+    }
+}
+
+
+/*
+ * handle_completion() - advance the job which owns 'cqe' to its next step.
+ */
+
+static void handle_completion(Options *op, Ring *ring, Job *jobs,
+                              const struct io_uring_cqe *cqe)
+{
+    int index = cqe->user_data >> OP_BITS;
+    int type = cqe->user_data & ((1 << OP_BITS) - 1);
+    Job *job = &jobs[index];
+    int res = cqe->res;
+
+    job->outstanding--;
+
+    switch (type) {
+    case OP_OPEN_SRC:
+    case OP_OPEN_DST:
+        if (res >= 0) {
+            *(type == OP_OPEN_SRC ? &job->src_fd : &job->dst_fd) = res;
+        } else if (!job->error) {
+            job->error = -res;
+        }
+        break;
+
+    case OP_STATX:
+        if (res < 0 && !job->error) {
+            job->error = -res;
+        }
+        break;
+
+    case OP_READ:
+        if (res <= 0) {
+            job->error = res < 0 ? -res : EIO;
+        } else {
+            /* a short read only shrinks the chunk */
+            job->chunk_len = res;
+            queue_write(ring, job, index);
+        }
+        break;
+
+    case OP_WRITE:
+        if (res < 0) {
+            job->error = -res;
+        } else {
+            job->chunk_written += res;
+
+            if (job->chunk_written < job->chunk_len) {
+                queue_write(ring, job, index);
+            } else {
+                job->offset += job->chunk_len;
+
+                if (job->offset < job->size) {
+                    queue_read(ring, job, index);
+                }
+            }
+        }
+        break;
+
+    case OP_CLOSE:
+        if (res < 0 && !job->error) {
+            job->error = -res;
+        }
+        break;
+    }
+
+    if (job->outstanding > 0) {
+        return;
+    }
+
+    if (job->state == JOB_OPENING && !job->error) {
+        job->size = job->stx.stx_size;
+        job->offset = 0;
+        job->state = JOB_COPYING;
+
+        if (job->size > 0) {
+            queue_read(ring, job, index);
+            return;
+        }
+    }
+
+    if (job->state == JOB_CLOSING) {
+        job->state = JOB_DONE;
+    } else {
+        queue_close(op, ring, job, index);
+    }
+}
+
+
+/*
+ * prepare_destination() - create the destination's directory, and unlink
+ * any existing file, so that a file which may be in use by another program
+ * is replaced rather than overwritten (as copy_file() does).
+ */
+
+static int prepare_destination(Options *op, Job *job)
+{
+    char *dirc = nvstrdup(job->dst);
+    char *dname = dirname(dirc);
+    int ret = directory_was_planned(dname) || mkdir_with_log(op, dname, 0755);
+
+    nvfree(dirc);
+
+    if (ret && unlink(job->dst) != 0 && errno != ENOENT) {
+        job->error = errno;
+    }
+
+    return ret && !job->error;
+}
+
+
+/*
+ * io_uring_install_files() - install the 'n' files srcs[i] as dsts[i] with
+ * modes modes[i], storing TRUE or FALSE in results[i] for each file. Errors
+ * for individual files are reported as they occur. Returns FALSE, without
+ * installing anything, if io_uring can't be used, in which case the caller
+ * should install the files with install_file() instead.
+ */
+
+int io_uring_install_files(Options *op, int n, const char * const *srcs,
+                           const char * const *dsts, const mode_t *modes,
+                           int *results)
+{
+    char *buffers[MAX_FILES_IN_FLIGHT];
+    int slot_owner[MAX_FILES_IN_FLIGHT];
+    int next = 0, done = 0, in_flight = 0, i;
+    Ring ring;
+    Job *jobs;
+
+    if (!ring_init(op, &ring)) {
+        return FALSE;
+    }
+
+    jobs = nvalloc(sizeof(Job) * n);
+    memset(buffers, 0, sizeof(buffers));
+
+    for (i = 0; i < MAX_FILES_IN_FLIGHT; i++) {
+        slot_owner[i] = -1;
+    }
+
+    while (done < n) {
+        unsigned head, tail;
+
+        /* start new files while there are free slots */
+
+        for (i = 0; i < MAX_FILES_IN_FLIGHT && next < n; i++) {
+            Job *job;
+
+            if (slot_owner[i] >= 0) {
+                continue;
+            }
+
+            job = &jobs[next];
+            job->src = srcs[next];
+            job->dst = dsts[next];
+            job->mode = modes[next];
+            job->src_fd = job->dst_fd = -1;
+
+            if (!prepare_destination(op, job)) {
+                job->state = JOB_DONE;
+                results[next] = FALSE;
+                ui_error(op, "Unable to install '%s' (%s).", job->dst,
+                         strerror(job->error ? job->error : EIO));
+                next++;
+                done++;
+                i--;
+                continue;
+            }
+
+            if (!buffers[i]) {
+                buffers[i] = nvalloc(COPY_CHUNK_SIZE);
+            }
+            job->buf = buffers[i];
+            slot_owner[i] = next;
+
+            queue_open(&ring, job, next);
+            next++;
+            in_flight++;
+        }
+
+        if (in_flight == 0) {
+            continue;
+        }
+
+        if (!ring_submit_and_wait(&ring)) {
+            ui_error(op, "io_uring_enter() failed (%s).", strerror(errno));
+            break;
+        }
+
+        /* reap every available completion */
+
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+        while (head != tail) {
+            const struct io_uring_cqe *cqe =
+                &ring.cqes[head & *ring.cq_mask];
+            int index = cqe->user_data >> OP_BITS;
+
+            handle_completion(op, &ring, jobs, cqe);
+            head++;
+
+            if (jobs[index].state == JOB_DONE) {
+                Job *job = &jobs[index];
+
+                results[index] = !job->error;
+
+                if (job->error) {
+                    ui_error(op, "Unable to install '%s' as '%s' (%s).",
+                             job->src, job->dst, strerror(job->error));
+
+                    /* don't leave a partially copied file behind */
+                    if (job->dst_fd >= 0) {
+                        unlink(job->dst);
+                    }
+                }
+
+                for (i = 0; i < MAX_FILES_IN_FLIGHT; i++) {
+                    if (slot_owner[i] == index) {
+                        slot_owner[i] = -1;
+                    }
+                }
+
+                in_flight--;
+                done++;
+            }
+        }
+
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /*
+     * If the ring failed mid-batch, report any files that never finished;
+     * their descriptors are released when the ring is torn down below.
+     */
+    for (i = 0; i < n; i++) {
+        if (i >= next || jobs[i].state != JOB_DONE) {
+            results[i] = FALSE;
+        }
+    }
+
+    ring_destroy(&ring);
+
+    for (i = 0; i < MAX_FILES_IN_FLIGHT; i++) {
+        nvfree(buffers[i]);
+    }
+    nvfree(jobs);
+
+    return TRUE;
+}
+
+#else /* NV_HAVE_IO_URING */
+
+int io_uring_install_files(Options *op, int n, const char * const *srcs,
+                           const char * const *dsts, const mode_t *modes,
+                           int *results)
+{
+    ui_log(op, "nvidia-installer was built without io_uring support; "
+           "installing files synchronously.");
+    return FALSE;
+}
+
+#endif /* NV_HAVE_IO_URING */
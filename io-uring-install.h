@@ -0,0 +1,32 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_IO_URING_INSTALL_H__
+#define __NVIDIA_INSTALLER_IO_URING_INSTALL_H__
+
+#include "nvidia-installer.h"
+
+/* maximum number of files passed to a single io_uring_install_files() call */
+#define IO_URING_INSTALL_MAX_BATCH 256
+
+int io_uring_install_files(Options *op, int n, const char * const *srcs,
+                           const char * const *dsts, const mode_t *modes,
+                           int *results);
+
+#endif /* __NVIDIA_INSTALLER_IO_URING_INSTALL_H__ */
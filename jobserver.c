@@ -0,0 +1,650 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * jobserver.c - choose and adjust the number of parallel make(1) jobs
+ * based on the resources that are actually available to the installer.
+ *
+ * The initial concurrency level is derived from the number of online CPUs,
+ * the cgroup v2 cpu.max and memory.max/memory.current limits of the
+ * installer's cgroup and its ancestors, MemAvailable, the load average and
+ * PSI (/proc/pressure/{cpu,memory}).
+ *
+ * While make(1) runs, parallelism is controlled through a GNU make
+ * jobserver owned by the installer: make is started without -j, and with
+ * MAKEFLAGS pointing at a pipe pre-filled with one token per additional
+ * job. A monitor thread samples memory headroom and memory pressure once a
+ * second, and withholds tokens from the pipe when memory runs short, or
+ * returns them when it recovers.
+ *
+ * The jobserver pipe is close-on-exec, so that only make(1), started with
+ * jobserver_popen(), inherits it.
+ */
+
+#define _GNU_SOURCE // needed for pipe2
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "jobserver.h"
+#include "misc.h"
+#include "msg.h"
+
+#define CGROUP2_MOUNT_POINT "/sys/fs/cgroup"
+
+/*
+ * Rough peak resident memory of a single compiler job building the kernel
+ * modules; used to convert available memory into a number of jobs.
+ */
+#define JOB_MEMORY_ESTIMATE (384LL * 1024 * 1024)
+
+/* PSI "some avg10" percentages above which parallelism is reduced */
+#define MEMORY_PRESSURE_THRESHOLD 10.0
+#define CPU_PRESSURE_THRESHOLD    50.0
+
+#define MONITOR_INTERVAL_SECONDS 1
+
+typedef struct {
+    int cpus;
+    int cgroup_cpus;            /* 0 if cpu.max is unlimited or unknown */
+    long long mem_available;    /* bytes; -1 if unknown */
+    double load1;               /* -1 if unknown */
+    double cpu_pressure;        /* -1 if unknown */
+    double mem_pressure;        /* -1 if unknown */
+} ResourceSnapshot;
+
+struct __jobserver {
+    int read_fd;
+    int write_fd;
+    int nonblock_read_fd;
+    int max_jobs;
+    int limit;
+    char *makeflags;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int thread_running;
+    int stop;
+
+    /* decisions made by the monitor thread, logged by jobserver_stop() */
+    char *decisions;
+};
+
+
+static char *read_small_file(const char *path)
+{
+    char buf[4096];
+    ssize_t len;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (len < 0) {
+        return NULL;
+    }
+
+    buf[len] = '\0';
+
+    return nvstrdup(buf);
+}
+
+
+/*
+ * get_cgroup_path() - return the cgroup v2 directory of the installer, or
+ * NULL if it isn't using the unified hierarchy.
+ */
+
+static char *get_cgroup_path(void)
+{
+    char *contents = read_small_file("/proc/self/cgroup"), *line, *path = NULL;
+    char *saveptr;
+
+    if (!contents) {
+        return NULL;
+    }
+
+    for (line = strtok_r(contents, "\n", &saveptr); line;
+         line = strtok_r(NULL, "\n", &saveptr)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            path = nvdircat(CGROUP2_MOUNT_POINT, line + 3, NULL);
+            remove_trailing_slashes(path);
+            break;
+        }
+    }
+
+    nvfree(contents);
+
+    if (path && !directory_exists(path)) {
+        nvfree(path);
+        path = NULL;
+    }
+
+    return path;
+}
+
+
+static int read_cgroup_value(const char *dir, const char *file,
+                             long long *value)
+{
+    char *path = nvdircat(dir, file, NULL);
+    char *contents = read_small_file(path);
+    int ret = FALSE;
+
+    nvfree(path);
+
+    if (contents && strncmp(contents, "max", 3) != 0) {
+        ret = (sscanf(contents, "%lld", value) == 1);
+    }
+
+    nvfree(contents);
+
+    return ret;
+}
+
+
+/*
+ * read_cgroup_limits() - walk from the installer's cgroup up to the root of
+ * the hierarchy, since a limit set on any ancestor also applies. Report
+ * the smallest memory headroom and CPU quota found.
+ */
+
+static void read_cgroup_limits(ResourceSnapshot *s)
+{
+    char *dir = get_cgroup_path();
+
+    while (dir && strcmp(dir, CGROUP2_MOUNT_POINT) != 0) {
+        long long max, current;
+        char *cpu_max_path, *cpu_max, *parent;
+
+        if (read_cgroup_value(dir, "memory.max", &max) &&
+            read_cgroup_value(dir, "memory.current", &current)) {
+            long long headroom = max > current ? max - current : 0;
+
+            if (s->mem_available < 0 || headroom < s->mem_available) {
+                s->mem_available = headroom;
+            }
+        }
+
+        cpu_max_path = nvdircat(dir, "cpu.max", NULL);
+        cpu_max = read_small_file(cpu_max_path);
+        nvfree(cpu_max_path);
+
+        if (cpu_max) {
+            long long quota, period;
+
+            if (sscanf(cpu_max, "%lld %lld", &quota, &period) == 2 &&
+                quota > 0 && period > 0) {
+                int cpus = (quota + period - 1) / period;
+
+                if (s->cgroup_cpus == 0 || cpus < s->cgroup_cpus) {
+                    s->cgroup_cpus = cpus;
+                }
+            }
+            nvfree(cpu_max);
+        }
+
+        parent = nv_dirname(dir);
+        nvfree(dir);
+        dir = parent;
+    }
+
+    nvfree(dir);
+}
+
+
+static double read_pressure(const char *resource)
+{
+    char *path = nvstrcat("/proc/pressure/", resource, NULL);
+    char *contents = read_small_file(path);
+    double avg10 = -1;
+
+    nvfree(path);
+
+    if (contents) {
+        if (sscanf(contents, "some avg10=%lf", &avg10) != 1) {
+            avg10 = -1;
+        }
+        nvfree(contents);
+    }
+
+    return avg10;
+}
+
+
+static void read_resource_snapshot(ResourceSnapshot *s, int with_load)
+{
+    memset(s, 0, sizeof(*s));
+
+    s->cpus = 1;
+#if defined _SC_NPROCESSORS_ONLN
+    s->cpus = NV_MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+
+    s->mem_available = get_meminfo_bytes("MemAvailable");
+    read_cgroup_limits(s);
+
+    s->mem_pressure = read_pressure("memory");
+    s->cpu_pressure = read_pressure("cpu");
+
+    s->load1 = -1;
+
+    if (with_load) {
+        char *loadavg = read_small_file("/proc/loadavg");
+
+        if (loadavg) {
+            if (sscanf(loadavg, "%lf", &s->load1) != 1) {
+                s->load1 = -1;
+            }
+            nvfree(loadavg);
+        }
+    }
+}
+
+
+/*
+ * apply_limit() - lower *jobs to 'limit' if that is smaller, and note the
+ * reason in *reason.
+ */
+
+static void apply_limit(int *jobs, int limit, char **reason,
+                        const char *fmt, ...) NV_ATTRIBUTE_PRINTF(4, 5);
+
+static void apply_limit(int *jobs, int limit, char **reason,
+                        const char *fmt, ...)
+{
+    limit = NV_MAX(1, limit);
+
+    if (limit < *jobs) {
+        char *msg;
+
+        NV_VSNPRINTF(msg, fmt);
+        nv_append_sprintf(reason, "%s%s", (*reason)[0] ? "; " : "", msg);
+        nvfree(msg);
+
+        *jobs = limit;
+    }
+}
+
+
+static int jobs_for_resources(const ResourceSnapshot *s, int max_jobs,
+                              char **reason)
+{
+    int jobs = max_jobs;
+
+    if (s->cgroup_cpus > 0) {
+        apply_limit(&jobs, s->cgroup_cpus, reason,
+                    "cgroup cpu.max allows %d CPUs", s->cgroup_cpus);
+    }
+
+    if (s->load1 >= 0) {
+        int idle = s->cpus - (int) (s->load1 + 0.5);
+
+        apply_limit(&jobs, idle, reason, "load average %.2f on %d CPUs",
+                    s->load1, s->cpus);
+    }
+
+    if (s->mem_available >= 0) {
+        apply_limit(&jobs, s->mem_available / JOB_MEMORY_ESTIMATE, reason,
+                    "%lld MiB of memory available",
+                    s->mem_available / (1024 * 1024));
+    }
+
+    if (s->mem_pressure > MEMORY_PRESSURE_THRESHOLD) {
+        apply_limit(&jobs, jobs / 2, reason, "memory pressure %.2f%%",
+                    s->mem_pressure);
+    }
+
+    if (s->cpu_pressure > CPU_PRESSURE_THRESHOLD) {
+        apply_limit(&jobs, jobs / 2, reason, "CPU pressure %.2f%%",
+                    s->cpu_pressure);
+    }
+
+    return jobs;
+}
+
+
+/*
+ * get_resource_aware_concurrency() - return the number of parallel jobs,
+ * no greater than 'max_jobs', that the current system can sustain, logging
+ * the reasons for any reduction.
+ */
+
+int get_resource_aware_concurrency(Options *op, int max_jobs)
+{
+    ResourceSnapshot s;
+    char *reason = nvstrdup("");
+    int jobs;
+
+    read_resource_snapshot(&s, TRUE);
+    jobs = jobs_for_resources(&s, max_jobs, &reason);
+
+    if (jobs < max_jobs) {
+        ui_log(op, "Reducing concurrency level from %d to %d (%s).",
+               max_jobs, jobs, reason);
+    }
+
+    nvfree(reason);
+
+    return jobs;
+}
+
+
+static void record_decision(Jobserver *js, const char *fmt, ...)
+    NV_ATTRIBUTE_PRINTF(2, 3);
+
+static void record_decision(Jobserver *js, const char *fmt, ...)
+{
+    char *msg;
+
+    NV_VSNPRINTF(msg, fmt);
+    nv_append_sprintf(&js->decisions, "  %s\n", msg);
+    nvfree(msg);
+}
+
+
+/*
+ * adjust_tokens() - move the number of jobs make(1) may run towards
+ * 'target' by withholding tokens from, or returning tokens to, the pipe.
+ * make(1) always holds one implicit token, so a limit of N corresponds to
+ * N - 1 tokens in circulation. Withholding only succeeds for tokens which
+ * are currently idle in the pipe; tokens held by running jobs are
+ * reclaimed on later passes, as those jobs finish.
+ */
+
+static void adjust_tokens(Jobserver *js, int target, const char *reason)
+{
+    int old_limit = js->limit;
+
+    while (js->limit > target) {
+        char token;
+
+        if (read(js->nonblock_read_fd, &token, 1) != 1) {
+            break;
+        }
+        js->limit--;
+    }
+
+    while (js->limit < target) {
+        if (write(js->write_fd, "+", 1) != 1) {
+            break;
+        }
+        js->limit++;
+    }
+
+    if (js->limit != old_limit) {
+        record_decision(js, "%s: %d -> %d jobs", reason, old_limit,
+                        js->limit);
+    }
+}
+
+
+static void *monitor_thread(void *arg)
+{
+    Jobserver *js = arg;
+
+    pthread_mutex_lock(&js->lock);
+
+    while (!js->stop) {
+        struct timespec deadline;
+        ResourceSnapshot s;
+        int idle_tokens = 0, active, target;
+        char *reason = NULL;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += MONITOR_INTERVAL_SECONDS;
+        pthread_cond_timedwait(&js->cond, &js->lock, &deadline);
+
+        if (js->stop) {
+            break;
+        }
+
+        /*
+         * Only memory is considered here: CPU load and pressure are driven
+         * by the build itself, and would make the throttle chase its own
+         * tail. Memory headroom is what protects against OOM and swapping.
+         */
+        read_resource_snapshot(&s, FALSE);
+
+        if (ioctl(js->read_fd, FIONREAD, &idle_tokens) != 0) {
+            idle_tokens = 0;
+        }
+        active = NV_MAX(1, js->limit - idle_tokens);
+
+        if (s.mem_pressure > MEMORY_PRESSURE_THRESHOLD ||
+            (s.mem_available >= 0 &&
+             s.mem_available < JOB_MEMORY_ESTIMATE / 2)) {
+            target = NV_MAX(1, js->limit - 1);
+            reason = nvasprintf("memory low (%lld MiB available, pressure "
+                                "%.2f%%)", s.mem_available / (1024 * 1024),
+                                s.mem_pressure);
+        } else {
+            int headroom_jobs = s.mem_available >= 0 ?
+                s.mem_available / JOB_MEMORY_ESTIMATE : js->max_jobs;
+
+            /* ramp up one job at a time */
+            target = NV_MIN(js->max_jobs,
+                            NV_MIN(js->limit + 1, active + headroom_jobs));
+            target = NV_MAX(target, 1);
+            reason = nvasprintf("memory recovered (%lld MiB available)",
+                                s.mem_available / (1024 * 1024));
+        }
+
+        adjust_tokens(js, target, reason);
+        nvfree(reason);
+    }
+
+    pthread_mutex_unlock(&js->lock);
+
+    return NULL;
+}
+
+
+/*
+ * jobserver_start() - create a jobserver allowing up to 'max_jobs' parallel
+ * jobs, and start monitoring memory. Returns NULL if a jobserver could not
+ * be created, in which case the caller should fall back to passing -jN.
+ */
+
+Jobserver *jobserver_start(Options *op, int max_jobs)
+{
+    Jobserver *js;
+    int fds[2], i;
+    char *proc_path;
+
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        ui_log(op, "Unable to create a jobserver pipe (%s).", strerror(errno));
+        return NULL;
+    }
+
+    js = nvalloc(sizeof(*js));
+    js->read_fd = fds[0];
+    js->write_fd = fds[1];
+    js->max_jobs = max_jobs;
+    js->limit = 1;
+    js->decisions = nvstrdup("");
+
+    /*
+     * Reopen the read end through /proc to get an independent open file
+     * description that can be non-blocking, without changing the blocking
+     * behavior that make(1) expects of its own descriptor.
+     */
+    proc_path = nvasprintf("/proc/self/fd/%d", js->read_fd);
+    js->nonblock_read_fd = open(proc_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    nvfree(proc_path);
+
+    for (i = 1; i < max_jobs; i++) {
+        if (write(js->write_fd, "+", 1) == 1) {
+            js->limit++;
+        }
+    }
+
+    /* --jobserver-fds for make < 4.2, --jobserver-auth for newer */
+    js->makeflags = nvasprintf(" -j --jobserver-auth=%d,%d "
+                               "--jobserver-fds=%d,%d",
+                               js->read_fd, js->write_fd,
+                               js->read_fd, js->write_fd);
+
+    pthread_mutex_init(&js->lock, NULL);
+    pthread_cond_init(&js->cond, NULL);
+
+    if (js->nonblock_read_fd >= 0) {
+        js->thread_running =
+            (pthread_create(&js->thread, NULL, monitor_thread, js) == 0);
+    }
+
+    if (!js->thread_running) {
+        ui_log(op, "Unable to monitor memory during the build; the "
+               "concurrency level will not be adjusted dynamically.");
+    }
+
+    return js;
+}
+
+
+const char *jobserver_makeflags(const Jobserver *js)
+{
+    return js->makeflags;
+}
+
+
+/*
+ * jobserver_stop() - stop monitoring, log any adjustments that were made
+ * while the jobserver was running, and release its resources.
+ */
+
+void jobserver_stop(Options *op, Jobserver *js)
+{
+    if (!js) {
+        return;
+    }
+
+    if (js->thread_running) {
+        pthread_mutex_lock(&js->lock);
+        js->stop = TRUE;
+        pthread_cond_signal(&js->cond);
+        pthread_mutex_unlock(&js->lock);
+        pthread_join(js->thread, NULL);
+    }
+
+    if (js->decisions[0]) {
+        ui_log(op, "Adjusted the concurrency level during the build:\n%s",
+               js->decisions);
+    }
+
+    pthread_mutex_destroy(&js->lock);
+    pthread_cond_destroy(&js->cond);
+
+    if (js->nonblock_read_fd >= 0) {
+        close(js->nonblock_read_fd);
+    }
+    close(js->read_fd);
+    close(js->write_fd);
+
+    nvfree(js->makeflags);
+    nvfree(js->decisions);
+    nvfree(js);
+}
+
+
+/*
+ * jobserver_popen() - popen(cmd, "r"), except that the command inherits
+ * the jobserver pipe of 'js': the close-on-exec flag of the pipe is only
+ * cleared in the child, just before it runs 'cmd'. The stream must be
+ * closed with jobserver_pclose(), passing the 'pid' returned here.
+ */
+
+FILE *jobserver_popen(const Jobserver *js, const char *cmd, pid_t *pid)
+{
+    FILE *stream;
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return NULL;
+    }
+
+    *pid = fork();
+
+    if (*pid == 0) {
+        /* only async-signal-safe calls until exec */
+
+        if (dup2(fds[1], STDOUT_FILENO) < 0 ||
+            fcntl(js->read_fd, F_SETFD, 0) != 0 ||
+            fcntl(js->write_fd, F_SETFD, 0) != 0) {
+            _exit(127);
+        }
+
+        execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+
+    if (*pid < 0 || (stream = fdopen(fds[0], "r")) == NULL) {
+        int saved_errno = errno;
+
+        close(fds[0]);
+        if (*pid > 0) {
+            waitpid(*pid, NULL, 0);
+        }
+        errno = saved_errno;
+        return NULL;
+    }
+
+    return stream;
+}
+
+
+/*
+ * jobserver_pclose() - pclose() for a stream from jobserver_popen(): close
+ * it, and return the wait status of the command, or -1 on error.
+ */
+
+int jobserver_pclose(FILE *stream, pid_t pid)
+{
+    int status;
+
+    fclose(stream);
+
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+
+    return status;
+}
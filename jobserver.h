@@ -0,0 +1,38 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_JOBSERVER_H__
+#define __NVIDIA_INSTALLER_JOBSERVER_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "nvidia-installer.h"
+
+typedef struct __jobserver Jobserver;
+
+int get_resource_aware_concurrency(Options *op, int max_jobs);
+
+Jobserver *jobserver_start(Options *op, int max_jobs);
+const char *jobserver_makeflags(const Jobserver *js);
+void jobserver_stop(Options *op, Jobserver *js);
+FILE *jobserver_popen(const Jobserver *js, const char *cmd, pid_t *pid);
+int jobserver_pclose(FILE *stream, pid_t pid);
+
+#endif /* __NVIDIA_INSTALLER_JOBSERVER_H__ */
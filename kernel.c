@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <fts.h>
 #include <syscall.h>
+#include <pthread.h>
 
 #include "nvidia-installer.h"
 #include "kernel.h"
@@ -40,7 +41,12 @@
 #include "misc.h"
 #include "precompiled.h"
 #include "crc.h"
+#include "digest.h"
 #include "conflicting-kernel-modules.h"
+#include "build-service.h"
+#include "jobserver.h"
+#include "timing-history.h"
+#include "probes.h"
 
 /* local prototypes */
 
@@ -62,10 +68,14 @@ static int run_conftest(Options *op, const char *dir, const char *args,
 static int run_make(Options *op, Package *p, const char *dir,
                     const char *cli_options, const char *status,
                     const RunCommandOutputMatch *match);
+static char *make_command(Options *op, const Package *p, const char *dir,
+                          const Jobserver *js, int jobs,
+                          const char *cli_options);
 static void load_kernel_module_quiet(Options *op, const char *module_name);
 static void modprobe_remove_kernel_module_quiet(Options *op, const char *name);
 static int kernel_configuration_conflict(Options *op, Package *p,
                                          int target_system_checks);
+static void find_module_signing_tools(Options *op, const char *build_directory);
 
 /*
  * Message text that is used by several error messages.
@@ -408,41 +418,98 @@ int determine_kernel_output_path(Options *op)
 
 
 /*
- * attach_signature() - If we have a detached signature, verify the checksum of
- * the linked module and append the signature.
+ * The outcomes of append_detached_signature().
  */
-static int attach_signature(Options *op, Package *p,
-                            const PrecompiledFileInfo *fileInfo,
-                            const char *module_name) {
-    uint32 actual_crc;
-    char *module_path;
-    int ret = FALSE, command_ret;
+enum {
+    ATTACH_SIGNED = 0,
+    ATTACH_WRITE_FAILED,
+    ATTACH_OPEN_FAILED,
+    ATTACH_CHECKSUM_MISMATCH,
+};
 
-    const char *choices[2] = {
-        "Install unsigned kernel module",
-        "Abort installation"
-    };
+
+/*
+ * append_detached_signature() - verify the checksum of the linked module and
+ * append the detached signature to it. Returns one of the ATTACH_* values;
+ * on ATTACH_CHECKSUM_MISMATCH, '*actual' and '*expected' are set to the
+ * checksums, formatted as strings, which the caller should free. This never
+ * prompts, so it may be called from a worker thread.
+ */
+static int append_detached_signature(Options *op, Package *p,
+                                     const PrecompiledFileInfo *fileInfo,
+                                     const char *module_name,
+                                     char **actual, char **expected)
+{
+    uint32 actual_crc = 0;
+    char *module_path;
+    int ret, command_ret;
 
     ui_log(op, "Attaching module signature to linked kernel module.");
 
     module_path = nvstrcat(p->kernel_module_build_directory, "/",
                            fileInfo->target_directory, "/", module_name, NULL);
 
-    command_ret = verify_crc(op, module_path, fileInfo->linked_module_crc,
-                             &actual_crc);
+    *actual = NULL;
+
+    /* prefer the stronger digest, when the package has one */
+
+    if (fileInfo->attributes & PRECOMPILED_ATTR(DIGEST)) {
+        command_ret = verify_digest(op, module_path,
+                                    &fileInfo->linked_module_digest, actual);
+        *expected = digest_to_string(&fileInfo->linked_module_digest);
+    } else {
+        command_ret = verify_crc(op, module_path, fileInfo->linked_module_crc,
+                                 &actual_crc);
+        *actual = nvasprintf("%u", actual_crc);
+        *expected = nvasprintf("%u", fileInfo->linked_module_crc);
+    }
 
     if (command_ret) {
         FILE *module_file;
 
         module_file = fopen(module_path, "a+");
+        ret = ATTACH_OPEN_FAILED;
 
         if (module_file && fileInfo->signature_size) {
             command_ret = fwrite(fileInfo->signature, 1,
                                  fileInfo->signature_size, module_file);
-            if (command_ret == fileInfo->signature_size) {
-                op->kernel_module_signed = ret = !ferror(module_file);
-            }
-        } else {
+            ret = (command_ret == fileInfo->signature_size &&
+                   !ferror(module_file)) ? ATTACH_SIGNED : ATTACH_WRITE_FAILED;
+        }
+
+        if (module_file) {
+            fclose(module_file);
+        }
+    } else {
+        ret = ATTACH_CHECKSUM_MISMATCH;
+    }
+
+    nvfree(module_path);
+    return ret;
+}
+
+
+/*
+ * resolve_attached_signature() - report the outcome of
+ * append_detached_signature(), asking the user whether to continue with an
+ * unsigned kernel module if the signature could not be attached. Returns
+ * TRUE if the installation should continue.
+ */
+static int resolve_attached_signature(Options *op, int attach_ret,
+                                      const char *actual, const char *expected)
+{
+    int ret = FALSE;
+
+    const char *choices[2] = {
+        "Install unsigned kernel module",
+        "Abort installation"
+    };
+
+    switch (attach_ret) {
+        case ATTACH_SIGNED:
+            op->kernel_module_signed = ret = TRUE;
+            break;
+        case ATTACH_OPEN_FAILED:
             ret = (ui_multiple_choice(op, choices, 2, 1,
                                       "A detached signature was included with "
                                       "the precompiled interface, but opening "
@@ -451,26 +518,26 @@ static int attach_signature(Options *op, Package *p,
                                       "signature will not be added; would you "
                                       "still like to install the unsigned "
                                       "kernel module?") == 0);
-        }
-
-        if (module_file) {
-            fclose(module_file);
-        }
-    } else {
-        ret = (ui_multiple_choice(op, choices, 2, 1,
-                                  "A detached signature was included with the "
-                                  "precompiled interface, but the checksum of "
-                                  "the linked kernel module (%d) did not match "
-                                  "the checksum of the the kernel module for "
-                                  "which the detached signature was generated "
-                                  "(%d).\n\nThis can happen if the linker on "
-                                  "the installation target system is not the "
-                                  "same as the linker on the system that built "
-                                  "the precompiled interface.\n\nThe detached "
-                                  "signature will not be added; would you "
-                                  "still like to install the unsigned kernel "
-                                  "module?", actual_crc,
-                                  fileInfo->linked_module_crc) == 0);
+            break;
+        case ATTACH_CHECKSUM_MISMATCH:
+            ret = (ui_multiple_choice(op, choices, 2, 1,
+                                      "A detached signature was included with "
+                                      "the precompiled interface, but the "
+                                      "checksum of the linked kernel module "
+                                      "(%s) did not match the checksum of the "
+                                      "the kernel module for which the "
+                                      "detached signature was generated "
+                                      "(%s).\n\nThis can happen if the linker "
+                                      "on the installation target system is "
+                                      "not the same as the linker on the "
+                                      "system that built the precompiled "
+                                      "interface.\n\nThe detached signature "
+                                      "will not be added; would you still "
+                                      "like to install the unsigned kernel "
+                                      "module?", actual, expected) == 0);
+            break;
+        default:
+            break;
     }
 
     if (ret) {
@@ -483,27 +550,49 @@ static int attach_signature(Options *op, Package *p,
         ui_error(op, "Failed to attach signature.");
     }
 
-    nvfree(module_path);
+    return ret;
+}
+
+
+/*
+ * attach_signature() - If we have a detached signature, verify the checksum of
+ * the linked module and append the signature.
+ */
+static int attach_signature(Options *op, Package *p,
+                            const PrecompiledFileInfo *fileInfo,
+                            const char *module_name) {
+    char *actual, *expected;
+    int ret;
+
+    ret = append_detached_signature(op, p, fileInfo, module_name,
+                                    &actual, &expected);
+    ret = resolve_attached_signature(op, ret, actual, expected);
+
+    nvfree(actual);
+    nvfree(expected);
     return ret;
 } /* attach_signature() */
 
 
+static int has_detached_signature(const PrecompiledFileInfo *fileInfo)
+{
+    uint32 attrmask = PRECOMPILED_ATTR(DETACHED_SIGNATURE) |
+                      PRECOMPILED_ATTR(LINKED_MODULE_CRC);
+
+    return (fileInfo->attributes & attrmask) == attrmask;
+}
+
+
 /*
- * unpack_kernel_modules() - unpack the precompiled file bundle, and link any
- * prebuilt kernel interface against their respective binary-only core object
- * files. This results in a complete kernel module, ready for installation.
- *
- * e.g.: ld -r -o nvidia.ko nv-linux.o nvidia/nv-kernel.o_binary
- *
- * If the precompiled file is a complete kernel module instead of an interface
- * file, no additional action is needed after unpacking.
+ * link_precompiled_file() - unpack the precompiled file, and if it is a
+ * kernel interface, link it against its binary-only core object file. This
+ * never prompts, so it may be called from a worker thread.
  */
 
-int unpack_kernel_modules(Options *op, Package *p, const char *build_directory,
-                          const PrecompiledFileInfo *fileInfo)
+static int link_precompiled_file(Options *op, const char *build_directory,
+                                 const PrecompiledFileInfo *fileInfo)
 {
     int ret;
-    uint32 attrmask;
 
     if (fileInfo->type != PRECOMPILED_FILE_TYPE_INTERFACE &&
         fileInfo->type != PRECOMPILED_FILE_TYPE_MODULE) {
@@ -536,10 +625,30 @@ int unpack_kernel_modules(Options *op, Package *p, const char *build_directory,
 
     ui_log(op, "Kernel module linked successfully.");
 
-    attrmask = PRECOMPILED_ATTR(DETACHED_SIGNATURE) |
-               PRECOMPILED_ATTR(LINKED_MODULE_CRC);
+    return TRUE;
+}
+
+
+/*
+ * unpack_kernel_modules() - unpack the precompiled file bundle, and link any
+ * prebuilt kernel interface against their respective binary-only core object
+ * files. This results in a complete kernel module, ready for installation.
+ *
+ * e.g.: ld -r -o nvidia.ko nv-linux.o nvidia/nv-kernel.o_binary
+ *
+ * If the precompiled file is a complete kernel module instead of an interface
+ * file, no additional action is needed after unpacking.
+ */
 
-    if ((fileInfo->attributes & attrmask) == attrmask) {
+int unpack_kernel_modules(Options *op, Package *p, const char *build_directory,
+                          const PrecompiledFileInfo *fileInfo)
+{
+    if (!link_precompiled_file(op, build_directory, fileInfo)) {
+        return FALSE;
+    }
+
+    if (fileInfo->type == PRECOMPILED_FILE_TYPE_INTERFACE &&
+        has_detached_signature(fileInfo)) {
         return attach_signature(op, p, fileInfo,
                                 fileInfo->linked_module_name);
     }
@@ -548,19 +657,283 @@ int unpack_kernel_modules(Options *op, Package *p, const char *build_directory,
    
 }
 
+
+/*
+ * The stages that each precompiled file goes through in
+ * link_precompiled_kernel_modules().
+ */
+enum {
+    LINK_STAGE_LINK = 0,     /* unpack, and link interfaces */
+    LINK_STAGE_SIGNATURE,    /* verify and attach a detached signature,
+                              * or sign the linked module */
+    NUM_LINK_STAGES
+};
+
+static const char * const link_stage_names[NUM_LINK_STAGES] = {
+    [LINK_STAGE_LINK] = "link",
+    [LINK_STAGE_SIGNATURE] = "signature",
+};
+
+/* the most worker threads used by link_precompiled_kernel_modules() */
+#define MAX_LINK_WORKERS 4
+
+typedef struct {
+    const PrecompiledFileInfo *fileInfo;
+    const char *module_filename;
+
+    int ret;
+    int attach_ret;            /* -1 if no detached signature was attached */
+    char *actual, *expected;
+    double seconds[NUM_LINK_STAGES];
+    UiWorkerMessages *messages;
+} LinkJob;
+
+typedef struct {
+    Options *op;
+    Package *p;
+    LinkJob *jobs;
+    int num_jobs;
+    int next_job;
+    int sign;
+    UiProgress progress;
+} LinkPipeline;
+
+
+static double link_seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+static void run_link_job(LinkPipeline *pl, LinkJob *job)
+{
+    Options *op = pl->op;
+    Package *p = pl->p;
+    const PrecompiledFileInfo *fileInfo = job->fileInfo;
+    struct timespec start;
+
+    job->attach_ret = -1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    job->ret = link_precompiled_file(op, p->kernel_module_build_directory,
+                                     fileInfo);
+    job->seconds[LINK_STAGE_LINK] = link_seconds_since(&start);
+    ui_progress_advance(op, &pl->progress, 1);
+
+    if (!job->ret) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (fileInfo->type == PRECOMPILED_FILE_TYPE_INTERFACE &&
+        has_detached_signature(fileInfo)) {
+        job->attach_ret = append_detached_signature(op, p, fileInfo,
+                                                    job->module_filename,
+                                                    &job->actual,
+                                                    &job->expected);
+    } else if (pl->sign) {
+        job->ret = sign_kernel_module(op, p->kernel_module_build_directory,
+                                      job->module_filename, FALSE);
+    }
+
+    job->seconds[LINK_STAGE_SIGNATURE] = link_seconds_since(&start);
+    ui_progress_advance(op, &pl->progress, 1);
+}
+
+
+static void *link_worker(void *arg)
+{
+    LinkPipeline *pl = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&pl->next_job, 1, __ATOMIC_SEQ_CST)) <
+           pl->num_jobs) {
+        ui_worker_begin();
+        run_link_job(pl, &pl->jobs[i]);
+        pl->jobs[i].messages = ui_worker_end();
+    }
+
+    return NULL;
+}
+
+
+/*
+ * link_precompiled_kernel_modules() - unpack and link all of the files in a
+ * precompiled package, and attach their detached signatures or, if signing
+ * keys were given and the kernel modules would be signed anyway, sign them.
+ *
+ * Each file goes through these stages on one of a small pool of worker
+ * threads, so that the stages of different files overlap. The messages
+ * from each file, and any questions about signatures that could not be
+ * attached, are then handled in the order of the package, along with the
+ * time spent in each stage. The kernel modules are test loaded afterwards
+ * by test_kernel_modules(), in the order of the manifest, as before.
+ */
+
+int link_precompiled_kernel_modules(Options *op, Package *p,
+                                    const PrecompiledInfo *info)
+{
+    LinkPipeline pl;
+    pthread_t threads[MAX_LINK_WORKERS];
+    int started[MAX_LINK_WORKERS];
+    double totals[NUM_LINK_STAGES] = { 0 };
+    int num_workers, any_detached = FALSE, ret = TRUE, i, s;
+
+    if (info->num_files == 0) {
+        return TRUE;
+    }
+
+    memset(&pl, 0, sizeof(pl));
+    pl.op = op;
+    pl.p = p;
+    pl.num_jobs = info->num_files;
+    pl.jobs = nvalloc(sizeof(LinkJob) * info->num_files);
+
+    for (i = 0; i < info->num_files; i++) {
+        const PrecompiledFileInfo *fileInfo = &info->files[i];
+
+        pl.jobs[i].fileInfo = fileInfo;
+        pl.jobs[i].module_filename =
+            fileInfo->type == PRECOMPILED_FILE_TYPE_INTERFACE ?
+                fileInfo->linked_module_name : fileInfo->name;
+
+        if (fileInfo->type == PRECOMPILED_FILE_TYPE_INTERFACE &&
+            has_detached_signature(fileInfo)) {
+            any_detached = TRUE;
+        }
+    }
+
+    /*
+     * Sign in the pipeline only where assisted_module_signing() would sign
+     * without asking: signing keys were given, there are no detached
+     * signatures, and the kernel configuration can be tested. The signing
+     * tools are looked up here, before any worker threads start.
+     */
+
+    if (!any_detached &&
+        op->module_signing_secret_key && op->module_signing_public_key &&
+        test_kernel_config_option(op, p, "CONFIG_DUMMY_OPTION") !=
+            KERNEL_CONFIG_OPTION_UNKNOWN) {
+        find_module_signing_tools(op, p->kernel_module_build_directory);
+        pl.sign = op->module_signing_script && op->module_signing_hash;
+    }
+
+    num_workers = NV_MAX(1, NV_MIN(NV_MIN(op->concurrency_level,
+                                          MAX_LINK_WORKERS),
+                                   info->num_files));
+
+    ui_progress_begin(&pl.progress, info->num_files * NUM_LINK_STAGES);
+    ui_status_begin(op, "Linking precompiled kernel modules:",
+                    pl.sign ? "Linking and signing" : "Linking");
+
+    /* as in run_command(), make sure the locale doesn't alter the output */
+
+    unsetenv("LANG");
+    unsetenv("LC_ALL");
+
+    for (i = 0; i < num_workers; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, link_worker,
+                                     &pl) == 0);
+    }
+
+    /*
+     * this thread takes jobs too, so the work still gets done if no worker
+     * thread could be started
+     */
+
+    link_worker(&pl);
+
+    for (i = 0; i < num_workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    ui_status_end(op, "done.");
+
+    for (i = 0; i < info->num_files; i++) {
+        LinkJob *job = &pl.jobs[i];
+
+        ui_worker_flush(op, job->messages);
+
+        if (ret && job->ret && job->attach_ret >= 0) {
+            job->ret = resolve_attached_signature(op, job->attach_ret,
+                                                  job->actual, job->expected);
+        }
+
+        ret = ret && job->ret;
+
+        ui_log(op, "%s: %s %.2fs, %s %.2fs.", job->module_filename,
+               link_stage_names[LINK_STAGE_LINK],
+               job->seconds[LINK_STAGE_LINK],
+               link_stage_names[LINK_STAGE_SIGNATURE],
+               job->seconds[LINK_STAGE_SIGNATURE]);
+
+        for (s = 0; s < NUM_LINK_STAGES; s++) {
+            totals[s] += job->seconds[s];
+        }
+
+        nvfree(job->actual);
+        nvfree(job->expected);
+    }
+
+    ui_log(op, "Processed %d precompiled files on %d threads; total time "
+           "in each stage: %s %.2fs, %s %.2fs.", info->num_files, num_workers,
+           link_stage_names[LINK_STAGE_LINK], totals[LINK_STAGE_LINK],
+           link_stage_names[LINK_STAGE_SIGNATURE],
+           totals[LINK_STAGE_SIGNATURE]);
+
+    if (ret && pl.sign) {
+        op->kernel_module_signed = TRUE;
+    }
+
+    nvfree(pl.jobs);
+
+    return ret;
+}
+
 /*
  * Estimate the number of expected lines of output that will be produced by
  * building the kernel modules. single_module may be set to restrict the
- * estimate to the result of building the specified module only.
+ * estimate to the result of building the specified module only. If the
+ * timing history has a line count from an earlier run of this build step,
+ * that is used instead.
  */
 static RunCommandOutputMatch *count_lines(Options *op, Package *p,
                                           const char *dir,
-                                          const char *single_module)
+                                          const char *single_module,
+                                          const TimingPhase *timing)
 {
     RunCommandOutputMatch *ret = nvalloc(sizeof(*ret) * 5);
     int conftest_count, object_count, module_count, count_success = FALSE;
+    int expected_lines = timing_phase_expected_lines(timing);
     char *data = NULL;
 
+    /*
+     * If this build step has been timed before, reuse the number of lines
+     * of output that it produced then, rather than running make(1) again to
+     * estimate it: only the total matters to run_command(), so give each
+     * pattern a single line and the first one the remainder.
+     */
+
+    if (expected_lines > 0) {
+        ret[0].lines = NV_MAX(expected_lines - 3, 1);
+        ret[0].initial_match = "make[";
+        ret[1].lines = 1;
+        ret[1].initial_match = "  CC ";
+        ret[2].lines = 1;
+        ret[2].initial_match = "  LD [M] ";
+        ret[3].lines = 1;
+        ret[3].initial_match = " CONFTEST: ";
+        return ret;
+    }
+
     /*
      * Build the make(1) command line. run_make() is explicitly avoided here:
      * the output from count-lines.mk shouldn't be logged or displayed.
@@ -636,22 +1009,31 @@ static int check_file(Options *op, Package *p, const char *dir,
     path = nvstrcat(dir, "/", modname, ".ko", NULL);
     ret = access(path, F_OK);
 
-    if (ret == -1) {
+    /*
+     * The build service has already attempted its own single-module
+     * rebuilds; don't fall back to building locally.
+     */
+    if (ret == -1 && !op->build_service_socket) {
         char *single_module_list = nvstrcat("NV_KERNEL_MODULES=\"", modname,
                                             "\"", NULL);
         char *rebuild_msg = nvstrcat("Checking to see whether the ", modname,
                                      " kernel module was successfully built",
                                      NULL);
-        RunCommandOutputMatch *match = count_lines(op, p, dir, modname);
+        char *phase = nvstrcat("rebuild-", modname, NULL);
+        TimingPhase *timing = timing_phase_begin(op, p, phase);
+        RunCommandOutputMatch *match = count_lines(op, p, dir, modname,
+                                                   timing);
         /* Attempt to rebuild the individual module, in case the failure
          * is module-specific and due to a different module */
         run_make(op, p, dir, single_module_list, rebuild_msg, match);
         nvfree(single_module_list);
         nvfree(rebuild_msg);
         nvfree(match);
+        nvfree(phase);
 
         /* Check the file again */
         ret = access(path, F_OK);
+        timing_phase_end(op, timing, ret != -1);
     }
 
     nvfree(path);
@@ -695,10 +1077,34 @@ static char *test_sign_file(const char *dir)
 
 
 
+/*
+ * find_module_signing_tools() - lazily set the default values for
+ * op->module_signing_script and op->module_signing_hash; either may still
+ * be NULL afterwards, if it could not be found.
+ */
+static void find_module_signing_tools(Options *op, const char *build_directory)
+{
+    if (!op->module_signing_script) {
+        op->module_signing_script = test_sign_file(op->kernel_output_path);
+        if (!op->module_signing_script) {
+            op->module_signing_script = test_sign_file(op->kernel_source_path);
+        }
+    }
+
+    if (op->module_signing_script && !op->module_signing_hash) {
+        op->module_signing_hash = guess_module_signing_hash(op,
+                                                            build_directory);
+    }
+}
+
+
+
 /*
  * sign_kernel_module() - sign a kernel module. The caller is responsible
  * for ensuring that the kernel module is already built successfully and that
- * op->module_signing_{secret,public}_key are set.
+ * op->module_signing_{secret,public}_key are set. If 'status' is FALSE, this
+ * may be called from a worker thread, once find_module_signing_tools() has
+ * been called on the main thread.
  */
 int sign_kernel_module(Options *op, const char *build_directory, 
                        const char *module_filename, int status) {
@@ -708,14 +1114,7 @@ int sign_kernel_module(Options *op, const char *build_directory,
     };
     int success;
 
-    /* Lazily set the default value for module_signing_script. */
-
-    if (!op->module_signing_script) {
-        op->module_signing_script = test_sign_file(op->kernel_output_path);
-        if (!op->module_signing_script) {
-            op->module_signing_script = test_sign_file(op->kernel_source_path);
-        }
-    }
+    find_module_signing_tools(op, build_directory);
 
     if (!op->module_signing_script) {
         ui_error(op, "nvidia-installer cannot sign %s without the `sign-file` "
@@ -730,11 +1129,6 @@ int sign_kernel_module(Options *op, const char *build_directory,
         ui_status_begin(op, "Signing kernel module:", "Signing");
     }
 
-    if (!op->module_signing_hash) {
-        op->module_signing_hash = guess_module_signing_hash(op,
-                                                            build_directory);
-    }
-
     if (!op->module_signing_hash) {
         ui_error(op, "The installer cannot sign %s without specifying a hash "
                  "algorithm on the command line to %s, and was also unable to "
@@ -744,7 +1138,7 @@ int sign_kernel_module(Options *op, const char *build_directory,
                  "line.", module_filename, op->module_signing_script);
     }
 
-    success = (run_command(op, NULL, TRUE, output_match, TRUE,
+    success = (run_command(op, NULL, TRUE, status ? output_match : NULL, TRUE,
                            "\"", op->module_signing_script, "\" ",
                            op->module_signing_hash, " \"",
                            op->module_signing_secret_key, "\" \"",
@@ -802,6 +1196,18 @@ static int create_detached_signature(Options *op, Package *p,
     fileInfo->linked_module_crc = compute_crc(op, module_path);
     fileInfo->attributes |= PRECOMPILED_ATTR(LINKED_MODULE_CRC);
 
+    if (op->digest_algorithm != DIGEST_CRC32) {
+        compute_digest_from_buffer(op->digest_algorithm, fileInfo->data,
+                                   fileInfo->size, &fileInfo->digest);
+        if (!compute_digest(op, op->digest_algorithm, module_path,
+                            &fileInfo->linked_module_digest)) {
+            ret = FALSE;
+            error = "Unable to compute the linked module digest.";
+            goto done;
+        }
+        fileInfo->attributes |= PRECOMPILED_ATTR(DIGEST);
+    }
+
     ui_status_update(op, .50, "Signing linked module");
 
     ret = sign_kernel_module(op, target_dir, module_filename, FALSE);
@@ -868,57 +1274,533 @@ static int pack_kernel_interface(Options *op, Package *p,
                 return FALSE;
             }
         }
-        return TRUE;
-    }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+static void handle_optional_module_failure(Options *op,
+                                           KernelModuleInfo module,
+                                           const char *action) {
+    if (module.is_optional) {
+        ui_error(op, "The %s kernel module failed to %s. This kernel module "
+                 "is required for the proper operation of %s. If you do not "
+                 "need to use %s, you can try to install this driver package "
+                 "again with the '--%s' option.",
+                 module.module_name, action, module.optional_module_dependee,
+                 module.optional_module_dependee, module.disable_option);
+    }
+}
+
+
+static int pack_kernel_module(Options *op,
+                              const char *build_dir,
+                              PrecompiledFileInfo *fileInfo,
+                              const char *module_filename)
+{
+    int command_ret;
+    char *file_path = nvstrcat(build_dir, "/", module_filename, NULL);
+
+    if (op->module_signing_secret_key && op->module_signing_public_key) {
+        if (sign_kernel_module(op, build_dir, module_filename, FALSE)) {
+            fileInfo->attributes |= PRECOMPILED_ATTR(EMBEDDED_SIGNATURE);
+        } else {
+            ui_error(op, "Failed to sign precompiled kernel module %s!",
+                     module_filename);
+            return FALSE;
+        }
+    }
+
+    command_ret = precompiled_read_module(fileInfo, file_path, "");
+
+    nvfree(file_path);
+
+    if (command_ret) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+
+
+/*
+ * copy_to_build_tmpdir() - create a temporary directory and copy the kernel
+ * module sources from 'srcdir' into it. Return the new directory, or NULL
+ * on error.
+ */
+
+static char *copy_to_build_tmpdir(Options *op, const char *srcdir)
+{
+    char *tmpdir = make_tmpdir(op);
+
+    if (!tmpdir) {
+        ui_error(op, "Unable to create a temporary build directory.");
+        return NULL;
+    }
+
+    ui_log(op, "Copying kernel module sources to temporary directory.");
+
+    if (!copy_directory_contents(op, srcdir, tmpdir)) {
+        ui_error(op, "Unable to copy the kernel module sources to temporary "
+                 "directory '%s'.", tmpdir);
+        remove_directory(op, tmpdir);
+        nvfree(tmpdir);
+        return NULL;
+    }
+
+    return tmpdir;
+}
+
+
+static int run_sanity_checks(Options *op, const char *builddir)
+{
+    int i;
+
+    struct {
+        const char *sanity_check_name;
+        const char *conftest_name;
+    } sanity_checks[] = {
+        { "Compiler", "cc_sanity_check" },
+        { "Dom0", "dom0_sanity_check" },
+        { "Xen", "xen_sanity_check" },
+        { "PREEMPT_RT", "preempt_rt_sanity_check" },
+        { "vgpu_kvm", "vgpu_kvm_sanity_check" },
+    };
+
+    for (i = 0; i < ARRAY_LEN(sanity_checks); i++) {
+        if (!conftest_sanity_check(op, builddir,
+                                   sanity_checks[i].sanity_check_name,
+                                   sanity_checks[i].conftest_name)) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * A make(1) invocation which runs on a worker thread alongside others; see
+ * run_makes_concurrently().
+ */
+
+typedef struct {
+    Options *op;
+    const char *name;          /* what is being built, for messages */
+    char *dir;                 /* the directory in which to run make */
+    char *cli_options;
+    RunCommandOutputMatch *match;
+    UiProgress *progress;
+    const Jobserver *js;
+    char *cmd;
+    char *output;
+    int ret;
+    UiWorkerMessages *messages;
+    pthread_t thread;
+    int thread_started;
+} ConcurrentMake;
+
+
+/*
+ * concurrent_make_worker() - run make(1) for one ConcurrentMake, capturing
+ * its output, and advancing the shared progress indicator for each line of
+ * output that matches the expected output of the build.
+ */
+
+static void *concurrent_make_worker(void *arg)
+{
+    ConcurrentMake *m = arg;
+    Options *op = m->op;
+    FILE *stream;
+    char *line;
+    size_t len = 0, size = 0;
+    pid_t pid = 0;
+    int eof = FALSE;
+
+    ui_worker_begin();
+
+    NV_PROBE2(run_make__start, m->dir, m->cli_options);
+
+    stream = m->js ? jobserver_popen(m->js, m->cmd, &pid) :
+                     popen(m->cmd, "r");
+
+    if (stream == NULL) {
+        ui_error(op, "Failure executing command '%s' (%s).",
+                 m->cmd, strerror(errno));
+        m->messages = ui_worker_end();
+        return NULL;
+    }
+
+    while (!eof && (line = fget_next_line(stream, &eof)) != NULL) {
+        size_t line_len = strlen(line);
+        int i;
+
+        for (i = 0; m->match && m->match[i].lines; i++) {
+            const char *s = m->match[i].initial_match;
+
+            if (s == NULL || strncmp(line, s, strlen(s)) == 0) {
+                ui_progress_advance(op, m->progress, 1);
+                break;
+            }
+        }
+
+        if (len + line_len + 2 > size) {
+            size = NV_MAX(size * 2, len + line_len + 2);
+            m->output = nvrealloc(m->output, size);
+        }
+
+        memcpy(m->output + len, line, line_len);
+        len += line_len;
+        m->output[len++] = '\n';
+        m->output[len] = '\0';
+
+        nvfree(line);
+    }
+
+    m->ret = ((m->js ? jobserver_pclose(stream, pid) : pclose(stream)) == 0);
+
+    NV_PROBE3(run_make__done, m->dir, m->cli_options, m->ret);
+
+    m->messages = ui_worker_end();
+
+    return NULL;
+}
+
+
+/*
+ * run_makes_concurrently() - run make(1) with each ConcurrentMake's
+ * cli_options in its directory, all at the same time, under a single
+ * ui_status progress bar driven by their 'match' records. With adaptive
+ * concurrency, the builds share one jobserver, so that together they stay
+ * within the concurrency level; otherwise, or if one can't be started, the
+ * concurrency level is divided between them.
+ *
+ * The messages and output of each build are reported, in order, once all
+ * of them have finished; the output is appended to p->kernel_make_logs.
+ * Returns TRUE if every build succeeded.
+ */
+
+static int run_makes_concurrently(Options *op, Package *p,
+                                  ConcurrentMake *makes, int num_makes,
+                                  const char *status)
+{
+    Jobserver *js;
+    UiProgress progress;
+    int total_lines = 0, jobs, ret = TRUE, i, j;
+
+    js = op->adaptive_concurrency ?
+         jobserver_start(op, op->concurrency_level) : NULL;
+    jobs = NV_MAX(1, op->concurrency_level / num_makes);
+
+    for (i = 0; i < num_makes; i++) {
+        ConcurrentMake *m = &makes[i];
+        char *cli_options = nvstrcat(m->cli_options ? m->cli_options : "",
+                                     " 2>&1", NULL);
+
+        m->op = op;
+        m->js = js;
+        m->progress = &progress;
+        m->cmd = make_command(op, p, m->dir, js, jobs, cli_options);
+        nvfree(cli_options);
+
+        for (j = 0; m->match && m->match[j].lines; j++) {
+            total_lines += m->match[j].lines;
+        }
+    }
+
+    ui_progress_begin(&progress, total_lines);
+    ui_status_begin(op, status, "");
+
+    /* as in run_command(), make sure the locale doesn't alter the output */
+
+    unsetenv("LANG");
+    unsetenv("LC_ALL");
+
+    for (i = 0; i < num_makes; i++) {
+        ui_command_output(op, "executing: '%s'...", makes[i].cmd);
+        makes[i].thread_started =
+            (pthread_create(&makes[i].thread, NULL, concurrent_make_worker,
+                            &makes[i]) == 0);
+
+        /* if a thread can't be started, build on this one */
+
+        if (!makes[i].thread_started) {
+            concurrent_make_worker(&makes[i]);
+        }
+    }
+
+    for (i = 0; i < num_makes; i++) {
+        if (makes[i].thread_started) {
+            pthread_join(makes[i].thread, NULL);
+        }
+        ret = ret && makes[i].ret;
+    }
+
+    jobserver_stop(op, js);
+
+    ui_status_end(op, ret ? "done." : "Error.");
+
+    for (i = 0; i < num_makes; i++) {
+        ConcurrentMake *m = &makes[i];
+        char *old_logs = p->kernel_make_logs;
+        const char *output = m->output ? m->output : "";
+
+        ui_worker_flush(op, m->messages);
+        m->messages = NULL;
+
+        if (!m->ret) {
+            ui_log(op, "The command `%s` for %s failed with the following "
+                   "output:\n\n%s", m->cmd, m->name, output);
+        }
+
+        p->kernel_make_logs = nvstrcat(old_logs ? old_logs : "", output,
+                                       NULL);
+        nvfree(old_logs);
+    }
+
+    return ret;
+}
+
+
+static void free_concurrent_make(ConcurrentMake *m)
+{
+    nvfree(m->cli_options);
+    nvfree(m->match);
+    nvfree(m->cmd);
+    nvfree(m->output);
+}
+
+
+/*
+ * copy_timestamps() - give each file below 'dst' the modification time of
+ * the file at the same path below 'src', so that make(1) considers a copy
+ * of a build directory to be exactly as up to date as the original.
+ */
+
+static void copy_timestamps(const char *src, const char *dst)
+{
+    char *paths[2] = { (char *) src, NULL };
+    size_t src_len = strlen(src);
+    FTS *fts;
+    FTSENT *ent;
+
+    fts = fts_open(paths, FTS_PHYSICAL, NULL);
+    if (!fts) return;
+
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info == FTS_F || ent->fts_info == FTS_DP) {
+            struct timespec times[2];
+            char *path = nvstrcat(dst, ent->fts_path + src_len, NULL);
+
+            times[0] = ent->fts_statp->st_atim;
+            times[1] = ent->fts_statp->st_mtim;
+            utimensat(AT_FDCWD, path, times, 0);
+            nvfree(path);
+        }
+    }
+
+    fts_close(fts);
+}
+
+
+/*
+ * isolate_failed_modules() - check that every kernel module was built in
+ * 'builddir'. A module can fail to build because of an error in a different
+ * one, so any module that is missing is rebuilt on its own; if it is then
+ * created, the build of that module is considered successful.
+ *
+ * A single missing module is rebuilt in place by check_file(). When several
+ * are missing, each is rebuilt in its own copy of the build directory, all
+ * at once; the copies keep the timestamps of the original, so that the
+ * conftest results of the main build are reused rather than regenerated.
+ * The failure of every module that still can't be built is reported,
+ * with its own build log, before returning FALSE.
+ */
+
+static int isolate_failed_modules(Options *op, Package *p,
+                                  const char *builddir)
+{
+    ConcurrentMake *makes;
+    int *missing, num_missing = 0, ret = TRUE, i;
+
+    missing = nvalloc(sizeof(int) * NV_MAX(p->num_kernel_modules, 1));
+
+    for (i = 0; i < p->num_kernel_modules; i++) {
+        char *path = nvstrcat(builddir, "/",
+                              p->kernel_modules[i].module_filename, NULL);
+
+        if (access(path, F_OK) != 0) {
+            missing[num_missing++] = i;
+        }
+        nvfree(path);
+    }
+
+    /*
+     * The build service has already attempted its own single-module
+     * rebuilds; don't fall back to building locally.
+     */
+    if (num_missing <= 1 || op->build_service_socket) {
+        for (i = 0; i < num_missing; i++) {
+            KernelModuleInfo *module = &p->kernel_modules[missing[i]];
+
+            if (!check_file(op, p, builddir, module->module_name)) {
+                handle_optional_module_failure(op, *module, "build");
+                ret = FALSE;
+            }
+        }
+
+        nvfree(missing);
+        return ret;
+    }
+
+    ui_log(op, "%d kernel modules were not built; rebuilding each of them "
+           "separately.", num_missing);
+
+    makes = nvalloc(sizeof(ConcurrentMake) * num_missing);
+
+    for (i = 0; i < num_missing; i++) {
+        ConcurrentMake *m = &makes[i];
+        const char *name = p->kernel_modules[missing[i]].module_name;
+
+        m->name = name;
+        m->dir = make_tmpdir(op);
+
+        if (!m->dir || !copy_directory_contents(op, builddir, m->dir)) {
+            ui_error(op, "Unable to create a directory in which to rebuild "
+                     "the %s kernel module.", name);
+            ret = FALSE;
+            goto done;
+        }
+
+        copy_timestamps(builddir, m->dir);
+
+        m->cli_options = nvstrcat("NV_KERNEL_MODULES=\"", name, "\"", NULL);
+        m->match = count_lines(op, p, m->dir, name, NULL);
+    }
+
+    run_makes_concurrently(op, p, makes, num_missing,
+                           "Checking which kernel modules failed to build");
+
+    /* report every failure, then bring back the modules that were built */
+
+    for (i = 0; i < num_missing; i++) {
+        KernelModuleInfo *module = &p->kernel_modules[missing[i]];
+        char *path = nvstrcat(makes[i].dir, "/", module->module_filename,
+                              NULL);
+
+        if (access(path, F_OK) != 0) {
+            ui_error(op, "The %s kernel module was not created.",
+                     module->module_name);
+            handle_optional_module_failure(op, *module, "build");
+            ret = FALSE;
+        } else {
+            char *dst = nvstrcat(builddir, "/", module->module_filename,
+                                 NULL);
+
+            ui_log(op, "The %s kernel module was built on its own.",
+                   module->module_name);
+
+            if (!copy_file(op, path, dst, 0644)) {
+                ret = FALSE;
+            }
+            nvfree(dst);
+        }
 
-    return FALSE;
-}
+        nvfree(path);
+    }
 
+done:
 
-static void handle_optional_module_failure(Options *op,
-                                           KernelModuleInfo module,
-                                           const char *action) {
-    if (module.is_optional) {
-        ui_error(op, "The %s kernel module failed to %s. This kernel module "
-                 "is required for the proper operation of %s. If you do not "
-                 "need to use %s, you can try to install this driver package "
-                 "again with the '--%s' option.",
-                 module.module_name, action, module.optional_module_dependee,
-                 module.optional_module_dependee, module.disable_option);
+    for (i = 0; i < num_missing; i++) {
+        if (makes[i].dir) {
+            remove_directory(op, makes[i].dir);
+            nvfree(makes[i].dir);
+        }
+        free_concurrent_make(&makes[i]);
     }
+
+    nvfree(makes);
+    nvfree(missing);
+
+    return ret;
 }
 
 
-static int pack_kernel_module(Options *op,
-                              const char *build_dir,
-                              PrecompiledFileInfo *fileInfo,
-                              const char *module_filename)
+/*
+ * check_and_pack_modules() - make sure that the build in 'builddir'
+ * produced every kernel module, and if fileInfos is non-NULL, store the
+ * precompiled files built from it in a newly allocated PrecompiledFileInfo
+ * array. 'build_ret' is the result of the build itself. Return the number
+ * of packaged files (or, if fileInfos is NULL, of built modules), or 0 on
+ * error.
+ */
+
+static int check_and_pack_modules(Options *op, Package *p,
+                                  const char *builddir, int build_ret,
+                                  PrecompiledFileInfo **fileInfos)
 {
-    int command_ret;
-    char *file_path = nvstrcat(build_dir, "/", module_filename, NULL);
+    int files_packaged;
 
-    if (op->module_signing_secret_key && op->module_signing_public_key) {
-        if (sign_kernel_module(op, build_dir, module_filename, FALSE)) {
-            fileInfo->attributes |= PRECOMPILED_ATTR(EMBEDDED_SIGNATURE);
-        } else {
-            ui_error(op, "Failed to sign precompiled kernel module %s!",
-                     module_filename);
-            return FALSE;
-        }
+    /* Test to make sure that all kernel modules were built. */
+    if (!isolate_failed_modules(op, p, builddir)) {
+        return 0;
     }
 
-    command_ret = precompiled_read_module(fileInfo, file_path, "");
+    /*
+     * Now check the status of the overall build: it may have failed, despite
+     * having produced all expected kernel modules.
+     */
+    if (!build_ret) {
+        return 0;
+    }
 
-    nvfree(file_path);
+    ui_log(op, "Kernel module compilation complete.");
 
-    if (command_ret) {
-        return TRUE;
+    /*
+     * If we're not building interfaces, return the number of built modules
+     * instead of the number of packaged interfaces.
+     */
+    if (fileInfos == NULL) {
+        /* If we've made it this far, all the modules were built. */
+        return p->num_kernel_modules;
     }
 
-    return FALSE;
-}
+    *fileInfos = nvalloc(sizeof(PrecompiledFileInfo) *
+        (p->num_kernel_modules + 1));
 
+    for (files_packaged = 0;
+         files_packaged < p->num_kernel_modules;
+         files_packaged++) {
+        PrecompiledFileInfo *fileInfo = *fileInfos + files_packaged;
+        KernelModuleInfo *module = p->kernel_modules + files_packaged;
+
+        if (module->has_separate_interface_file) {
+            if (!((op->build_service_socket ||
+                   run_make(op, p, builddir, module->interface_filename,
+                            NULL, NULL)) &&
+                pack_kernel_interface(op, p, builddir, fileInfo,
+                                      module->interface_filename,
+                                      module->module_filename,
+                                      module->core_object_name))) {
+                break;
+            }
+        } else if (!pack_kernel_module(op, builddir, fileInfo,
+                                       module->module_filename)) {
+                break;
+        }
+    }
 
+    if (files_packaged == 0) {
+        nvfree(*fileInfos);
+        *fileInfos = NULL;
+    }
+
+    return files_packaged;
+}
 
 
 /*
@@ -939,20 +1821,9 @@ int build_kernel_interfaces(Options *op, Package *p,
                             PrecompiledFileInfo ** fileInfos)
 {
     char *tmpdir = NULL, *builddir;
-    int ret, files_packaged = 0, i;
+    int ret, files_packaged = 0;
     RunCommandOutputMatch *match;
 
-    struct {
-        const char *sanity_check_name;
-        const char *conftest_name;
-    } sanity_checks[] = {
-        { "Compiler", "cc_sanity_check" },
-        { "Dom0", "dom0_sanity_check" },
-        { "Xen", "xen_sanity_check" },
-        { "PREEMPT_RT", "preempt_rt_sanity_check" },
-        { "vgpu_kvm", "vgpu_kvm_sanity_check" },
-    };
-
     /* do not build if there is a kernel configuration conflict (and don't
      * perform target system checks if we're only building interfaces) */
 
@@ -964,25 +1835,14 @@ int build_kernel_interfaces(Options *op, Package *p,
         *fileInfos = NULL;
     }
 
-    /* create a temporary directory if we will be packing interfaces */
+    /* copy the sources to a temporary directory if we will be packing
+     * interfaces */
 
     if (fileInfos) {
-        tmpdir = make_tmpdir(op);
+        tmpdir = copy_to_build_tmpdir(op, p->kernel_module_build_directory);
         builddir = tmpdir;
 
         if (!tmpdir) {
-            ui_error(op, "Unable to create a temporary build directory.");
-            goto done;
-        }
-
-        /* copy the kernel module sources to it */
-
-        ui_log(op, "Copying kernel module sources to temporary directory.");
-
-        if (!copy_directory_contents
-            (op, p->kernel_module_build_directory, tmpdir)) {
-            ui_error(op, "Unable to copy the kernel module sources to temporary "
-                     "directory '%s'.", tmpdir);
             goto done;
         }
     } else {
@@ -994,87 +1854,151 @@ int build_kernel_interfaces(Options *op, Package *p,
      * skew error messages
      */
 
-    /* run sanity checks */
-    for (i = 0; i < ARRAY_LEN(sanity_checks); i++) {
-        if (!conftest_sanity_check(op, builddir,
-                                   sanity_checks[i].sanity_check_name,
-                                   sanity_checks[i].conftest_name)) {
-            return FALSE;
-        }
+    if (!run_sanity_checks(op, builddir)) {
+        goto done;
     }
 
     ui_log(op, "Cleaning kernel module build directory.");
     run_make(op, p, builddir, "clean", NULL, 0);
 
-    match = count_lines(op, p, builddir, NULL);
-    ret = run_make(op, p, builddir, "", "Building kernel modules", match);
-    nvfree(match);
+    if (op->build_service_socket) {
+        ret = build_service_build_kernel_modules(op, p, builddir,
+                                                 fileInfos != NULL);
+    } else {
+        TimingPhase *timing = timing_phase_begin(op, p, "build");
 
-    /* Test to make sure that all kernel modules were built. */
-    for (i = 0; i < p->num_kernel_modules; i++) {
-        if (!check_file(op, p, builddir, p->kernel_modules[i].module_name)) {
-            handle_optional_module_failure(op, p->kernel_modules[i], "build");
+        match = count_lines(op, p, builddir, NULL, timing);
+        ret = run_make(op, p, builddir, "", "Building kernel modules", match);
+        nvfree(match);
+
+        timing_phase_end(op, timing, ret);
+    }
+
+    files_packaged = check_and_pack_modules(op, p, builddir, ret, fileInfos);
+
+done:
+
+    if (tmpdir) {
+        remove_directory(op, tmpdir);
+        nvfree(tmpdir);
+    }
+
+    return files_packaged;
+}
+
+
+/*
+ * build_kernel_interfaces_all_types() - build the kernel interfaces for each
+ * of the 'num_dirs' kernel module types in 'dirs' at once, and store the
+ * precompiled files for each in a newly allocated array in 'fileInfos'.
+ *
+ * The sanity checks only depend on the compiler and the kernel, so they are
+ * run once; the builds then run concurrently, sharing one jobserver so that
+ * together they stay within the concurrency level. Everything after the
+ * build, including any rebuilds of individual modules and the packing, is
+ * done for one kernel module type at a time, with
+ * p->kernel_module_build_directory pointing at that type's directory.
+ *
+ * Return TRUE if every kernel module type was built and packed, or FALSE,
+ * with nothing allocated in 'fileInfos', on error.
+ */
+
+int build_kernel_interfaces_all_types(Options *op, Package *p,
+                                      const char **dirs, int num_dirs,
+                                      PrecompiledFileInfo **fileInfos)
+{
+    ConcurrentMake builds[NUM_KERNEL_MODULE_TYPES];
+    char *selected_dir = p->kernel_module_build_directory;
+    int ret = FALSE, i;
+
+    memset(builds, 0, sizeof(builds));
+
+    for (i = 0; i < num_dirs; i++) {
+        fileInfos[i] = NULL;
+    }
+
+    if (op->build_service_socket) {
+        ui_error(op, "Kernel modules of all types cannot be built with the "
+                 "kernel module build service.");
+        return FALSE;
+    }
+
+    if (kernel_configuration_conflict(op, p, FALSE)) {
+        return FALSE;
+    }
+
+    for (i = 0; i < num_dirs; i++) {
+        builds[i].name = dirs[i];
+        builds[i].dir = copy_to_build_tmpdir(op, dirs[i]);
+
+        if (!builds[i].dir) {
             goto done;
         }
     }
 
-    /*
-     * Now check the status of the overall build: it may have failed, despite
-     * having produced all expected kernel modules.
-     */
-    if (!ret) {
+    if (!run_sanity_checks(op, builds[0].dir)) {
         goto done;
     }
 
-    ui_log(op, "Kernel module compilation complete.");
+    for (i = 0; i < num_dirs; i++) {
+        ui_log(op, "Cleaning kernel module build directory.");
+        run_make(op, p, builds[i].dir, "clean", NULL, 0);
+
+        builds[i].match = count_lines(op, p, builds[i].dir, NULL, NULL);
+    }
+
+    ret = run_makes_concurrently(op, p, builds, num_dirs,
+                                 "Building kernel modules of all types");
 
     /*
-     * If we're not building interfaces, return the number of built modules
-     * instead of the number of packaged interfaces.
+     * as for a single kernel module type, find out which modules failed to
+     * build, and print the hints for any optional ones
      */
-    if (fileInfos == NULL) {
-        /* If we've made it this far, all the modules were built. */
-        files_packaged = p->num_kernel_modules;
-        goto done;
+
+    for (i = 0; i < num_dirs; i++) {
+        if (!builds[i].ret) {
+            ui_error(op, "An error occurred while building the '%s' kernel "
+                     "modules. See %s for details.", builds[i].name,
+                     op->log_file_name);
+
+            p->kernel_module_build_directory = (char *) dirs[i];
+            isolate_failed_modules(op, p, builds[i].dir);
+        }
     }
 
-    *fileInfos = nvalloc(sizeof(PrecompiledFileInfo) *
-        (p->num_kernel_modules + 1));
+    /* check and pack each kernel module type in turn */
 
-    for (files_packaged = 0;
-         files_packaged < p->num_kernel_modules;
-         files_packaged++) {
-        PrecompiledFileInfo *fileInfo = *fileInfos + files_packaged;
-        KernelModuleInfo *module = p->kernel_modules + files_packaged;
+    for (i = 0; ret && i < num_dirs; i++) {
+        ui_log(op, "Packing the precompiled files for the '%s' kernel "
+               "modules.", builds[i].name);
 
-        if (module->has_separate_interface_file) {
-            if (!(run_make(op, p, tmpdir, module->interface_filename,
-                           NULL, NULL) &&
-                pack_kernel_interface(op, p, tmpdir, fileInfo,
-                                      module->interface_filename,
-                                      module->module_filename,
-                                      module->core_object_name))) {
-                goto done;
-            }
-        } else if (!pack_kernel_module(op, tmpdir, fileInfo,
-                                       module->module_filename)) {
-                goto done;
+        p->kernel_module_build_directory = (char *) dirs[i];
+
+        if (check_and_pack_modules(op, p, builds[i].dir, builds[i].ret,
+                                   &fileInfos[i]) != p->num_kernel_modules) {
+            ret = FALSE;
         }
     }
 
+    p->kernel_module_build_directory = selected_dir;
+
 done:
 
-    if (files_packaged == 0 && fileInfos) {
-        nvfree(*fileInfos);
-        *fileInfos = NULL;
-    }
+    for (i = 0; i < num_dirs; i++) {
+        if (!ret) {
+            nvfree(fileInfos[i]);
+            fileInfos[i] = NULL;
+        }
 
-    if (tmpdir) {
-        remove_directory(op, tmpdir);
-        nvfree(tmpdir);
+        if (builds[i].dir) {
+            remove_directory(op, builds[i].dir);
+            nvfree(builds[i].dir);
+        }
+
+        free_concurrent_make(&builds[i]);
     }
 
-    return files_packaged;
+    return ret;
 }
 
 
@@ -2404,6 +3328,40 @@ const char *get_machine_arch(Options *op)
     }
 } /* get_machine_arch() */
 
+/*
+ * make_command() - return the command line for running `make` in 'dir' with
+ * the options we need for the kernel module build, followed by
+ * 'cli_options'. make(1) is made a client of the jobserver 'js' if it is
+ * non-NULL, and is otherwise given 'jobs' jobs.
+ */
+static char *make_command(Options *op, const Package *p, const char *dir,
+                          const Jobserver *js, int jobs,
+                          const char *cli_options)
+{
+    char *cmd, *concurrency, *env;
+
+    if (js) {
+        env = nvstrcat("MAKEFLAGS=\"", jobserver_makeflags(js), "\" ", NULL);
+        concurrency = nvstrdup(" ");
+    } else {
+        env = nvstrdup("");
+        concurrency = nvasprintf(" -j%d ", jobs);
+    }
+
+    cmd = nvstrcat("cd ", dir, "; ", env,
+                   op->utils[MAKE], " -k", concurrency,
+                   " NV_EXCLUDE_KERNEL_MODULES=\"",
+                   p->excluded_kernel_modules, "\"",
+                   " SYSSRC=\"", op->kernel_source_path, "\"",
+                   " SYSOUT=\"", op->kernel_output_path, "\" ",
+                   cli_options,
+                   NULL);
+    nvfree(concurrency);
+    nvfree(env);
+
+    return cmd;
+}
+
 /*
  * Run `make` with the options we need for the kernel module build, plus
  * any user-supplied command line options.
@@ -2415,26 +3373,33 @@ const char *get_machine_arch(Options *op)
 static int run_make(Options *op, Package *p, const char *dir,
                     const char *cli_options, const char *status,
                     const RunCommandOutputMatch *match) {
-    char *cmd, *concurrency, *data = NULL;
+    char *cmd, *data = NULL;
+    Jobserver *js = NULL;
     int ret;
 
-    concurrency = nvasprintf(" -j%d ", op->concurrency_level);
+    /*
+     * With adaptive concurrency, make(1) is run as a client of our own
+     * jobserver, so that the number of jobs can be adjusted mid-build.
+     */
+    if (op->adaptive_concurrency) {
+        js = jobserver_start(op, op->concurrency_level);
+    }
 
-    cmd = nvstrcat("cd ", dir, "; ",
-                   op->utils[MAKE], " -k", concurrency,
-                   " NV_EXCLUDE_KERNEL_MODULES=\"",
-                   p->excluded_kernel_modules, "\"",
-                   " SYSSRC=\"", op->kernel_source_path, "\"",
-                   " SYSOUT=\"", op->kernel_output_path, "\" ",
-                   cli_options,
-                   NULL);
-    nvfree(concurrency);
+    cmd = make_command(op, p, dir, js, op->concurrency_level, cli_options);
 
     if (status) {
         ui_status_begin(op, status, "");
     }
 
-    ret = (run_command(op, &data, TRUE, status ? match : NULL, TRUE, cmd, NULL) == 0);
+    NV_PROBE2(run_make__start, dir, cli_options);
+
+    ret = (run_command_with_jobserver(op, js, &data, TRUE,
+                                      status ? match : NULL, TRUE,
+                                      cmd, NULL) == 0);
+
+    NV_PROBE3(run_make__done, dir, cli_options, ret);
+
+    jobserver_stop(op, js);
 
     if (status) {
         if (ret) {
@@ -2747,6 +3712,26 @@ int valid_kernel_module_types(Options *op, struct module_type_info *info)
     return num_valid_types;
 }
 
+/*
+ * kernel_module_type_directories() - fill 'dirs' with the directories of
+ * all of the kernel module types present in this package, regardless of
+ * which of them suit the GPUs in this system, and return their number.
+ */
+
+int kernel_module_type_directories(const char **dirs)
+{
+    int num_dirs = 0, i;
+
+    for (i = 0; i < NUM_KERNEL_MODULE_TYPES; i++) {
+        if (directory_exists(kernel_module_types[i].dir)) {
+            dirs[num_dirs++] = kernel_module_types[i].dir;
+        }
+    }
+
+    return num_dirs;
+}
+
+
 int override_kernel_module_build_directory(Options *op, const char *directory)
 {
     int i, num_types, ret = FALSE;
@@ -2822,18 +3807,27 @@ int override_kernel_module_build_directory(Options *op, const char *directory)
     return ret;
 }
 
-int override_kernel_module_type(Options *op, const char *type)
+/*
+ * kernel_module_type_directory() - return the kernel module build directory
+ * for the given kernel module type, or NULL if the type is not valid.
+ */
+const char *kernel_module_type_directory(const char *type)
 {
-    const char *directory = NULL;
     int i;
 
     for (i = 0; i < NUM_KERNEL_MODULE_TYPES; i++) {
         if (tolower(type[0]) == kernel_module_types[i].type) {
-            directory = kernel_module_types[i].dir;
-            break;
+            return kernel_module_types[i].dir;
         }
     }
 
+    return NULL;
+}
+
+int override_kernel_module_type(Options *op, const char *type)
+{
+    const char *directory = kernel_module_type_directory(type);
+
     if (!directory) {
         ui_error(op, "'%s' is not a valid kernel module type.", type);
         return FALSE;
@@ -2841,3 +3835,26 @@ int override_kernel_module_type(Options *op, const char *type)
 
     return override_kernel_module_build_directory(op, directory);
 }
+
+
+/*
+ * apply_kernel_module_build_directory_requests() - validate and apply the
+ * kernel module build directory and type given on the command line.  This
+ * is deferred until the package is available, since the requests are
+ * checked against the build directories present in the package.
+ */
+int apply_kernel_module_build_directory_requests(Options *op)
+{
+    if (op->kernel_module_build_directory_request &&
+        !override_kernel_module_build_directory(
+            op, op->kernel_module_build_directory_request)) {
+        return FALSE;
+    }
+
+    if (op->kernel_module_type_request &&
+        !override_kernel_module_type(op, op->kernel_module_type_request)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
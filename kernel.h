@@ -44,9 +44,14 @@ int determine_kernel_output_path                   (Options*);
 int unpack_kernel_modules                          (Options*, Package*,
                                                     const char *,
                                                     const PrecompiledFileInfo *);
+int link_precompiled_kernel_modules                (Options*, Package*,
+                                                    const PrecompiledInfo *);
 int build_kernel_modules                           (Options*, Package*);
 int build_kernel_interfaces                        (Options*, Package*,
                                                     PrecompiledFileInfo **);
+int build_kernel_interfaces_all_types              (Options*, Package*,
+                                                    const char **, int,
+                                                    PrecompiledFileInfo **);
 int test_kernel_modules                            (Options*, Package*);
 int load_kernel_module                             (Options*, const char*);
 int check_for_unloaded_kernel_module               (Options*);
@@ -68,8 +73,11 @@ int conftest_sanity_check                          (Options*, const char *,
 char *precompiled_kernel_interface_path            (const Package*);
 int valid_kernel_module_types                      (Options*,
                                                     struct module_type_info*);
+int kernel_module_type_directories                 (const char **);
 int override_kernel_module_build_directory         (Options*, const char*);
 int override_kernel_module_type                    (Options*, const char*);
+const char *kernel_module_type_directory           (const char*);
+int apply_kernel_module_build_directory_requests   (Options*);
 
 #ifndef ENOKEY
 #define	ENOKEY		126	/* Required key not available */
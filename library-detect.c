@@ -0,0 +1,703 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * library-detect.c - find the system libraries that the driver depends on
+ * the way the dynamic linker would, and identify them from their ELF
+ * headers, without loading them or running any other program.
+ *
+ * A library is looked for in the directories in LD_LIBRARY_PATH, then in
+ * /etc/ld.so.cache, and then in the default library directories; the
+ * first file that is a shared library for the installer's own ELF class
+ * and machine is the one that dlopen() would load.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "library-detect.h"
+#include "misc.h"
+
+#define LD_SO_CACHE "/etc/ld.so.cache"
+
+/* the bits of a .gnu.version entry, as binutils names them */
+
+#define VERSYM_HIDDEN  0x8000
+#define VERSYM_VERSION 0x7fff
+
+#define LD_SO_CACHE_MAGIC_OLD "ld.so-1.7.0"
+#define LD_SO_CACHE_MAGIC_NEW "glibc-ld.so.cache1.1"
+
+/* the layout of /etc/ld.so.cache, from glibc's dl-cache.h */
+
+typedef struct {
+    int32_t flags;
+    uint32_t key, value;
+} LdCacheEntryOld;
+
+typedef struct {
+    char magic[sizeof(LD_SO_CACHE_MAGIC_OLD) - 1];
+    uint32_t nlibs;
+} LdCacheHeaderOld;
+
+typedef struct {
+    int32_t flags;
+    uint32_t key, value;
+    uint32_t osversion;
+    uint64_t hwcap;
+} LdCacheEntryNew;
+
+typedef struct {
+    char magic[sizeof(LD_SO_CACHE_MAGIC_NEW) - 1];
+    uint32_t nlibs;
+    uint32_t len_strings;
+    uint8_t flags;
+    uint8_t padding[3];
+    uint32_t extension_offset;
+    uint32_t unused[3];
+} LdCacheHeaderNew;
+
+/*
+ * LdCache - the entries of a mapped ld.so.cache; the key (soname) and value
+ * (path) of each entry are offsets into 'strings'.
+ */
+
+typedef struct {
+    char *map;
+    size_t len;
+    const char *entries;
+    size_t entry_size;
+    uint32_t nlibs;
+    const char *strings;
+    size_t strings_len;
+} LdCache;
+
+typedef struct {
+    char *map;
+    size_t len;
+    const ElfW(Ehdr) *ehdr;
+} ElfImage;
+
+
+/*
+ * The libraries that make up libglvnd.  Every one of them except
+ * libGLdispatch itself links against libGLdispatch, which a non-libglvnd
+ * library with the same name (such as a legacy libGL.so.1) does not.
+ */
+
+#define GLDISPATCH_SONAME "libGLdispatch.so.0"
+
+static const char * const libglvnd_libs[] = {
+    GLDISPATCH_SONAME,
+    "libOpenGL.so.0",
+    "libGLX.so.0",
+    "libGL.so.1",
+    "libEGL.so.1",
+    "libGLESv1_CM.so.1",
+    "libGLESv2.so.2",
+};
+
+static const char * const default_lib_dirs[] = {
+#if defined(__LP64__)
+    "/lib64", "/usr/lib64",
+#endif
+    "/lib", "/usr/lib",
+};
+
+
+static int map_file(const char *path, char **map, size_t *len)
+{
+    struct stat stat_buf;
+    int fd = open(path, O_RDONLY);
+
+    *map = NULL;
+    *len = 0;
+
+    if (fd < 0) return FALSE;
+
+    if (fstat(fd, &stat_buf) == -1 || !S_ISREG(stat_buf.st_mode) ||
+        stat_buf.st_size == 0) {
+        close(fd);
+        return FALSE;
+    }
+
+    *map = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (*map == MAP_FAILED) {
+        *map = NULL;
+        return FALSE;
+    }
+
+    *len = stat_buf.st_size;
+
+    return TRUE;
+}
+
+
+/*
+ * open_ld_cache() - map /etc/ld.so.cache, in either the new format or the
+ * old format with the new format appended; a missing or unrecognized cache
+ * is treated as empty.
+ */
+
+static void open_ld_cache(Options *op, LdCache *cache)
+{
+    const LdCacheHeaderNew *hdr;
+    size_t offset = 0;
+
+    memset(cache, 0, sizeof(*cache));
+
+    if (!map_file(LD_SO_CACHE, &cache->map, &cache->len)) {
+        ui_log(op, "Unable to read '%s'.", LD_SO_CACHE);
+        return;
+    }
+
+    if (cache->len >= sizeof(LdCacheHeaderOld) &&
+        memcmp(cache->map, LD_SO_CACHE_MAGIC_OLD,
+               sizeof(LD_SO_CACHE_MAGIC_OLD) - 1) == 0) {
+        const LdCacheHeaderOld *old = (const LdCacheHeaderOld *) cache->map;
+        size_t align = __alignof__(LdCacheEntryNew);
+
+        offset = sizeof(*old) + (size_t) old->nlibs * sizeof(LdCacheEntryOld);
+        if (offset > cache->len) goto invalid;
+
+        /* use the old format only if the new format isn't appended */
+
+        offset = (offset + align - 1) & ~(align - 1);
+        if (offset + sizeof(*hdr) > cache->len ||
+            memcmp(cache->map + offset, LD_SO_CACHE_MAGIC_NEW,
+                   sizeof(LD_SO_CACHE_MAGIC_NEW) - 1) != 0) {
+            cache->entries = cache->map + sizeof(*old);
+            cache->entry_size = sizeof(LdCacheEntryOld);
+            cache->nlibs = old->nlibs;
+            cache->strings = cache->entries +
+                             (size_t) old->nlibs * sizeof(LdCacheEntryOld);
+            cache->strings_len = cache->map + cache->len - cache->strings;
+            return;
+        }
+    }
+
+    if (offset + sizeof(*hdr) > cache->len ||
+        memcmp(cache->map + offset, LD_SO_CACHE_MAGIC_NEW,
+               sizeof(LD_SO_CACHE_MAGIC_NEW) - 1) != 0) {
+        goto invalid;
+    }
+
+    hdr = (const LdCacheHeaderNew *) (cache->map + offset);
+
+    if ((cache->len - offset - sizeof(*hdr)) / sizeof(LdCacheEntryNew) <
+        hdr->nlibs) {
+        goto invalid;
+    }
+
+    cache->entries = (const char *) (hdr + 1);
+    cache->entry_size = sizeof(LdCacheEntryNew);
+    cache->nlibs = hdr->nlibs;
+    cache->strings = (const char *) hdr;
+    cache->strings_len = cache->map + cache->len - cache->strings;
+    return;
+
+ invalid:
+    ui_log(op, "Unrecognized format of '%s'.", LD_SO_CACHE);
+    munmap(cache->map, cache->len);
+    memset(cache, 0, sizeof(*cache));
+}
+
+
+static void close_ld_cache(LdCache *cache)
+{
+    if (cache->map) {
+        munmap(cache->map, cache->len);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+
+/*
+ * ld_cache_string() - the NUL terminated string at 'offset' in the cache's
+ * string table, or NULL if it would run off the end of the cache.
+ */
+
+static const char *ld_cache_string(const LdCache *cache, uint32_t offset)
+{
+    if (offset >= cache->strings_len ||
+        !memchr(cache->strings + offset, '\0', cache->strings_len - offset)) {
+        return NULL;
+    }
+
+    return cache->strings + offset;
+}
+
+
+/*
+ * host_elf_machine() - the ELF machine of the installer itself; libraries
+ * for other machines are skipped, as the dynamic linker would.  Returns
+ * EM_NONE if it can't be determined, in which case any machine matches.
+ */
+
+static int host_elf_machine(void)
+{
+    static int machine = -1;
+    ElfW(Ehdr) ehdr;
+    int fd;
+
+    if (machine >= 0) return machine;
+
+    machine = EM_NONE;
+
+    fd = open("/proc/self/exe", O_RDONLY);
+    if (fd >= 0) {
+        if (read(fd, &ehdr, sizeof(ehdr)) == sizeof(ehdr) &&
+            memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0) {
+            machine = ehdr.e_machine;
+        }
+        close(fd);
+    }
+
+    return machine;
+}
+
+
+/*
+ * open_elf_image() - map the file at 'path' if it is a shared library that
+ * the installer itself could load: of the same ELF class, byte order and
+ * machine, with section headers that lie within the file.
+ */
+
+static int open_elf_image(const char *path, ElfImage *img)
+{
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    const unsigned char host_data = ELFDATA2LSB;
+#else
+    const unsigned char host_data = ELFDATA2MSB;
+#endif
+    const ElfW(Ehdr) *ehdr;
+    int machine = host_elf_machine();
+
+    memset(img, 0, sizeof(*img));
+
+    if (!map_file(path, &img->map, &img->len)) return FALSE;
+
+    ehdr = (const ElfW(Ehdr) *) img->map;
+
+    if (img->len < sizeof(*ehdr) ||
+        memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_ident[EI_CLASS] != (sizeof(void *) == 8 ? ELFCLASS64 :
+                                                          ELFCLASS32) ||
+        ehdr->e_ident[EI_DATA] != host_data ||
+        ehdr->e_type != ET_DYN ||
+        (machine != EM_NONE && ehdr->e_machine != machine) ||
+        ehdr->e_shentsize != sizeof(ElfW(Shdr)) ||
+        ehdr->e_shoff > img->len ||
+        (img->len - ehdr->e_shoff) / sizeof(ElfW(Shdr)) < ehdr->e_shnum) {
+        munmap(img->map, img->len);
+        memset(img, 0, sizeof(*img));
+        return FALSE;
+    }
+
+    img->ehdr = ehdr;
+
+    return TRUE;
+}
+
+
+static void close_elf_image(ElfImage *img)
+{
+    if (img->map) {
+        munmap(img->map, img->len);
+    }
+    memset(img, 0, sizeof(*img));
+}
+
+
+/*
+ * elf_section() - the section header at 'index', or the first one of the
+ * given type if 'index' is negative; NULL if there is none, or its
+ * contents do not lie within the file.
+ */
+
+static const ElfW(Shdr) *elf_section(const ElfImage *img, int index,
+                                     ElfW(Word) type)
+{
+    const ElfW(Shdr) *shdrs =
+        (const ElfW(Shdr) *) (img->map + img->ehdr->e_shoff);
+    int i;
+
+    for (i = 0; i < img->ehdr->e_shnum; i++) {
+        if ((index >= 0 && i != index) ||
+            (index < 0 && shdrs[i].sh_type != type)) {
+            continue;
+        }
+
+        if (shdrs[i].sh_type == SHT_NOBITS ||
+            shdrs[i].sh_offset > img->len ||
+            shdrs[i].sh_size > img->len - shdrs[i].sh_offset) {
+            return NULL;
+        }
+
+        return &shdrs[i];
+    }
+
+    return NULL;
+}
+
+
+/*
+ * elf_string() - the NUL terminated string at 'offset' in the string table
+ * section 'strtab', or NULL if it would run off the end of the table.
+ */
+
+static const char *elf_string(const ElfImage *img, const ElfW(Shdr) *strtab,
+                              size_t offset)
+{
+    const char *s = img->map + strtab->sh_offset;
+
+    if (offset >= strtab->sh_size ||
+        !memchr(s + offset, '\0', strtab->sh_size - offset)) {
+        return NULL;
+    }
+
+    return s + offset;
+}
+
+
+/*
+ * elf_dynamic_string() - look for an entry of the dynamic section with the
+ * given tag (such as DT_SONAME or DT_NEEDED) whose value is 'value'; if
+ * 'value' is NULL, return the value of the first entry with the tag.
+ */
+
+static const char *elf_dynamic_string(const ElfImage *img, ElfW(Sxword) tag,
+                                      const char *value)
+{
+    const ElfW(Shdr) *dynamic = elf_section(img, -1, SHT_DYNAMIC);
+    const ElfW(Shdr) *strtab;
+    const ElfW(Dyn) *dyn;
+    size_t i, n;
+
+    if (!dynamic) return NULL;
+
+    strtab = elf_section(img, dynamic->sh_link, 0);
+    if (!strtab) return NULL;
+
+    dyn = (const ElfW(Dyn) *) (img->map + dynamic->sh_offset);
+    n = dynamic->sh_size / sizeof(ElfW(Dyn));
+
+    for (i = 0; i < n && dyn[i].d_tag != DT_NULL; i++) {
+        const char *s;
+
+        if (dyn[i].d_tag != tag) continue;
+
+        s = elf_string(img, strtab, dyn[i].d_un.d_val);
+        if (s && (!value || strcmp(s, value) == 0)) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+
+/*
+ * elf_version_name() - the name of the version with the index 'ndx' in the
+ * version definitions (.gnu.version_d), or NULL if it isn't defined there.
+ */
+
+static const char *elf_version_name(const ElfImage *img, ElfW(Half) ndx)
+{
+    const ElfW(Shdr) *verdef = elf_section(img, -1, SHT_GNU_verdef);
+    const ElfW(Shdr) *strtab;
+    size_t offset = 0;
+
+    if (!verdef) return NULL;
+
+    strtab = elf_section(img, verdef->sh_link, 0);
+    if (!strtab) return NULL;
+
+    while (verdef->sh_size >= sizeof(ElfW(Verdef)) &&
+           offset <= verdef->sh_size - sizeof(ElfW(Verdef))) {
+        const ElfW(Verdef) *vd = (const ElfW(Verdef) *)
+            (img->map + verdef->sh_offset + offset);
+
+        if (vd->vd_ndx == ndx && vd->vd_cnt > 0 &&
+            vd->vd_aux <= verdef->sh_size - offset - sizeof(ElfW(Verdaux))) {
+            const ElfW(Verdaux) *vda = (const ElfW(Verdaux) *)
+                ((const char *) vd + vd->vd_aux);
+
+            return elf_string(img, strtab, vda->vda_name);
+        }
+
+        if (vd->vd_next == 0) break;
+        offset += vd->vd_next;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * elf_defines_symbol() - whether the dynamic symbol table defines (rather
+ * than imports) the named symbol in the given version, or, if 'version' is
+ * NULL, in the version that an unversioned reference such as dlsym() binds
+ * to: the symbol must then be unversioned, or be the default version of
+ * the symbol rather than a hidden older one. The versions come from the
+ * .gnu.version and .gnu.version_d sections, if the library has them.
+ */
+
+static int elf_defines_symbol(const ElfImage *img, const char *name,
+                              const char *version)
+{
+    const ElfW(Shdr) *dynsym = elf_section(img, -1, SHT_DYNSYM);
+    const ElfW(Shdr) *versym = elf_section(img, -1, SHT_GNU_versym);
+    const ElfW(Shdr) *strtab;
+    const ElfW(Sym) *syms;
+    const ElfW(Half) *versions = NULL;
+    size_t i, n;
+
+    if (!dynsym) return FALSE;
+
+    strtab = elf_section(img, dynsym->sh_link, 0);
+    if (!strtab) return FALSE;
+
+    syms = (const ElfW(Sym) *) (img->map + dynsym->sh_offset);
+    n = dynsym->sh_size / sizeof(ElfW(Sym));
+
+    /* .gnu.version has one entry for each dynamic symbol */
+
+    if (versym && versym->sh_size / sizeof(ElfW(Half)) >= n) {
+        versions = (const ElfW(Half) *) (img->map + versym->sh_offset);
+    }
+
+    for (i = 0; i < n; i++) {
+        ElfW(Half) ndx;
+        const char *s;
+
+        if (syms[i].st_shndx == SHN_UNDEF) continue;
+
+        s = elf_string(img, strtab, syms[i].st_name);
+        if (!s || strcmp(s, name) != 0) continue;
+
+        ndx = versions ? versions[i] : VER_NDX_GLOBAL;
+
+        if ((ndx & VERSYM_VERSION) == VER_NDX_LOCAL) continue;
+
+        if (!version) {
+            if (!(ndx & VERSYM_HIDDEN)) {
+                return TRUE;
+            }
+        } else if ((ndx & VERSYM_VERSION) > VER_NDX_GLOBAL) {
+            const char *v = elf_version_name(img, ndx & VERSYM_VERSION);
+
+            if (v && strcmp(v, version) == 0) {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * try_library() - open 'dir'/'soname' (or 'path', if 'dir' is NULL) if it
+ * is a loadable shared library whose SONAME, if it has one, is 'soname'.
+ */
+
+static int try_library(Options *op, const char *dir, const char *path,
+                       const char *soname, ElfImage *img)
+{
+    char *file = dir ? nvdircat(dir, soname, NULL) : nvstrdup(path);
+    const char *actual;
+    int ret = FALSE;
+
+    if (open_elf_image(file, img)) {
+        actual = elf_dynamic_string(img, DT_SONAME, NULL);
+
+        if (actual && strcmp(actual, soname) != 0) {
+            ui_log(op, "Ignoring '%s', whose SONAME is '%s'.", file, actual);
+            close_elf_image(img);
+        } else {
+            ui_log(op, "Found '%s' at '%s'.", soname, file);
+            ret = TRUE;
+        }
+    }
+
+    nvfree(file);
+
+    return ret;
+}
+
+
+/*
+ * find_library() - find and open the library that dlopen(soname) would
+ * load, without loading it.
+ */
+
+static int find_library(Options *op, const LdCache *cache,
+                        const char *soname, ElfImage *img)
+{
+    const char *env = getenv("LD_LIBRARY_PATH");
+    uint32_t i;
+
+    if (env) {
+        char *paths = nvstrdup(env), *dir, *save = NULL;
+        int found = FALSE;
+
+        for (dir = strtok_r(paths, ":;", &save); dir && !found;
+             dir = strtok_r(NULL, ":;", &save)) {
+            found = try_library(op, dir, NULL, soname, img);
+        }
+
+        nvfree(paths);
+
+        if (found) return TRUE;
+    }
+
+    for (i = 0; i < cache->nlibs; i++) {
+        const LdCacheEntryOld *e = (const LdCacheEntryOld *)
+            (cache->entries + (size_t) i * cache->entry_size);
+        const char *key = ld_cache_string(cache, e->key);
+        const char *value = ld_cache_string(cache, e->value);
+
+        if (key && value && strcmp(key, soname) == 0 &&
+            try_library(op, NULL, value, soname, img)) {
+            return TRUE;
+        }
+    }
+
+    for (i = 0; i < ARRAY_LEN(default_lib_dirs); i++) {
+        if (try_library(op, default_lib_dirs[i], NULL, soname, img)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+static void append_to_list(char **list, const char *item)
+{
+    char *tmp = *list;
+
+    *list = nvstrcat(tmp ? tmp : "", tmp ? " " : "", item, NULL);
+    nvfree(tmp);
+}
+
+
+/*
+ * detect_libglvnd() - determine whether each of the libglvnd libraries is
+ * installed, and is the libglvnd implementation of that library.  Returns
+ * whether all, none or some of them are; in the last case, 'missing_libs'
+ * is set to a space-separated list of the missing libraries, which the
+ * caller should free.
+ */
+
+LibglvndInstallCheckResult detect_libglvnd(Options *op, char **missing_libs)
+{
+    LdCache cache;
+    char *found = NULL, *missing = NULL;
+    int num_found = 0, i;
+
+    *missing_libs = NULL;
+
+    open_ld_cache(op, &cache);
+
+    for (i = 0; i < ARRAY_LEN(libglvnd_libs); i++) {
+        const char *lib = libglvnd_libs[i];
+        ElfImage img;
+        int is_glvnd = FALSE;
+
+        if (find_library(op, &cache, lib, &img)) {
+            if (strcmp(lib, GLDISPATCH_SONAME) == 0) {
+                is_glvnd = elf_defines_symbol(&img, "__glDispatchInit",
+                                              NULL);
+            } else {
+                is_glvnd = elf_dynamic_string(&img, DT_NEEDED,
+                                              GLDISPATCH_SONAME) != NULL;
+            }
+
+            if (!is_glvnd) {
+                ui_log(op, "'%s' is not the libglvnd implementation.", lib);
+            }
+
+            close_elf_image(&img);
+        }
+
+        if (is_glvnd) {
+            append_to_list(&found, lib);
+            num_found++;
+        } else {
+            append_to_list(&missing, lib);
+        }
+    }
+
+    close_ld_cache(&cache);
+
+    ui_log(op, "Found libglvnd libraries: %s", found ? found : "");
+    ui_log(op, "Missing libglvnd libraries: %s", missing ? missing : "");
+
+    nvfree(found);
+
+    if (num_found == ARRAY_LEN(libglvnd_libs)) {
+        return LIBGLVND_CHECK_RESULT_INSTALLED;
+    }
+
+    if (num_found == 0) {
+        nvfree(missing);
+        return LIBGLVND_CHECK_RESULT_NOT_INSTALLED;
+    }
+
+    *missing_libs = missing;
+
+    return LIBGLVND_CHECK_RESULT_PARTIAL;
+}
+
+
+/*
+ * detect_vulkan_loader() - whether a Vulkan loader is installed: a
+ * libvulkan.so.1 that exports vkGetInstanceProcAddr.
+ */
+
+int detect_vulkan_loader(Options *op)
+{
+    LdCache cache;
+    ElfImage img;
+    int ret = FALSE;
+
+    open_ld_cache(op, &cache);
+
+    if (find_library(op, &cache, "libvulkan.so.1", &img)) {
+        ret = elf_defines_symbol(&img, "vkGetInstanceProcAddr", NULL);
+        close_elf_image(&img);
+    }
+
+    close_ld_cache(&cache);
+
+    return ret;
+}
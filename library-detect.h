@@ -0,0 +1,35 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_LIBRARY_DETECT_H__
+#define __NVIDIA_INSTALLER_LIBRARY_DETECT_H__
+
+#include "nvidia-installer.h"
+
+typedef enum {
+    LIBGLVND_CHECK_RESULT_INSTALLED = 0,
+    LIBGLVND_CHECK_RESULT_NOT_INSTALLED = 1,
+    LIBGLVND_CHECK_RESULT_PARTIAL = 2,
+    LIBGLVND_CHECK_RESULT_ERROR = 3,
+} LibglvndInstallCheckResult;
+
+LibglvndInstallCheckResult detect_libglvnd(Options *op, char **missing_libs);
+int detect_vulkan_loader(Options *op);
+
+#endif /* __NVIDIA_INSTALLER_LIBRARY_DETECT_H__ */
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include "nvidia-installer.h"
@@ -35,6 +36,14 @@
 
 static FILE *log_file_stream;
 
+/* a second stream receiving a copy of the log output; see log_copy_begin() */
+
+static FILE *log_copy_stream;
+
+/* serializes log_printf() calls from different threads */
+
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 /* convenience macro for logging boolean values */
 
@@ -133,6 +142,8 @@ void log_printf(Options *op, const char *prefix, const char *fmt, ...)
 
     NV_VSNPRINTF(buf, fmt);
 
+    pthread_mutex_lock(&log_mutex);
+
     /*
      * do not append a newline to the end of the string if the caller
      * already did
@@ -147,10 +158,76 @@ void log_printf(Options *op, const char *prefix, const char *fmt, ...)
     }
     fprintf(log_file_stream, "%s%s", buf, append_newline ? "\n" : "");
 
+    if (log_copy_stream) {
+        fprintf(log_copy_stream, "%s%s%s", prefix ? prefix : "", buf,
+                append_newline ? "\n" : "");
+        fflush(log_copy_stream);
+    }
+
     nvfree(buf);
     
     /* flush, just to be safe */
 
     fflush(log_file_stream);
+
+    pthread_mutex_unlock(&log_mutex);
     
 } /* log_printf() */
+
+
+
+/*
+ * log_copy_begin() - until log_copy_end() is called, also write the log
+ * output to the file 'path', which begins with a header like the one
+ * written by log_init().  This lets a step that used to run as a separate
+ * installer process, such as uninstalling the previous installation,
+ * still leave its own log file behind.
+ */
+
+void log_copy_begin(Options *op, const char *path, const char *title)
+{
+    time_t now;
+
+    if (!op->logging) return;
+
+    pthread_mutex_lock(&log_mutex);
+
+    log_copy_stream = fopen(path, "w");
+
+    if (log_copy_stream) {
+        now = time(NULL);
+        fprintf(log_copy_stream, "%s log file '%s'\n", PROGRAM_NAME, path);
+        fprintf(log_copy_stream, "creation time: %s", ctime(&now));
+        fprintf(log_copy_stream, "installer version: %s\n\n",
+                NVIDIA_INSTALLER_VERSION);
+        fprintf(log_copy_stream, "%s\n\n", title);
+        fflush(log_copy_stream);
+    }
+
+    pthread_mutex_unlock(&log_mutex);
+
+    if (!log_copy_stream) {
+        log_printf(op, NULL, "Unable to open the log file '%s' (%s).", path,
+                   strerror(errno));
+    }
+
+} /* log_copy_begin() */
+
+
+
+/*
+ * log_copy_end() - stop copying the log output started by log_copy_begin().
+ */
+
+void log_copy_end(Options *op)
+{
+    pthread_mutex_lock(&log_mutex);
+
+    if (log_copy_stream) {
+        fclose(log_copy_stream);
+        log_copy_stream = NULL;
+    }
+
+    pthread_mutex_unlock(&log_mutex);
+
+} /* log_copy_end() */
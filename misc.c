@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
@@ -38,6 +39,8 @@
 #include <pciaccess.h>
 #include <elf.h>
 #include <link.h>
+#include <sched.h>
+#include <sys/syscall.h>
 
 #include "nvidia-installer.h"
 #include "user-interface.h"
@@ -45,52 +48,21 @@
 #include "files.h"
 #include "misc.h"
 #include "crc.h"
+#include "digest.h"
+#include "jobserver.h"
 #include "nvGpus.h"
 #include "manifest.h"
 #include "nvpci-utils.h"
 #include "conflicting-kernel-modules.h"
 #include "initramfs.h"
 #include "detect-self-hosted.h"
+#include "timing-history.h"
+#include "probes.h"
+#include "library-detect.h"
 
 static int check_symlink(Options*, const char*, const char*, const char*);
 
 
-/*
- * read_next_word() - given a string buf, skip any whitespace, and
- * then copy the next set of characters until more white space is
- * encountered.  A new string containing this next word is returned.
- * The passed-by-reference parameter e, if not NULL, is set to point
- * at the where the end of the word was, to facilitate multiple calls
- * of read_next_word().
- */
-
-char *read_next_word (char *buf, char **e)
-{
-    char *c = buf;
-    char *start, *ret;
-    int len;
-    
-    while ((*c) && (isspace (*c)) && (*c != '\n')) c++;
-    start = c;
-    while ((*c) && (!isspace (*c)) && (*c != '\n')) c++;
-    
-    len = c - start;
-
-    if (len == 0) return NULL;
-    
-    ret = (char *) nvalloc (len + 1);
-
-    strncpy (ret, start, len);
-    ret[len] = '\0';
-
-    if (e) *e = c;
-
-    return ret;
-    
-} /* read_next_word() */
-
-
-
 /*
  * check_euid() - this function checks that the effective uid of this
  * application is root, and calls the ui to print an error if it's not
@@ -157,101 +129,55 @@ int adjust_cwd(Options *op, const char *program_name)
 
 
 /*
- * get_next_line() - this function scans for the next newline,
- * carriage return, NUL terminator, or EOF in buf.  If non-NULL, the
- * passed-by-reference parameter 'end' is set to point to the next
- * printable character in the buffer, or NULL if EOF is encountered.
- *
- * If the parameter 'start' is non-NULL, then that is interpreted as
- * the start of the buffer string, and we check that we never walk
- * 'length' bytes past 'start'.
- * 
- * On success, a newly allocated buffer is allocated containing the
- * next line of text (with a NULL terminator in place of the
- * newline/carriage return).
- *
- * On error, NULL is returned.
+ * Commands may be run from several threads at once, so the SIGWINCH
+ * disposition is saved by the first of the concurrent run_command() calls
+ * and restored by the last one, rather than by each call; otherwise, the
+ * save/restore pairs could interleave and leave SIG_IGN installed.
  */
+static pthread_mutex_t sigwinch_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sigwinch_users;
+static struct sigaction sigwinch_old_act;
 
-char *get_next_line(char *buf, char **end, char *start, int length)
+static void ignore_sigwinch(void)
 {
-    char *c, *retbuf;
-    int len;
+    struct sigaction act;
 
-    if (start && (length < 1)) return NULL;
+    pthread_mutex_lock(&sigwinch_lock);
 
-#define __AT_END(_start, _current, _length) \
-    ((_start) && (((_current) - (_start)) >= (_length)))
-    
-    if (end) *end = NULL;
-    
-    // Cast all char comparisons to EOF to signed char in order to
-    // allow proper sign extension on platforms like GCC ARM where
-    // char is unsigned char
-    if ((!buf) ||
-        __AT_END(start, buf, length) ||
-        (*buf == '\0') ||
-        (((signed char)*buf) == EOF)) return NULL;
-    
-    c = buf;
-    
-    while ((!__AT_END(start, c, length)) &&
-           (*c != '\0') &&
-           (((signed char)*c) != EOF) &&
-           (*c != '\n') &&
-           (*c != '\r')) c++;
-
-    len = c - buf;
-    retbuf = nvalloc(len + 1);
-    strncpy(retbuf, buf, len);
-    retbuf[len] = '\0';
-    
-    if (end) {
-        while ((!__AT_END(start, c, length)) &&
-               (*c != '\0') &&
-               (((signed char)*c) != EOF) &&
-               (!isprint(*c))) c++;
-        
-        if (__AT_END(start, c, length) ||
-            (*c == '\0') ||
-            (((signed char)*c) == EOF)) *end = NULL;
-        else *end = c;
+    if (sigwinch_users++ == 0) {
+        act.sa_handler = SIG_IGN;
+        sigemptyset(&act.sa_mask);
+        act.sa_flags = 0;
+
+        if (sigaction(SIGWINCH, &act, &sigwinch_old_act) < 0)
+            sigwinch_old_act.sa_handler = NULL;
     }
-    
-    return retbuf;
 
-} /* get_next_line() */
+    pthread_mutex_unlock(&sigwinch_lock);
+}
+
+static void restore_sigwinch(void)
+{
+    pthread_mutex_lock(&sigwinch_lock);
+
+    if (--sigwinch_users == 0) {
+        sigaction(SIGWINCH, &sigwinch_old_act, NULL);
+    }
+
+    pthread_mutex_unlock(&sigwinch_lock);
+}
 
 
 
 /*
- * run_command() - this function runs the given command and assigns
- * the data parameter to a malloced buffer containing the command's
- * output, if any.  The caller of this function should free the data
- * string.  The return value of the command is returned from this
- * function.
- *
- * The output parameter controls whether command output is sent to the
- * ui; if this is TRUE, then everyline of output that is read is sent
- * to the ui.
- *
- * If the output_match parameter is set to a { 0 }-terminated array of
- * RunCommandOutputMatch records, it is interpreted as a rough estimate of how
- * many lines of output (optionally requiring an initial substring match) will
- * be generated by the command.  This is used to compute the value that should
- * be passed to ui_status_update() as lines of output are received. This may be
- * set to NULL to skip the ui_status_update() updates.
- *
- * The redirect argument tells run_command() to redirect stderr to
- * stdout so that all output is collected, or just stdout.
- *
- * XXX maybe we should do something to cap the time we allow the
- * command to run?
+ * run_command_va() - run_command(), with the command given as a va_list,
+ * and run as a client of the jobserver 'js' if that is non-NULL.
  */
 
-int run_command(Options *op, char **data, int output,
-                const RunCommandOutputMatch *output_match, int redirect,
-                const char *cmd_start, ...)
+static int run_command_va(Options *op, const Jobserver *js, char **data,
+                          int output,
+                          const RunCommandOutputMatch *output_match,
+                          int redirect, const char *cmd_start, va_list ap)
 {
     int n = 0; /* output line counter */
     int len = 0; /* length of what has actually been read */
@@ -259,14 +185,12 @@ int run_command(Options *op, char **data, int output,
     int ret, total_lines;
     char *cmd, *buf = NULL;
     FILE *stream = NULL;
-    struct sigaction act, old_act;
+    TimingPhase *phase;
+    pid_t pid = 0;
     float percent;
     int *match_sizes = NULL;
-    va_list ap;
 
-    va_start(ap, cmd_start);
     cmd = nvvstrcat(cmd_start, ap);
-    va_end(ap);
 
     if (!cmd) {
         return 1;
@@ -296,12 +220,7 @@ int run_command(Options *op, char **data, int output,
      * SIGWINCH when its caught in the parent process.
      */
     if (op->sigwinch_workaround) {
-        act.sa_handler = SIG_IGN;
-        sigemptyset(&act.sa_mask);
-        act.sa_flags = 0;
-
-        if (sigaction(SIGWINCH, &act, &old_act) < 0)
-            old_act.sa_handler = NULL;
+        ignore_sigwinch();
     }
 
     /*
@@ -319,17 +238,24 @@ int run_command(Options *op, char **data, int output,
      * command.
      */
     
-    stream = popen(cmd, "r");
+    NV_PROBE1(run_command__start, cmd);
+
+    /*
+     * take the timing phase whose progress this command reports now, rather
+     * than for each line of output, in case another thread begins or ends
+     * a phase while the command runs
+     */
+
+    phase = output_match ? timing_active_phase() : NULL;
+
+    stream = js ? jobserver_popen(js, cmd, &pid) : popen(cmd, "r");
 
     if (stream == NULL) {
         ret = errno;
         ui_error(op, "Failure executing command '%s' (%s).",
                  cmd, strerror(errno));
-    }
-
-    nvfree(cmd);
-
-    if (stream == NULL) {
+        NV_PROBE2(run_command__done, cmd, ret);
+        nvfree(cmd);
         return ret;
     }
 
@@ -389,8 +315,7 @@ int run_command(Options *op, char **data, int output,
                 }
             }
 
-            if (n > total_lines) n = total_lines;
-            percent = (float) n / (float) total_lines;
+            percent = (float) NV_MIN(n, total_lines) / (float) total_lines;
 
             /*
              * XXX: manually call the SIGWINCH handler, if set, to
@@ -399,15 +324,34 @@ int run_command(Options *op, char **data, int output,
             if (op->sigwinch_workaround) {
                 /* Only call into the handler if it isn't one of the special
                  * pointer values from bits/signum-generic.h */
-                if (old_act.sa_handler != NULL &&
-                    old_act.sa_handler != SIG_DFL &&
-                    old_act.sa_handler != SIG_IGN &&
-                    old_act.sa_handler != SIG_ERR) {
-                    old_act.sa_handler(SIGWINCH);
+                void (*handler)(int) = sigwinch_old_act.sa_handler;
+
+                if (handler != NULL &&
+                    handler != SIG_DFL &&
+                    handler != SIG_IGN &&
+                    handler != SIG_ERR) {
+                    handler(SIGWINCH);
                 }
             }
 
-            ui_status_update(op, percent, NULL);
+            /*
+             * If the duration of this build step is known from earlier
+             * builds, let the timing history measure progress by elapsed
+             * time, and report the estimated time remaining.
+             */
+            if (phase) {
+                char eta[64];
+
+                percent = timing_phase_progress(phase, n, percent, eta,
+                                                sizeof(eta));
+                if (eta[0]) {
+                    ui_status_update(op, percent, "%s", eta);
+                } else {
+                    ui_status_update(op, percent, NULL);
+                }
+            } else {
+                ui_status_update(op, percent, NULL);
+            }
         }
 
         len += strlen(buf + len);
@@ -417,14 +361,17 @@ int run_command(Options *op, char **data, int output,
 
     /* Close the popen()'ed stream. */
 
-    ret = pclose(stream);
+    ret = js ? jobserver_pclose(stream, pid) : pclose(stream);
+
+    NV_PROBE2(run_command__done, cmd, ret);
+    nvfree(cmd);
 
     /*
      * Restore the SIGWINCH signal disposition and handler, if any,
      * to their original values.
      */
     if (op->sigwinch_workaround)
-        sigaction(SIGWINCH, &old_act, NULL);
+        restore_sigwinch();
 
     /* if the last character in the buffer is a newline, null it */
     
@@ -434,23 +381,85 @@ int run_command(Options *op, char **data, int output,
     else free(buf);
     
     return ret;
-    
+}
+
+
+/*
+ * run_command() - this function runs the given command and assigns
+ * the data parameter to a malloced buffer containing the command's
+ * output, if any.  The caller of this function should free the data
+ * string.  The return value of the command is returned from this
+ * function.
+ *
+ * The output parameter controls whether command output is sent to the
+ * ui; if this is TRUE, then everyline of output that is read is sent
+ * to the ui.
+ *
+ * If the output_match parameter is set to a { 0 }-terminated array of
+ * RunCommandOutputMatch records, it is interpreted as a rough estimate of how
+ * many lines of output (optionally requiring an initial substring match) will
+ * be generated by the command.  This is used to compute the value that should
+ * be passed to ui_status_update() as lines of output are received. This may be
+ * set to NULL to skip the ui_status_update() updates.
+ *
+ * The redirect argument tells run_command() to redirect stderr to
+ * stdout so that all output is collected, or just stdout.
+ *
+ * XXX maybe we should do something to cap the time we allow the
+ * command to run?
+ */
+
+int run_command(Options *op, char **data, int output,
+                const RunCommandOutputMatch *output_match, int redirect,
+                const char *cmd_start, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, cmd_start);
+    ret = run_command_va(op, NULL, data, output, output_match, redirect,
+                         cmd_start, ap);
+    va_end(ap);
+
+    return ret;
 } /* run_command() */
 
 
+/*
+ * run_command_with_jobserver() - run_command(), with the command run as a
+ * client of the jobserver 'js' if that is non-NULL.
+ */
+
+int run_command_with_jobserver(Options *op, const Jobserver *js,
+                               char **data, int output,
+                               const RunCommandOutputMatch *output_match,
+                               int redirect, const char *cmd_start, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, cmd_start);
+    ret = run_command_va(op, js, data, output, output_match, redirect,
+                         cmd_start, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+
 
 /*
  * read_text_file() - open a text file, read its contents and return
- * them to the caller in a newly allocated buffer.  Returns TRUE on
- * success and FALSE on failure.
+ * them to the caller in a newly allocated, NUL terminated buffer.  The
+ * file is read in large blocks rather than line by line, since its size
+ * is not known in advance for files in /proc.  Returns TRUE on success
+ * and FALSE on failure.
  */
 
 int read_text_file(const char *filename, char **buf)
 {
     FILE *fp;
-    int index = 0, buflen = 0;
-    int eof = FALSE;
-    char *line, *tmpbuf;
+    size_t len = 0, buflen = 4096, ret;
 
     *buf = NULL;
 
@@ -458,28 +467,23 @@ int read_text_file(const char *filename, char **buf)
     if (!fp)
         return FALSE;
 
-    while (((line = fget_next_line(fp, &eof)) != NULL)) {
-        if ((index + strlen(line) + 2) > buflen) {
-            buflen = 2 * (index + strlen(line) + 2);
-            tmpbuf = (char *)nvalloc(buflen);
-            if (!tmpbuf) {
-                if (*buf) nvfree(*buf);
-                fclose(fp);
-                return FALSE;
-            }
-            if (*buf) {
-                memcpy(tmpbuf, *buf, index);
-                nvfree(*buf);
-            }
-            *buf = tmpbuf;
+    *buf = nvalloc(buflen);
+
+    while ((ret = fread(*buf + len, 1, buflen - len - 1, fp)) > 0) {
+        len += ret;
+        if (len + 1 == buflen) {
+            buflen *= 2;
+            *buf = nvrealloc(*buf, buflen);
         }
+    }
 
-        index += sprintf(*buf + index, "%s\n", line);
-        nvfree(line);
+    (*buf)[len] = '\0';
 
-        if (eof) {
-            break;
-        }
+    if (ferror(fp)) {
+        nvfree(*buf);
+        *buf = NULL;
+        fclose(fp);
+        return FALSE;
     }
 
     fclose(fp);
@@ -1263,7 +1267,7 @@ void check_installed_files_from_package(Options *op, Package *p)
             }
         } else if (installable_files.types[p->entries[i].type]) {
             if (!check_installed_file(op, p->entries[i].dst,
-                                      p->entries[i].mode, 0, ui_warn)) {
+                                      p->entries[i].mode, NULL, ui_warn)) {
                 ret = FALSE;
             }
         }
@@ -1367,6 +1371,40 @@ int verify_crc(Options *op, const char *filename, unsigned int crc,
 
 
 
+/*
+ * verify_digest() - Compute the digest of a file, with the algorithm of the
+ * expected digest, and compare the two. Returns TRUE if they match, or if
+ * there is no expected digest; otherwise, returns FALSE and sets
+ * '*actual_str' to the new digest, formatted as a string, which the caller
+ * should free.
+ */
+int verify_digest(Options *op, const char *filename, const Digest *expected,
+                  char **actual_str)
+{
+    static const uint8 zero[DIGEST_MAX_LENGTH];
+    Digest actual;
+
+    /* as in verify_crc(), an all-zero digest means there is nothing to check */
+    if (!expected || memcmp(expected->bytes, zero, expected->length) == 0) {
+        return TRUE;
+    }
+
+    if (!compute_digest(op, expected->algorithm, filename, &actual)) {
+        *actual_str = nvstrdup("unreadable");
+        return FALSE;
+    }
+
+    if (digests_equal(&actual, expected)) {
+        return TRUE;
+    }
+
+    *actual_str = digest_to_string(&actual);
+
+    return FALSE;
+} /* verify_digest() */
+
+
+
 /*
  * check_installed_file() - check that the specified installed file exists,
  * has the correct permissions, and has the correct crc. Takes a function
@@ -1378,11 +1416,12 @@ int verify_crc(Options *op, const char *filename, unsigned int crc,
  */
 
 int check_installed_file(Options *op, const char *filename,
-                         const mode_t mode, const uint32 crc,
+                         const mode_t mode, const Digest *digest,
                          ui_message_func *logwarn)
 {
     struct stat stat_buf;
-    uint32 actual_crc;
+    char *actual = NULL, *expected = NULL;
+    int ret = FALSE;
 
     if (lstat(filename, &stat_buf) == -1) {
         logwarn(op, "Unable to find installed file '%s' (%s).",
@@ -1408,46 +1447,54 @@ int check_installed_file(Options *op, const char *filename,
     }
 
 
-    if (!verify_crc(op, filename, crc, &actual_crc)) {
-        int ret;
+    if (!verify_digest(op, filename, digest, &actual)) {
+        expected = digest_to_string(digest);
 
         /* If this is not an ELF file, we should not try to unprelink it. */
 
         if (get_elf_architecture(filename) == ELF_INVALID_FILE) {
             logwarn(op, "The installed file '%s' has a different checksum "
-                    "(%ul) than when it was installed (%ul).", filename,
-                    actual_crc, crc);
-            return FALSE;
+                    "(%s) than when it was installed (%s).", filename,
+                    actual, expected);
+            goto done;
         }
 
         /* Otherwise, unprelinking may be able to restore the original file. */
 
-        ui_expert(op, "The installed file '%s' has a different checksum (%ul) "
-                  "than when it was installed (%ul). This may be due to "
+        ui_expert(op, "The installed file '%s' has a different checksum (%s) "
+                  "than when it was installed (%s). This may be due to "
                   "prelinking; attempting `prelink -u %s` to restore the file.",
-                  filename, actual_crc, crc, filename);
+                  filename, actual, expected, filename);
 
-        ret = unprelink(op, filename);
-        if (ret != 0) {
+        if (unprelink(op, filename) != 0) {
             logwarn(op, "The installed file '%s' seems to have changed, but "
                     "`prelink -u` failed; unable to restore '%s' to an "
                     "un-prelinked state.", filename, filename);
-            return FALSE;
+            goto done;
         }
 
-        if (!verify_crc(op, filename, crc, &actual_crc)) {
+        nvfree(actual);
+        actual = NULL;
+
+        if (!verify_digest(op, filename, digest, &actual)) {
             logwarn(op, "The installed file '%s' has a different checksum "
-                    "(%ul) after running `prelink -u` than when it was "
-                    "installed (%ul).",
-                    filename, actual_crc, crc);
-            return FALSE;
+                    "(%s) after running `prelink -u` than when it was "
+                    "installed (%s).",
+                    filename, actual, expected);
+            goto done;
         }
 
         ui_expert(op, "Un-prelinking successful: %s was restored to its "
                   "original state.", filename);
     }
 
-    return TRUE;
+    ret = TRUE;
+
+done:
+    nvfree(actual);
+    nvfree(expected);
+
+    return ret;
     
 }
 
@@ -3073,6 +3120,11 @@ void set_concurrency_level(Options *op)
         }
 
         if (detected_cpus >= 1) {
+            if (op->adaptive_concurrency) {
+                default_concurrency =
+                    get_resource_aware_concurrency(op, default_concurrency);
+            }
+
             ui_log(op, "Detected %d CPUs online; setting concurrency level "
                    "to %d.", detected_cpus, default_concurrency);
         } else
@@ -3095,10 +3147,151 @@ to detect the number of processors.
            val = atoi(ui_get_input(op, strval, "Concurrency level"));
            nvfree(strval);
         } while (val < 1);
+
+        if (val != op->concurrency_level) {
+            ui_log(op, "Concurrency level set to %d.", val);
+        }
         op->concurrency_level = val;
     }
 }
 
+/*
+ * get_meminfo_bytes() - return the value of 'field' (e.g. "MemAvailable")
+ * from /proc/meminfo in bytes, or -1 if it can't be read.
+ */
+
+long long get_meminfo_bytes(const char *field)
+{
+    FILE *fp = fopen("/proc/meminfo", "r");
+    char line[256];
+    size_t len = strlen(field);
+    long long kb = -1;
+
+    if (!fp) {
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, field, len) == 0 && line[len] == ':') {
+            if (sscanf(line + len + 1, "%lld", &kb) != 1) {
+                kb = -1;
+            }
+            break;
+        }
+    }
+
+    fclose(fp);
+
+    return kb < 0 ? -1 : kb * 1024;
+}
+
+
+/* ioprio_set(2) has no glibc wrapper, nor (on older systems) a header */
+#define NV_IOPRIO_WHO_PROCESS 1
+#define NV_IOPRIO_CLASS_IDLE  3
+#define NV_IOPRIO_CLASS_SHIFT 13
+
+/*
+ * set_low_impact_priority() - for --low-impact installations, move the
+ * installer into the idle I/O scheduling class and the SCHED_IDLE CPU
+ * scheduling policy (falling back to the lowest nice value), so that it
+ * only uses otherwise idle resources. These settings are inherited by every
+ * process the installer starts, including make(1), depmod(8) and
+ * ldconfig(8), and by any threads it creates afterwards; call this before
+ * starting any threads. Also record the size of the page cache, so that
+ * report_page_cache_usage() can report how much of it the install used.
+ */
+
+void set_low_impact_priority(Options *op)
+{
+    if (!op->low_impact) {
+        return;
+    }
+
+    op->page_cache_at_start = get_meminfo_bytes("Cached");
+    compute_crc_set_drop_page_cache(TRUE);
+
+#if defined(SYS_ioprio_set)
+    if (syscall(SYS_ioprio_set, NV_IOPRIO_WHO_PROCESS, 0,
+                NV_IOPRIO_CLASS_IDLE << NV_IOPRIO_CLASS_SHIFT) == 0) {
+        ui_log(op, "Set the I/O scheduling class to idle.");
+    } else {
+        ui_log(op, "Unable to set the I/O scheduling class to idle (%s).",
+               strerror(errno));
+    }
+#endif
+
+#if defined(SCHED_IDLE)
+    {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+
+        if (sched_setscheduler(0, SCHED_IDLE, &param) == 0) {
+            ui_log(op, "Set the CPU scheduling policy to SCHED_IDLE.");
+            return;
+        }
+
+        ui_log(op, "Unable to set the CPU scheduling policy to SCHED_IDLE "
+               "(%s).", strerror(errno));
+    }
+#endif
+
+    errno = 0;
+    if (nice(19) == -1 && errno != 0) {
+        ui_log(op, "Unable to lower the CPU scheduling priority (%s).",
+               strerror(errno));
+    } else {
+        ui_log(op, "Lowered the CPU scheduling priority to nice 19.");
+    }
+}
+
+
+/*
+ * drop_from_page_cache() - for --low-impact installations, drop the
+ * contents of the file open on 'fd' from the page cache once the installer
+ * is done with it. Only clean pages can be dropped, so if 'flush' is set,
+ * write back any dirty pages first.
+ */
+
+void drop_from_page_cache(Options *op, int fd, int flush)
+{
+    if (!op->low_impact || fd < 0) {
+        return;
+    }
+
+    if (flush) {
+        fdatasync(fd);
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+
+/*
+ * report_page_cache_usage() - log how much the page cache grew over the
+ * course of a --low-impact installation.
+ */
+
+void report_page_cache_usage(Options *op)
+{
+    long long now;
+
+    if (!op->low_impact || op->page_cache_at_start < 0) {
+        return;
+    }
+
+    now = get_meminfo_bytes("Cached");
+
+    if (now >= 0) {
+        ui_log(op, "The page cache grew by %lld KiB during installation "
+               "(from %lld KiB to %lld KiB).",
+               (now - op->page_cache_at_start) / 1024,
+               op->page_cache_at_start / 1024, now / 1024);
+    }
+}
+
+
 /*
  * get_pkg_config_variable() - call pkg-config to query the value of the given
  *                             variable.
@@ -3263,20 +3456,6 @@ int option_is_supported(Options *op, const char *cmd, const char *help,
 }
 
 
-/* Attempt to dlopen(3) a DSO to detect its availability. */
-static int detect_library(const char *library)
-{
-    void *handle = dlopen(library, RTLD_NOW);
-
-    if (handle) {
-        dlclose(handle);
-        return TRUE;
-    }
-
-    return FALSE;
-}
-
-
 /* Test if the system has a Vulkan loader; warn if none is detected */
 void check_for_vulkan_loader(Options *op)
 {
@@ -3288,7 +3467,7 @@ void check_for_vulkan_loader(Options *op)
         return;
     }
 
-    if (!detect_library("libvulkan.so.1")) {
+    if (!detect_vulkan_loader(op)) {
         ui_warn(op, "This NVIDIA driver package includes Vulkan components, "
                 "but no Vulkan ICD loader was detected on this system. "
                 "The NVIDIA Vulkan ICD will not function without the loader. "
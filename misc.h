@@ -30,6 +30,8 @@
 #include "nvidia-installer.h"
 #include "command-list.h"
 #include "user-interface.h"
+#include "digest.h"
+#include "jobserver.h"
 
 /*
  * Enumeration to identify whether the execution of a distro hook script has
@@ -64,15 +66,17 @@ typedef struct {
     char *initial_match;
 } RunCommandOutputMatch;
 
-char *read_next_word (char *buf, char **e);
-
 int check_euid(Options *op);
 int adjust_cwd(Options *op, const char *program_name);
-char *get_next_line(char *buf, char **e, char *start, int length);
 __attribute__((sentinel))
 int run_command(Options *op, char **data, int output,
                 const RunCommandOutputMatch *match, int redirect,
                 const char *cmd_start, ...);
+__attribute__((sentinel))
+int run_command_with_jobserver(Options *op, const Jobserver *js,
+                               char **data, int output,
+                               const RunCommandOutputMatch *match,
+                               int redirect, const char *cmd_start, ...);
 int read_text_file(const char *filename, char **buf);
 char *find_system_util(const char *util);
 int find_system_utils(Options *op);
@@ -89,7 +93,7 @@ void should_install_optional_modules(Options *op, Package *p,
                                      const KernelModuleInfo *optional_modules,
                                      int num_optional_modules);
 void check_installed_files_from_package(Options *op, Package *p);
-int check_installed_file(Options*, const char*, const mode_t, const uint32,
+int check_installed_file(Options*, const char*, const mode_t, const Digest*,
                          ui_message_func *logwarn);
 int check_for_running_x(Options *op);
 void query_xorg_version(Options *op);
@@ -104,9 +108,15 @@ void dkms_register_module(Options *op, Package *p, const char *kernel);
 int dkms_remove_module(Options *op, const char *version);
 int verify_crc(Options *op, const char *filename, unsigned int crc,
                unsigned int *actual_crc);
+int verify_digest(Options *op, const char *filename, const Digest *expected,
+                  char **actual_str);
 int secure_boot_enabled(void);
 ElfFileType get_elf_architecture(const char *filename);
 void set_concurrency_level(Options *op);
+long long get_meminfo_bytes(const char *field);
+void set_low_impact_priority(Options *op);
+void drop_from_page_cache(Options *op, int fd, int flush);
+void report_page_cache_usage(Options *op);
 char *get_pkg_config_variable(Options *op,
                               const char *pkg, const char *variable);
 int check_systemd(Options *op);
@@ -72,11 +72,12 @@ typedef struct {
 
 #include "common-utils.h"
 #include "crc.h"
+#include "digest.h"
 #include "precompiled.h"
 
 
 /*
- * XXX hack to resolve symbols used by crc.c and precompiled.c
+ * XXX hack to resolve symbols used by crc.c, digest.c and precompiled.c
  */
 
 void ui_warn(Options *op, const char *fmt, ...);
@@ -673,6 +674,11 @@ int main(int argc, char *argv[])
 
             printf("  size: %d bytes\n", file->size);
             printf("  crc: %" PRIu32 "\n", file->crc);
+            if (file->attributes & PRECOMPILED_ATTR(DIGEST)) {
+                char *digest = digest_to_string(&file->digest);
+                printf("  digest: %s\n", digest);
+                nvfree(digest);
+            }
             printf("  target directory: %s\n", file->target_directory);
 
             if (file->type == PRECOMPILED_FILE_TYPE_INTERFACE) {
@@ -681,6 +687,12 @@ int main(int argc, char *argv[])
                 if (file->signature_size) {
                     printf("  linked module crc: %" PRIu32 "\n",
                            file->linked_module_crc);
+                    if (file->attributes & PRECOMPILED_ATTR(DIGEST)) {
+                        char *digest =
+                            digest_to_string(&file->linked_module_digest);
+                        printf("  linked module digest: %s\n", digest);
+                        nvfree(digest);
+                    }
                     printf("  signature size: %d\n", file->signature_size);
                 }
             }
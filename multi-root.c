@@ -0,0 +1,724 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ *
+ * multi-root.c - install the driver into several root directories, such as
+ * the roots of container or virtual machine images, in one run.
+ *
+ * The destination of each file only depends on the library directories
+ * and the X paths found in a root, so the roots are grouped by those, and
+ * the installation plan is computed once for each group; the other
+ * destinations don't depend on this system. Each file in the package is
+ * then mapped and checksummed once, and the roots are installed in
+ * parallel, each one writing every file from the shared mapping. Lastly, a
+ * backup log is written into each root, listing the files and directories
+ * that were installed there, with paths as they appear from within the
+ * root.
+ *
+ * Nothing is done to this system: no existing files in the roots are
+ * backed up, and the steps that need to run within the root (ldconfig,
+ * SELinux labeling, X configuration) are left to the image build. Every
+ * path is resolved within its root with open_in_root() and the *at()
+ * calls, so that symbolic links in an image, such as "usr/lib -> /usr/lib",
+ * can't redirect the installation onto this system.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "multi-root.h"
+#include "manifest.h"
+#include "backup.h"
+#include "digest.h"
+#include "files.h"
+#include "misc.h"
+
+/* the most roots installed at the same time */
+#define MAX_ROOT_WORKERS 16
+
+typedef struct {
+    int source;         /* the package entry to copy, or -1 for a symlink */
+    char *dst;
+    char *target;       /* the symlink target */
+    mode_t mode;
+    int if_missing;     /* only install if nothing exists at 'dst' */
+} RootInstallEntry;
+
+typedef struct {
+    const char *native_libdir;
+    const char *compat32_libdir;
+    char *x_library_path;
+    char *x_module_path;
+    char *x_sysconfig_path;
+
+    RootInstallEntry *entries;
+    int num_entries;
+} RootLayout;
+
+typedef struct {
+    const uint8 *data;
+    size_t size;
+    Digest digest;
+} RootSource;
+
+typedef struct {
+    const char *root;
+    int root_fd;        /* from open_root() */
+    int layout;
+
+    RootBackupEntry *installed;
+    int num_installed;
+    char *dirs;
+    int ret;
+    UiWorkerMessages *messages;
+} RootJob;
+
+typedef struct {
+    Options *op;
+    const RootLayout *layouts;
+    const RootSource *sources;
+
+    RootJob *jobs;
+    int num_jobs;
+    int next_job;
+
+    UiProgress progress;
+} RootInstall;
+
+
+/*
+ * parse_roots() - split the comma-separated list of roots, and check that
+ * each one is an existing directory; duplicates are dropped.
+ */
+
+static char **parse_roots(Options *op, const char *list, int *num_roots)
+{
+    char **roots = NULL, *buf, *root, *save = NULL;
+    int n = 0, i, ret = TRUE;
+
+    buf = nvstrdup(list);
+
+    for (root = strtok_r(buf, ",", &save); root;
+         root = strtok_r(NULL, ",", &save)) {
+        size_t len;
+        int duplicate = FALSE;
+
+        collapse_multiple_slashes(root);
+        len = strlen(root);
+        while (len > 1 && root[len - 1] == '/') {
+            root[--len] = '\0';
+        }
+
+        if (root[0] != '/' || len == 1) {
+            ui_error(op, "The target root '%s' must be an absolute path, and "
+                     "not '/'.", root);
+            ret = FALSE;
+            continue;
+        }
+
+        if (!directory_exists(root)) {
+            ui_error(op, "The target root '%s' is not a directory.", root);
+            ret = FALSE;
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (strcmp(roots[i], root) == 0) {
+                duplicate = TRUE;
+            }
+        }
+
+        if (!duplicate) {
+            roots = nvrealloc(roots, sizeof(char *) * (n + 1));
+            roots[n++] = nvstrdup(root);
+        }
+    }
+
+    nvfree(buf);
+
+    if (!ret || n == 0) {
+        if (n == 0 && ret) {
+            ui_error(op, "No target roots were given.");
+        }
+        for (i = 0; i < n; i++) {
+            nvfree(roots[i]);
+        }
+        nvfree(roots);
+        return NULL;
+    }
+
+    *num_roots = n;
+    return roots;
+}
+
+
+static int same_path(const char *a, const char *b)
+{
+    return (a == b) || (a && b && strcmp(a, b) == 0);
+}
+
+
+static int same_layout(const RootLayout *a, const RootLayout *b)
+{
+    return same_path(a->native_libdir, b->native_libdir) &&
+           same_path(a->compat32_libdir, b->compat32_libdir) &&
+           same_path(a->x_library_path, b->x_library_path) &&
+           same_path(a->x_module_path, b->x_module_path) &&
+           same_path(a->x_sysconfig_path, b->x_sysconfig_path);
+}
+
+
+/*
+ * plan_layout() - compute the destinations of the package files for the
+ * library directories and X paths of 'layout', with set_destinations(),
+ * and record the files and symlinks to install. The original symlink targets are in
+ * 'targets', since set_destinations() prepends directories to some.
+ */
+
+static void plan_layout(Options *op, Package *p, RootLayout *layout,
+                        char * const *targets)
+{
+    PackageEntryFileTypeList installable_files;
+    char *opengl_libdir = op->opengl_libdir;
+    char *utility_libdir = op->utility_libdir;
+    char *gbm_backend_dir = op->gbm_backend_dir;
+    char *wine_libdir = op->wine_libdir;
+    char *compat32_libdir = op->compat32_libdir;
+    char *x_library_path = op->x_library_path;
+    char *x_module_path = op->x_module_path;
+    char *x_sysconfig_path = op->x_sysconfig_path;
+    char *host_gbm_dir, *host_wine_dir, *gbm_dir = NULL, *wine_dir = NULL;
+    const char *json_path;
+    int i;
+
+    /*
+     * move the library directories that follow the native library
+     * directory, unless they were given explicitly
+     */
+
+    if (!same_path(layout->native_libdir, op->opengl_libdir)) {
+        host_gbm_dir = nvstrcat(op->opengl_libdir, "/gbm", NULL);
+        gbm_dir = nvstrcat(layout->native_libdir, "/gbm", NULL);
+        host_wine_dir = nvstrcat(op->opengl_libdir, "/",
+                                 DEFAULT_WINE_LIBDIR_SUFFIX, NULL);
+        wine_dir = nvstrcat(layout->native_libdir, "/",
+                            DEFAULT_WINE_LIBDIR_SUFFIX, NULL);
+        collapse_multiple_slashes(host_wine_dir);
+        collapse_multiple_slashes(wine_dir);
+
+        if (same_path(op->utility_libdir, op->opengl_libdir)) {
+            op->utility_libdir = (char *) layout->native_libdir;
+        }
+        if (same_path(op->gbm_backend_dir, host_gbm_dir)) {
+            op->gbm_backend_dir = gbm_dir;
+        }
+        if (same_path(op->wine_libdir, host_wine_dir)) {
+            op->wine_libdir = wine_dir;
+        }
+        op->opengl_libdir = (char *) layout->native_libdir;
+
+        nvfree(host_gbm_dir);
+        nvfree(host_wine_dir);
+    }
+    op->compat32_libdir = (char *) layout->compat32_libdir;
+    op->x_library_path = layout->x_library_path;
+    op->x_module_path = layout->x_module_path;
+    op->x_sysconfig_path = layout->x_sysconfig_path;
+
+    for (i = 0; i < p->num_entries; i++) {
+        if (p->entries[i].type != FILE_TYPE_NONE) {
+            nvfree(p->entries[i].dst);
+            p->entries[i].dst = NULL;
+        }
+        if (targets[i]) {
+            nvfree(p->entries[i].target);
+            p->entries[i].target = nvstrdup(targets[i]);
+        }
+    }
+
+    set_destinations(op, p);
+
+    op->opengl_libdir = opengl_libdir;
+    op->utility_libdir = utility_libdir;
+    op->gbm_backend_dir = gbm_backend_dir;
+    op->wine_libdir = wine_libdir;
+    op->compat32_libdir = compat32_libdir;
+    op->x_library_path = x_library_path;
+    op->x_module_path = x_module_path;
+    op->x_sysconfig_path = x_sysconfig_path;
+    nvfree(gbm_dir);
+    nvfree(wine_dir);
+
+    /*
+     * the libglvnd EGL vendor library config files go in the libglvnd
+     * data directory of the root, which can't be asked for here
+     */
+
+    json_path = op->libglvnd_json_path ? op->libglvnd_json_path :
+                                         DEFAULT_GLVND_EGL_JSON_PATH;
+
+    get_installable_file_type_list(op, &installable_files);
+
+    for (i = 0; i < p->num_entries; i++) {
+        PackageEntry *pe = &p->entries[i];
+        RootInstallEntry *e;
+
+        if (pe->type == FILE_TYPE_GLVND_EGL_ICD_JSON) {
+            pe->dst = nvstrcat(json_path, "/", pe->name, NULL);
+            collapse_multiple_slashes(pe->dst);
+        }
+
+        if (!pe->dst ||
+            !(pe->caps.is_symlink || installable_files.types[pe->type])) {
+            continue;
+        }
+
+        layout->entries = nvrealloc(layout->entries, sizeof(RootInstallEntry) *
+                                    (layout->num_entries + 1));
+        e = &layout->entries[layout->num_entries++];
+
+        e->source = pe->caps.is_symlink ? -1 : i;
+        e->dst = nvstrdup(pe->dst);
+        e->target = pe->caps.is_symlink ? nvstrdup(pe->target) : NULL;
+        e->mode = pe->mode;
+
+        /* as check_libGLX_indirect_links() does, keep an existing link */
+
+        e->if_missing = (pe->type == FILE_TYPE_OPENGL_SYMLINK) &&
+                        (strcmp(pe->name, "libGLX_indirect.so.0") == 0) &&
+                        (op->install_libglx_indirect != NV_OPTIONAL_BOOL_TRUE);
+    }
+}
+
+
+/*
+ * map_sources() - map each file that is installed by any layout, and
+ * compute its digest for the backup logs.
+ */
+
+static int map_sources(Options *op, Package *p, const RootLayout *layouts,
+                       int num_layouts, RootSource *sources)
+{
+    int l, i;
+
+    for (l = 0; l < num_layouts; l++) {
+        for (i = 0; i < layouts[l].num_entries; i++) {
+            int source = layouts[l].entries[i].source;
+            RootSource *s;
+            struct stat stat_buf;
+            int fd;
+
+            if (source < 0 || sources[source].data) {
+                continue;
+            }
+
+            s = &sources[source];
+
+            if ((fd = open(p->entries[source].file, O_RDONLY)) == -1 ||
+                fstat(fd, &stat_buf) == -1) {
+                ui_error(op, "Unable to open '%s' (%s).",
+                         p->entries[source].file, strerror(errno));
+                if (fd != -1) close(fd);
+                return FALSE;
+            }
+
+            s->size = stat_buf.st_size;
+
+            if (s->size > 0) {
+                void *data = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE,
+                                  fd, 0);
+                if (data == MAP_FAILED) {
+                    ui_error(op, "Unable to map '%s' (%s).",
+                             p->entries[source].file, strerror(errno));
+                    close(fd);
+                    return FALSE;
+                }
+                s->data = data;
+            }
+
+            close(fd);
+
+            compute_digest_from_buffer(op->digest_algorithm, s->data,
+                                       s->size, &s->digest);
+        }
+    }
+
+    return TRUE;
+}
+
+
+/*
+ * install_root_entry() - install one file or symlink into the root of
+ * 'job', creating its directory if needed. This runs on a worker thread.
+ */
+
+static int install_root_entry(Options *op, RootJob *job,
+                              const RootInstallEntry *e,
+                              const RootSource *sources)
+{
+    char *path, *dir, *name;
+    struct stat stat_buf;
+    int ret = FALSE, dir_fd, fd;
+
+    /* the full path is only used in messages */
+
+    path = nvstrcat(job->root, "/", e->dst, NULL);
+    collapse_multiple_slashes(path);
+
+    dir = nv_dirname(e->dst);
+    name = nv_basename(e->dst);
+
+    if (e->if_missing) {
+        dir_fd = open_in_root(job->root_fd, dir, O_RDONLY | O_DIRECTORY, 0);
+
+        if (dir_fd >= 0 &&
+            fstatat(dir_fd, name, &stat_buf, AT_SYMLINK_NOFOLLOW) == 0) {
+            ui_log(op, "Keeping the existing '%s'.", path);
+            close(dir_fd);
+            ret = TRUE;
+            goto done;
+        }
+
+        if (dir_fd >= 0) close(dir_fd);
+    }
+
+    /* log the created directories as they appear from within the root */
+
+    dir_fd = mkdir_in_root(job->root_fd, dir, 0755, &job->dirs);
+    if (dir_fd == -1) {
+        ui_error(op, "Unable to create the directory '%s' in '%s' (%s).",
+                 dir, job->root, strerror(errno));
+        goto done;
+    }
+
+    if (unlinkat(dir_fd, name, 0) == -1 && errno != ENOENT) {
+        ui_error(op, "Unable to remove '%s' (%s).", path, strerror(errno));
+        goto close_dir;
+    }
+
+    if (e->source < 0) {
+        if (symlinkat(e->target, dir_fd, name) == -1) {
+            ui_error(op, "Unable to create symbolic link '%s' -> '%s' (%s).",
+                     path, e->target, strerror(errno));
+            goto close_dir;
+        }
+    } else {
+        const RootSource *s = &sources[e->source];
+        size_t written = 0;
+
+        fd = openat(dir_fd, name,
+                    O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                    e->mode);
+        if (fd == -1) {
+            ui_error(op, "Unable to create '%s' (%s).", path, strerror(errno));
+            goto close_dir;
+        }
+
+        while (written < s->size) {
+            ssize_t n = write(fd, s->data + written, s->size - written);
+
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += n;
+        }
+
+        /* set the mode explicitly, in case of the umask */
+
+        if (written < s->size || fchmod(fd, e->mode) == -1 ||
+            close(fd) == -1) {
+            ui_error(op, "Unable to write '%s' (%s).", path, strerror(errno));
+            if (written < s->size) close(fd);
+            goto close_dir;
+        }
+    }
+
+    job->installed = nvrealloc(job->installed, sizeof(RootBackupEntry) *
+                               (job->num_installed + 1));
+    job->installed[job->num_installed].filename = e->dst;
+    job->installed[job->num_installed].target = e->target;
+    if (e->source >= 0) {
+        job->installed[job->num_installed].digest = sources[e->source].digest;
+    }
+    job->num_installed++;
+
+    ret = TRUE;
+
+ close_dir:
+    close(dir_fd);
+
+ done:
+    nvfree(name);
+    nvfree(dir);
+    nvfree(path);
+
+    return ret;
+}
+
+
+static void *root_worker(void *arg)
+{
+    RootInstall *ri = arg;
+    int i, j;
+
+    while ((i = __atomic_fetch_add(&ri->next_job, 1, __ATOMIC_SEQ_CST)) <
+           ri->num_jobs) {
+        RootJob *job = &ri->jobs[i];
+        const RootLayout *layout = &ri->layouts[job->layout];
+
+        ui_worker_begin();
+
+        job->ret = TRUE;
+        for (j = 0; j < layout->num_entries; j++) {
+            if (!install_root_entry(ri->op, job, &layout->entries[j],
+                                    ri->sources)) {
+                job->ret = FALSE;
+            }
+            ui_progress_advance(ri->op, &ri->progress, 1);
+        }
+
+        job->messages = ui_worker_end();
+    }
+
+    return NULL;
+}
+
+
+/*
+ * install_into_roots() - install the files of the package into each of the
+ * roots in op->target_roots; the package has already been trimmed to the
+ * files to install by select_package_files().
+ */
+
+int install_into_roots(Options *op, Package *p)
+{
+    RootInstall ri;
+    RootLayout *layouts = NULL;
+    RootSource *sources;
+    pthread_t threads[MAX_ROOT_WORKERS];
+    int started[MAX_ROOT_WORKERS];
+    char **roots, **targets;
+    int num_roots, num_layouts = 0, num_workers, num_ok = 0, ret = FALSE;
+    int total = 0, roots_ok = TRUE, i, l;
+
+    roots = parse_roots(op, op->target_roots, &num_roots);
+    if (!roots) {
+        return FALSE;
+    }
+
+    memset(&ri, 0, sizeof(ri));
+    ri.op = op;
+    ri.num_jobs = num_roots;
+    ri.jobs = nvalloc(sizeof(RootJob) * num_roots);
+
+    /*
+     * refuse to install into any root if paths can't be resolved within
+     * each of them
+     */
+
+    for (i = 0; i < num_roots; i++) {
+        ri.jobs[i].root = roots[i];
+        ri.jobs[i].root_fd = open_root(op, roots[i]);
+        if (ri.jobs[i].root_fd == -1) {
+            roots_ok = FALSE;
+        }
+    }
+
+    if (!roots_ok) {
+        for (i = 0; i < num_roots; i++) {
+            if (ri.jobs[i].root_fd >= 0) {
+                close(ri.jobs[i].root_fd);
+            }
+            nvfree(roots[i]);
+        }
+        nvfree(ri.jobs);
+        nvfree(roots);
+        return FALSE;
+    }
+
+    /*
+     * whether libglvnd is already present can't be checked for each root,
+     * so only install it if asked to
+     */
+
+    if (op->install_libglvnd_libraries != NV_OPTIONAL_BOOL_TRUE) {
+        ui_log(op, "Will not install libglvnd libraries into the target "
+               "roots; use '--install-libglvnd' to install them.");
+        remove_libglvnd_files_from_package(op, p);
+    }
+
+    targets = nvalloc(sizeof(char *) * p->num_entries);
+    for (i = 0; i < p->num_entries; i++) {
+        targets[i] = p->entries[i].target ? nvstrdup(p->entries[i].target) :
+                                            NULL;
+    }
+
+    sources = nvalloc(sizeof(RootSource) * p->num_entries);
+
+    /*
+     * group the roots by their library directories and X paths; refuse to
+     * install if a root doesn't have the layout that this system's
+     * destinations are based on, and which can't be looked up in the root
+     */
+
+    for (i = 0; i < num_roots; i++) {
+        RootLayout layout;
+
+        memset(&layout, 0, sizeof(layout));
+
+        if (!get_libdirs_in_root(op, ri.jobs[i].root_fd, &layout.native_libdir,
+                                 &layout.compat32_libdir)) {
+            ui_error(op, "The 32-bit compatibility libraries are installed "
+                     "into the chroot '%s' on this system, which does not "
+                     "exist in the target root '%s'.  Please install the "
+                     "driver into that root separately.",
+                     op->compat32_chroot, roots[i]);
+            goto done;
+        }
+
+        get_x_paths_in_root(op, ri.jobs[i].root_fd, &layout.x_library_path,
+                            &layout.x_module_path, &layout.x_sysconfig_path);
+
+        for (l = 0; l < num_layouts; l++) {
+            if (same_layout(&layouts[l], &layout)) {
+                break;
+            }
+        }
+
+        if (l == num_layouts) {
+            layouts = nvrealloc(layouts, sizeof(RootLayout) * (l + 1));
+            layouts[l] = layout;
+            plan_layout(op, p, &layouts[l], targets);
+            num_layouts++;
+        } else {
+            nvfree(layout.x_library_path);
+            nvfree(layout.x_module_path);
+            nvfree(layout.x_sysconfig_path);
+        }
+
+        ri.jobs[i].layout = l;
+        total += layouts[l].num_entries;
+
+        ui_log(op, "Installing into '%s' with the library directory '%s'%s%s.",
+               roots[i], layouts[l].native_libdir,
+               layouts[l].x_module_path ? " and the X module path " : "",
+               layouts[l].x_module_path ? layouts[l].x_module_path : "");
+    }
+
+    ui_log(op, "Planned the installation into %d roots with %d distinct "
+           "layouts.", num_roots, num_layouts);
+
+    ri.layouts = layouts;
+    ri.sources = sources;
+
+    if (!map_sources(op, p, layouts, num_layouts, sources)) {
+        goto done;
+    }
+
+    num_workers = NV_MIN(NV_MIN(op->concurrency_level, MAX_ROOT_WORKERS),
+                         num_roots) - 1;
+
+    ui_progress_begin(&ri.progress, total);
+    ui_status_begin(op, "Installing into the target roots:", "Installing");
+
+    for (i = 0; i < num_workers; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, root_worker,
+                                     &ri) == 0);
+    }
+
+    root_worker(&ri);
+
+    for (i = 0; i < num_workers; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    ui_status_end(op, "done.");
+
+    for (i = 0; i < num_roots; i++) {
+        RootJob *job = &ri.jobs[i];
+
+        ui_worker_flush(op, job->messages);
+
+        if (write_root_backup_log(op, p, job->root, job->root_fd,
+                                  job->installed, job->num_installed,
+                                  job->dirs) &&
+            job->ret) {
+            num_ok++;
+        } else {
+            ui_error(op, "Installation into '%s' has failed.", job->root);
+        }
+    }
+
+    if (op->selinux_enabled) {
+        ui_warn(op, "SELinux security contexts were not set on the files "
+                "installed into the target roots; relabel them when the "
+                "images are built.");
+    }
+
+    ui_message(op, "Installed the %s driver version %s into %d of %d target "
+               "roots.", p->description, p->version, num_ok, num_roots);
+
+    ret = (num_ok == num_roots);
+
+ done:
+    for (i = 0; i < p->num_entries; i++) {
+        if (sources[i].data) {
+            munmap((void *) sources[i].data, sources[i].size);
+        }
+        if (p->entries[i].caps.is_temporary) {
+            unlink(p->entries[i].file);
+        }
+        nvfree(targets[i]);
+    }
+
+    for (l = 0; l < num_layouts; l++) {
+        for (i = 0; i < layouts[l].num_entries; i++) {
+            nvfree(layouts[l].entries[i].dst);
+            nvfree(layouts[l].entries[i].target);
+        }
+        nvfree(layouts[l].entries);
+        nvfree(layouts[l].x_library_path);
+        nvfree(layouts[l].x_module_path);
+        nvfree(layouts[l].x_sysconfig_path);
+    }
+
+    for (i = 0; i < num_roots; i++) {
+        close(ri.jobs[i].root_fd);
+        nvfree(ri.jobs[i].installed);
+        nvfree(ri.jobs[i].dirs);
+        nvfree(roots[i]);
+    }
+
+    nvfree(ri.jobs);
+    nvfree(sources);
+    nvfree(targets);
+    nvfree(layouts);
+    nvfree(roots);
+
+    return ret;
+}
@@ -52,15 +52,49 @@ typedef struct {
 
 
 
+/*
+ * PagerText - the text displayed by a pager.  The text is split into
+ * paragraphs (at newlines) once, when the pager text is created; each
+ * paragraph is only wrapped into rows when one of its rows is needed, and
+ * its rows are kept until the width they were wrapped to changes.  Rows
+ * are wrapped exactly as nv_format_text_rows() would wrap the whole text.
+ */
+
+typedef struct {
+    int start;            /* offset of the row in the text */
+    int end;              /* offset of the end of the row */
+} PagerRow;
+
+typedef struct {
+    int start;            /* offset of the paragraph's first row */
+    int width;            /* width of the rows; 0 if not wrapped yet */
+    PagerRow *rows;
+    int num_rows;
+    int max_rows;
+} PagerParagraph;
+
+typedef struct {
+    const char *text;
+    int len;
+    PagerParagraph *paragraphs;
+    int num_paragraphs;
+    char *search;         /* the last string searched for */
+} PagerText;
+
+typedef struct {
+    int paragraph;
+    int row;
+} PagerPosition;
+
 /*
  * PagerStruct - Pager implements the functionality of `less`
  */
 
 typedef struct {
-    TextRows *t;          /* rows of text to be displayed */
+    PagerText *t;         /* text to be displayed */
     RegionStruct *region; /* region in which the text will be displayed */
     const char *label;    /* label for the left side of the footer */
-    int cur;              /* current position in the pager */
+    PagerPosition cur;    /* current position in the pager */
     int page;             /* height of a page (for use with pgup/pgdn) */
 } PagerStruct;
 
@@ -130,6 +164,7 @@ typedef struct {
 #define NV_NCURSES_TAB 9
 #define NV_NCURSES_ENTER 10
 #define NV_NCURSES_BACKSPACE 8
+#define NV_NCURSES_ESCAPE 27
 
 #define NV_NCURSES_CTRL(x) ((x) & 0x1f)
 
@@ -167,7 +202,7 @@ static void  nv_ncurses_status_begin        (Options*, const char*,
 static void  nv_ncurses_status_update       (Options*, const float,
                                              const char*);
 
-static void  nv_ncurses_update_indeterminate(Options*, const char*);
+static unsigned int nv_ncurses_update_indeterminate(Options*, const char*);
 static void  nv_ncurses_status_end          (Options*, const char*);
 static void  nv_ncurses_close               (Options*);
 
@@ -207,8 +242,11 @@ static void nv_ncurses_do_progress_bar_message(DataStruct *, const char *,
 
 /* pager functions */
 
+static PagerText *nv_ncurses_create_pager_text(const char *);
+static void nv_ncurses_destroy_pager_text(PagerText *);
 static PagerStruct *nv_ncurses_create_pager(DataStruct *, int, int, int, int,
-                                            TextRows *, const char *, int);
+                                            PagerText *, const char *, int);
+static int nv_ncurses_pager_offset(PagerStruct *);
 static void nv_ncurses_pager_update(DataStruct *, PagerStruct *);
 static void nv_ncurses_pager_handle_events(DataStruct *, PagerStruct *, int);
 static void nv_ncurses_destroy_pager(PagerStruct *);
@@ -775,8 +813,14 @@ static int nv_ncurses_approve_command_list(Options *op, CommandList *cl,
 
     len = strlen(descr) + 256;
     question = (char *) malloc(len + 1);
-    snprintf(question, len, "The following operations will be performed to "
-             "install the %s.  Is this acceptable?", descr);
+    if (cl->num_unoptimized > cl->num) {
+        snprintf(question, len, "The following %d operations (optimized from "
+                 "%d) will be performed to install the %s.  Is this "
+                 "acceptable?", cl->num, cl->num_unoptimized, descr);
+    } else {
+        snprintf(question, len, "The following operations will be performed "
+                 "to install the %s.  Is this acceptable?", descr);
+    }
     
     commandlist = nv_ncurses_create_command_list_text(d, cl);
 
@@ -945,7 +989,8 @@ static void nv_ncurses_status_update(Options *op, const float percent,
 } /* nv_ncurses_status_update() */
 
 
-static void nv_ncurses_update_indeterminate(Options *op, const char *msg)
+static unsigned int nv_ncurses_update_indeterminate(Options *op,
+                                                    const char *msg)
 {
     DataStruct *d = op->ui.priv;
     static uint32_t pattern = 0x7ff;
@@ -980,7 +1025,7 @@ static void nv_ncurses_update_indeterminate(Options *op, const char *msg)
 
     pattern = pattern << 1 | (pattern >> 31 & 1);
 
-    usleep(100000);
+    return 100000;
 }
 
 
@@ -1463,24 +1508,291 @@ static void nv_ncurses_do_progress_bar_message(DataStruct *d, const char *str,
  */
 
 
+#define PAGER_SEARCH_MAX_LEN 64
+
+/*
+ * nv_ncurses_create_pager_text() - index the start of each paragraph of
+ * the given text; the paragraphs are not wrapped into rows until they are
+ * displayed.  The text is not copied, and must outlive the PagerText.
+ */
+
+static PagerText *nv_ncurses_create_pager_text(const char *text)
+{
+    PagerText *t = (PagerText *) malloc(sizeof(PagerText));
+    int start = 0, max = 0, i;
+
+    t->text = text ? text : "";
+    t->len = strlen(t->text);
+    t->paragraphs = NULL;
+    t->num_paragraphs = 0;
+    t->search = NULL;
+
+    /*
+     * A new paragraph starts after each newline, at the first character
+     * that is not whitespace (other than another newline); this matches
+     * where nv_format_text_rows() starts the row after a newline.
+     */
+
+    do {
+        if (t->num_paragraphs == max) {
+            max = max ? max * 2 : 64;
+            t->paragraphs = (PagerParagraph *)
+                realloc(t->paragraphs, sizeof(PagerParagraph) * max);
+        }
+        memset(&t->paragraphs[t->num_paragraphs], 0, sizeof(PagerParagraph));
+        t->paragraphs[t->num_paragraphs++].start = start;
+
+        for (i = start; i < t->len && t->text[i] != '\n'; i++);
+        if (i >= t->len) break;
+
+        for (start = i + 1; start < t->len &&
+             isspace((unsigned char) t->text[start]) &&
+             t->text[start] != '\n'; start++);
+    } while (start < t->len);
+
+    return t;
+
+} /* nv_ncurses_create_pager_text() */
+
+
+
+/*
+ * nv_ncurses_destroy_pager_text() - free the rows of each paragraph, and
+ * the PagerText itself.
+ */
+
+static void nv_ncurses_destroy_pager_text(PagerText *t)
+{
+    int i;
+
+    if (!t) return;
+
+    for (i = 0; i < t->num_paragraphs; i++) {
+        free(t->paragraphs[i].rows);
+    }
+    free(t->paragraphs);
+    free(t->search);
+    free(t);
+
+} /* nv_ncurses_destroy_pager_text() */
+
+
+
+/*
+ * pager_paragraph() - return the given paragraph of the pager's text,
+ * wrapping it to the width of the pager if it has not already been
+ * wrapped to that width.  The paragraph is broken into rows the same way
+ * nv_format_text_rows() (with word_boundary TRUE) would break it.
+ */
+
+static PagerParagraph *pager_paragraph(PagerStruct *p, int n)
+{
+    PagerParagraph *para = &p->t->paragraphs[n];
+    const char *a, *b, *c, *end;
+    int w = NV_MAX(p->region->w, 1), z, newline;
+
+    if (para->width == w) return para;
+
+    para->width = w;
+    para->num_rows = 0;
+
+    a = p->t->text + para->start;
+    end = p->t->text + p->t->len;
+
+    do {
+        z = end - a;
+
+        if (z < w) {
+            b = a + z;
+        } else {
+            b = a + w;
+            while ((b >= a) && !isspace((unsigned char) *b)) b--;
+            if (b <= a) b = a + w;
+        }
+
+        for (c = a; c < b; c++) if (*c == '\n') { b = c; break; }
+
+        if (para->num_rows == para->max_rows) {
+            para->max_rows = para->max_rows ? para->max_rows * 2 : 4;
+            para->rows = (PagerRow *)
+                realloc(para->rows, sizeof(PagerRow) * para->max_rows);
+        }
+        para->rows[para->num_rows].start = a - p->t->text;
+        para->rows[para->num_rows].end = b - p->t->text;
+        para->num_rows++;
+
+        newline = (*b == '\n');
+        a = b + 1;
+
+        if (isspace((unsigned char) *b)) {
+            while ((a < end) && isspace((unsigned char) *a) && (*a != '\n')) {
+                a++;
+            }
+        } else {
+            a--;
+        }
+    } while (!newline && (a < end));
+
+    return para;
+
+} /* pager_paragraph() */
+
+
+
+/*
+ * helpers for moving a PagerPosition through the rows of the text; the
+ * movement functions return FALSE if there is no row to move to.
+ */
+
+static int pager_compare_positions(PagerPosition a, PagerPosition b)
+{
+    if (a.paragraph != b.paragraph) return a.paragraph - b.paragraph;
+    return a.row - b.row;
+}
+
+static int pager_next_row(PagerStruct *p, PagerPosition *pos)
+{
+    if (pos->row + 1 < pager_paragraph(p, pos->paragraph)->num_rows) {
+        pos->row++;
+    } else if (pos->paragraph + 1 < p->t->num_paragraphs) {
+        pos->paragraph++;
+        pos->row = 0;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int pager_prev_row(PagerStruct *p, PagerPosition *pos)
+{
+    if (pos->row > 0) {
+        pos->row--;
+    } else if (pos->paragraph > 0) {
+        pos->paragraph--;
+        pos->row = pager_paragraph(p, pos->paragraph)->num_rows - 1;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static int pager_visible_rows(PagerStruct *p)
+{
+    return NV_MAX(p->region->h - 1, 1);
+}
+
+
+/*
+ * pager_last_top() - the position of the top row when the pager is
+ * scrolled all the way to the bottom; only the paragraphs that fit in the
+ * last page need to be wrapped to find it.
+ */
+
+static PagerPosition pager_last_top(PagerStruct *p)
+{
+    PagerPosition pos;
+    int i;
+
+    pos.paragraph = p->t->num_paragraphs - 1;
+    pos.row = pager_paragraph(p, pos.paragraph)->num_rows - 1;
+
+    for (i = 1; i < pager_visible_rows(p); i++) {
+        if (!pager_prev_row(p, &pos)) break;
+    }
+
+    return pos;
+}
+
+
+/*
+ * pager_position_offset() - the offset in the text of the row at the
+ * given position.
+ */
+
+static int pager_position_offset(PagerStruct *p, PagerPosition pos)
+{
+    return pager_paragraph(p, pos.paragraph)->rows[pos.row].start;
+}
+
+
+/*
+ * pager_offset_position() - the position of the row that contains the
+ * given offset in the text, or the position of the row that starts
+ * closest before it.
+ */
+
+static PagerPosition pager_offset_position(PagerStruct *p, int offset)
+{
+    PagerParagraph *para;
+    PagerPosition pos;
+    int lo = 0, hi = p->t->num_paragraphs - 1, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (p->t->paragraphs[mid].start <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+
+    pos.paragraph = lo;
+    para = pager_paragraph(p, lo);
+
+    for (pos.row = para->num_rows - 1; pos.row > 0; pos.row--) {
+        if (para->rows[pos.row].start <= offset) break;
+    }
+
+    return pos;
+}
+
+
+/*
+ * nv_ncurses_pager_offset() - the offset in the text of the pager's top
+ * row; used to keep the same text in view when the pager is recreated at
+ * a different width.
+ */
+
+static int nv_ncurses_pager_offset(PagerStruct *p)
+{
+    return pager_position_offset(p, p->cur);
+}
+
+
+/*
+ * pager_scroll_to() - make the row that contains the given offset the top
+ * row, or scroll to the bottom if there are not enough rows after it to
+ * fill the pager.
+ */
+
+static void pager_scroll_to(PagerStruct *p, int offset)
+{
+    PagerPosition last = pager_last_top(p);
+
+    p->cur = pager_offset_position(p, offset);
+
+    if (pager_compare_positions(p->cur, last) > 0) {
+        p->cur = last;
+    }
+}
+
+
+
 /*
  * pager functions -- these functions provide the basic behavior of a
- * text viewer... used to display TextRows.
+ * text viewer... used to display PagerText.
  *
  *  d      : DataStruct struct
  *  x      : starting x coordinate of the pager
  *  y      : starting y coordinate of the pager
  *  w      : width of the pager
  *  h      : height of the pager
- *  t      : TextRows to be displayed
+ *  t      : PagerText to be displayed
  *  label  : string to be displayed in the status bar 
- *  cur    : initial current line of the pager
+ *  offset : offset in the text of the initial top row of the pager
  */
 
 static PagerStruct *nv_ncurses_create_pager(DataStruct *d,
                                             int x, int y, int w, int h,
-                                            TextRows *t, const char *label,
-                                            int cur)
+                                            PagerText *t, const char *label,
+                                            int offset)
 {
     PagerStruct *p = (PagerStruct *) malloc(sizeof(PagerStruct));
     
@@ -1488,7 +1800,7 @@ static PagerStruct *nv_ncurses_create_pager(DataStruct *d,
     p->region = nv_ncurses_create_region(d, x, y, w, h, A_NORMAL, A_NORMAL);
     p->label = label;
     
-    p->cur = cur;
+    pager_scroll_to(p, offset);
     
     p->page = h - 2;
 
@@ -1503,7 +1815,8 @@ static PagerStruct *nv_ncurses_create_pager(DataStruct *d,
 
 /*
  * nv_ncurses_destroy_pager() - free resources associated with the
- * pager
+ * pager; the PagerText is kept, so that it can be displayed again
+ * without indexing the text again.
  */
 
 static void nv_ncurses_destroy_pager(PagerStruct *p)
@@ -1517,44 +1830,49 @@ static void nv_ncurses_destroy_pager(PagerStruct *p)
 
 /*
  * nv_ncurses_pager_update() - redraw the text in the pager, and
- * update the information about the pager in the footer.  Note that
- * this function does not call refresh().
+ * update the information about the pager in the footer.  Only the rows
+ * that are visible are laid out.  Note that this function does not call
+ * refresh().
  */
 
 static void nv_ncurses_pager_update(DataStruct *d, PagerStruct *p)
 {
-    int i, maxy, percent, denom;
+    PagerPosition pos, last;
+    PagerRow *row;
+    int i, percent, denom, more = TRUE;
     char tmp[10];
 
     if (!p) return;
 
-    /* determine the maximum y value for the text */
-
-    maxy = (p->cur + (p->region->h - 1));
-    if (maxy > p->t->n) maxy = p->t->n;
-
     /* draw the text */
 
     wattrset(nv_stdscr, p->region->attr);
 
-    for (i = p->cur; i < maxy; i++) {
-        mvwaddstr(nv_stdscr, p->region->y + i - p->cur, p->region->x,
+    pos = p->cur;
+
+    for (i = 0; i < pager_visible_rows(p); i++) {
+        mvwaddstr(nv_stdscr, p->region->y + i, p->region->x,
                   p->region->line);
-        if (p->t->t[i]) {
-            mvwaddstr(nv_stdscr, p->region->y + i - p->cur, p->region->x,
-                      p->t->t[i]);
+        if (more) {
+            row = &pager_paragraph(p, pos.paragraph)->rows[pos.row];
+            mvwaddnstr(nv_stdscr, p->region->y + i, p->region->x,
+                       p->t->text + row->start, row->end - row->start);
+            more = pager_next_row(p, &pos);
         }
     }
 
-    /* compute the percentage */
-    
-    denom = p->t->n - (p->region->h - 1);
+    /* compute the percentage, from how far into the text the top row is */
+
+    last = pager_last_top(p);
+
+    denom = pager_position_offset(p, last);
     if (denom < 1) percent = 100;
-    else percent = ((100.0 * (float) (p->cur)) / (float) denom);
+    else percent = ((100.0 * (float) nv_ncurses_pager_offset(p)) /
+                    (float) denom);
     
     /* create the percentage string */
     
-    if (p->t->n <= (p->region->h - 1)) snprintf(tmp, 10, "All");
+    if (last.paragraph == 0 && last.row == 0) snprintf(tmp, 10, "All");
     else if (percent <= 0)          snprintf(tmp, 10, "Top");
     else if (percent >= 100)        snprintf(tmp, 10, "Bot");
     else                            snprintf(tmp, 10, "%3d%%", percent);
@@ -1567,6 +1885,77 @@ static void nv_ncurses_pager_update(DataStruct *d, PagerStruct *p)
 
 
 
+/*
+ * pager_read_search() - read a search string in the footer; returns the
+ * string, or NULL if the search was cancelled with Escape.
+ */
+
+static char *pager_read_search(DataStruct *d)
+{
+    char buf[PAGER_SEARCH_MAX_LEN + 2];
+    int ch, len = 0;
+
+    buf[len++] = '/';
+    buf[len] = '\0';
+
+    do {
+        nv_ncurses_set_footer(d, buf, "");
+        wrefresh(nv_stdscr);
+
+        ch = wgetch(nv_stdscr);
+
+        switch (ch) {
+        case NV_NCURSES_BACKSPACE:
+        case KEY_BACKSPACE:
+            if (len > 1) buf[--len] = '\0';
+            break;
+
+        case NV_NCURSES_ESCAPE:
+        case KEY_RESIZE:
+            return NULL;
+
+        default:
+            if (isprint(ch) && len <= PAGER_SEARCH_MAX_LEN) {
+                buf[len++] = (char) ch;
+                buf[len] = '\0';
+            }
+            break;
+        }
+    } while (ch != NV_NCURSES_ENTER);
+
+    return strdup(buf + 1);
+
+} /* pager_read_search() */
+
+
+
+/*
+ * pager_search() - scroll to the next occurrence of the last search
+ * string after the top row, searching the text directly rather than the
+ * rows, so that paragraphs after the match are never laid out.  Returns
+ * FALSE if there is no match.
+ */
+
+static int pager_search(PagerStruct *p)
+{
+    PagerPosition pos = p->cur;
+    const char *match;
+
+    if (!p->t->search || !p->t->search[0]) return FALSE;
+
+    if (!pager_next_row(p, &pos)) return FALSE;
+
+    match = strstr(p->t->text + pager_position_offset(p, pos), p->t->search);
+    if (!match) return FALSE;
+
+    pager_scroll_to(p, match - p->t->text);
+
+    return TRUE;
+
+} /* pager_search() */
+
+
+
 /*
  * nv_ncurses_pager_handle_events() - process any keys that affect the
  * pager.
@@ -1575,45 +1964,85 @@ static void nv_ncurses_pager_update(DataStruct *d, PagerStruct *p)
 static void nv_ncurses_pager_handle_events(DataStruct *d,
                                            PagerStruct *p, int ch)
 {
-    int n;
+    PagerPosition last;
+    char *search;
+    int i;
     
     if (!p) return;
-    n = p->t->n - (p->region->h - 1);
+    last = pager_last_top(p);
 
     switch (ch) {
     case KEY_UP:
-        if (p->cur > 0) {
-            p->cur--;
+        if (pager_prev_row(p, &p->cur)) {
             nv_ncurses_pager_update(d, p);
             wrefresh(nv_stdscr);
         }
         break;
 
     case KEY_DOWN:
-        if (p->cur < n) {
-            p->cur++;
+        if (pager_compare_positions(p->cur, last) < 0) {
+            pager_next_row(p, &p->cur);
             nv_ncurses_pager_update(d, p);
             wrefresh(nv_stdscr);
         }
         break;
 
     case KEY_PPAGE:
-        if (p->cur > 0) {
-            p->cur -= p->page;
-            if (p->cur < 0) p->cur = 0;
+        if (p->cur.paragraph > 0 || p->cur.row > 0) {
+            for (i = 0; i < p->page; i++) {
+                if (!pager_prev_row(p, &p->cur)) break;
+            }
             nv_ncurses_pager_update(d, p);
             wrefresh(nv_stdscr);
         }
         break;
 
     case KEY_NPAGE:
-        if (p->cur < n) {
-            p->cur += p->page;
-            if (p->cur > n) p->cur = n;
+        if (pager_compare_positions(p->cur, last) < 0) {
+            for (i = 0; i < p->page; i++) {
+                if (pager_compare_positions(p->cur, last) >= 0) break;
+                pager_next_row(p, &p->cur);
+            }
             nv_ncurses_pager_update(d, p);
             wrefresh(nv_stdscr);
         }
         break;
+
+    case KEY_HOME:
+    case 'g':
+        p->cur.paragraph = 0;
+        p->cur.row = 0;
+        nv_ncurses_pager_update(d, p);
+        wrefresh(nv_stdscr);
+        break;
+
+    case KEY_END:
+    case 'G':
+        p->cur = last;
+        nv_ncurses_pager_update(d, p);
+        wrefresh(nv_stdscr);
+        break;
+
+    case '/':
+    case 'n':
+        if (ch == '/') {
+            search = pager_read_search(d);
+            if (!search) {
+                nv_ncurses_pager_update(d, p);
+                wrefresh(nv_stdscr);
+                break;
+            }
+            free(p->t->search);
+            p->t->search = search;
+        }
+        if (pager_search(p)) {
+            nv_ncurses_pager_update(d, p);
+        } else {
+            nv_ncurses_pager_update(d, p);
+            nv_ncurses_set_footer(d, "Pattern not found", d->footer_right);
+        }
+        wrefresh(nv_stdscr);
+        break;
     }
 } /* nv_ncurses_pager_handle_events() */
 
@@ -1643,8 +2072,8 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
                                    int num_buttons, int default_button)
 {
     DataStruct *d = (DataStruct *) op->ui.priv;
-    TextRows *t_pager = NULL;
-    int ch, cur = 0;
+    PagerText *t_pager = NULL;
+    int ch, offset = 0;
     int i, button_w = 0, button_y, button = default_button;
     int buttons_x[num_buttons];
     PagerStruct *p = NULL;
@@ -1663,7 +2092,7 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
 
   print_message:
 
-    /* free any existing message region, pager, and pager textrows */
+    /* free any existing message region and pager */
 
     if (d->message) {
 
@@ -1685,10 +2114,6 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
         nv_ncurses_destroy_pager(p);
         p = NULL;
     }
-    if (t_pager) {
-        nv_ncurses_free_text_rows(t_pager);
-        t_pager = NULL;
-    }
 
     /* create the message region and print the question in it */
 
@@ -1707,11 +2132,18 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
 
     /* draw the paged text */
 
+    /*
+     * the pager text is only indexed once; it is wrapped to the new width
+     * as it is displayed, keeping the same text at the top of the pager
+     */
+
     if (pager_title && pager_text) {
-        t_pager = d->format_text_rows(NULL, pager_text, d->message->w, TRUE);
+        if (!t_pager) {
+            t_pager = nv_ncurses_create_pager_text(pager_text);
+        }
         p = nv_ncurses_create_pager(d, 1, d->message->h + 2, d->message->w,
                                     d->height - d->message->h - 4, t_pager,
-                                    pager_title, cur);
+                                    pager_title, offset);
     }
 
     wrefresh(nv_stdscr);
@@ -1722,7 +2154,7 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
         /* if a resize occurred, jump back to the top and redraw */
             if (nv_ncurses_check_resize(d, FALSE)) {
                 if (p) {
-                    cur = p->cur;
+                    offset = nv_ncurses_pager_offset(p);
                 }
                 goto print_message;
         }
@@ -1748,7 +2180,7 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
             case NV_NCURSES_CTRL('L'):
                 nv_ncurses_check_resize(d, TRUE);
                 if (p) {
-                    cur = p->cur;
+                    offset = nv_ncurses_pager_offset(p);
                 }
                 goto print_message;
                 break;
@@ -1785,12 +2217,10 @@ static int nv_ncurses_paged_prompt(Options *op, const char *question,
 
     /* clean up */
 
-    if (t_pager) {
-        nv_ncurses_free_text_rows(t_pager);
-    }
     if (p) {
         nv_ncurses_destroy_pager(p);
     }
+    nv_ncurses_destroy_pager_text(t_pager);
     nv_ncurses_destroy_region(d->message);
     d->message = NULL;
 
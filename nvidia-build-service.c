@@ -0,0 +1,1046 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * nvidia-build-service - a reference implementation of a local kernel
+ * module build service for `nvidia-installer --build-service-socket`.
+ *
+ * The service listens on a Unix domain socket and forks a handler for
+ * each client. Each request is staged into a private work directory under
+ * the cache directory and keyed by a BLAKE3 digest over everything the
+ * client sent (the module sources, the kernel configuration fingerprint and
+ * the build parameters). Requests with the same key share a single build:
+ * the first client to arrive builds while holding the key's lock file, and
+ * later clients block on that lock and are then served from the cache.
+ * Builds for different keys are serialized by a global build lock, so at
+ * most one make(1) runs on the machine at a time, with at most --jobs
+ * parallel jobs.
+ *
+ * Only successful builds are cached; the result of a failed build is sent
+ * to the client and then discarded. The least recently used entries are
+ * removed when the cache grows beyond --cache-size MiB.
+ *
+ * See build-service.h for a description of the wire protocol.
+ */
+
+#define BINNAME "nvidia-build-service"
+#define DEFAULT_CACHE_DIR "/var/cache/nvidia-build-service"
+#define DEFAULT_CACHE_SIZE 1024 /* MiB */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fts.h>
+#include <dirent.h>
+#include <utime.h>
+
+#include <nvgetopt.h>
+
+typedef unsigned int uint32;
+typedef unsigned char uint8;
+
+/*
+ * Options structure
+ */
+
+typedef struct {
+    char *socket_path;
+    char *cache_dir;
+    int cache_size; /* MiB; 0 for no limit */
+    char *make;
+    int jobs;
+} Options;
+
+/*
+ * A single client request, as received from the socket
+ */
+
+typedef struct {
+    char *protocol;
+    char *kernel_name;
+    char *kernel_source_path;
+    char *kernel_output_path;
+    char *excluded_kernel_modules;
+    char **modules;
+    int num_modules;
+    char **targets;
+    int num_targets;
+    char *manifest;
+    size_t total_size;
+} Request;
+
+#define NV_BUILD_SERVICE_DAEMON
+#include "common-utils.h"
+#include "build-service.h"
+#include "crc.h"
+#include "digest.h"
+
+
+/*
+ * XXX hack to resolve symbols used by crc.c and digest.c
+ */
+
+void ui_warn(Options *op, const char *fmt, ...);
+
+void ui_warn(Options *op, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+
+static void log_message(const char *fmt, ...) NV_ATTRIBUTE_PRINTF(1, 2);
+
+static void log_message(const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "%s[%d]: ", BINNAME, (int) getpid());
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+
+/*
+ * print_help()
+ */
+
+static void print_help(void)
+{
+    printf("\n%s: build NVIDIA kernel modules on behalf of nvidia-installer.\n"
+           "\n"
+           "USAGE: %s [options]\n\n", BINNAME, BINNAME);
+
+    printf("Options:\n"
+           "    -s | --socket <path>\n"
+           "        The Unix domain socket to listen on. Pass the same path\n"
+           "        to nvidia-installer with --build-service-socket.\n"
+           "        Default: %s\n"
+           "    -c | --cache-dir <directory>\n"
+           "        The directory in which requests are staged and built\n"
+           "        modules are cached. Default: %s\n"
+           "    -S | --cache-size <MiB>\n"
+           "        The most disk space used by cached builds; the least\n"
+           "        recently used builds are removed to stay within it.\n"
+           "        A size of 0 removes the limit. Default: %d\n"
+           "    -j | --jobs <n>\n"
+           "        The number of parallel make(1) jobs used for each build.\n"
+           "        Builds are serialized, so this also bounds the number of\n"
+           "        compiler processes started by the service. Default: 1\n"
+           "    -m | --make <path>\n"
+           "        The make(1) to run. Default: make\n"
+           "    -h | --help\n"
+           "        Print this help text and exit.\n\n",
+           BUILD_SERVICE_DEFAULT_SOCKET, DEFAULT_CACHE_DIR,
+           DEFAULT_CACHE_SIZE);
+}
+
+
+static Options *parse_commandline(int argc, char *argv[])
+{
+    Options *op;
+    int c, intval;
+    char *strval;
+
+    static const NVGetoptOption long_options[] = {
+        { "socket",    's', NVGETOPT_STRING_ARGUMENT,  NULL, NULL },
+        { "cache-dir", 'c', NVGETOPT_STRING_ARGUMENT,  NULL, NULL },
+        { "cache-size", 'S', NVGETOPT_INTEGER_ARGUMENT, NULL, NULL },
+        { "jobs",      'j', NVGETOPT_INTEGER_ARGUMENT, NULL, NULL },
+        { "make",      'm', NVGETOPT_STRING_ARGUMENT,  NULL, NULL },
+        { "help",      'h', 0,                         NULL, NULL },
+        { NULL,        0,   0,                         NULL, NULL }
+    };
+
+    op = (Options *) nvalloc(sizeof(Options));
+
+    op->socket_path = BUILD_SERVICE_DEFAULT_SOCKET;
+    op->cache_dir = DEFAULT_CACHE_DIR;
+    op->cache_size = DEFAULT_CACHE_SIZE;
+    op->make = "make";
+    op->jobs = 1;
+
+    while (1) {
+        c = nvgetopt(argc, argv, long_options, &strval,
+                     NULL, /* boolval */
+                     &intval,
+                     NULL, /* doubleval */
+                     NULL  /* disable_val */);
+
+        if (c == -1)
+            break;
+
+        switch (c) {
+        case 's': op->socket_path = strval; break;
+        case 'c': op->cache_dir = strval; break;
+        case 'm': op->make = strval; break;
+        case 'S':
+            if (intval < 0) {
+                fprintf(stderr, "Invalid cache size: %d\n", intval);
+                exit(1);
+            }
+            op->cache_size = intval;
+            break;
+        case 'j':
+            if (intval < 1) {
+                fprintf(stderr, "Invalid number of jobs: %d\n", intval);
+                exit(1);
+            }
+            op->jobs = intval;
+            break;
+        case 'h': print_help(); exit(0); break;
+        default:
+            fprintf(stderr, "Please run `%s --help` for usage information.\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+
+    return op;
+}
+
+
+static void free_request(Request *req)
+{
+    int i;
+
+    nvfree(req->protocol);
+    nvfree(req->kernel_name);
+    nvfree(req->kernel_source_path);
+    nvfree(req->kernel_output_path);
+    nvfree(req->excluded_kernel_modules);
+
+    for (i = 0; i < req->num_modules; i++) {
+        nvfree(req->modules[i]);
+    }
+    nvfree(req->modules);
+
+    for (i = 0; i < req->num_targets; i++) {
+        nvfree(req->targets[i]);
+    }
+    nvfree(req->targets);
+
+    nvfree(req->manifest);
+}
+
+
+/*
+ * blake3_hex() - the BLAKE3 digest of 'buf', as hexadecimal digits.
+ */
+
+static char *blake3_hex(const void *buf, size_t len)
+{
+    Digest digest;
+    char *str, *hex;
+
+    compute_digest_from_buffer(DIGEST_BLAKE3,
+                               (const uint8 *) (buf ? buf : ""), len,
+                               &digest);
+
+    str = digest_to_string(&digest);
+    hex = nvstrdup(strchr(str, ':') + 1);
+    nvfree(str);
+
+    return hex;
+}
+
+
+static void append_string(char ***list, int *n, const char *s)
+{
+    *list = nvrealloc(*list, sizeof(char *) * (*n + 1));
+    (*list)[(*n)++] = nvstrdup(s);
+}
+
+
+/*
+ * receive_request() - read records from 'fd' until the "end" record,
+ * writing files into 'srcdir' and collecting parameters into 'req'. Every
+ * record is also summarized in req->manifest, from which the cache key is
+ * derived.
+ */
+
+static int receive_request(int fd, const char *srcdir, Request *req)
+{
+    while (TRUE) {
+        BuildServiceRecord rec;
+        int done = FALSE, ret = TRUE;
+        char *digest;
+
+        if (!build_service_recv_record(fd, &rec)) {
+            log_message("Malformed request, or connection closed by client.");
+            return FALSE;
+        }
+
+        digest = blake3_hex(rec.data, rec.size);
+        nv_append_sprintf(&req->manifest, "%s %o %zu %s %s\n",
+                          rec.kind, (unsigned int) rec.mode, rec.size,
+                          digest, rec.name);
+        nvfree(digest);
+        req->total_size += rec.size;
+
+        if (strcmp(rec.kind, BUILD_SERVICE_RECORD_END) == 0) {
+            done = TRUE;
+        } else if (strcmp(rec.kind, BUILD_SERVICE_RECORD_FILE) == 0) {
+            ret = build_service_write_file(srcdir, &rec);
+            if (!ret) {
+                log_message("Unable to stage '%s'.", rec.name);
+            }
+        } else if (strcmp(rec.kind, BUILD_SERVICE_RECORD_PARAM) == 0) {
+            char **scalar = NULL;
+
+            if (strcmp(rec.name, "protocol") == 0) {
+                scalar = &req->protocol;
+            } else if (strcmp(rec.name, "kernel-name") == 0) {
+                scalar = &req->kernel_name;
+            } else if (strcmp(rec.name, "kernel-source-path") == 0) {
+                scalar = &req->kernel_source_path;
+            } else if (strcmp(rec.name, "kernel-output-path") == 0) {
+                scalar = &req->kernel_output_path;
+            } else if (strcmp(rec.name, "excluded-kernel-modules") == 0) {
+                scalar = &req->excluded_kernel_modules;
+            } else if (strcmp(rec.name, "module") == 0) {
+                append_string(&req->modules, &req->num_modules, rec.data);
+            } else if (strcmp(rec.name, "target") == 0) {
+                if (build_service_path_is_safe(rec.data)) {
+                    append_string(&req->targets, &req->num_targets, rec.data);
+                } else {
+                    ret = FALSE;
+                }
+            }
+
+            if (scalar) {
+                nvfree(*scalar);
+                *scalar = nvstrdup(rec.data);
+            }
+        }
+
+        build_service_free_record(&rec);
+
+        if (!ret) {
+            return FALSE;
+        }
+        if (done) {
+            return TRUE;
+        }
+    }
+}
+
+
+/*
+ * run_make() - run make(1) in 'dir' with the kernel module build variables
+ * from 'req', plus 'extra' (which may be NULL). Output is appended to *log.
+ * Returns TRUE if make exited successfully.
+ */
+
+static int run_make(Options *op, const Request *req, const char *dir,
+                    const char *extra, char **log)
+{
+    char *jobs, *exclude, *syssrc, *sysout;
+    int pipe_fds[2], status;
+    pid_t pid;
+
+    jobs = nvasprintf("-j%d", op->jobs);
+    exclude = nvstrcat("NV_EXCLUDE_KERNEL_MODULES=",
+                       req->excluded_kernel_modules ?
+                       req->excluded_kernel_modules : "", NULL);
+    syssrc = nvstrcat("SYSSRC=", req->kernel_source_path, NULL);
+    sysout = nvstrcat("SYSOUT=", req->kernel_output_path, NULL);
+
+    nv_append_sprintf(log, "%s: make %s %s %s\n", BINNAME, jobs,
+                      extra ? extra : "", exclude);
+
+    if (pipe(pipe_fds) != 0) {
+        status = -1;
+        goto done;
+    }
+
+    pid = fork();
+
+    if (pid == 0) {
+        char *argv[] = { op->make, "-k", jobs, exclude, syssrc, sysout,
+                         (char *) extra, NULL };
+
+        close(pipe_fds[0]);
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        close(pipe_fds[1]);
+
+        if (chdir(dir) == 0) {
+            execvp(op->make, argv);
+        }
+        _exit(127);
+    }
+
+    close(pipe_fds[1]);
+
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        status = -1;
+        goto done;
+    }
+
+    while (TRUE) {
+        char buf[4096];
+        ssize_t len = read(pipe_fds[0], buf, sizeof(buf) - 1);
+
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            break;
+        }
+
+        buf[len] = '\0';
+        nv_append_sprintf(log, "%s", buf);
+    }
+
+    close(pipe_fds[0]);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+done:
+    nvfree(jobs);
+    nvfree(exclude);
+    nvfree(syssrc);
+    nvfree(sysout);
+
+    return status == 0;
+}
+
+
+/*
+ * build_request() - build the modules and targets requested in 'req' from
+ * the sources in 'srcdir', and move the results into 'outdir'. Mirrors
+ * nvidia-installer's own build: a single `make -k` for all modules, then a
+ * single-module rebuild for each module which wasn't created, to isolate
+ * module-specific failures. The targets keep their paths relative to
+ * 'srcdir', so that the client can write them back to the same place.
+ * Returns TRUE if everything requested was built.
+ */
+
+static int build_request(Options *op, const Request *req, const char *srcdir,
+                         const char *outdir, char **log)
+{
+    int i, ret;
+
+    ret = run_make(op, req, srcdir, NULL, log);
+
+    for (i = 0; i < req->num_modules; i++) {
+        char *ko = nvstrcat(srcdir, "/", req->modules[i], ".ko", NULL);
+
+        if (access(ko, F_OK) != 0) {
+            char *single = nvstrcat("NV_KERNEL_MODULES=", req->modules[i],
+                                    NULL);
+            run_make(op, req, srcdir, single, log);
+            nvfree(single);
+        }
+
+        if (access(ko, F_OK) != 0) {
+            nv_append_sprintf(log, "%s: the %s kernel module was not "
+                              "created.\n", BINNAME, req->modules[i]);
+            ret = FALSE;
+        }
+
+        nvfree(ko);
+    }
+
+    for (i = 0; ret && i < req->num_targets; i++) {
+        ret = run_make(op, req, srcdir, req->targets[i], log);
+    }
+
+    if (!ret) {
+        return FALSE;
+    }
+
+    for (i = 0; ret && i < req->num_modules + req->num_targets; i++) {
+        char *name, *src, *dst, *dir, *error = NULL;
+
+        if (i < req->num_modules) {
+            name = nvstrcat(req->modules[i], ".ko", NULL);
+        } else {
+            name = nvstrdup(req->targets[i - req->num_modules]);
+        }
+
+        src = nvdircat(srcdir, name, NULL);
+        dst = nvdircat(outdir, name, NULL);
+
+        dir = nv_dirname(dst);
+        if (!nv_mkdir_recursive(dir, 0755, &error, NULL)) {
+            nv_append_sprintf(log, "%s: %s\n", BINNAME, error);
+            ret = FALSE;
+        } else if (rename(src, dst) != 0) {
+            nv_append_sprintf(log, "%s: unable to move '%s' into the cache "
+                              "(%s).\n", BINNAME, name, strerror(errno));
+            ret = FALSE;
+        }
+
+        nvfree(error);
+        nvfree(dir);
+        nvfree(name);
+        nvfree(src);
+        nvfree(dst);
+    }
+
+    return ret;
+}
+
+
+/*
+ * lock_file() - open and lock 'path', creating it if needed. An entry's
+ * lock file is removed along with the entry when it is evicted, so a lock
+ * taken on a file which has since been removed is retried.
+ */
+
+static int lock_file(const char *path)
+{
+    while (TRUE) {
+        struct stat fd_stat, path_stat;
+        int fd = open(path, O_RDWR | O_CREAT, 0600);
+
+        if (fd < 0) {
+            return -1;
+        }
+
+        while (flock(fd, LOCK_EX) != 0 && errno == EINTR);
+
+        if (fstat(fd, &fd_stat) == 0 && stat(path, &path_stat) == 0 &&
+            fd_stat.st_dev == path_stat.st_dev &&
+            fd_stat.st_ino == path_stat.st_ino) {
+            return fd;
+        }
+
+        close(fd);
+    }
+}
+
+
+static char *read_file_contents(const char *path)
+{
+    struct stat stat_buf;
+    char *contents;
+    int fd = open(path, O_RDONLY);
+    ssize_t len = 0;
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &stat_buf) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    contents = nvalloc(stat_buf.st_size + 1);
+
+    while (len < stat_buf.st_size) {
+        ssize_t ret = read(fd, contents + len, stat_buf.st_size - len);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        len += ret;
+    }
+
+    contents[len] = '\0';
+    close(fd);
+
+    return contents;
+}
+
+
+static int send_cache_entry(Options *op, int fd, const Request *req,
+                            const char *entry, int cache_hit)
+{
+    char *status, *log, *path;
+    int i, ret, ok;
+
+    path = nvdircat(entry, "status", NULL);
+    status = read_file_contents(path);
+    nvfree(path);
+
+    path = nvdircat(entry, "log", NULL);
+    log = read_file_contents(path);
+    nvfree(path);
+
+    /* nv_string_to_file() appends a newline */
+    ok = status && strcmp(nv_trim_space(status), "ok") == 0;
+
+    ret = build_service_send_param(fd, "protocol",
+                                   BUILD_SERVICE_PROTOCOL_VERSION) &&
+          build_service_send_param(fd, "cache", cache_hit ? "hit" : "miss") &&
+          build_service_send_record(fd, BUILD_SERVICE_RECORD_LOG, 0, NULL,
+                                    log, log ? strlen(log) : 0);
+
+    for (i = 0; ret && ok && i < req->num_modules; i++) {
+        char *name = nvstrcat(req->modules[i], ".ko", NULL);
+        ret = build_service_send_file(fd, entry, name);
+        nvfree(name);
+    }
+
+    for (i = 0; ret && ok && i < req->num_targets; i++) {
+        ret = build_service_send_file(fd, entry, req->targets[i]);
+    }
+
+    ret = ret &&
+          build_service_send_param(fd, "status", ok ? "ok" : "failed") &&
+          build_service_send_record(fd, BUILD_SERVICE_RECORD_END, 0, NULL,
+                                    NULL, 0);
+
+    nvfree(status);
+    nvfree(log);
+
+    return ret;
+}
+
+
+static void remove_tree(const char *path)
+{
+    char *paths[] = { (char *) path, NULL };
+    FTS *fts = fts_open(paths, FTS_PHYSICAL | FTS_NOSTAT, NULL);
+    FTSENT *ent;
+
+    if (!fts) {
+        return;
+    }
+
+    while ((ent = fts_read(fts)) != NULL) {
+        if (ent->fts_info != FTS_D) {
+            remove(ent->fts_accpath);
+        }
+    }
+
+    fts_close(fts);
+}
+
+
+/*
+ * build_or_reuse() - populate the cache entry 'entry' from the staged
+ * request, unless another client already did so. The caller must hold the
+ * entry's lock. Sets *cache_hit accordingly. Returns the directory from
+ * which the client is to be served: the cache entry, or, if the build
+ * failed, a temporary directory which the caller must remove.
+ */
+
+static char *build_or_reuse(Options *op, const Request *req,
+                            const char *srcdir, const char *entry,
+                            int *cache_hit)
+{
+    char *status_path, *log_path, *tmp_entry, *lock_path, *log = NULL;
+    char *status;
+    int build_lock, ret;
+
+    status_path = nvdircat(entry, "status", NULL);
+    status = read_file_contents(status_path);
+
+    /* nv_string_to_file() appends a newline */
+    *cache_hit = status && strcmp(nv_trim_space(status), "ok") == 0;
+
+    nvfree(status);
+
+    if (*cache_hit) {
+        /* the status file's modification time records when it was used */
+        utime(status_path, NULL);
+        nvfree(status_path);
+        return nvstrdup(entry);
+    }
+
+    nvfree(status_path);
+
+    /* remove any failed entry cached by an earlier version */
+    remove_tree(entry);
+
+    tmp_entry = nvstrcat(entry, ".tmp", NULL);
+    remove_tree(tmp_entry);
+    nv_mkdir_recursive(tmp_entry, 0700, &log, NULL);
+    nvfree(log);
+    log = NULL;
+
+    lock_path = nvdircat(op->cache_dir, "build.lock", NULL);
+    build_lock = lock_file(lock_path);
+    nvfree(lock_path);
+
+    log_message("Building for kernel %s.",
+                req->kernel_name ? req->kernel_name : "(unknown)");
+    ret = build_request(op, req, srcdir, tmp_entry, &log);
+    log_message("Build %s.", ret ? "succeeded" : "failed");
+
+    if (build_lock >= 0) {
+        close(build_lock);
+    }
+
+    log_path = nvdircat(tmp_entry, "log", NULL);
+    nv_string_to_file(log_path, log && log[0] ? log : "\n");
+    nvfree(log_path);
+
+    /* write the status file last: its presence marks a complete entry */
+
+    status_path = nvdircat(tmp_entry, "status", NULL);
+    nv_string_to_file(status_path, ret ? "ok" : "failed");
+    nvfree(status_path);
+    nvfree(log);
+
+    if (!ret) {
+        return tmp_entry;
+    }
+
+    if (rename(tmp_entry, entry) != 0) {
+        log_message("Unable to commit cache entry '%s': %s", entry,
+                    strerror(errno));
+        return tmp_entry;
+    }
+
+    nvfree(tmp_entry);
+
+    return nvstrdup(entry);
+}
+
+
+typedef struct {
+    char *name;
+    time_t last_used;
+    unsigned long long size;
+} CacheEntry;
+
+
+static unsigned long long directory_size(const char *dir)
+{
+    unsigned long long size = 0;
+    struct dirent *ent;
+    DIR *d;
+
+    if ((d = opendir(dir)) == NULL) {
+        return 0;
+    }
+
+    while ((ent = readdir(d)) != NULL) {
+        struct stat stat_buf;
+        char *path;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        path = nvdircat(dir, ent->d_name, NULL);
+
+        if (lstat(path, &stat_buf) == 0) {
+            size += S_ISDIR(stat_buf.st_mode) ? directory_size(path) :
+                                                stat_buf.st_blocks * 512ULL;
+        }
+
+        nvfree(path);
+    }
+
+    closedir(d);
+
+    return size;
+}
+
+
+static int compare_last_used(const void *a, const void *b)
+{
+    const CacheEntry *ea = a, *eb = b;
+
+    return (ea->last_used > eb->last_used) - (ea->last_used < eb->last_used);
+}
+
+
+/*
+ * evict_entries() - remove the least recently used cache entries, other
+ * than 'current', until the cache fits in op->cache_size MiB. Entries that
+ * another client has locked are left alone.
+ */
+
+static void evict_entries(Options *op, const char *current)
+{
+    unsigned long long limit, total = 0;
+    CacheEntry *entries = NULL;
+    struct dirent *ent;
+    int n = 0, i;
+    DIR *d;
+
+    if (op->cache_size == 0 || (d = opendir(op->cache_dir)) == NULL) {
+        return;
+    }
+
+    /*
+     * entries are named by their keys; skip the lock files, work
+     * directories and entries under construction, whose names have a '.'
+     */
+
+    while ((ent = readdir(d)) != NULL) {
+        struct stat stat_buf;
+        char *dir, *status;
+
+        if (strchr(ent->d_name, '.')) {
+            continue;
+        }
+
+        dir = nvdircat(op->cache_dir, ent->d_name, NULL);
+        status = nvdircat(dir, "status", NULL);
+
+        if (stat(status, &stat_buf) == 0) {
+            entries = nvrealloc(entries, sizeof(CacheEntry) * (n + 1));
+            entries[n].name = nvstrdup(ent->d_name);
+            entries[n].last_used = stat_buf.st_mtime;
+            entries[n].size = directory_size(dir);
+            total += entries[n].size;
+            n++;
+        }
+
+        nvfree(status);
+        nvfree(dir);
+    }
+
+    closedir(d);
+
+    qsort(entries, n, sizeof(CacheEntry), compare_last_used);
+
+    limit = (unsigned long long) op->cache_size * 1024 * 1024;
+
+    for (i = 0; i < n; i++) {
+        char *dir = nvdircat(op->cache_dir, entries[i].name, NULL);
+        char *lock_path = nvstrcat(dir, ".lock", NULL);
+        int fd;
+
+        if (total > limit && strcmp(dir, current) != 0 &&
+            (fd = open(lock_path, O_RDWR | O_CREAT, 0600)) >= 0) {
+            if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+                log_message("Removing the cached build %s (%llu KiB) to keep "
+                            "the cache within %d MiB.", entries[i].name,
+                            entries[i].size / 1024, op->cache_size);
+                remove_tree(dir);
+                unlink(lock_path);
+                total -= entries[i].size;
+            }
+            close(fd);
+        }
+
+        nvfree(lock_path);
+        nvfree(dir);
+        nvfree(entries[i].name);
+    }
+
+    nvfree(entries);
+}
+
+
+static void send_error(int fd, const char *error)
+{
+    log_message("%s", error);
+    build_service_send_param(fd, "protocol", BUILD_SERVICE_PROTOCOL_VERSION);
+    build_service_send_param(fd, "error", error);
+    build_service_send_param(fd, "status", "failed");
+    build_service_send_record(fd, BUILD_SERVICE_RECORD_END, 0, NULL, NULL, 0);
+}
+
+
+/*
+ * handle_client() - serve a single client connection; runs in a child
+ * process forked for the connection.
+ */
+
+static void handle_client(Options *op, int fd)
+{
+    Request req;
+    char *workdir, *srcdir = NULL, *entry = NULL, *lock_path = NULL;
+    char *key, *served;
+    int entry_lock = -1, cache_hit = FALSE;
+
+    memset(&req, 0, sizeof(req));
+    req.manifest = nvstrdup("");
+
+    workdir = nvdircat(op->cache_dir, "tmp.XXXXXX", NULL);
+
+    if (!mkdtemp(workdir)) {
+        send_error(fd, "Unable to create a work directory.");
+        goto done;
+    }
+
+    srcdir = nvdircat(workdir, "src", NULL);
+
+    if (!receive_request(fd, srcdir, &req)) {
+        send_error(fd, "Unable to receive the build request.");
+        goto done;
+    }
+
+    if (!req.protocol ||
+        strcmp(req.protocol, BUILD_SERVICE_PROTOCOL_VERSION) != 0) {
+        send_error(fd, "Unsupported build service protocol version.");
+        goto done;
+    }
+
+    if (!req.kernel_source_path || !req.kernel_output_path ||
+        req.num_modules == 0) {
+        send_error(fd, "Incomplete build request.");
+        goto done;
+    }
+
+    key = blake3_hex(req.manifest, strlen(req.manifest));
+    entry = nvdircat(op->cache_dir, key, NULL);
+    nvfree(key);
+    lock_path = nvstrcat(entry, ".lock", NULL);
+
+    /*
+     * Identical requests block here until the first one has populated the
+     * cache entry, and are then served from it.
+     */
+    entry_lock = lock_file(lock_path);
+    served = build_or_reuse(op, &req, srcdir, entry, &cache_hit);
+
+    log_message("Serving %s (cache %s).", served, cache_hit ? "hit" : "miss");
+
+    if (!send_cache_entry(op, fd, &req, served, cache_hit)) {
+        log_message("Failed to send the reply: %s", strerror(errno));
+    }
+
+    if (strcmp(served, entry) != 0) {
+        remove_tree(served);
+    } else if (!cache_hit) {
+        evict_entries(op, entry);
+    }
+
+    nvfree(served);
+
+done:
+    if (entry_lock >= 0) {
+        close(entry_lock);
+    }
+
+    remove_tree(workdir);
+
+    free_request(&req);
+    nvfree(workdir);
+    nvfree(srcdir);
+    nvfree(entry);
+    nvfree(lock_path);
+}
+
+
+static int create_socket(Options *op)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(op->socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "The socket path '%s' is too long.\n",
+                op->socket_path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, op->socket_path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    /* remove a stale socket left behind by a previous instance */
+    unlink(op->socket_path);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        chmod(op->socket_path, 0600) != 0 ||
+        listen(fd, 16) != 0) {
+        fprintf(stderr, "Unable to listen on '%s': %s\n", op->socket_path,
+                strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options *op;
+    char *error = NULL;
+    int listen_fd;
+
+    op = parse_commandline(argc, argv);
+
+    if (!nv_mkdir_recursive(op->cache_dir, 0700, &error, NULL)) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    listen_fd = create_socket(op);
+
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    /* handlers are reaped automatically; a client hanging up is not fatal */
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+
+    log_message("Listening on %s, caching builds in %s.", op->socket_path,
+                op->cache_dir);
+
+    while (TRUE) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        pid_t pid;
+
+        if (client_fd < 0) {
+            if (errno != EINTR) {
+                perror("accept");
+            }
+            continue;
+        }
+
+        pid = fork();
+
+        if (pid == 0) {
+            close(listen_fd);
+            signal(SIGCHLD, SIG_DFL);
+            handle_client(op, client_fd);
+            close(client_fd);
+            _exit(0);
+        }
+
+        if (pid < 0) {
+            perror("fork");
+        }
+
+        close(client_fd);
+    }
+
+    return 0;
+}
@@ -162,9 +162,11 @@ typedef struct __nv_installer_ui {
      * update_indeterminate() - this is called in a loop by a worker thread
      * which is started by ui_indeterminate_begin. The worker stays alive as
      * long as the indeterminate state is active. The loop breaks when the next
-     * ui_indeterminate_end() call sets the state to inactive.
+     * ui_indeterminate_end() call sets the state to inactive. Each call draws
+     * one frame of the indicator, and returns the number of microseconds to
+     * wait before the next; the worker waits without holding the ui lock.
      */
-    void (*update_indeterminate)(Options *, const char *msg);
+    unsigned int (*update_indeterminate)(Options *, const char *msg);
 
     /*
      * close - close down the ui.
@@ -45,6 +45,7 @@
 #include "msg.h"
 #include "manifest.h"
 #include "initramfs.h"
+#include "digest.h"
 
 
 static void print_version(void);
@@ -150,6 +151,10 @@ static Options *load_default_options(void)
     op->use_systemd = NV_OPTIONAL_BOOL_DEFAULT;
     op->rebuild_initramfs = NV_OPTIONAL_BOOL_DEFAULT;
     op->disable_nouveau = TRUE;
+    op->adaptive_concurrency = TRUE;
+    op->page_cache_at_start = -1;
+    op->package_cache_dir = DEFAULT_PACKAGE_CACHE_DIR;
+    op->package_cache_size = DEFAULT_PACKAGE_CACHE_SIZE;
 
     return op;
 
@@ -194,6 +199,29 @@ static int assign_file_type_override(Options *op, char *optarg)
  * through the options is left for the functions that use this data.
  */
 
+/*
+ * absolute_path() - return 'path', made absolute relative to the current
+ * directory; main() changes to the directory containing the installer
+ * before paths given on the command line are used.  Returns NULL if the
+ * current directory can't be determined.
+ */
+
+static char *absolute_path(const char *path)
+{
+    char cwd[PATH_MAX];
+
+    if (path[0] == '/') {
+        return nvstrdup(path);
+    }
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        return NULL;
+    }
+
+    return nvdircat(cwd, path, NULL);
+}
+
+
 static void parse_commandline(int argc, char *argv[], Options *op)
 {
     int c;
@@ -380,6 +408,9 @@ static void parse_commandline(int argc, char *argv[], Options *op)
         case 'r':
             op->no_recursion = TRUE;
             break;
+        case RESCAN_ALL_OPTION:
+            op->rescan_all = TRUE;
+            break;
         case FORCE_SELINUX_OPTION:
             if (strcasecmp(strval, "yes") == 0)
                 op->selinux_option = SELINUX_FORCE_YES;
@@ -524,14 +555,10 @@ static void parse_commandline(int argc, char *argv[], Options *op)
             op->systemd_sysconf_prefix = strval;
             break;
         case 'm':
-            if (!override_kernel_module_build_directory(op, strval)) {
-                goto fail;
-            }
+            op->kernel_module_build_directory_request = strval;
             break;
         case 'M':
-            if (!override_kernel_module_type(op, strval)) {
-                goto fail;
-            }
+            op->kernel_module_type_request = strval;
             break;
         case ALLOW_INSTALLATION_WITH_RUNNING_DRIVER_OPTION:
             op->allow_installation_with_running_driver = boolval;
@@ -543,6 +570,67 @@ static void parse_commandline(int argc, char *argv[], Options *op)
         case GBM_BACKEND_DIR_OPTION:
             op->gbm_backend_dir = strval;
             break;
+        case LOW_IMPACT_OPTION:
+            op->low_impact = boolval;
+            break;
+        case COPY_RATE_LIMIT_OPTION:
+            if (intval < 0) {
+                ui_error(op, "Invalid copy rate limit %d.", intval);
+                goto fail;
+            }
+            op->copy_rate_limit = intval;
+            break;
+        case IO_URING_INSTALL_OPTION:
+            op->io_uring_install = boolval;
+            break;
+        case INSTALL_FROM_ARCHIVE_OPTION:
+            op->archive_file = absolute_path(strval);
+            if (!op->archive_file) {
+                ui_error(op, "Unable to determine the absolute path of "
+                         "'%s' (%s).", strval, strerror(errno));
+                goto fail;
+            }
+            break;
+        case PACKAGE_CACHE_DIR_OPTION:
+            op->package_cache_dir = absolute_path(strval);
+            if (!op->package_cache_dir) {
+                ui_error(op, "Unable to determine the absolute path of "
+                         "'%s' (%s).", strval, strerror(errno));
+                goto fail;
+            }
+            break;
+        case PACKAGE_CACHE_SIZE_OPTION:
+            if (intval < 0) {
+                ui_error(op, "Invalid package cache size %d.", intval);
+                goto fail;
+            }
+            op->package_cache_size = intval;
+            break;
+        case ALL_KERNEL_MODULE_TYPES_OPTION:
+            op->all_kernel_module_types = TRUE;
+            break;
+        case TARGET_ROOTS_OPTION:
+            op->target_roots = strval;
+            op->no_kernel_modules = TRUE;
+            break;
+        case DIGEST_OPTION:
+            {
+                DigestAlgorithm algorithm;
+
+                if (!digest_algorithm_from_name(strval, &algorithm)) {
+                    ui_error(op, "Invalid digest algorithm '%s'; valid values "
+                             "are 'crc32', 'xxh3-128' and 'blake3'.", strval);
+                    goto fail;
+                }
+                op->digest_algorithm = algorithm;
+            }
+            break;
+        case ADAPTIVE_CONCURRENCY_OPTION:
+            op->adaptive_concurrency = boolval;
+            break;
+        case BUILD_SERVICE_SOCKET_OPTION:
+            op->build_service_socket = strval;
+            break;
         default:
             goto fail;
         }
@@ -567,6 +655,17 @@ static void parse_commandline(int argc, char *argv[], Options *op)
     }
 
 
+    /*
+     * the kernel module build directory requests are checked against the
+     * package; when installing from an archive, install_from_archive()
+     * applies them once the package has been extracted.
+     */
+
+    if (!op->archive_file &&
+        !apply_kernel_module_build_directory_requests(op)) {
+        goto fail;
+    }
+
     /*
      * if the installer prefix was not specified, default it to the
      * utility prefix; this is done so that the installer prefix is
@@ -631,6 +730,10 @@ int main(int argc, char *argv[])
     
     log_init(op, argc, argv);
 
+    /* lower our priority before starting any threads or child processes */
+
+    set_low_impact_priority(op);
+
     /* chdir() to the directory containing the binary */
     
     if (!adjust_cwd(op, argv[0])) return 1;
@@ -693,6 +796,15 @@ int main(int argc, char *argv[])
                                         op->skip_depmod);
     }
 
+    /*
+     * install from a package archive, or add this kernel to the package
+     * extracted from it
+     */
+
+    else if (op->archive_file) {
+        ret = install_from_archive(op);
+    }
+
     /* add this kernel */
 
     else if (op->add_this_kernel) {
@@ -710,7 +822,9 @@ int main(int argc, char *argv[])
     }
 
  done:
-    
+
+    report_page_cache_usage(op);
+
     ui_close(op);
 
     nvfree((void*)op);
@@ -202,6 +202,7 @@ typedef struct __options {
     int no_abi_note;
     int no_rpms;
     int no_recursion;
+    int rescan_all;
     int run_nvidia_xconfig;
     int selinux_option;
     int selinux_enabled;
@@ -224,6 +225,17 @@ typedef struct __options {
     int vulkan_icd_json_packaged;
     int vulkansc_icd_json_packaged;
     int concurrency_level;
+    int adaptive_concurrency;
+    int low_impact;
+    int copy_rate_limit;
+    long long page_cache_at_start;
+    int io_uring_install;
+    char *archive_file;
+    char *package_cache_dir;
+    int package_cache_size; /* MiB; 0 disables the package cache */
+    int digest_algorithm; /* a DigestAlgorithm; see digest.h */
+    int all_kernel_module_types;
+    char *target_roots;
     int skip_module_load;
     int skip_depmod;
     int allow_installation_with_running_driver;
@@ -288,6 +300,7 @@ typedef struct __options {
     char *kernel_name;
     char *rpm_file_list;
     char *precompiled_kernel_interfaces_path;
+    char *build_service_socket;
     const char *selinux_chcon_type;
 
     char *module_signing_secret_key;
@@ -310,6 +323,8 @@ typedef struct __options {
     char *systemd_sysconf_prefix;
 
     char *kernel_module_build_directory_override;
+    char *kernel_module_build_directory_request;
+    char *kernel_module_type_request;
 
     struct {
         char *name;
@@ -552,6 +567,9 @@ typedef struct __package {
 #define DEFAULT_LOG_FILE_NAME "/var/log/nvidia-installer.log"
 #define DEFAULT_UNINSTALL_LOG_FILE_NAME "/var/log/nvidia-uninstall.log"
 
+#define DEFAULT_PACKAGE_CACHE_DIR "/var/cache/nvidia-installer/packages"
+#define DEFAULT_PACKAGE_CACHE_SIZE 1024 /* MiB */
+
 #define NUM_TIMES_QUESTIONS_ASKED 3
 
 #define LD_OPTIONS "-d -r"
@@ -579,8 +597,11 @@ typedef struct __package {
 
 void log_init(Options *op, int argc, char * const argv[]);
 void log_printf(Options *op, const char *prefix, const char *fmt, ...) NV_ATTRIBUTE_PRINTF(3, 4);
+void log_copy_begin(Options *op, const char *path, const char *title);
+void log_copy_end(Options *op);
 
 int  install_from_cwd(Options *op);
+int  install_from_archive(Options *op);
 int  add_this_kernel(Options *op);
 
 void add_package_entry(Package *p,
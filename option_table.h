@@ -119,6 +119,18 @@ enum {
     GBM_BACKEND_DIR_OPTION,
     ALLOW_INSTALLATION_WITH_RUNNING_DRIVER_OPTION,
     REBUILD_INITRAMFS_OPTION,
+    BUILD_SERVICE_SOCKET_OPTION,
+    ADAPTIVE_CONCURRENCY_OPTION,
+    LOW_IMPACT_OPTION,
+    COPY_RATE_LIMIT_OPTION,
+    IO_URING_INSTALL_OPTION,
+    INSTALL_FROM_ARCHIVE_OPTION,
+    PACKAGE_CACHE_DIR_OPTION,
+    PACKAGE_CACHE_SIZE_OPTION,
+    DIGEST_OPTION,
+    ALL_KERNEL_MODULE_TYPES_OPTION,
+    TARGET_ROOTS_OPTION,
+    RESCAN_ALL_OPTION,
 };
 
 static const NVGetoptOption __options[] = {
@@ -441,6 +453,12 @@ static const NVGetoptOption __options[] = {
       "and X server installation locations.  With this option set, "
       "the installer will only search in the top-level directories." },
 
+    { "rescan-all", RESCAN_ALL_OPTION, 0, NULL,
+      "The installer remembers what it found in each directory searched "
+      "for conflicting files, and later searches only read the directories "
+      "that have been modified since.  This option ignores what was "
+      "remembered, and reads every directory again." },
+
     /* alias for backwards compatibility */
     { "kernel-module-only", 'K',
       NVGETOPT_OPTION_APPLIES_TO_NVIDIA_UNINSTALL, NULL, NULL },
@@ -639,6 +657,78 @@ static const NVGetoptOption __options[] = {
       "CPUs will have the default concurrency level limited to 32; setting "
       "a higher level on the command line will override this limit." },
 
+    { "adaptive-concurrency", ADAPTIVE_CONCURRENCY_OPTION,
+      NVGETOPT_IS_BOOLEAN, NULL,
+      "When automatically determining the concurrency level, take into "
+      "account the CPU and memory limits of nvidia-installer's cgroup, the "
+      "available memory, the load average and CPU and memory pressure; and "
+      "while building kernel modules, reduce the number of parallel jobs "
+      "if memory runs short.  This is enabled by default; use "
+      "--no-adaptive-concurrency to always run the number of jobs given by "
+      "the concurrency level." },
+
+    { "low-impact", LOW_IMPACT_OPTION, NVGETOPT_IS_BOOLEAN, NULL,
+      "Minimize the impact of the installation on other workloads running on "
+      "the system: run nvidia-installer and every program it starts (such as "
+      "the kernel module build, depmod(8) and ldconfig(8)) in the idle I/O "
+      "scheduling class and with the SCHED_IDLE CPU scheduling policy, and "
+      "drop installed and checksummed files from the page cache once "
+      "nvidia-installer is done with them.  The growth of the page cache "
+      "over the course of the installation is recorded in the log file." },
+
+    { "copy-rate-limit", COPY_RATE_LIMIT_OPTION, NVGETOPT_INTEGER_ARGUMENT,
+      NULL,
+      "Limit the rate at which files are copied into place during "
+      "installation to the given number of MiB per second.  This is most "
+      "useful in "
+      "combination with --low-impact.  The default is 0 (unlimited)." },
+
+    { "io-uring-install", IO_URING_INSTALL_OPTION, NVGETOPT_IS_BOOLEAN, NULL,
+      "Copy files into place in batches using io_uring(7), keeping many "
+      "files in flight at once, rather than copying one file at a time.  If "
+      "io_uring is not supported by the running kernel, files are copied "
+      "one at a time.  This option has no effect when --copy-rate-limit is "
+      "used." },
+
+    { "install-from-archive", INSTALL_FROM_ARCHIVE_OPTION,
+      NVGETOPT_STRING_ARGUMENT, NULL,
+      "Install from the given driver package archive (a self-extracting "
+      ".run file, or the tar archive it contains) rather than from the "
+      "current directory.  Only the files that may be installed are "
+      "extracted, so that files excluded by options such as "
+      "--no-opengl-files, --no-wine-files, --kernel-modules-only, "
+      "--kernel-module-type and --install-compat32-libs=no are never "
+      "written to disk.  The xz(1), zstd(1) or gzip(1) utility is used to "
+      "decompress the archive's payload." },
+
+    { "package-cache-dir", PACKAGE_CACHE_DIR_OPTION,
+      NVGETOPT_STRING_ARGUMENT, NULL,
+      "The directory in which packages extracted by --install-from-archive "
+      "are kept, so that running the installer again with the same "
+      "archive, e.g. after a failed installation, can use the extracted "
+      "files instead of extracting them again.  The files are checked "
+      "against the checksums recorded when they were extracted before "
+      "they are used.  Precompiled kernel interfaces added with "
+      "--add-this-kernel are kept with the extracted package.  The "
+      "default is '" DEFAULT_PACKAGE_CACHE_DIR "'." },
+
+    { "package-cache-size", PACKAGE_CACHE_SIZE_OPTION,
+      NVGETOPT_INTEGER_ARGUMENT, NULL,
+      "The most disk space, in MiB, used by the extracted packages in the "
+      "package cache; the least recently used packages are removed to stay "
+      "within it.  A size of 0 disables the package cache.  The default is "
+      "1024." },
+
+    { "digest", DIGEST_OPTION, NVGETOPT_STRING_ARGUMENT, NULL,
+      "Select the algorithm used to checksum installed files in the backup "
+      "log, which is checked when the driver is uninstalled, and to "
+      "checksum linked kernel modules in the precompiled packages created "
+      "by --add-this-kernel.  Valid values are 'crc32' (the default), "
+      "'xxh3-128', which is considerably faster on large files, and "
+      "'blake3', a cryptographic hash that is computed on multiple CPUs for "
+      "large files.  The algorithm is recorded alongside each checksum, so "
+      "files installed with any algorithm can be checked." },
+
     { "force-libglx-indirect", FORCE_LIBGLX_INDIRECT, 0, NULL,
       "Always install a libGLX_indirect.so.0 symlink, overwriting one if it "
       "exists." },
@@ -728,6 +818,26 @@ static const NVGetoptOption __options[] = {
       "instead."
     },
 
+    { "all-kernel-module-types", ALL_KERNEL_MODULE_TYPES_OPTION, 0, NULL,
+      "When used with --add-this-kernel, build the kernel modules of every "
+      "type that is present in the package (e.g. both the open and the "
+      "proprietary kernel modules), rather than only the selected type, "
+      "and add a precompiled kernel interface for each.  The builds run "
+      "at the same time, and share the concurrency level."
+    },
+
+    { "target-roots", TARGET_ROOTS_OPTION, NVGETOPT_STRING_ARGUMENT, NULL,
+      "Install the driver into each of the comma-separated directories in "
+      "TARGET-ROOTS, such as the root directories of container or virtual "
+      "machine images, instead of into this system.  The installation "
+      "plan is computed once for each distinct library directory layout "
+      "among the roots, each file in the package is read once and written "
+      "to all of the roots at the same time, and a backup log is written "
+      "into each root, so that the driver can be uninstalled from within "
+      "the image.  This implies '--no-kernel-modules'; nothing is done to "
+      "this system's kernel modules, X configuration or loader cache."
+    },
+
     { "allow-installation-with-running-driver",
       ALLOW_INSTALLATION_WITH_RUNNING_DRIVER_OPTION, NVGETOPT_IS_BOOLEAN, NULL,
       "Proceed with installation even if an NVIDIA driver is already installed "
@@ -744,6 +854,17 @@ static const NVGetoptOption __options[] = {
       "recommend by default in an interactive installation."
     },
 
+    { "build-service-socket",
+      BUILD_SERVICE_SOCKET_OPTION, NVGETOPT_STRING_ARGUMENT, NULL,
+      "Instead of building the kernel modules with make(1) directly, send "
+      "the kernel module sources to the kernel module build service "
+      "listening on the Unix domain socket at the given path, and install "
+      "the kernel modules that it returns.  The build service is expected "
+      "to have access to the same kernel source and output paths as the "
+      "installer; nvidia-build-service is a reference implementation which "
+      "serializes builds and caches the results, so that many machines or "
+      "containers sharing a kernel can reuse a single build." },
+
     /* Orphaned options: These options were in the long_options table in
      * nvidia-installer.c but not in the help. */
     { "debug",                    'd', 0, NULL,NULL },
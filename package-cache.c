@@ -0,0 +1,498 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ *
+ * package-cache.c - keep the packages extracted by --install-from-archive,
+ * so that running the installer again with the same archive (e.g. after
+ * an installation failed because the kernel headers were missing) doesn't
+ * need to extract it again.
+ *
+ * Each package is kept in a directory named after the digest of the
+ * archive, next to an index file that lists the digest of each extracted
+ * file, and the files of the package that were not extracted because of
+ * the options in effect at the time. Before an extracted package is used,
+ * each listed file is checked against its digest. The index is written
+ * last, so a package without an index is incomplete and is extracted
+ * again. The modification time of the index records when the package was
+ * last used, and the least recently used packages are removed when the
+ * cache grows beyond op->package_cache_size MiB. Anything that is added to
+ * an extracted package, like a precompiled kernel interface built with
+ * --add-this-kernel, stays with it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "package-cache.h"
+#include "digest.h"
+#include "files.h"
+#include "misc.h"
+
+#define PACKAGE_CACHE_LOCK  ".lock"
+#define PACKAGE_CACHE_INDEX ".index"
+
+/*
+ * the cached tree is later executed as root, so it must be keyed and
+ * verified with a cryptographic digest
+ */
+#define PACKAGE_CACHE_DIGEST DIGEST_BLAKE3
+
+struct __package_cache {
+    int lock_fd;
+    char *key;          /* the digest of the archive, in hex */
+    char *dir;          /* the extracted package */
+    char *index;        /* the index of the extracted package */
+};
+
+typedef struct {
+    char *index;
+    char *dir;
+    time_t last_used;
+    unsigned long long size;
+} CachedPackage;
+
+
+static int compare_strings(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+
+/*
+ * package_cache_open() - lock the package cache, and find where the
+ * package in op->archive_file is kept in it. Returns NULL if the package
+ * cache is disabled or can't be used.
+ */
+
+PackageCache *package_cache_open(Options *op)
+{
+    PackageCache *pc;
+    char *lock, *error_str = NULL, *digest_str;
+    Digest digest;
+    int fd;
+
+    if (op->package_cache_size == 0 || !op->package_cache_dir) {
+        return NULL;
+    }
+
+    if (!nv_mkdir_recursive(op->package_cache_dir, 0700, &error_str, NULL)) {
+        ui_log(op, "Unable to use the package cache: %s", error_str);
+        nvfree(error_str);
+        return NULL;
+    }
+
+    /* a second installer using the cache waits for the first to finish */
+
+    lock = nvdircat(op->package_cache_dir, PACKAGE_CACHE_LOCK, NULL);
+    fd = open(lock, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+
+    if (fd < 0 || flock(fd, LOCK_EX) != 0) {
+        ui_log(op, "Unable to lock the package cache '%s' (%s).", lock,
+               strerror(errno));
+        if (fd >= 0) close(fd);
+        nvfree(lock);
+        return NULL;
+    }
+
+    nvfree(lock);
+
+    if (!compute_digest(op, PACKAGE_CACHE_DIGEST, op->archive_file,
+                        &digest)) {
+        close(fd);
+        return NULL;
+    }
+
+    pc = nvalloc(sizeof(PackageCache));
+    pc->lock_fd = fd;
+
+    digest_str = digest_to_string(&digest);
+    pc->key = nvstrdup(strchr(digest_str, ':') + 1);
+    nvfree(digest_str);
+
+    pc->dir = nvdircat(op->package_cache_dir, pc->key, NULL);
+    pc->index = nvstrcat(pc->dir, PACKAGE_CACHE_INDEX, NULL);
+
+    return pc;
+}
+
+
+const char *package_cache_directory(const PackageCache *pc)
+{
+    return pc->dir;
+}
+
+
+/*
+ * check_index() - check that every file listed in the index of the
+ * extracted package is unchanged, and that every file that wasn't
+ * extracted is also in 'excluded', the sorted list of files that this
+ * installation doesn't need.
+ */
+
+static int check_index(Options *op, PackageCache *pc, FILE *fp,
+                       char * const *excluded, int num_excluded)
+{
+    char *line;
+    int eof = FALSE, ret = TRUE, num_files = 0;
+
+    while (ret && !eof && (line = fget_next_line(fp, &eof)) != NULL) {
+        if (strncmp(line, "excluded ", 9) == 0) {
+            const char *name = line + 9;
+
+            if (num_excluded == 0 ||
+                !bsearch(&name, excluded, num_excluded, sizeof(char *),
+                         compare_strings)) {
+                ui_log(op, "The cached package in '%s' does not contain "
+                       "'%s', which may be needed.", pc->dir, name);
+                ret = FALSE;
+            }
+        } else if (strncmp(line, "file ", 5) == 0) {
+            Digest expected, actual;
+            char *name = strchr(line + 5, ' '), *path;
+
+            if (!name || !digest_from_string(line + 5, &expected) ||
+                expected.algorithm != PACKAGE_CACHE_DIGEST) {
+                ret = FALSE;
+                nvfree(line);
+                break;
+            }
+
+            path = nvdircat(pc->dir, name + 1, NULL);
+
+            if (!compute_digest(op, expected.algorithm, path, &actual) ||
+                !digests_equal(&expected, &actual)) {
+                ui_log(op, "The cached file '%s' has changed since it was "
+                       "extracted.", path);
+                ret = FALSE;
+            }
+
+            nvfree(path);
+            num_files++;
+        }
+
+        nvfree(line);
+    }
+
+    if (ret) {
+        ui_log(op, "Checked %d files in the cached package '%s'.", num_files,
+               pc->dir);
+    }
+
+    return ret;
+}
+
+
+/*
+ * package_cache_lookup() - return TRUE if the package is in the cache,
+ * intact, and has all of the files that aren't in 'excluded'.
+ */
+
+int package_cache_lookup(Options *op, PackageCache *pc,
+                         char * const *excluded, int num_excluded)
+{
+    FILE *fp;
+    int ret;
+
+    if (!directory_exists(pc->dir) || (fp = fopen(pc->index, "r")) == NULL) {
+        return FALSE;
+    }
+
+    ui_indeterminate_begin(op, "Checking the cached package");
+    ret = check_index(op, pc, fp, excluded, num_excluded);
+    ui_indeterminate_end(op);
+
+    fclose(fp);
+
+    return ret;
+}
+
+
+/*
+ * package_cache_prepare() - remove any incomplete or damaged copy of the
+ * package from the cache, and create an empty directory to extract it in.
+ */
+
+int package_cache_prepare(Options *op, PackageCache *pc)
+{
+    unlink(pc->index);
+
+    if (directory_exists(pc->dir) && !remove_directory(op, pc->dir)) {
+        return FALSE;
+    }
+
+    return mkdir_recursive(op, pc->dir, 0755, FALSE);
+}
+
+
+/*
+ * index_directory() - write the digest of each regular file below 'dir'
+ * to the index, with its path relative to the extracted package.
+ */
+
+static int index_directory(Options *op, FILE *fp, const char *top,
+                           const char *rel)
+{
+    char *dir = rel ? nvdircat(top, rel, NULL) : nvstrdup(top);
+    struct dirent *ent;
+    DIR *d;
+    int ret = TRUE;
+
+    if ((d = opendir(dir)) == NULL) {
+        ui_log(op, "Unable to open the directory '%s' (%s).", dir,
+               strerror(errno));
+        nvfree(dir);
+        return FALSE;
+    }
+
+    while (ret && (ent = readdir(d)) != NULL) {
+        struct stat stat_buf;
+        char *path, *name;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        path = nvdircat(dir, ent->d_name, NULL);
+        name = rel ? nvdircat(rel, ent->d_name, NULL) : nvstrdup(ent->d_name);
+
+        if (lstat(path, &stat_buf) != 0) {
+            ret = FALSE;
+        } else if (S_ISDIR(stat_buf.st_mode)) {
+            ret = index_directory(op, fp, top, name);
+        } else if (S_ISREG(stat_buf.st_mode)) {
+            Digest digest;
+
+            if (compute_digest(op, PACKAGE_CACHE_DIGEST, path, &digest)) {
+                char *digest_str = digest_to_string(&digest);
+                fprintf(fp, "file %s %s\n", digest_str, name);
+                nvfree(digest_str);
+            } else {
+                ret = FALSE;
+            }
+        }
+
+        nvfree(name);
+        nvfree(path);
+    }
+
+    closedir(d);
+    nvfree(dir);
+
+    return ret;
+}
+
+
+/*
+ * package_cache_commit() - write the index of the freshly extracted
+ * package, which makes it available to later runs; 'excluded' lists the
+ * files that were not extracted.
+ */
+
+void package_cache_commit(Options *op, PackageCache *pc,
+                          char * const *excluded, int num_excluded)
+{
+    char *tmp = nvstrcat(pc->index, ".tmp", NULL);
+    FILE *fp = fopen(tmp, "w");
+    int i, ret;
+
+    if (!fp) {
+        ui_log(op, "Unable to create the package cache index '%s' (%s).",
+               tmp, strerror(errno));
+        nvfree(tmp);
+        return;
+    }
+
+    for (i = 0; i < num_excluded; i++) {
+        fprintf(fp, "excluded %s\n", excluded[i]);
+    }
+
+    ret = index_directory(op, fp, pc->dir, NULL);
+
+    if (fclose(fp) != 0 || !ret || rename(tmp, pc->index) != 0) {
+        ui_log(op, "Unable to write the package cache index '%s'.",
+               pc->index);
+        unlink(tmp);
+    } else {
+        ui_log(op, "Kept the extracted package in '%s'.", pc->dir);
+    }
+
+    nvfree(tmp);
+}
+
+
+static unsigned long long directory_size(const char *dir)
+{
+    unsigned long long size = 0;
+    struct dirent *ent;
+    DIR *d;
+
+    if ((d = opendir(dir)) == NULL) {
+        return 0;
+    }
+
+    while ((ent = readdir(d)) != NULL) {
+        struct stat stat_buf;
+        char *path;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        path = nvdircat(dir, ent->d_name, NULL);
+
+        if (lstat(path, &stat_buf) == 0) {
+            size += S_ISDIR(stat_buf.st_mode) ? directory_size(path) :
+                                                stat_buf.st_blocks * 512ULL;
+        }
+
+        nvfree(path);
+    }
+
+    closedir(d);
+
+    return size;
+}
+
+
+static int compare_last_used(const void *a, const void *b)
+{
+    const CachedPackage *pa = a, *pb = b;
+
+    return (pa->last_used > pb->last_used) - (pa->last_used < pb->last_used);
+}
+
+
+/*
+ * evict_packages() - remove the least recently used packages, other than
+ * the current one, until the cache fits in op->package_cache_size MiB.
+ * Package directories without an index are incomplete, and are removed.
+ */
+
+static void evict_packages(Options *op, PackageCache *pc)
+{
+    unsigned long long limit, total = 0;
+    CachedPackage *packages = NULL;
+    struct dirent *ent;
+    int n = 0, i;
+    DIR *d;
+
+    if ((d = opendir(op->package_cache_dir)) == NULL) {
+        return;
+    }
+
+    while ((ent = readdir(d)) != NULL) {
+        struct stat stat_buf;
+        char *dir, *index;
+
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        dir = nvdircat(op->package_cache_dir, ent->d_name, NULL);
+
+        if (!directory_exists(dir)) {
+            nvfree(dir);
+            continue;
+        }
+
+        index = nvstrcat(dir, PACKAGE_CACHE_INDEX, NULL);
+
+        if (stat(index, &stat_buf) != 0) {
+            if (strcmp(dir, pc->dir) != 0) {
+                ui_log(op, "Removing the incomplete cached package '%s'.",
+                       dir);
+                remove_directory(op, dir);
+            }
+            nvfree(index);
+            nvfree(dir);
+            continue;
+        }
+
+        packages = nvrealloc(packages, sizeof(CachedPackage) * (n + 1));
+        packages[n].dir = dir;
+        packages[n].index = index;
+        packages[n].last_used = stat_buf.st_mtime;
+        packages[n].size = directory_size(dir);
+        total += packages[n].size;
+        n++;
+    }
+
+    closedir(d);
+
+    qsort(packages, n, sizeof(CachedPackage), compare_last_used);
+
+    limit = (unsigned long long) op->package_cache_size * 1024 * 1024;
+
+    for (i = 0; i < n; i++) {
+        if (total > limit && strcmp(packages[i].dir, pc->dir) != 0) {
+            ui_log(op, "Removing the cached package '%s' (%llu KiB) to keep "
+                   "the package cache within %d MiB.", packages[i].dir,
+                   packages[i].size / 1024, op->package_cache_size);
+            unlink(packages[i].index);
+            remove_directory(op, packages[i].dir);
+            total -= packages[i].size;
+        }
+        nvfree(packages[i].dir);
+        nvfree(packages[i].index);
+    }
+
+    nvfree(packages);
+
+    if (total > limit) {
+        ui_log(op, "The package cache holds %llu MiB, more than its size "
+               "limit of %d MiB, because the current package alone does.",
+               total / (1024 * 1024), op->package_cache_size);
+    }
+}
+
+
+/*
+ * package_cache_close() - mark the package as just used, make room in the
+ * cache, and unlock it.
+ */
+
+void package_cache_close(Options *op, PackageCache *pc)
+{
+    if (!pc) {
+        return;
+    }
+
+    utime(pc->index, NULL);
+
+    evict_packages(op, pc);
+
+    close(pc->lock_fd);
+
+    nvfree(pc->key);
+    nvfree(pc->dir);
+    nvfree(pc->index);
+    nvfree(pc);
+}
@@ -0,0 +1,36 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_PACKAGE_CACHE_H__
+#define __NVIDIA_INSTALLER_PACKAGE_CACHE_H__
+
+#include "nvidia-installer.h"
+
+typedef struct __package_cache PackageCache;
+
+PackageCache *package_cache_open(Options *op);
+const char *package_cache_directory(const PackageCache *pc);
+int package_cache_lookup(Options *op, PackageCache *pc,
+                         char * const *excluded, int num_excluded);
+int package_cache_prepare(Options *op, PackageCache *pc);
+void package_cache_commit(Options *op, PackageCache *pc,
+                          char * const *excluded, int num_excluded);
+void package_cache_close(Options *op, PackageCache *pc);
+
+#endif /* __NVIDIA_INSTALLER_PACKAGE_CACHE_H__ */
@@ -37,11 +37,14 @@
 #include "precompiled.h"
 #include "misc.h"
 #include "crc.h"
+#include "digest.h"
+#include "probes.h"
 
 
 
 static int precompiled_read_fileinfo(Options *op, PrecompiledFileInfo *fileInfos,
-                                     int index, char *buf, int offset, int size);
+                                     int index, char *buf, int offset, int size,
+                                     uint32 pkg_version);
 
 /*
  * read_uint32() - given a buffer and an offset, read the next 4 bytes from
@@ -157,7 +160,7 @@ PrecompiledInfo *get_precompiled_info(Options *op,
 {
     int fd, offset, num_files, i;
     char *buf;
-    uint32 val, size;
+    uint32 val, size, pkg_version;
     char *version, *description, *proc_version_string;
     struct stat stat_buf;
     PrecompiledInfo *info = NULL;
@@ -166,6 +169,8 @@ PrecompiledInfo *get_precompiled_info(Options *op,
     fd = size = 0;
     buf = description = proc_version_string = version = NULL;
 
+    NV_PROBE1(get_precompiled_info__start, filename);
+
     /* open the file to be unpacked */
     
     if ((fd = open(filename, O_RDONLY)) == -1) {
@@ -210,10 +215,11 @@ PrecompiledInfo *get_precompiled_info(Options *op,
 
     /* check the package format version */
 
-    val = read_uint32(buf, &offset);
-    if (val != PRECOMPILED_PKG_VERSION) {
+    pkg_version = read_uint32(buf, &offset);
+    if (pkg_version != PRECOMPILED_PKG_VERSION &&
+        pkg_version != PRECOMPILED_PKG_VERSION_NO_DIGEST) {
         ui_expert(op, "Incompatible package format version %d: expected %d.",
-                  val, PRECOMPILED_PKG_VERSION);
+                  pkg_version, PRECOMPILED_PKG_VERSION);
         goto done;
     }
     
@@ -283,7 +289,8 @@ PrecompiledInfo *get_precompiled_info(Options *op,
     fileInfos = nvalloc(num_files * sizeof(PrecompiledFileInfo));
     for (i = 0; i < num_files; i++) {
         int ret;
-        ret = precompiled_read_fileinfo(op, fileInfos, i, buf, offset, size);
+        ret = precompiled_read_fileinfo(op, fileInfos, i, buf, offset, size,
+                                        pkg_version);
 
         if (ret > 0) {
             offset += ret;
@@ -355,6 +362,8 @@ done:
     nvfree(fileInfos);
     nvfree(version);
 
+    NV_PROBE2(get_precompiled_info__done, filename, info != NULL);
+
     return info;
 
 }
@@ -471,6 +480,7 @@ int precompiled_pack(const PrecompiledInfo *info, const char *package_filename)
     uint8 *out;
     int version_len, description_len, proc_version_len;
     int total_len, files_len, i;
+    uint32 pkg_version = PRECOMPILED_PKG_VERSION_NO_DIGEST;
 
     /*
      * get the lengths of the description, the proc version string,
@@ -489,6 +499,11 @@ int precompiled_pack(const PrecompiledInfo *info, const char *package_filename)
                      strlen(info->files[i].target_directory) +
                      info->files[i].size +
                      info->files[i].signature_size;
+
+        if (info->files[i].attributes & PRECOMPILED_ATTR(DIGEST)) {
+            files_len += 4 + 4 + 2 * info->files[i].digest.length;
+            pkg_version = PRECOMPILED_PKG_VERSION;
+        }
     }
 
     total_len = PRECOMPILED_PKG_CONSTANT_LENGTH +
@@ -514,9 +529,12 @@ int precompiled_pack(const PrecompiledInfo *info, const char *package_filename)
     memcpy(&(out[0]), PRECOMPILED_PKG_HEADER, 8);
     offset += 8;
 
-    /* write the package version */
+    /*
+     * write the package version; packages without digests keep the older
+     * format version, so that older installers can still read them
+     */
 
-    encode_uint32(PRECOMPILED_PKG_VERSION, out, &offset);
+    encode_uint32(pkg_version, out, &offset);
 
     /* write the version */
 
@@ -600,6 +618,18 @@ int precompiled_pack(const PrecompiledInfo *info, const char *package_filename)
         /* linked module crc */
         encode_uint32(file->linked_module_crc, out, &offset);
 
+        /* digests */
+        if (file->attributes & PRECOMPILED_ATTR(DIGEST)) {
+            uint32 len = file->digest.length;
+
+            encode_uint32(file->digest.algorithm, out, &offset);
+            encode_uint32(len, out, &offset);
+            memcpy(&(out[offset]), file->digest.bytes, len);
+            offset += len;
+            memcpy(&(out[offset]), file->linked_module_digest.bytes, len);
+            offset += len;
+        }
+
         /* detached signature */
         encode_uint32(file->signature_size, out, &offset);
         if (file->signature_size) {
@@ -752,13 +782,16 @@ int precompiled_read_module(PrecompiledFileInfo *fileInfo, const char *filename,
  *   size:      The size of the package data buffer. This is used for bounds
  *              checking, to make sure that a reading a length specified in the
  *              won't go past the end of the package file.
+ *   pkg_version: The package format version, which determines whether the
+ *              record may contain digests.
  *
  * Return value:
  *   The number of bytes read from the package file on success, or -1 on error.
  */
 
 static int precompiled_read_fileinfo(Options *op, PrecompiledFileInfo *fileInfos,
-                                     int index, char *buf, int offset, int size)
+                                     int index, char *buf, int offset, int size,
+                                     uint32 pkg_version)
 {
     PrecompiledFileInfo *fileInfo = fileInfos + index;
     uint32 val;
@@ -783,6 +816,11 @@ static int precompiled_read_fileinfo(Options *op, PrecompiledFileInfo *fileInfos
     fileInfo->type = read_uint32(buf, &offset);
     fileInfo->attributes = read_uint32(buf, &offset);
 
+    /* older packages have no digest fields, whatever their attributes say */
+    if (pkg_version == PRECOMPILED_PKG_VERSION_NO_DIGEST) {
+        fileInfo->attributes &= ~PRECOMPILED_ATTR(DIGEST);
+    }
+
     val = read_uint32(buf, &offset);
     if (offset + val > size) {
         ui_log(op, "Bad filename length.");
@@ -852,6 +890,51 @@ static int precompiled_read_fileinfo(Options *op, PrecompiledFileInfo *fileInfos
 
     fileInfo->linked_module_crc = read_uint32(buf, &offset);
 
+    if (fileInfo->attributes & PRECOMPILED_ATTR(DIGEST)) {
+        Digest actual;
+        uint32 algorithm, len;
+
+        if (size - offset < 8) {
+            ui_log(op, "Bad digest header.");
+            return -1;
+        }
+
+        algorithm = read_uint32(buf, &offset);
+        len = read_uint32(buf, &offset);
+
+        if (algorithm >= NUM_DIGEST_ALGORITHMS ||
+            len != digest_length(algorithm) ||
+            offset + 2 * len > size) {
+            ui_log(op, "Bad digest algorithm %" PRIu32 " or length %" PRIu32
+                   ".", algorithm, len);
+            return -1;
+        }
+
+        fileInfo->digest.algorithm = algorithm;
+        fileInfo->digest.length = len;
+        memcpy(fileInfo->digest.bytes, buf + offset, len);
+        offset += len;
+
+        fileInfo->linked_module_digest.algorithm = algorithm;
+        fileInfo->linked_module_digest.length = len;
+        memcpy(fileInfo->linked_module_digest.bytes, buf + offset, len);
+        offset += len;
+
+        compute_digest_from_buffer(algorithm, fileInfo->data, fileInfo->size,
+                                   &actual);
+        if (!digests_equal(&actual, &fileInfo->digest)) {
+            char *expected_str = digest_to_string(&fileInfo->digest);
+            char *actual_str = digest_to_string(&actual);
+
+            ui_log(op, "The digest for the file '%s' (%s) does not match the "
+                   "expected value (%s).", fileInfo->name, actual_str,
+                   expected_str);
+
+            nvfree(expected_str);
+            nvfree(actual_str);
+        }
+    }
+
     fileInfo->signature_size = read_uint32(buf, &offset);
     if (fileInfo->signature_size) {
         if (offset + fileInfo->signature_size > size) {
@@ -947,6 +1030,7 @@ const char **precompiled_file_attribute_names(uint32 attribute_mask)
                                                     "detached signature",
                                                     "linked module crc",
                                                     "embedded signature",
+                                                    "digest",
                                                 };
     static const char *unknown_attribute = "unknown attribute";
 
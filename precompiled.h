@@ -53,6 +53,7 @@
  *     1: has detached signature
  *     2: has linked module CRC
  *     4: has embedded signature
+ *     8: has digest
  *
  *   the next 4 bytes (unsigned) are: length of the file name (n)
  *
@@ -77,6 +78,18 @@
  *   the next 4 bytes (unsigned) are: CRC of linked module, when appropriate;
  *   undefined if "has linked module CRC" attribute is not set
  *
+ *   if the package format version is 3 or later, and the "has digest"
+ *   attribute is set:
+ *
+ *     the next 4 bytes (unsigned) are: the digest algorithm (see digest.h)
+ *
+ *     the next 4 bytes (unsigned) are: length of each digest (g)
+ *
+ *     the next g bytes are: digest of the packaged file
+ *
+ *     the next g bytes are: digest of the linked module; all zeroes if the
+ *     "has linked module CRC" attribute is not set
+ *
  *   the next 4 bytes (unsigned) are: length of detached signature (s), when
  *   appropriate; 0 if "has detached signature" attribute is not set
  *
@@ -90,6 +103,8 @@
 #ifndef __NVIDIA_INSTALLER_PRECOMPILED_H__
 #define __NVIDIA_INSTALLER_PRECOMPILED_H__
 
+#include "digest.h"
+
 #define PRECOMPILED_PKG_CONSTANT_LENGTH (8 + /* precompiled package header */ \
                                          4 + /* package format version */ \
                                          4 + /* driver version string length */ \
@@ -99,7 +114,10 @@
 
 #define PRECOMPILED_PKG_HEADER "\aNVIDIA\a"
 
-#define PRECOMPILED_PKG_VERSION 2
+#define PRECOMPILED_PKG_VERSION 3
+
+/* the last package format version without the per-file digests */
+#define PRECOMPILED_PKG_VERSION_NO_DIGEST 2
 
 #define PRECOMPILED_FILE_CONSTANT_LENGTH (4 + /* precompiled file header */ \
                                           4 + /* file serial number */ \
@@ -129,6 +147,7 @@ enum {
     PRECOMPILED_FILE_HAS_DETACHED_SIGNATURE = 0,
     PRECOMPILED_FILE_HAS_LINKED_MODULE_CRC,
     PRECOMPILED_FILE_HAS_EMBEDDED_SIGNATURE,
+    PRECOMPILED_FILE_HAS_DIGEST,
 };
 
 #define PRECOMPILED_ATTR(attr) (1 << PRECOMPILED_FILE_HAS_##attr)
@@ -144,6 +163,8 @@ typedef struct __precompiled_file_info {
     uint32 size;
     uint8 *data;
     uint32 linked_module_crc;
+    Digest digest;
+    Digest linked_module_digest;
     uint32 signature_size;
     char *signature;
 } PrecompiledFileInfo;
@@ -0,0 +1,61 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * probes.h - statically defined tracepoints (USDT probes) on the paths
+ * where the installer spends its time, so that a slow installation can be
+ * profiled with bpftrace, perf or SystemTap without rebuilding.  Each
+ * operation has a "<name>__start" and a "<name>__done" probe in the
+ * "nvidia_installer" provider; see nvidia-installer-latency.bt.
+ *
+ * The probes need <sys/sdt.h>, from SystemTap; when it isn't available,
+ * or NV_NO_PROBES is defined, they compile to nothing.  An enabled probe
+ * costs a single nop when no tracer is attached.
+ */
+
+#ifndef __NVIDIA_INSTALLER_PROBES_H__
+#define __NVIDIA_INSTALLER_PROBES_H__
+
+#if !defined(NV_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NV_HAVE_PROBES 1
+#endif
+#endif
+
+#if defined(NV_HAVE_PROBES)
+
+#define NV_PROBE1(name, a1) \
+    DTRACE_PROBE1(nvidia_installer, name, a1)
+#define NV_PROBE2(name, a1, a2) \
+    DTRACE_PROBE2(nvidia_installer, name, a1, a2)
+#define NV_PROBE3(name, a1, a2, a3) \
+    DTRACE_PROBE3(nvidia_installer, name, a1, a2, a3)
+
+#else
+
+#define NV_PROBE1(name, a1) \
+    do { (void) (a1); } while (0)
+#define NV_PROBE2(name, a1, a2) \
+    do { (void) (a1); (void) (a2); } while (0)
+#define NV_PROBE3(name, a1, a2, a3) \
+    do { (void) (a1); (void) (a2); (void) (a3); } while (0)
+
+#endif
+
+#endif /* __NVIDIA_INSTALLER_PROBES_H__ */
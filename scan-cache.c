@@ -0,0 +1,670 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * scan-cache.c - remember what the search for conflicting files found in
+ * each directory, so that later searches only need to read the directories
+ * that have changed since.  Adding, removing or renaming an entry in a
+ * directory updates its modification time, so a directory whose device,
+ * inode and modification time are unchanged still has the same files and
+ * subdirectories.  The subdirectories of an unchanged directory are still
+ * visited, since changes within them do not update its modification time.
+ * Neither do changes to the targets of its symbolic links, so every link
+ * is cached, whatever it pointed to when the directory was read.
+ *
+ * The cache is a text file with a section for each set of conflicting
+ * file names searched for under a set of search paths, on the filesystem
+ * mounted at "/", most recently used first:
+ *
+ *   scan <key>
+ *   dir <dev> <ino> <mtime seconds> <mtime nanoseconds> <path>
+ *   f <name of a matching file>
+ *   d <name of a subdirectory>
+ *   l <name of a symbolic link>
+ *
+ * Only the names are cached: whether a matching file conflicts may depend
+ * on its contents (see ignore_conflicting_file()), so that is checked
+ * again on each search.
+ *
+ * The cache file is only written by runs that install into this system's
+ * default locations; see may_write_cache().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "scan-cache.h"
+#include "digest.h"
+#include "misc.h"
+
+#define SCAN_CACHE_DIR  "/var/cache/nvidia-installer"
+#define SCAN_CACHE_FILE (SCAN_CACHE_DIR "/conflicting-files")
+
+/* the number of sets of conflicting file names kept in the cache */
+#define SCAN_CACHE_MAX_SECTIONS 8
+
+/*
+ * a directory modified this close to the start of the search may be
+ * modified again without its timestamp changing, so it is not cached.
+ */
+#define SCAN_CACHE_RACY_SECONDS 2
+
+struct __scan_cache {
+    const ConflictingFileInfo *files;
+    char *key;
+    time_t start;
+
+    char *buf;                      /* the contents of the cache file */
+
+    NvSlice *others;                /* other sections, verbatim */
+    int num_others;
+
+    ScanCacheDirectory **old;       /* sorted by path */
+    char *reused;                   /* which of 'old' are in 'found' */
+    int num_old;
+
+    ScanCacheDirectory **found;     /* the directories read or reused */
+    int num_found;
+
+    ScanCacheDirectory **uncached;  /* read, but not to be cached */
+    int num_uncached;
+
+    char **roots;
+    int num_roots;
+
+    int hits;
+    int misses;
+};
+
+
+static void free_directory(ScanCacheDirectory *d)
+{
+    int i;
+
+    if (!d) return;
+
+    for (i = 0; i < d->num_files; i++) {
+        nvfree(d->files[i]);
+    }
+    for (i = 0; i < d->num_subdirs; i++) {
+        nvfree(d->subdirs[i]);
+    }
+    for (i = 0; i < d->num_links; i++) {
+        nvfree(d->links[i]);
+    }
+
+    nvfree(d->files);
+    nvfree(d->subdirs);
+    nvfree(d->links);
+    nvfree(d->path);
+    nvfree(d);
+}
+
+
+static void append_name(char ***names, int *n, char *name)
+{
+    *names = nvrealloc(*names, sizeof(char *) * (*n + 1));
+    (*names)[(*n)++] = name;
+}
+
+
+static void append_directory(ScanCacheDirectory ***dirs, int *n,
+                             ScanCacheDirectory *d)
+{
+    *dirs = nvrealloc(*dirs, sizeof(ScanCacheDirectory *) * (*n + 1));
+    (*dirs)[(*n)++] = d;
+}
+
+
+static int compare_directories(const void *a, const void *b)
+{
+    const ScanCacheDirectory *da = *(const ScanCacheDirectory * const *) a;
+    const ScanCacheDirectory *db = *(const ScanCacheDirectory * const *) b;
+
+    return strcmp(da->path, db->path);
+}
+
+
+/*
+ * get_key() - identify the search, by a digest of the conflicting file
+ * names and the lengths to which they are matched, the search paths, and
+ * the device and inode of "/", so that a search of another root (such as
+ * from a chroot that shares the cache directory) doesn't use this one's
+ * listings. The format of the listings is included, so that sections
+ * written in an older format are not used.
+ */
+
+#define SCAN_CACHE_FORMAT "format 3\n"
+
+static char *get_key(const ConflictingFileInfo *files,
+                     char * const *roots, int num_roots)
+{
+    Digest digest;
+    struct stat st;
+    char *str = nvstrdup(SCAN_CACHE_FORMAT), *tmp, len[16];
+    int i;
+
+    for (i = 0; files[i].name; i++) {
+        snprintf(len, sizeof(len), "%d", files[i].len);
+        tmp = nvstrcat(str, files[i].name, " ", len, "\n", NULL);
+        nvfree(str);
+        str = tmp;
+    }
+
+    for (i = 0; i < num_roots; i++) {
+        tmp = nvstrcat(str, "root ", roots[i], "\n", NULL);
+        nvfree(str);
+        str = tmp;
+    }
+
+    if (stat("/", &st) == 0) {
+        nv_append_sprintf(&str, "fs %llu %llu\n",
+                          (unsigned long long) st.st_dev,
+                          (unsigned long long) st.st_ino);
+    }
+
+    compute_digest_from_buffer(DIGEST_XXH3_128, (const uint8 *) str,
+                               strlen(str), &digest);
+    nvfree(str);
+
+    return digest_to_string(&digest);
+}
+
+
+/*
+ * parse_directory() - parse a "dir" line of the cache file; returns NULL
+ * if it is malformed.
+ */
+
+static ScanCacheDirectory *parse_directory(NvSlice line)
+{
+    ScanCacheDirectory *d;
+    unsigned long long dev, ino;
+    long long sec;
+    long nsec;
+    char *str = nv_slice_dup(line);
+    int n = 0;
+
+    if (sscanf(str, "dir %llu %llu %lld %ld %n", &dev, &ino, &sec, &nsec,
+               &n) != 4 || n == 0 || str[n] == '\0') {
+        nvfree(str);
+        return NULL;
+    }
+
+    d = nvalloc(sizeof(ScanCacheDirectory));
+    d->path = nvstrdup(str + n);
+    d->dev = dev;
+    d->ino = ino;
+    d->mtime.tv_sec = sec;
+    d->mtime.tv_nsec = nsec;
+
+    nvfree(str);
+
+    return d;
+}
+
+
+/*
+ * read_cache() - read the cache file: the section for this cache's key
+ * (unless --rescan-all was given) is parsed into 'old', and the others
+ * are kept as they are, to be written back when the cache is closed.
+ */
+
+static void read_cache(Options *op, ScanCache *c)
+{
+    enum { SKIP, MINE, OTHER } section = SKIP;
+    ScanCacheDirectory *cur = NULL;
+    NvLineIter it;
+    NvSlice line, other = { NULL, 0 };
+
+    if (!read_text_file(SCAN_CACHE_FILE, &c->buf)) {
+        c->buf = NULL;
+        return;
+    }
+
+    nv_line_iter_init(&it, c->buf, strlen(c->buf));
+
+    while (nv_line_iter_next(&it, &line)) {
+        if (nv_slice_has_prefix(line, "scan ")) {
+            NvSlice key = { line.s + 5, line.len - 5 };
+
+            if (section == OTHER) {
+                other.len = line.s - other.s;
+                c->others = nvrealloc(c->others,
+                                      sizeof(NvSlice) * (c->num_others + 1));
+                c->others[c->num_others++] = other;
+            }
+
+            cur = NULL;
+
+            if (!nv_slice_equal(key, c->key)) {
+                section = OTHER;
+                other.s = line.s;
+            } else {
+                section = op->rescan_all ? SKIP : MINE;
+            }
+            continue;
+        }
+
+        if (section != MINE) continue;
+
+        if (nv_slice_has_prefix(line, "dir ")) {
+            cur = parse_directory(line);
+            if (cur) {
+                append_directory(&c->old, &c->num_old, cur);
+            }
+        } else if (cur && nv_slice_has_prefix(line, "f ") && line.len > 2) {
+            NvSlice name = { line.s + 2, line.len - 2 };
+            append_name(&cur->files, &cur->num_files, nv_slice_dup(name));
+        } else if (cur && nv_slice_has_prefix(line, "d ") && line.len > 2) {
+            NvSlice name = { line.s + 2, line.len - 2 };
+            append_name(&cur->subdirs, &cur->num_subdirs, nv_slice_dup(name));
+        } else if (cur && nv_slice_has_prefix(line, "l ") && line.len > 2) {
+            NvSlice name = { line.s + 2, line.len - 2 };
+            append_name(&cur->links, &cur->num_links, nv_slice_dup(name));
+        }
+    }
+
+    if (section == OTHER) {
+        other.len = c->buf + strlen(c->buf) - other.s;
+        c->others = nvrealloc(c->others,
+                              sizeof(NvSlice) * (c->num_others + 1));
+        c->others[c->num_others++] = other;
+    }
+
+    qsort(c->old, c->num_old, sizeof(ScanCacheDirectory *),
+          compare_directories);
+
+    c->reused = nvalloc(c->num_old + 1);
+}
+
+
+/*
+ * scan_cache_open() - start a search for the given conflicting files under
+ * the search paths 'roots', using what earlier searches for the same files
+ * under the same paths found.
+ */
+
+ScanCache *scan_cache_open(Options *op, const ConflictingFileInfo *files,
+                           char * const *roots, int num_roots)
+{
+    ScanCache *c = nvalloc(sizeof(ScanCache));
+
+    c->files = files;
+    c->key = get_key(files, roots, num_roots);
+    c->start = time(NULL);
+
+    read_cache(op, c);
+
+    return c;
+}
+
+
+/*
+ * scan_cache_add_root() - record that the hierarchy under 'root' is being
+ * searched; cached directories under it that the search does not visit
+ * are dropped from the cache when it is closed.
+ */
+
+void scan_cache_add_root(ScanCache *c, const char *root)
+{
+    append_name(&c->roots, &c->num_roots, nvstrdup(root));
+}
+
+
+static int is_under_root(const ScanCache *c, const char *path)
+{
+    int i;
+
+    for (i = 0; i < c->num_roots; i++) {
+        size_t len = strlen(c->roots[i]);
+
+        if (strncmp(path, c->roots[i], len) == 0 &&
+            (path[len] == '\0' || path[len] == '/' ||
+             (len > 0 && c->roots[i][len - 1] == '/'))) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * scan_cache_child_path() - the path of the entry 'name' in the directory
+ * 'dir', joined as fts(3) would.
+ */
+
+char *scan_cache_child_path(const char *dir, const char *name)
+{
+    size_t len = strlen(dir);
+    char *prefix, *path;
+
+    if (len > 0 && dir[len - 1] == '/') {
+        len--;
+    }
+
+    prefix = nvstrndup(dir, len);
+    path = nvstrcat(prefix, "/", name, NULL);
+    nvfree(prefix);
+
+    return path;
+}
+
+
+static int matches_conflicting_file(const ScanCache *c, const char *name)
+{
+    int i;
+
+    for (i = 0; c->files[i].name; i++) {
+        if (strncmp(name, c->files[i].name, c->files[i].len) == 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * list_directory() - read the directory 'path', keeping the names of its
+ * subdirectories, of its symbolic links, and of the regular files whose
+ * names match a conflicting file.  'cacheable' is cleared if the listing
+ * cannot be recorded in the cache.
+ */
+
+static ScanCacheDirectory *list_directory(const ScanCache *c,
+                                          const char *path,
+                                          const struct stat *st,
+                                          int *cacheable)
+{
+    ScanCacheDirectory *d;
+    struct dirent *ent;
+    DIR *dir;
+
+    *cacheable = st->st_mtime + SCAN_CACHE_RACY_SECONDS < c->start &&
+                 !strpbrk(path, "\r\n");
+
+    if ((dir = opendir(path)) == NULL) {
+        return NULL;
+    }
+
+    d = nvalloc(sizeof(ScanCacheDirectory));
+    d->path = nvstrdup(path);
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime = st->st_mtim;
+
+    while ((ent = readdir(dir)) != NULL) {
+        int is_dir = (ent->d_type == DT_DIR);
+        int is_file = (ent->d_type == DT_REG);
+        int is_link = (ent->d_type == DT_LNK);
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (ent->d_type == DT_UNKNOWN) {
+            char *child = scan_cache_child_path(path, ent->d_name);
+            struct stat child_st;
+
+            if (lstat(child, &child_st) == 0) {
+                is_dir = S_ISDIR(child_st.st_mode);
+                is_file = S_ISREG(child_st.st_mode);
+                is_link = S_ISLNK(child_st.st_mode);
+            }
+
+            nvfree(child);
+        }
+
+        if (is_link) {
+            append_name(&d->links, &d->num_links, nvstrdup(ent->d_name));
+        } else if (is_dir) {
+            append_name(&d->subdirs, &d->num_subdirs, nvstrdup(ent->d_name));
+        } else if (is_file && matches_conflicting_file(c, ent->d_name)) {
+            append_name(&d->files, &d->num_files, nvstrdup(ent->d_name));
+        } else {
+            continue;
+        }
+
+        if (strpbrk(ent->d_name, "\r\n")) {
+            *cacheable = FALSE;
+        }
+    }
+
+    closedir(dir);
+
+    return d;
+}
+
+
+/*
+ * scan_cache_read_directory() - return the listing of the directory
+ * 'path', whose stat(2) information is 'st': from the cache, if the
+ * directory is unchanged since it was cached, or else by reading it.
+ * Returns NULL if the directory cannot be read.  The listing remains
+ * valid until the cache is closed.
+ */
+
+const ScanCacheDirectory *scan_cache_read_directory(ScanCache *c,
+                                                    const char *path,
+                                                    const struct stat *st)
+{
+    ScanCacheDirectory key, *pkey = &key, **match, *d;
+    int cacheable;
+
+    key.path = (char *) path;
+
+    match = bsearch(&pkey, c->old, c->num_old, sizeof(ScanCacheDirectory *),
+                    compare_directories);
+
+    if (match && !c->reused[match - c->old]) {
+        d = *match;
+
+        if (d->dev == st->st_dev && d->ino == st->st_ino &&
+            d->mtime.tv_sec == st->st_mtim.tv_sec &&
+            d->mtime.tv_nsec == st->st_mtim.tv_nsec) {
+            c->reused[match - c->old] = TRUE;
+            append_directory(&c->found, &c->num_found, d);
+            c->hits++;
+            return d;
+        }
+    }
+
+    c->misses++;
+
+    d = list_directory(c, path, st, &cacheable);
+    if (!d) return NULL;
+
+    if (cacheable) {
+        append_directory(&c->found, &c->num_found, d);
+    } else {
+        append_directory(&c->uncached, &c->num_uncached, d);
+    }
+
+    return d;
+}
+
+
+static void write_directory(FILE *fp, const ScanCacheDirectory *d)
+{
+    int i;
+
+    fprintf(fp, "dir %llu %llu %lld %ld %s\n",
+            (unsigned long long) d->dev, (unsigned long long) d->ino,
+            (long long) d->mtime.tv_sec, (long) d->mtime.tv_nsec, d->path);
+
+    for (i = 0; i < d->num_files; i++) {
+        fprintf(fp, "f %s\n", d->files[i]);
+    }
+    for (i = 0; i < d->num_subdirs; i++) {
+        fprintf(fp, "d %s\n", d->subdirs[i]);
+    }
+    for (i = 0; i < d->num_links; i++) {
+        fprintf(fp, "l %s\n", d->links[i]);
+    }
+}
+
+
+/*
+ * write_cache() - replace the cache file with this search's section,
+ * followed by the cached directories outside of the hierarchies that
+ * were searched, and then the most recently used other sections.
+ */
+
+static void write_cache(Options *op, const ScanCache *c)
+{
+    char *tmp, *error_str = NULL;
+    FILE *fp;
+    int i;
+
+    if (!nv_mkdir_recursive(SCAN_CACHE_DIR, 0755, &error_str, NULL)) {
+        ui_log(op, "Unable to cache the search for conflicting files: %s",
+               error_str);
+        nvfree(error_str);
+        return;
+    }
+
+    tmp = nvstrcat(SCAN_CACHE_FILE, ".tmp", NULL);
+
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        ui_log(op, "Unable to cache the search for conflicting files in "
+               "'%s' (%s).", tmp, strerror(errno));
+        nvfree(tmp);
+        return;
+    }
+
+    fprintf(fp, "scan %s\n", c->key);
+
+    for (i = 0; i < c->num_found; i++) {
+        write_directory(fp, c->found[i]);
+    }
+
+    for (i = 0; i < c->num_old; i++) {
+        if (!c->reused[i] && !is_under_root(c, c->old[i]->path)) {
+            write_directory(fp, c->old[i]);
+        }
+    }
+
+    for (i = 0; i < NV_MIN(c->num_others, SCAN_CACHE_MAX_SECTIONS - 1); i++) {
+        fwrite(c->others[i].s, 1, c->others[i].len, fp);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp, SCAN_CACHE_FILE) != 0) {
+        ui_log(op, "Unable to cache the search for conflicting files in "
+               "'%s' (%s).", SCAN_CACHE_FILE, strerror(errno));
+        unlink(tmp);
+    }
+
+    nvfree(tmp);
+}
+
+
+static int is_default_prefix(const char *prefix, const char *def)
+{
+    return !prefix || strcmp(prefix, def) == 0;
+}
+
+
+/*
+ * may_write_cache() - whether this run may update the cache file: not if
+ * it must leave the system as it is (--no-backup, --sanity), or installs
+ * somewhere other than this system's default locations (a non-default
+ * prefix, or --target-roots), whose listings later runs would not use.
+ */
+
+static int may_write_cache(const Options *op, const char **reason)
+{
+    if (op->no_backup) {
+        *reason = "--no-backup was given";
+    } else if (op->sanity) {
+        *reason = "this is a sanity check";
+    } else if (op->target_roots) {
+        *reason = "installing into other roots";
+    } else if (!is_default_prefix(op->opengl_prefix, DEFAULT_OPENGL_PREFIX) ||
+               !is_default_prefix(op->utility_prefix,
+                                  DEFAULT_UTILITY_PREFIX) ||
+               (!is_default_prefix(op->x_prefix, DEFAULT_X_PREFIX) &&
+                !is_default_prefix(op->x_prefix, XORG7_DEFAULT_X_PREFIX))) {
+        *reason = "a non-default installation prefix was given";
+    } else {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+/*
+ * scan_cache_close() - log how much of the search the cache saved, update
+ * the cache file if this run may, and free the cache.
+ */
+
+void scan_cache_close(Options *op, ScanCache *c)
+{
+    const char *reason = NULL;
+    int i;
+
+    if (!c) return;
+
+    ui_log(op, "Searched %d directories for conflicting files: %d unchanged "
+           "since the last search (cache hits), %d read (cache misses)%s.",
+           c->hits + c->misses, c->hits, c->misses,
+           op->rescan_all ? "; the cache was ignored (--rescan-all)" : "");
+
+    if (may_write_cache(op, &reason)) {
+        write_cache(op, c);
+    } else {
+        ui_log(op, "Not updating the cache of the search for conflicting "
+               "files, since %s.", reason);
+    }
+
+    for (i = 0; i < c->num_old; i++) {
+        if (!c->reused[i]) {
+            free_directory(c->old[i]);
+        }
+    }
+    for (i = 0; i < c->num_found; i++) {
+        free_directory(c->found[i]);
+    }
+    for (i = 0; i < c->num_uncached; i++) {
+        free_directory(c->uncached[i]);
+    }
+    for (i = 0; i < c->num_roots; i++) {
+        nvfree(c->roots[i]);
+    }
+
+    nvfree(c->old);
+    nvfree(c->reused);
+    nvfree(c->found);
+    nvfree(c->uncached);
+    nvfree(c->roots);
+    nvfree(c->others);
+    nvfree(c->buf);
+    nvfree(c->key);
+    nvfree(c);
+}
@@ -0,0 +1,63 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_SCAN_CACHE_H__
+#define __NVIDIA_INSTALLER_SCAN_CACHE_H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "nvidia-installer.h"
+
+typedef struct __scan_cache ScanCache;
+
+/*
+ * ScanCacheDirectory - what a search for conflicting files needs to know
+ * about one directory: the regular files in it whose names match one of the
+ * conflicting files, its subdirectories, and all of its symbolic links,
+ * whose targets are looked up again on each search.
+ */
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    char **files;
+    int num_files;
+
+    char **subdirs;
+    int num_subdirs;
+
+    char **links;
+    int num_links;
+} ScanCacheDirectory;
+
+ScanCache *scan_cache_open(Options *op, const ConflictingFileInfo *files,
+                           char * const *roots, int num_roots);
+void scan_cache_add_root(ScanCache *c, const char *root);
+const ScanCacheDirectory *scan_cache_read_directory(ScanCache *c,
+                                                    const char *path,
+                                                    const struct stat *st);
+void scan_cache_close(Options *op, ScanCache *c);
+
+char *scan_cache_child_path(const char *dir, const char *name);
+
+#endif /* __NVIDIA_INSTALLER_SCAN_CACHE_H__ */
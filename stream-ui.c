@@ -53,7 +53,7 @@ int   stream_paged_prompt        (Options *op, const char *, const char *,
 void  stream_status_begin        (Options*, const char*, const char*);
 void  stream_status_update       (Options*, const float, const char*);
 void  stream_status_end          (Options*, const char*);
-void  stream_update_indeterminate(Options*, const char*);
+unsigned int stream_update_indeterminate(Options*, const char*);
 void  stream_close               (Options*);
 
 InstallerUI stream_ui_dispatch_table = {
@@ -310,6 +310,12 @@ int stream_approve_command_list(Options *op, CommandList *cl,
         nv_info_msg(prefix, "%s", cl->descriptions[i]);
     }
 
+    if (cl->num_unoptimized > cl->num) {
+        nv_info_msg(NULL, "");
+        nv_info_msg(NULL, "(%d operations, optimized from %d)", cl->num,
+                    cl->num_unoptimized);
+    }
+
     fflush(stdout);
 
     if (!stream_yes_no(op, TRUE, "\nIs this acceptable? (answering 'no' will "
@@ -498,12 +504,13 @@ void stream_status_update(Options *op, const float percent, const char *msg)
 } /* stream_status_update() */
 
 
-void stream_update_indeterminate(Options *op, const char *msg)
+unsigned int stream_update_indeterminate(Options *op, const char *msg)
 {
     Data *d = op->ui.priv;
 
     print_status_bar(d, STATUS_INDETERMINATE, 0.0);
-    usleep(250000);
+
+    return 250000;
 }
 
 
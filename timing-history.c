@@ -0,0 +1,380 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ *
+ *
+ * timing-history.c - remember how long each kernel module build phase took,
+ * and how many lines of progress output it produced, so that the progress
+ * bar and the estimated time remaining for later builds can be based on
+ * what actually happened before, rather than on an estimate of the output.
+ *
+ * The history is a text file with one record per line:
+ *
+ *   <driver version> <kernel release> <concurrency level> <phase> \
+ *       <seconds> <lines>
+ *
+ * A phase's estimate comes from the record with the same key, or failing
+ * that, the most recent record for the same phase and concurrency level,
+ * and then for the same phase.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "nvidia-installer.h"
+#include "user-interface.h"
+#include "timing-history.h"
+#include "kernel.h"
+
+#define TIMING_HISTORY_DIR  "/var/cache/nvidia-installer"
+#define TIMING_HISTORY_FILE (TIMING_HISTORY_DIR "/build-times")
+
+/* the number of records kept in the history file */
+#define TIMING_HISTORY_MAX_RECORDS 64
+
+typedef struct {
+    char *version;
+    char *kernel;
+    int jobs;
+    char *phase;
+    double seconds;
+    int lines;
+} TimingRecord;
+
+struct __timing_phase {
+    char *version;
+    char *kernel;
+    int jobs;
+    char *phase;
+
+    struct timespec start;
+
+    int have_history;
+    double expected_seconds;
+    int expected_lines;
+
+    int lines;
+};
+
+/*
+ * run_command() may be called from worker threads, so the active phase,
+ * and the progress recorded for it, are guarded by this lock.
+ */
+static pthread_mutex_t active_phase_lock = PTHREAD_MUTEX_INITIALIZER;
+static TimingPhase *active_phase;
+
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+static void free_records(TimingRecord *records, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        nvfree(records[i].version);
+        nvfree(records[i].kernel);
+        nvfree(records[i].phase);
+    }
+
+    nvfree(records);
+}
+
+
+/*
+ * read_history() - read the records from the history file, in the order
+ * in which they were written; a missing or malformed file yields no
+ * records.
+ */
+
+static TimingRecord *read_history(int *n)
+{
+    TimingRecord *records = NULL;
+    FILE *fp = fopen(TIMING_HISTORY_FILE, "r");
+    char *line;
+    int eof = FALSE;
+
+    *n = 0;
+
+    if (!fp) return NULL;
+
+    while (!eof && (line = fget_next_line(fp, &eof)) != NULL) {
+        char version[64], kernel[256], phase[64];
+        TimingRecord *r;
+        double seconds;
+        int jobs, lines;
+
+        if (sscanf(line, "%63s %255s %d %63s %lf %d", version, kernel, &jobs,
+                   phase, &seconds, &lines) != 6 || seconds <= 0) {
+            nvfree(line);
+            continue;
+        }
+        nvfree(line);
+
+        records = nvrealloc(records, sizeof(TimingRecord) * (*n + 1));
+        r = &records[(*n)++];
+
+        r->version = nvstrdup(version);
+        r->kernel = nvstrdup(kernel);
+        r->jobs = jobs;
+        r->phase = nvstrdup(phase);
+        r->seconds = seconds;
+        r->lines = lines;
+    }
+
+    fclose(fp);
+
+    return records;
+}
+
+
+static int record_matches(const TimingRecord *r, const TimingPhase *t,
+                          int level)
+{
+    if (strcmp(r->phase, t->phase) != 0) return FALSE;
+    if (level >= 1 && r->jobs != t->jobs) return FALSE;
+    if (level >= 2 && strcmp(r->kernel, t->kernel) != 0) return FALSE;
+    if (level >= 3 && strcmp(r->version, t->version) != 0) return FALSE;
+
+    return TRUE;
+}
+
+
+/*
+ * write_history() - replace the history file with the given records,
+ * dropping the oldest ones beyond TIMING_HISTORY_MAX_RECORDS.
+ */
+
+static void write_history(Options *op, const TimingRecord *records, int n)
+{
+    char *tmp, *error_str = NULL;
+    FILE *fp;
+    int i;
+
+    if (!nv_mkdir_recursive(TIMING_HISTORY_DIR, 0755, &error_str, NULL)) {
+        ui_log(op, "Unable to record kernel module build times: %s",
+               error_str);
+        nvfree(error_str);
+        return;
+    }
+
+    tmp = nvstrcat(TIMING_HISTORY_FILE, ".tmp", NULL);
+
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        ui_log(op, "Unable to record kernel module build times in '%s' (%s).",
+               tmp, strerror(errno));
+        nvfree(tmp);
+        return;
+    }
+
+    for (i = NV_MAX(0, n - TIMING_HISTORY_MAX_RECORDS); i < n; i++) {
+        fprintf(fp, "%s %s %d %s %.2f %d\n", records[i].version,
+                records[i].kernel, records[i].jobs, records[i].phase,
+                records[i].seconds, records[i].lines);
+    }
+
+    if (fclose(fp) != 0 || rename(tmp, TIMING_HISTORY_FILE) != 0) {
+        ui_log(op, "Unable to record kernel module build times in '%s' (%s).",
+               TIMING_HISTORY_FILE, strerror(errno));
+        unlink(tmp);
+    }
+
+    nvfree(tmp);
+}
+
+
+/*
+ * timing_phase_begin() - start timing the named phase of the kernel module
+ * build, and make it the active phase whose progress run_command() reports.
+ */
+
+TimingPhase *timing_phase_begin(Options *op, const Package *p,
+                                const char *phase)
+{
+    TimingPhase *t = nvalloc(sizeof(TimingPhase));
+    TimingRecord *records;
+    int n, i, level;
+
+    t->version = nvstrdup(p->version);
+    t->kernel = nvstrdup(get_kernel_name(op));
+    t->jobs = op->concurrency_level;
+    t->phase = nvstrdup(phase);
+
+    records = read_history(&n);
+
+    /* search from the most specific match to the least */
+
+    for (level = 3; level >= 0 && !t->have_history; level--) {
+        for (i = n - 1; i >= 0; i--) {
+            if (record_matches(&records[i], t, level)) {
+                t->have_history = TRUE;
+                t->expected_seconds = records[i].seconds;
+                t->expected_lines = records[i].lines;
+                break;
+            }
+        }
+    }
+
+    free_records(records, n);
+
+    if (t->have_history) {
+        ui_log(op, "Based on previous builds, the '%s' step is expected to "
+               "take about %d seconds.", phase, (int) t->expected_seconds);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t->start);
+
+    pthread_mutex_lock(&active_phase_lock);
+    active_phase = t;
+    pthread_mutex_unlock(&active_phase_lock);
+
+    return t;
+}
+
+
+/*
+ * timing_phase_expected_lines() - the number of lines of progress output
+ * produced by the last comparable run of this phase, or 0 if unknown.
+ */
+
+int timing_phase_expected_lines(const TimingPhase *t)
+{
+    return (t && t->have_history) ? t->expected_lines : 0;
+}
+
+
+TimingPhase *timing_active_phase(void)
+{
+    TimingPhase *t;
+
+    pthread_mutex_lock(&active_phase_lock);
+    t = active_phase;
+    pthread_mutex_unlock(&active_phase_lock);
+
+    return t;
+}
+
+
+/*
+ * timing_phase_progress() - record that 'lines' lines of progress output
+ * have been seen, and return the fraction of the phase that is complete.
+ * When there is history for this phase, progress is measured by elapsed
+ * time against the previous duration, and an estimate of the time
+ * remaining is written to 'eta'; otherwise 'line_percent' is returned, and
+ * 'eta' is set to an empty string.
+ */
+
+float timing_phase_progress(TimingPhase *t, int lines, float line_percent,
+                            char *eta, size_t eta_len)
+{
+    double elapsed, remaining;
+
+    pthread_mutex_lock(&active_phase_lock);
+    t->lines = lines;
+    pthread_mutex_unlock(&active_phase_lock);
+
+    eta[0] = '\0';
+
+    if (!t->have_history) {
+        return line_percent;
+    }
+
+    elapsed = seconds_since(&t->start);
+    remaining = t->expected_seconds - elapsed;
+
+    if (remaining >= 1.0) {
+        snprintf(eta, eta_len, "About %d:%02d remaining",
+                 (int) remaining / 60, (int) remaining % 60);
+    } else {
+        snprintf(eta, eta_len, "Almost done");
+    }
+
+    return NV_MIN(elapsed / t->expected_seconds, 0.99);
+}
+
+
+/*
+ * timing_phase_end() - stop timing the phase; if it succeeded, add its
+ * duration and output line count to the history, replacing any record with
+ * the same key.
+ */
+
+void timing_phase_end(Options *op, TimingPhase *t, int success)
+{
+    TimingRecord *records;
+    double elapsed;
+    int n, i, lines;
+
+    if (!t) return;
+
+    pthread_mutex_lock(&active_phase_lock);
+    if (active_phase == t) {
+        active_phase = NULL;
+    }
+    lines = t->lines;
+    pthread_mutex_unlock(&active_phase_lock);
+
+    elapsed = seconds_since(&t->start);
+
+    ui_log(op, "The '%s' step took %.1f seconds.", t->phase, elapsed);
+
+    if (success && lines > 0) {
+        records = read_history(&n);
+
+        for (i = 0; i < n; i++) {
+            if (record_matches(&records[i], t, 3)) {
+                nvfree(records[i].version);
+                nvfree(records[i].kernel);
+                nvfree(records[i].phase);
+                memmove(&records[i], &records[i + 1],
+                        sizeof(TimingRecord) * (n - i - 1));
+                n--;
+                break;
+            }
+        }
+
+        records = nvrealloc(records, sizeof(TimingRecord) * (n + 1));
+        records[n].version = nvstrdup(t->version);
+        records[n].kernel = nvstrdup(t->kernel);
+        records[n].jobs = t->jobs;
+        records[n].phase = nvstrdup(t->phase);
+        records[n].seconds = elapsed;
+        records[n].lines = lines;
+        n++;
+
+        write_history(op, records, n);
+        free_records(records, n);
+    }
+
+    nvfree(t->version);
+    nvfree(t->kernel);
+    nvfree(t->phase);
+    nvfree(t);
+}
@@ -0,0 +1,36 @@
+/*
+ * nvidia-installer: A tool for installing NVIDIA software packages on
+ * Unix and Linux systems.
+ *
+ * Copyright (C) 2024 NVIDIA Corporation
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses>.
+ */
+
+#ifndef __NVIDIA_INSTALLER_TIMING_HISTORY_H__
+#define __NVIDIA_INSTALLER_TIMING_HISTORY_H__
+
+#include "nvidia-installer.h"
+
+typedef struct __timing_phase TimingPhase;
+
+TimingPhase *timing_phase_begin(Options *op, const Package *p,
+                                const char *phase);
+int timing_phase_expected_lines(const TimingPhase *t);
+float timing_phase_progress(TimingPhase *t, int lines, float line_percent,
+                            char *eta, size_t eta_len);
+void timing_phase_end(Options *op, TimingPhase *t, int success);
+
+TimingPhase *timing_active_phase(void);
+
+#endif /* __NVIDIA_INSTALLER_TIMING_HISTORY_H__ */
@@ -33,6 +33,7 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <signal.h>
+#include <pthread.h>
 #include "nvidia-installer.h"
 #include "nvidia-installer-ui.h"
 #include "misc.h"
@@ -97,6 +98,55 @@ static const char *level_str(int level)
     }
 }
 
+/*
+ * All calls into the ui dispatch table, and the log writes that accompany
+ * them, are made with ui_mutex held, so that messages from worker threads
+ * are never interleaved with those from the main thread.  ui_lock_waiters
+ * counts the threads waiting for the mutex; the indeterminate progress
+ * worker backs off while it is nonzero, so that it doesn't starve them.
+ */
+
+static pthread_mutex_t ui_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int ui_lock_waiters;
+
+static void ui_lock(void)
+{
+    __atomic_add_fetch(&ui_lock_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&ui_mutex);
+    __atomic_sub_fetch(&ui_lock_waiters, 1, __ATOMIC_SEQ_CST);
+}
+
+static void ui_unlock(void)
+{
+    pthread_mutex_unlock(&ui_mutex);
+}
+
+
+/*
+ * Messages from a worker thread between ui_worker_begin() and
+ * ui_worker_end() are collected in the thread's own buffer, rather than
+ * displayed, and ui_worker_flush() replays them later.
+ */
+
+typedef enum {
+    UI_OUTPUT_MESSAGE,
+    UI_OUTPUT_LOG,
+    UI_OUTPUT_COMMAND,
+} UiOutputKind;
+
+typedef struct {
+    UiOutputKind kind;
+    int level;
+    char *msg;
+} UiWorkerMessage;
+
+struct __ui_worker_messages {
+    UiWorkerMessage *messages;
+    int num_messages;
+};
+
+static __thread UiWorkerMessages *worker_messages;
+
 static void do_print_message(Options *op, int level, const char *msg)
 {
     /* Print all warnings/errors;  only print normal messages when not silent */
@@ -198,7 +248,12 @@ int ui_init(Options *op)
      * stream ui.
      */
 
-    if (!__ui->init(op, nv_format_text_rows)) return FALSE;
+    ui_lock();
+
+    if (!__ui->init(op, nv_format_text_rows)) {
+        ui_unlock();
+        return FALSE;
+    }
 
     op->ui.indeterminate_data = indeterminate_init();
 
@@ -232,6 +287,8 @@ int ui_init(Options *op)
     op->ui_deferred_messages = NULL;
     op->num_ui_deferred_messages = 0;
 
+    ui_unlock();
+
     /* so far, so good */
 
     return TRUE;
@@ -252,7 +309,9 @@ void ui_set_title(Options *op, const char *fmt, ...)
 
     NV_VSNPRINTF(title, fmt);
 
+    ui_lock();
     __ui->set_title(op, title);
+    ui_unlock();
     free(title);
 
 } /* ui_set_title() */
@@ -269,6 +328,7 @@ char *ui_get_input(Options *op, const char *def, const char *fmt, ...)
     
     NV_VSNPRINTF(msg, fmt);
 
+    ui_lock();
     if (op->no_questions) {
         ret = nvstrdup(def ? def : "");
         tmp = nvstrcat(msg, " (Answer: '", ret, "')", NULL);
@@ -280,6 +340,7 @@ char *ui_get_input(Options *op, const char *def, const char *fmt, ...)
         tmp = nvstrcat(msg, " (Answer: '", ret, "')", NULL);
     }
     log_printf(op, NV_BULLET_STR, "%s", tmp);
+    ui_unlock();
     nvfree(msg);
     nvfree(tmp);
 
@@ -317,16 +378,55 @@ static void defer_message(Options *op, int level, const char *message)
     }
 }
 
-static void message_helper(Options *op, int level, const char *msg)
+static void emit_message(Options *op, UiOutputKind kind, int level,
+                         const char *msg)
 {
-    if (__ui) {
-        do_print_message(op, level, msg);
-        log_printf(op, level_str(level), "%s", msg);
+    ui_lock();
+
+    switch (kind) {
+        case UI_OUTPUT_MESSAGE:
+            if (__ui) {
+                do_print_message(op, level, msg);
+                log_printf(op, level_str(level), "%s", msg);
+            } else {
+                defer_message(op, level, msg);
+            }
+            break;
+        case UI_OUTPUT_LOG:
+            if (__ui && !op->silent) __ui->message(op, NV_MSG_LEVEL_LOG, msg);
+            log_printf(op, NV_BULLET_STR, "%s", msg);
+            break;
+        case UI_OUTPUT_COMMAND:
+            if (__ui && !op->silent) __ui->command_output(op, msg);
+            log_printf(op, NV_CMD_OUT_PREFIX, "%s", msg);
+            break;
+    }
+
+    ui_unlock();
+}
+
+static void output_message(Options *op, UiOutputKind kind, int level,
+                           const char *msg)
+{
+    UiWorkerMessages *w = worker_messages;
+
+    if (w) {
+        w->messages = nvrealloc(w->messages, (w->num_messages + 1) *
+                                             sizeof(w->messages[0]));
+        w->messages[w->num_messages].kind = kind;
+        w->messages[w->num_messages].level = level;
+        w->messages[w->num_messages].msg = nvstrdup(msg);
+        w->num_messages++;
     } else {
-        defer_message(op, level, msg);
+        emit_message(op, kind, level, msg);
     }
 }
 
+static void message_helper(Options *op, int level, const char *msg)
+{
+    output_message(op, UI_OUTPUT_MESSAGE, level, msg);
+}
+
 
 /*
  * ui_{error,warn,message}() - have the ui display a message
@@ -365,10 +465,7 @@ void ui_log(Options *op, const char *fmt, ...)
     char *msg;
 
     NV_VSNPRINTF(msg, fmt);
-
-    if (__ui && !op->silent) __ui->message(op, NV_MSG_LEVEL_LOG, msg);
-    log_printf(op, NV_BULLET_STR, "%s", msg);
-
+    output_message(op, UI_OUTPUT_LOG, NV_MSG_LEVEL_LOG, msg);
     free(msg);
 
 } /* ui_message() */
@@ -386,10 +483,7 @@ void ui_expert(Options *op, const char *fmt, ...)
     if (!op->expert) return;
 
     NV_VSNPRINTF(msg, fmt);
-
-    if (!op->silent) __ui->message(op, NV_MSG_LEVEL_LOG, msg);
-    log_printf(op, NV_BULLET_STR, "%s", msg);
-
+    output_message(op, UI_OUTPUT_LOG, NV_MSG_LEVEL_LOG, msg);
     free (msg);
     
 } /* ui_expert() */
@@ -401,11 +495,7 @@ void ui_command_output(Options *op, const char *fmt, ...)
     char *msg;
 
     NV_VSNPRINTF(msg, fmt);
-
-    if (!op->silent) __ui->command_output(op, msg);
-
-    log_printf(op, NV_CMD_OUT_PREFIX, "%s", msg);
-
+    output_message(op, UI_OUTPUT_COMMAND, NV_MSG_LEVEL_LOG, msg);
     free(msg);
 
 } /* ui_command_output() */
@@ -425,11 +515,13 @@ int ui_approve_command_list(Options *op, CommandList *c, const char *fmt, ...)
 
     NV_VSNPRINTF(msg, fmt);
 
+    ui_lock();
     ret = __ui->approve_command_list(op, c, msg);
     free(msg);
 
     if (ret) __ui->message(op, NV_MSG_LEVEL_LOG, "Commandlist approved.");
     else __ui->message(op, NV_MSG_LEVEL_LOG, "Commandlist rejected.");
+    ui_unlock();
 
     return ret;
 
@@ -447,6 +539,7 @@ int ui_yes_no (Options *op, const int def, const char *fmt, ...)
     
     NV_VSNPRINTF(msg, fmt);
     
+    ui_lock();
     if (op->no_questions) {
         ret = def;
         tmp = nvstrcat(msg, " (Answer: ", (ret ? "Yes" : "No"), ")", NULL);
@@ -459,6 +552,7 @@ int ui_yes_no (Options *op, const int def, const char *fmt, ...)
     }
     
     log_printf(op, NV_BULLET_STR, "%s", tmp);
+    ui_unlock();
     nvfree(msg);
     nvfree(tmp);
 
@@ -476,6 +570,7 @@ int ui_multiple_choice (Options *op, const char * const *answers,
 
     NV_VSNPRINTF(question, fmt);
 
+    ui_lock();
     if (op->no_questions) {
         ret = default_answer;
     } else {
@@ -490,6 +585,7 @@ int ui_multiple_choice (Options *op, const char * const *answers,
     }
 
     log_printf(op, NV_BULLET_STR, "%s", tmp);
+    ui_unlock();
     nvfree(question);
     nvfree(tmp);
 
@@ -505,6 +601,7 @@ int ui_paged_prompt (Options *op, const char *question, const char *pager_title,
     char *tmp;
     int ret;
 
+    ui_lock();
     if (op->no_questions) {
         ret = default_answer;
     } else {
@@ -520,6 +617,7 @@ int ui_paged_prompt (Options *op, const char *question, const char *pager_title,
     }
 
     log_printf(op, NV_BULLET_STR, "%s", tmp);
+    ui_unlock();
     nvfree(tmp);
 
     return ret;
@@ -539,15 +637,19 @@ void ui_status_begin(Options *op, const char *title, const char *fmt, ...)
 {
     char *msg;
 
+    ui_lock();
     log_printf(op, NV_BULLET_STR, "%s", title);
+    ui_unlock();
 
     if (op->silent) return;
  
     NV_VSNPRINTF(msg, fmt);
 
+    ui_lock();
     op->ui.status_active = TRUE;
 
     __ui->status_begin(op, title, msg);
+    ui_unlock();
     free(msg);
 }
 
@@ -568,10 +670,46 @@ void ui_status_update(Options *op, const float percent, const char *fmt, ...)
 
     NV_VSNPRINTF(msg, fmt);
 
+    ui_lock();
     __ui->status_update(op, percent, msg);
+    ui_unlock();
     free(msg);
 }
 
+
+/*
+ * ui_progress_begin(): start counting completed units of work toward
+ * 'total', for a status indicator shared by several worker threads.
+ */
+
+void ui_progress_begin(UiProgress *progress, int total)
+{
+    progress->total = NV_MAX(total, 1);
+    __atomic_store_n(&progress->done, 0, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * ui_progress_advance(): record that 'n' more units of work have been
+ * completed, and update the status indicator begun with ui_status_begin().
+ * The count is read again with the ui lock held, so that updates from
+ * different threads can never move the indicator backwards.
+ */
+
+void ui_progress_advance(Options *op, UiProgress *progress, int n)
+{
+    int done;
+
+    __atomic_add_fetch(&progress->done, n, __ATOMIC_SEQ_CST);
+
+    if (op->silent) return;
+
+    ui_lock();
+    done = __atomic_load_n(&progress->done, __ATOMIC_SEQ_CST);
+    __ui->status_update(op, (float) NV_MIN(done, progress->total) /
+                            (float) progress->total, NULL);
+    ui_unlock();
+}
+
 struct indeterminate_args {
     Options *op;
     char *msg;
@@ -585,7 +723,20 @@ static void *indeterminate_worker(void *p)
     IndeterminateData *id = op->ui.indeterminate_data;
 
     while (indeterminate_get(id) == INDETERMINATE_ACTIVE) {
-        __ui->update_indeterminate(op, msg);
+        unsigned int delay;
+
+        if (__atomic_load_n(&ui_lock_waiters, __ATOMIC_SEQ_CST) > 0) {
+            usleep(10000);
+            continue;
+        }
+
+        /* draw one frame, and wait for the next without the lock held */
+
+        ui_lock();
+        delay = __ui->update_indeterminate(op, msg);
+        ui_unlock();
+
+        usleep(delay);
     }
 
     nvfree(msg);
@@ -634,17 +785,75 @@ void ui_status_end(Options *op, const char *fmt, ...)
 
     NV_VSNPRINTF(msg, fmt);
 
+    ui_lock();
     if (!op->silent) __ui->status_end(op, msg);
     log_printf(op, NV_BULLET_STR, "%s", msg);
+    op->ui.status_active = FALSE;
+    ui_unlock();
+
     free(msg);
+}
 
-    op->ui.status_active = FALSE;
+
+/*
+ * ui_worker_begin(): called on a worker thread to start collecting the
+ * messages that the thread reports through ui_{error,warn,message,log,
+ * expert,command_output}(), instead of displaying them.
+ */
+
+void ui_worker_begin(void)
+{
+    if (!worker_messages) {
+        worker_messages = nvalloc(sizeof(*worker_messages));
+    }
+}
+
+/*
+ * ui_worker_end(): called on the worker thread to stop collecting its
+ * messages; returns them, to be passed to ui_worker_flush().
+ */
+
+UiWorkerMessages *ui_worker_end(void)
+{
+    UiWorkerMessages *ret = worker_messages;
+
+    worker_messages = NULL;
+
+    return ret;
+}
+
+/*
+ * ui_worker_flush(): display and log the messages collected from a worker
+ * thread, in the order in which the worker reported them, and free them.
+ * Flushing the workers of a parallel phase one after another, in a fixed
+ * order, gives the same output no matter how their execution interleaved.
+ */
+
+void ui_worker_flush(Options *op, UiWorkerMessages *w)
+{
+    int i;
+
+    if (!w) return;
+
+    for (i = 0; i < w->num_messages; i++) {
+        output_message(op, w->messages[i].kind, w->messages[i].level,
+                       w->messages[i].msg);
+        nvfree(w->messages[i].msg);
+    }
+
+    nvfree(w->messages);
+    nvfree(w);
 }
 
 
 
 void ui_close (Options *op)
 {
+    /*
+     * Don't take the ui lock when called from the signal handler: the
+     * interrupted thread may already hold it.
+     */
+    if (op) ui_lock();
     if (__ui) __ui->close(op);
 
     if (__extracted_user_interface_filename) {
@@ -654,6 +863,8 @@ void ui_close (Options *op)
     __ui = NULL;
 
     if (op) {
+        ui_unlock();
+
         /* ui_close() may be called with NULL op from a signal handler */
         indeterminate_destroy(op->ui.indeterminate_data);
         op->ui.indeterminate_data = NULL;
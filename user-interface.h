@@ -33,6 +33,37 @@ enum {
 };
 extern const char * const CONTINUE_ABORT_CHOICES[];
 
+/*
+ * Thread safety: the ui may be used from worker threads as well as from the
+ * main thread, under the following rules.
+ *
+ * - ui_{error,warn,message,log,expert,command_output}(), ui_status_update()
+ *   and ui_progress_advance() may be called from any thread; each call is
+ *   displayed and logged as a unit, never interleaved with another.
+ *
+ * - A worker thread whose messages should appear in a deterministic order
+ *   calls ui_worker_begin() when it starts and ui_worker_end() when it is
+ *   done; the messages it reported in between are held back, and the thread
+ *   that joins it passes them to ui_worker_flush() to display them.
+ *
+ * - Everything else, i.e. ui_init(), ui_close(), ui_set_title(), the
+ *   ui_status_begin()/ui_status_end() and ui_indeterminate_*() pairs, and
+ *   anything that prompts the user, may only be called from the main thread.
+ *   A prompt holds the ui lock until it is answered, so worker threads that
+ *   report messages directly will wait for it.
+ */
+
+typedef struct __ui_worker_messages UiWorkerMessages;
+
+/*
+ * A count of completed units of work, which several worker threads may
+ * advance at once, driving a single status indicator.
+ */
+typedef struct {
+    int total;
+    int done;
+} UiProgress;
+
 int   ui_init                (Options*);
 void  ui_set_title           (Options*, const char*, ...)              NV_ATTRIBUTE_PRINTF(2, 3);
 char *ui_get_input           (Options*, const char*, const char*, ...) NV_ATTRIBUTE_PRINTF(3, 4);
@@ -55,6 +86,13 @@ void  ui_indeterminate_end   (Options*);
 void  ui_status_end          (Options*, const char*, ...)              NV_ATTRIBUTE_PRINTF(2, 3);
 void  ui_close               (Options*);
 
+void  ui_progress_begin      (UiProgress*, int);
+void  ui_progress_advance    (Options*, UiProgress*, int);
+
+void  ui_worker_begin        (void);
+UiWorkerMessages *ui_worker_end(void);
+void  ui_worker_flush        (Options*, UiWorkerMessages*);
+
 /* Useful when different message types may be suitable in different contexts */
 typedef void ui_message_func (Options*, const char*, ...) NV_ATTRIBUTE_PRINTF(2, 3);
 